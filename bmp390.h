@@ -0,0 +1,318 @@
+#pragma once
+#ifndef BMP390_H
+#define BMP390_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "i2c_bus.h"
+
+/**
+ * Register map of the Bosch BMP390 (and BMP388) as used by this driver.
+ * See the BMP390 datasheet, section 5.
+ */
+#define BMP390_ADDRESS          0x77
+#define BMP390_CHIP_ID          0x60
+#define BMP388_CHIP_ID          0x50
+
+#define BMP390_REG_CHIP_ID      0x00
+#define BMP390_REG_ERR          0x02
+#define BMP390_REG_STATUS       0x03
+#define BMP390_REG_INT_STATUS   0x11
+#define BMP390_REG_FIFO_LENGTH  0x12
+#define BMP390_REG_FIFO_DATA    0x14
+#define BMP390_REG_FIFO_WTM     0x15
+#define BMP390_REG_FIFO_CONFIG1 0x17
+#define BMP390_REG_FIFO_CONFIG2 0x18
+#define BMP390_REG_INT_CTRL     0x19
+#define BMP390_REG_PWR_CTRL     0x1B
+#define BMP390_REG_OSR          0x1C
+#define BMP390_REG_ODR          0x1D
+#define BMP390_REG_CONFIG       0x1F
+#define BMP390_REG_CALIB        0x31
+#define BMP390_REG_CMD          0x7E
+
+#define BMP390_CALIB_LEN        21
+#define BMP390_FIFO_SIZE        512
+
+#define BMP390_CMD_SOFTRESET    0xB6
+#define BMP390_CMD_FIFO_FLUSH   0xB0
+
+/**
+ * Milliseconds the sensor needs after a soft reset before its registers can be read
+ * (datasheet t_startup, 2 ms), with some margin.
+ */
+#define BMP390_STARTUP_MS       3
+
+#define BMP390_PWR_PRESS        0x01
+#define BMP390_PWR_TEMP         0x02
+#define BMP390_MODE_SLEEP       0x00
+#define BMP390_MODE_NORMAL      0x30
+
+#define BMP390_FIFO_MODE        0x01
+#define BMP390_FIFO_STOP_FULL   0x02
+#define BMP390_FIFO_PRESS_EN    0x08
+#define BMP390_FIFO_TEMP_EN     0x10
+#define BMP390_FIFO_FILTERED    0x08
+
+/**
+ * FIFO frame headers. Data bytes follow the header, least significant byte first.
+ */
+#define BMP390_FRAME_TEMP_PRESS 0x94
+#define BMP390_FRAME_TEMP       0x90
+#define BMP390_FRAME_PRESS      0x84
+#define BMP390_FRAME_TIME       0xA0
+#define BMP390_FRAME_EMPTY      0x80
+#define BMP390_FRAME_CFG_CHANGE 0x48
+#define BMP390_FRAME_CFG_ERROR  0x44
+
+/**
+ * Size in bytes of a temperature + pressure frame in the FIFO.
+ */
+#define BMP390_FRAME_LEN        7
+
+/**
+ * Most temperature + pressure frames a full FIFO holds.
+ */
+#define BMP390_FIFO_FRAMES      (BMP390_FIFO_SIZE / BMP390_FRAME_LEN)
+
+/**
+ * Oversampling, IIR and output data rate settings, as register values.
+ * Oversampling is 2^n, IIR coefficient is 2^n - 1, ODR is 200 / 2^n Hz.
+ */
+enum BMP390Oversampling : uint8_t { BMP390_OS_1X = 0, BMP390_OS_2X, BMP390_OS_4X, BMP390_OS_8X, BMP390_OS_16X, BMP390_OS_32X };
+enum BMP390Filter : uint8_t { BMP390_IIR_0 = 0, BMP390_IIR_1, BMP390_IIR_3, BMP390_IIR_7, BMP390_IIR_15, BMP390_IIR_31, BMP390_IIR_63, BMP390_IIR_127 };
+enum BMP390Rate : uint8_t { BMP390_ODR_200 = 0, BMP390_ODR_100, BMP390_ODR_50, BMP390_ODR_25, BMP390_ODR_12_5, BMP390_ODR_6_25 };
+
+/**
+ * A single compensated sample from the sensor.
+ */
+struct BMP390Sample {
+    double pressure;        // Pressure in Pascals
+    double temperature;     // Temperature in degrees Celsius
+};
+
+/**
+ * Calibration coefficients, already scaled to floating point as per datasheet section 8.4.
+ */
+struct BMP390Calib {
+    double t1, t2, t3;
+    double p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11;
+};
+
+/**
+ * Register level BMP390 driver which lets the sensor do the averaging.
+ * Oversampling and the IIR filter run in hardware, and samples are queued in the
+ * on-chip FIFO, to be collected in a single burst read instead of one conversion per poll.
+ *
+ * @tparam Bus: Any type providing the bus interface described in i2c_bus.h.
+ */
+template <typename Bus>
+class BMP390 {
+public:
+    BMP390() {}
+    BMP390(Bus b, uint8_t address = BMP390_ADDRESS) : bus(b), addr(address) {}
+
+    /**
+     * Check the chip id, soft reset the sensor and read the calibration data.
+     * @return True if a BMP390 or BMP388 answered and its calibration was read.
+     */
+    bool begin() {
+        uint8_t id = 0;
+        if (!readRegs(BMP390_REG_CHIP_ID, &id, 1)) return false;
+        if (id != BMP390_CHIP_ID && id != BMP388_CHIP_ID) return false;
+        if (!writeReg(BMP390_REG_CMD, BMP390_CMD_SOFTRESET)) return false;
+        bus.wait(BMP390_STARTUP_MS);
+        return readCalibration();
+    }
+
+    /**
+     * Configure oversampling, IIR filter and data rate, and start streaming
+     * filtered temperature + pressure frames into the FIFO in normal mode.
+     * The rate must leave room for the conversion time of the chosen oversampling.
+     */
+    bool startFifo(BMP390Oversampling osrP, BMP390Oversampling osrT, BMP390Filter iir, BMP390Rate odr) {
+        rate = odr;
+        return writeReg(BMP390_REG_PWR_CTRL, BMP390_MODE_SLEEP) &&
+               writeReg(BMP390_REG_OSR, (uint8_t)(osrP | (osrT << 3))) &&
+               writeReg(BMP390_REG_ODR, odr) &&
+               writeReg(BMP390_REG_CONFIG, (uint8_t)(iir << 1)) &&
+               writeReg(BMP390_REG_FIFO_CONFIG2, BMP390_FIFO_FILTERED) &&
+               writeReg(BMP390_REG_FIFO_CONFIG1, BMP390_FIFO_MODE | BMP390_FIFO_STOP_FULL | BMP390_FIFO_PRESS_EN | BMP390_FIFO_TEMP_EN) &&
+               writeReg(BMP390_REG_CMD, BMP390_CMD_FIFO_FLUSH) &&
+               writeReg(BMP390_REG_PWR_CTRL, BMP390_PWR_PRESS | BMP390_PWR_TEMP | BMP390_MODE_NORMAL);
+    }
+
+    /**
+     * Put the sensor back to sleep and disable the FIFO.
+     */
+    bool stop() {
+        return writeReg(BMP390_REG_PWR_CTRL, BMP390_MODE_SLEEP) &&
+               writeReg(BMP390_REG_FIFO_CONFIG1, 0);
+    }
+
+    /**
+     * Milliseconds between two samples at the configured data rate.
+     */
+    uint32_t samplePeriodMs() const {
+        return (5u << rate);
+    }
+
+    /**
+     * Drain the FIFO in one burst and write every compensated sample in it to out.
+     * Frames are popped as they are read and need not all be the same size, so the whole
+     * FIFO is read and out holds a full FIFO's worth. Frames without pressure data are skipped.
+     * @param out: The array to write samples to.
+     *
+     * @return The number of samples written, or -1 on a bus error.
+     */
+    int readFifo(BMP390Sample (&out)[BMP390_FIFO_FRAMES]) {
+        uint8_t lenBytes[2];
+        if (!readRegs(BMP390_REG_FIFO_LENGTH, lenBytes, 2)) return -1;
+        size_t length = ((size_t)(lenBytes[1] & 0x01) << 8) | lenBytes[0];
+        if (length == 0) return 0;
+        if (length > BMP390_FIFO_SIZE) length = BMP390_FIFO_SIZE;
+
+        // The chunks go out as one sequence, so the burst is not interleaved with other traffic.
+        uint8_t fifo[BMP390_FIFO_SIZE];
+        const uint8_t reg = BMP390_REG_FIFO_DATA;
+        I2CTransfer chunks[FIFO_CHUNKS];
+        size_t count = 0;
+        for (size_t got = 0; got < length; got += FIFO_CHUNK) {
+            const size_t chunk = length - got > FIFO_CHUNK ? FIFO_CHUNK : length - got;
+            chunks[count++] = {&reg, 1, fifo + got, chunk};
+        }
+        if (!bus.sequence(addr, chunks, count)) return -1;
+
+        return (int)parseFifo(fifo, length, out, BMP390_FIFO_FRAMES);
+    }
+
+    /**
+     * Parse raw FIFO bytes into compensated samples.
+     * @return The number of samples written to out.
+     */
+    size_t parseFifo(const uint8_t* data, size_t length, BMP390Sample* out, size_t max) const {
+        size_t n = 0;
+        size_t i = 0;
+        while (i < length && n < max) {
+            const uint8_t header = data[i++];
+            switch (header) {
+                case BMP390_FRAME_TEMP_PRESS:
+                    if (i + 6 > length) return n;
+                    {
+                        const double t = compensateTemperature(raw24(data + i));
+                        out[n].temperature = t;
+                        out[n].pressure = compensatePressure(raw24(data + i + 3), t);
+                        n++;
+                    }
+                    i += 6;
+                    break;
+                case BMP390_FRAME_TEMP:
+                case BMP390_FRAME_PRESS:
+                case BMP390_FRAME_TIME:
+                    i += 3;
+                    break;
+                case BMP390_FRAME_CFG_CHANGE:
+                case BMP390_FRAME_CFG_ERROR:
+                    i += 1;
+                    break;
+                default:
+                    // Empty frame or garbage: nothing more to read.
+                    return n;
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Compensate a raw temperature reading.
+     * @return Temperature in degrees Celsius.
+     */
+    double compensateTemperature(uint32_t raw) const {
+        const double d1 = (double)raw - calib.t1;
+        const double d2 = d1 * calib.t2;
+        return d2 + (d1 * d1) * calib.t3;
+    }
+
+    /**
+     * Compensate a raw pressure reading.
+     * @param raw: The raw pressure reading.
+     * @param t: The compensated temperature of the same frame.
+     * @return Pressure in Pascals.
+     */
+    double compensatePressure(uint32_t raw, double t) const {
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        const double p = (double)raw;
+
+        const double out1 = calib.p5 + calib.p6 * t + calib.p7 * t2 + calib.p8 * t3;
+        const double out2 = p * (calib.p1 + calib.p2 * t + calib.p3 * t2 + calib.p4 * t3);
+        const double out3 = (p * p) * (calib.p9 + calib.p10 * t) + (p * p * p) * calib.p11;
+        return out1 + out2 + out3;
+    }
+
+    Bus bus;
+
+private:
+    /**
+     * Largest FIFO read per transaction. Bytes are popped as they are read,
+     * so consecutive chunks simply continue the stream.
+     */
+    static constexpr size_t FIFO_CHUNK = 126;
+    static constexpr size_t FIFO_CHUNKS = (BMP390_FIFO_SIZE + FIFO_CHUNK - 1) / FIFO_CHUNK;
+    static_assert(FIFO_CHUNKS <= I2C_SEQUENCE_MAX, "A FIFO burst must fit in one sequence");
+
+    uint8_t addr = BMP390_ADDRESS;
+    uint8_t rate = BMP390_ODR_25;
+    BMP390Calib calib = {};
+
+    static uint32_t raw24(const uint8_t* b) {
+        return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16);
+    }
+
+    bool writeReg(uint8_t reg, uint8_t value) {
+        const uint8_t buf[2] = {reg, value};
+        return bus.write(addr, buf, 2);
+    }
+
+    bool readRegs(uint8_t reg, uint8_t* out, size_t len) {
+        return bus.writeRead(addr, &reg, 1, out, len);
+    }
+
+    bool readCalibration() {
+        uint8_t c[BMP390_CALIB_LEN];
+        if (!readRegs(BMP390_REG_CALIB, c, BMP390_CALIB_LEN)) return false;
+
+        const uint16_t t1 = (uint16_t)(c[1] << 8 | c[0]);
+        const uint16_t t2 = (uint16_t)(c[3] << 8 | c[2]);
+        const int8_t t3 = (int8_t)c[4];
+        const int16_t p1 = (int16_t)(c[6] << 8 | c[5]);
+        const int16_t p2 = (int16_t)(c[8] << 8 | c[7]);
+        const int8_t p3 = (int8_t)c[9];
+        const int8_t p4 = (int8_t)c[10];
+        const uint16_t p5 = (uint16_t)(c[12] << 8 | c[11]);
+        const uint16_t p6 = (uint16_t)(c[14] << 8 | c[13]);
+        const int8_t p7 = (int8_t)c[15];
+        const int8_t p8 = (int8_t)c[16];
+        const int16_t p9 = (int16_t)(c[18] << 8 | c[17]);
+        const int8_t p10 = (int8_t)c[19];
+        const int8_t p11 = (int8_t)c[20];
+
+        calib.t1 = t1 * 256.0;                              // 2^8
+        calib.t2 = t2 / 1073741824.0;                       // 2^30
+        calib.t3 = t3 / 281474976710656.0;                  // 2^48
+        calib.p1 = (p1 - 16384) / 1048576.0;                // 2^14, 2^20
+        calib.p2 = (p2 - 16384) / 536870912.0;              // 2^14, 2^29
+        calib.p3 = p3 / 4294967296.0;                       // 2^32
+        calib.p4 = p4 / 137438953472.0;                     // 2^37
+        calib.p5 = p5 * 8.0;                                // 2^3
+        calib.p6 = p6 / 64.0;                               // 2^6
+        calib.p7 = p7 / 256.0;                              // 2^8
+        calib.p8 = p8 / 32768.0;                            // 2^15
+        calib.p9 = p9 / 281474976710656.0;                  // 2^48
+        calib.p10 = p10 / 281474976710656.0;                // 2^48
+        calib.p11 = p11 / 36893488147419103232.0;           // 2^65
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "cadence.h"
+#include <math.h>
+
+/**
+ * Rate of change of a quantity per hour, relative to what counts as fast.
+ * @return 0 if either value is missing.
+ */
+static float relativeRate(double now, double before, double hours, double fast) {
+    if (now == UNDEFINED || before == UNDEFINED) return 0;
+    return fabs(now - before) / hours / fast;
+}
+
+/**
+ * Feed the observations of a wake.
+ * @param in: What the wake observed.
+ *
+ * @return The new interval in seconds.
+ */
+uint32_t Cadence::update(const CadenceInput& in) {
+    score = in.hashDistance >= 0 ? (float)in.hashDistance / CADENCE_HASH_DISTANCE : 0;
+
+    const int64_t gap = (int64_t)in.time - readAt;
+    if (seeded && gap > 0 && gap <= CADENCE_MAX_GAP) {
+        const double hours = gap / 3600.0;
+        score = fmaxf(score, relativeRate(in.pressure, pressure, hours, CADENCE_PRESSURE_RATE));
+        score = fmaxf(score, relativeRate(in.temperature, temperature, hours, CADENCE_TEMPERATURE_RATE));
+        score = fmaxf(score, relativeRate(in.cloudFraction, cloudFraction, hours, CADENCE_CLOUD_RATE));
+    }
+
+    uint32_t next = interval;
+    if (score >= 1) next = interval / 2;
+    else if (score <= CADENCE_STABLE) next = interval + interval / 4;
+
+    if (seeded && in.backlog > CADENCE_BACKLOG_BYTES && in.backlog > backlog) {
+        const uint32_t backoff = interval + interval / 2;
+        if (next < backoff) next = backoff;
+    }
+
+    interval = next < CADENCE_MIN_SECS ? CADENCE_MIN_SECS : next > CADENCE_MAX_SECS ? CADENCE_MAX_SECS : next;
+    seeded = true;
+    readAt = in.time;
+    pressure = in.pressure;
+    temperature = in.temperature;
+    cloudFraction = in.cloudFraction;
+    backlog = in.backlog;
+    return interval;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef CADENCE_H
+#define CADENCE_H
+
+#include <stdint.h>
+#include <time.h>
+#include "sensors.h"
+
+/**
+ * Bounds of the daytime wake interval, in seconds, and where it starts on cold boot.
+ */
+#define CADENCE_MIN_SECS 300
+#define CADENCE_MAX_SECS 3600
+#define CADENCE_DEFAULT_SECS (SLEEP_MINS * 60)
+
+/**
+ * Rates of change which count as fast, per hour: a pressure fall of a squall line,
+ * a temperature swing of a passing front, cloud building up or breaking up.
+ * An image hash this many bits from the last kept image counts as fast too.
+ */
+#define CADENCE_PRESSURE_RATE 100.0     // Pa per hour
+#define CADENCE_TEMPERATURE_RATE 2.0    // Degrees per hour
+#define CADENCE_CLOUD_RATE 0.3          // Cloud fraction per hour
+#define CADENCE_HASH_DISTANCE 12
+
+/**
+ * Below this change score conditions are stable. Readings further apart than
+ * CADENCE_MAX_GAP seconds, such as across the night, give no rates.
+ */
+#define CADENCE_STABLE 0.3
+#define CADENCE_MAX_GAP 21600
+
+/**
+ * Past this many bytes of offline backlog, a growing backlog lengthens the interval
+ * whatever the sky does, to save the radio and storage for when the network is back.
+ */
+#define CADENCE_BACKLOG_BYTES 32768
+
+/**
+ * What one wake observed.
+ */
+struct CadenceInput {
+    time_t time;                // When the reading was taken
+    double pressure;            // Pascals, or UNDEFINED
+    double temperature;         // Degrees Celsius, or UNDEFINED
+    double cloudFraction;       // 0 to 1, or UNDEFINED
+    int16_t hashDistance;       // Bits from the last kept image, -1 if unknown
+    uint32_t backlog;           // Bytes waiting in the offline log
+};
+
+/**
+ * Adaptive wake interval: halves when the sky changes fast, grows by a quarter while it is stable,
+ * and grows by half while the offline backlog is large and growing.
+ * It is a pure component: the caller feeds it observations and reads the interval back.
+ * Across deep sleep it keeps the interval and the last wake's observations, which the next is scored against.
+ */
+struct Cadence {
+    uint32_t interval = CADENCE_DEFAULT_SECS;   // Seconds until the next daytime wake
+    float score = 0;                // Change score of the last update, 1 is fast
+    bool seeded = false;            // Whether the fields below hold a previous observation
+    time_t readAt = 0;
+    double pressure = UNDEFINED;
+    double temperature = UNDEFINED;
+    double cloudFraction = UNDEFINED;
+    uint32_t backlog = 0;
+
+    /**
+     * Feed the observations of a wake.
+     * @param in: What the wake observed.
+     *
+     * @return The new interval in seconds.
+     */
+    uint32_t update(const CadenceInput& in);
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "camera.h"
+#include "esp_timer.h"
+
+/**
+ * Deinitialize the camera driver.
+ */
+esp_err_t CameraDriver::deinit() {
+    esp_err_t err = ESP_OK;
+
+    // Deinitialize camera
+    err = esp_camera_deinit();
+
+    // Display any errors associated with camera deinitialization
+    if (err != ESP_OK) debugf("Error deinitializing camera: %s\n", esp_err_to_name(err));
+    else debugf("Camera deinitialized successfully\n");
+    
+    debugln();
+    return err;
+}
+
+/**
+ * Configure and initialize the camera.
+ */
+bool CameraDriver::initImpl() {
+    debugln("Setting up camera...");
+    initMs = millis();
+    config.ledc_channel = LEDC_CHANNEL_0;
+    config.ledc_timer = LEDC_TIMER_0;
+    config.pin_d0 = Y2_GPIO_NUM;
+    config.pin_d1 = Y3_GPIO_NUM;
+    config.pin_d2 = Y4_GPIO_NUM;
+    config.pin_d3 = Y5_GPIO_NUM;
+    config.pin_d4 = Y6_GPIO_NUM;
+    config.pin_d5 = Y7_GPIO_NUM;
+    config.pin_d6 = Y8_GPIO_NUM;
+    config.pin_d7 = Y9_GPIO_NUM;
+    config.pin_xclk = XCLK_GPIO_NUM;
+    config.pin_pclk = PCLK_GPIO_NUM;
+    config.pin_vsync = VSYNC_GPIO_NUM;
+    config.pin_href = HREF_GPIO_NUM;
+    config.pin_sscb_sda = SIOD_GPIO_NUM;
+    config.pin_sscb_scl = SIOC_GPIO_NUM;
+    config.pin_pwdn = PWDN_GPIO_NUM;
+    config.pin_reset = RESET_GPIO_NUM;
+    config.xclk_freq_hz = CAMERA_CLK;
+    config.frame_size = FRAMESIZE_QHD;
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.grab_mode = CAMERA_GRAB_LATEST; // Needs to be "CAMERA_GRAB_LATEST" for camera to capture.
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    config.jpeg_quality = 10;
+    config.fb_count = 2;    // Double buffered: one frame is stored while the next exposes.
+
+    /** if PSRAM keep res and jpeg quality.
+    * Limit the frame size & quality when PSRAM is not available
+    */
+    if(!psramFound()) {
+        debugln("Couldn't find PSRAM on the board!");
+        config.frame_size = FRAMESIZE_SVGA;
+        config.fb_location = CAMERA_FB_IN_DRAM;
+        config.jpeg_quality = 30;
+        config.fb_count = 1;
+    }
+
+    /**
+    * Initialize the camera
+    */
+    esp_err_t initErr = esp_camera_init(&config);
+    if (initErr != ESP_OK) {
+        debugf("Camera init failed with error 0x%x", initErr);
+        if (initErr == ESP_ERR_NOT_FOUND) debugln("Camera not found");
+        esp_err_t deinitErr = deinit();
+        if (deinitErr != ESP_OK) debugf("Camera de-init failed with error 0x%x", deinitErr);
+        debugln();
+        return false;
+    }
+
+    // Only touch the registers which differ from what the driver just loaded.
+    sensor_t * s = esp_camera_sensor_get();
+    CAMERA_SET(s, set_brightness, brightness, 0);       // -2 to 2
+    CAMERA_SET(s, set_contrast, contrast, 1);           // -2 to 2
+    CAMERA_SET(s, set_saturation, saturation, 0);       // -2 to 2
+    CAMERA_SET(s, set_special_effect, special_effect, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
+    CAMERA_SET(s, set_whitebal, awb, 1);                // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_awb_gain, awb_gain, 1);           // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_wb_mode, wb_mode, 2);             // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
+    CAMERA_SET(s, set_exposure_ctrl, aec, 1);           // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_aec2, aec2, 0);                   // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_ae_level, ae_level, 0);           // -2 to 2
+    CAMERA_SET(s, set_aec_value, aec_value, 300);       // 0 to 1200
+    CAMERA_SET(s, set_gain_ctrl, agc, 1);               // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_agc_gain, agc_gain, 0);           // 0 to 30
+    if (s->status.gainceiling != 6) s->set_gainceiling(s, (gainceiling_t)6);  // 0 to 6 (6 from "timelapse" example sjr, OK)
+    CAMERA_SET(s, set_bpc, bpc, 0);                     // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_wpc, wpc, 1);                     // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_raw_gma, raw_gma, 1);             // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_lenc, lenc, 1);                   // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_hmirror, hmirror, 0);             // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_vflip, vflip, 1);                 // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_dcw, dcw, 1);                     // 0 = disable , 1 = enable
+    CAMERA_SET(s, set_colorbar, colorbar, 0);           // 0 = disable , 1 = enable
+
+    // No test capture here: the first capture() doubles as the check, and its
+    // warm-up frames are the ones auto exposure needs anyway.
+    debugln("Camera configuration complete!");
+    return true;
+}
+
+/**
+ * Take an image once auto exposure has settled.
+ * Frames are discarded until exposure, gain and average brightness stop moving,
+ * or until CAMERA_SETTLE_MAX_FRAMES have been thrown away.
+ */
+ImageBuffer CameraDriver::capture() {
+    debugln("Taking image...");
+    sensor_t * s = esp_camera_sensor_get();
+    camera_fb_t *frame = nullptr;
+    ExposureSettle settle;
+
+    for (uint8_t i = 0; i < CAMERA_SETTLE_MAX_FRAMES; i++) {
+        frame = esp_camera_fb_get();
+        if (!frame) {
+            debugln("Camera capture failed");
+            return ImageBuffer();
+        }
+
+        if (!s || settle.update(readExposure(s), readGain(s), readLuma(s))) break;
+
+        esp_camera_fb_return(frame);
+        frame = nullptr;
+    }
+
+    if (!frame) {
+        debugln("Exposure did not settle, using the next frame");
+        frame = esp_camera_fb_get();
+        if (!frame) {
+            debugln("Camera capture failed");
+            return ImageBuffer();
+        }
+    }
+
+    settleMs = millis() - initMs;
+    settleFrames = settle.frames;
+    settleLevel = settle.level;
+    debugf("Image captured! First good frame %lu ms after init, %u frames\n", settleMs, settleFrames);
+    return ImageBuffer::fromDriver(frame -> buf, frame -> len, frame -> width, frame -> height, release, frame);
+}
+
+/**
+ * Take CAMERA_BRACKET_FRAMES frames at fixed exposures around the last settled one.
+ * Gain is pinned at unity and the settled exposure x gain spread over exposure time alone,
+ * so the frames differ only in exposure. The next exposure is set before a frame goes to the sink,
+ * so the sensor is already exposing it into the second frame buffer while the sink writes.
+ * @return The number of frames the sink took.
+ */
+uint8_t CameraDriver::bracket(BracketSink sink, void* ctx) {
+    sensor_t * s = esp_camera_sensor_get();
+    if (!s || !sink || !settleLevel) return 0;
+
+    uint32_t exposures[CAMERA_BRACKET_FRAMES];
+    for (uint8_t i = 0; i < CAMERA_BRACKET_FRAMES; i++) {
+        const int8_t stops = (i - (CAMERA_BRACKET_FRAMES - 1) / 2) * CAMERA_BRACKET_STEP;
+        uint32_t e = settleLevel / 16;
+        e = stops < 0 ? e >> -stops : e << stops;
+        exposures[i] = e < 1 ? 1 : e > CAMERA_AEC_MAX ? CAMERA_AEC_MAX : e;
+    }
+
+    debugf("Bracketing %u frames around %lu lines\n", CAMERA_BRACKET_FRAMES, settleLevel / 16);
+    const int64_t start = esp_timer_get_time();
+    CAMERA_SET(s, set_exposure_ctrl, aec, 0);
+    CAMERA_SET(s, set_gain_ctrl, agc, 0);
+    CAMERA_SET(s, set_agc_gain, agc_gain, 0);
+    s->set_aec_value(s, exposures[0]);
+    int64_t changed = esp_timer_get_time();
+
+    uint8_t taken = 0;
+    for (uint8_t i = 0; i < CAMERA_BRACKET_FRAMES; i++) {
+        camera_fb_t* frame = frameAfter(changed);
+        if (!frame) {
+            debugln("Bracket capture failed");
+            break;
+        }
+
+        if (i + 1 < CAMERA_BRACKET_FRAMES) {
+            s->set_aec_value(s, exposures[i + 1]);
+            changed = esp_timer_get_time();
+        }
+
+        // The frame goes back to the driver as soon as the sink is done with it.
+        const int64_t captured = frameTime(frame);
+        const bool more = sink(ctx, i, ImageBuffer::fromDriver(frame -> buf, frame -> len, frame -> width, frame -> height, release, frame), exposures[i]);
+        debugf("Bracket frame %u at %lu lines: stored %lu ms after capture\n", i, exposures[i], (unsigned long)((esp_timer_get_time() - captured) / 1000));
+        if (!more) break;
+        taken++;
+    }
+
+    CAMERA_SET(s, set_exposure_ctrl, aec, 1);
+    CAMERA_SET(s, set_gain_ctrl, agc, 1);
+    debugf("Bracket of %u frames took %lu ms\n", taken, (unsigned long)((esp_timer_get_time() - start) / 1000));
+    return taken;
+}
+
+/**
+ * The first frame exposed wholly after a setting changed at since (esp_timer microseconds).
+ * Frames already under way, and CAMERA_BRACKET_LATENCY more, are handed straight back.
+ * @return The frame, or nullptr if the camera failed or never caught up.
+ */
+camera_fb_t* CameraDriver::frameAfter(int64_t since) {
+    uint8_t late = 0;
+    for (uint8_t i = 0; i < CAMERA_SETTLE_MAX_FRAMES; i++) {
+        camera_fb_t* frame = esp_camera_fb_get();
+        if (!frame) return nullptr;
+        if (frameTime(frame) > since && late++ >= CAMERA_BRACKET_LATENCY) return frame;
+        esp_camera_fb_return(frame);
+    }
+    return nullptr;
+}
+
+/**
+ * When the driver started receiving a frame, in esp_timer microseconds.
+ */
+int64_t CameraDriver::frameTime(const camera_fb_t* frame) {
+    return (int64_t)frame -> timestamp.tv_sec * 1000000 + frame -> timestamp.tv_usec;
+}
+
+/**
+ * Exposure time in lines, from AEC_PK_EXPOSURE [19:0], whose low 4 bits are fractional.
+ */
+uint32_t CameraDriver::readExposure(sensor_t* s) {
+    const uint32_t hi = s->get_reg(s, OV5640_REG_EXPOSURE_HI, 0x0F);
+    const uint32_t mid = s->get_reg(s, OV5640_REG_EXPOSURE_MID, 0xFF);
+    const uint32_t lo = s->get_reg(s, OV5640_REG_EXPOSURE_LO, 0xFF);
+    return ((hi << 16) | (mid << 8) | lo) >> 4;
+}
+
+/**
+ * Real gain in 1/16ths, from AEC_PK_REAL_GAIN [9:0].
+ */
+uint16_t CameraDriver::readGain(sensor_t* s) {
+    const uint16_t hi = s->get_reg(s, OV5640_REG_GAIN_HI, 0x03);
+    const uint16_t lo = s->get_reg(s, OV5640_REG_GAIN_LO, 0xFF);
+    return (hi << 8) | lo;
+}
+
+/**
+ * Average luminance of the last frame, as measured by the ISP.
+ */
+uint8_t CameraDriver::readLuma(sensor_t* s) {
+    return s->get_reg(s, OV5640_REG_AVG_LUMA, 0xFF);
+}
+
+/**
+ * Return a frame to the camera driver, once its ImageBuffer is dropped.
+ */
+void CameraDriver::release(void* fb) {
+    if (fb) esp_camera_fb_return((camera_fb_t*)fb);
+}
+
+/**
+ * Power down the camera.
+ */
+bool CameraDriver::teardownImpl() {
+    return deinit() == ESP_OK;
+}
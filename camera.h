@@ -0,0 +1,160 @@
+#pragma once
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "io.h"
+#include "sensor_driver.h"
+#include "image_buffer.h"
+
+#define CAMERA_CLK 5000000
+#define CAMERA_MODEL_ESP32S3_EYE
+
+#include "camera_pins.h"
+
+/**
+ * OV5640 registers read back to follow auto exposure.
+ */
+#define OV5640_REG_EXPOSURE_HI  0x3500
+#define OV5640_REG_EXPOSURE_MID 0x3501
+#define OV5640_REG_EXPOSURE_LO  0x3502
+#define OV5640_REG_GAIN_HI      0x350A
+#define OV5640_REG_GAIN_LO      0x350B
+#define OV5640_REG_AVG_LUMA     0x56A1
+
+/**
+ * Exposure is settled once exposure x gain moves less than CAMERA_SETTLE_TOLERANCE percent,
+ * and the average luminance less than CAMERA_SETTLE_LUMA, for CAMERA_SETTLE_FRAMES frames in a row.
+ */
+#define CAMERA_SETTLE_TOLERANCE 6
+#define CAMERA_SETTLE_LUMA 4
+#define CAMERA_SETTLE_FRAMES 2
+#define CAMERA_SETTLE_MAX_FRAMES 12
+
+/**
+ * Bracketed capture: CAMERA_BRACKET_FRAMES frames CAMERA_BRACKET_STEP stops apart, centred on
+ * the settled auto exposure, taken when the scene is brighter than CAMERA_BRACKET_LEVEL
+ * (exposure lines x gain in 1/16ths, tune on site). Exposure changes reach the sensor
+ * CAMERA_BRACKET_LATENCY frames late, so that many frames after a change are dropped.
+ */
+#define CAMERA_BRACKET_FRAMES 3
+#define CAMERA_BRACKET_STEP 2
+#define CAMERA_BRACKET_LEVEL 1600
+#define CAMERA_BRACKET_LATENCY 1
+#define CAMERA_AEC_MAX 1200
+
+/**
+ * Write a sensor setting only if the driver's view of it differs.
+ */
+#define CAMERA_SET(s, setter, field, value) if ((s)->status.field != (value)) (s)->setter((s), (value))
+
+/**
+ * Tracks auto exposure / gain convergence over consecutive frames.
+ */
+struct ExposureSettle {
+    uint8_t frames = 0;         // Frames seen so far
+    uint8_t stable = 0;         // Consecutive frames within tolerance
+    uint32_t level = 0;         // Exposure x gain of the previous frame
+    uint8_t luma = 0;           // Average luminance of the previous frame
+
+    /**
+     * Feed the statistics of one frame.
+     * @param exposure: The exposure time in lines.
+     * @param gain: The gain in 1/16ths.
+     * @param avgLuma: The average luminance.
+     *
+     * @return True once exposure has settled.
+     */
+    bool update(uint32_t exposure, uint16_t gain, uint8_t avgLuma) {
+        const uint32_t current = exposure * (gain ? gain : 1);
+        frames++;
+
+        if (frames > 1) {
+            const uint32_t delta = current > level ? current - level : level - current;
+            const uint8_t dLuma = avgLuma > luma ? avgLuma - luma : luma - avgLuma;
+            const bool steady = (uint64_t)delta * 100 <= (uint64_t)level * CAMERA_SETTLE_TOLERANCE && dLuma <= CAMERA_SETTLE_LUMA;
+            stable = steady ? stable + 1 : 0;
+        }
+
+        level = current;
+        luma = avgLuma;
+        return stable >= CAMERA_SETTLE_FRAMES;
+    }
+};
+
+/**
+ * Receives each frame of a bracket while the camera exposes the next.
+ * @param ctx: The context given to bracket().
+ * @param index: The position of the frame in the bracket, darkest first.
+ * @param frame: The frame, handed back to the driver once the sink returns.
+ * @param exposure: The exposure it was taken at, in lines at unity gain.
+ *
+ * @return False to stop the bracket.
+ */
+typedef bool (*BracketSink)(void* ctx, uint8_t index, const ImageBuffer& frame, uint32_t exposure);
+
+/**
+ * Driver for the OV5640 sky camera on top of esp_camera.
+ * Frames from capture() stay owned by the camera driver, and go back to it when the ImageBuffer is dropped.
+ */
+class CameraDriver : public SensorDriver<CameraDriver> {
+    friend class SensorDriver<CameraDriver>;
+
+public:
+    camera_config_t config;
+    unsigned long settleMs = 0;     // Time from init to the first good frame of the last capture
+    uint8_t settleFrames = 0;       // Frames it took exposure to settle
+    uint32_t settleLevel = 0;       // Exposure x gain the last capture settled at
+
+    /**
+     * Take an image once auto exposure has settled.
+     * @return The frame, empty if the capture failed.
+     */
+    ImageBuffer capture();
+
+    /**
+     * Whether the last capture was bright enough to be worth bracketing.
+     */
+    bool wantsBracket() const {
+        return CAMERA_BRACKET_FRAMES > 1 && settleLevel && settleLevel <= CAMERA_BRACKET_LEVEL;
+    }
+
+    /**
+     * Take CAMERA_BRACKET_FRAMES frames at fixed exposures around the last settled one.
+     * Each frame goes to the sink while the sensor exposes the next into the other frame buffer.
+     * Auto exposure and gain are switched back on afterwards.
+     * @param sink: Where the frames go.
+     * @param ctx: Passed to the sink.
+     *
+     * @return The number of frames the sink took.
+     */
+    uint8_t bracket(BracketSink sink, void* ctx);
+
+    /**
+     * Deinitialize the camera driver.
+     * @return The esp_camera error code.
+     */
+    esp_err_t deinit();
+
+private:
+    unsigned long initMs = 0;
+
+    static void release(void* fb);
+    static camera_fb_t* frameAfter(int64_t since);
+    static int64_t frameTime(const camera_fb_t* frame);
+
+    static uint32_t readExposure(sensor_t* s);
+    static uint16_t readGain(sensor_t* s);
+    static uint8_t readLuma(sensor_t* s);
+
+    bool initImpl();
+    bool teardownImpl();
+
+    /**
+     * The camera contributes no scalar fields to a reading.
+     */
+    bool sampleImpl(Reading*) {
+        return true;
+    }
+};
+
+#endif
@@ -16,8 +16,7 @@ void setClock(tm *timeinfo) {
   debug(F("Waiting for NTP time sync: "));
   time_t nowSecs = time(nullptr);
   while (nowSecs < 8 * 3600 * 2) {
-    delay(500);
-    debug(F("."));
+    powerWait(500);
     yield();
     nowSecs = time(nullptr);
   }
@@ -49,62 +48,24 @@ void getTime(tm *timeinfo, int timer) {
   do {
     time(&now);
     localtime_r(&now, timeinfo);
-    debug(".");
-    delay(random(150, 550));
-  } while (((millis() - start) <= (1000 * timer)) && (timeinfo -> tm_year <= 1970));
+    powerWait(random(150, 550));
+  } while (((millis() - start) <= (1000 * timer)) && (timeinfo -> tm_year <= (1970 - 1900)));
   debugln("Done");
 }
 
 
 /**
- * Check if the current time is between 5 PM and 6 AM.
- * If so, enter deep sleep mode until 6 AM.
+ * Go straight back to sleep if the sun is down, before anything is powered up.
+ * The clock keeps running through deep sleep, so this needs no network.
  * 
- * @param timeinfo*: tm struct within global Network struct to store the time information.
- * @param wakeHour: The hour to wake up at.
- * @param sleepHour: The hour to sleep at.
+ * @param now: The current time.
  */
-void checkAndSleep(tm *timeinfo, uint8_t wakeHour = 6, uint8_t sleepHour = 21) {
-    int currentHour = timeinfo->tm_hour;
-    int currentMinute = timeinfo->tm_min;
-    int currentSecond = timeinfo->tm_sec;
-
-    if (wakehour >= sleepHour) {
-      debugln("Invalid wakeHour and sleepHour values.");
-      return;
-    }
-
-    if (wakeHour > 24 || sleepHour > 24 || wakeHour < 0 || sleepHour < 0) {
-      debugln("Invalid wakeHour and sleepHour values.");
-      return;
-    }
+void checkAndSleep(time_t now) {
+  const WakePlan plan = planWake(now);
+  if (plan.phase != SOLAR_NIGHT) return;
 
-    // Check if the current time is between 5 PM and 6 AM
-    if (currentHour >= sleepHour || currentHour < wakeHour) {
-      int sleepDuration = 0;  // in seconds
-
-      if (currentHour >= sleepHour) {
-          // Current time is after 5 PM, calculate time until midnight
-          sleepDuration = (24 - currentHour + wakeHour) * 3600 - currentMinute * 60 - currentSecond;
-      } else {
-          // Current time is before 6 AM, calculate remaining time until 6 AM
-          sleepDuration = (wakeHour - currentHour) * 3600 - currentMinute * 60 - currentSecond;
-      }
-
-      // Log sleep duration
-      debugln("Outside normal operating times.");
-      debug("Sleeping for ");
-      debug(sleepDuration / 3600);
-      debug(" hours, ");
-      debug((sleepDuration % 3600) / 60);
-      debug(" minutes, and ");
-      debug(sleepDuration % 60);
-      debugln(" seconds.");
-
-      // Enter deep sleep mode for the calculated duration
-      esp_sleep_enable_timer_wakeup(sleepDuration * 1000000LL);  // Convert to microseconds
-      esp_deep_sleep_start();
-    }
+  debugf("Sun at %.1f degrees, sleeping %lu s until twilight\n", plan.elevation, (unsigned long)plan.sleepSecs);
+  deepSleepMins(plan.sleepSecs / 60.0);
 }
 
 /**
@@ -123,8 +84,7 @@ bool connect(const char* ssid, const char* pass, NetworkInfo* network, Sensors::
 
   // Wait for the WiFi connection to be established with a timeout of 10 attempts.
   while (WiFi.status() != WL_CONNECTED && connect_count < 20) {
-    delay(random(350, 550));
-    debug(".");
+    powerWait(random(350, 550));
     connect_count++;
   }
 
@@ -153,9 +113,9 @@ bool wifiSetup(NetworkInfo* network, Sensors::Status *stat) {
 
   // Read the networkinfo file and get the lisgt of network ssids and passwords.
   const char* nwinfo = readFile(SD_MMC, NETWORK_FILE);
-  JsonDocument jsoninfo;
+  JsonDocument jsoninfo(&JSON_ARENA);
   deserializeJson(jsoninfo, nwinfo);
-  delete[] nwinfo;
+  heapFree(nwinfo);
   const JsonArray networks = jsoninfo["networks"];
 
   // Scan surrounding networks.
@@ -183,19 +143,18 @@ bool wifiSetup(NetworkInfo* network, Sensors::Status *stat) {
 
 /**
  * Send a request to the server and return the response as a string.
- * WARNING: Dynamically allocated memory for the response string.
+ * WARNING: Dynamically allocated memory for the response string, freed with heapFree.
  * @param HTTP: The HTTPClient object to use for the request.
  * @param httpCode: The HTTP response code to check for errors.
  * 
  * @return The response from the server as a string.
  */
 const char* getResponse(HTTPClient *HTTP, int httpCode) {
-  String output;
-  if (httpCode > 0) output.concat(HTTP -> getString());
-  else output.concat(HTTP -> errorToString(httpCode));
+  const String output = httpCode > 0 ? HTTP -> getString() : HTTP -> errorToString(httpCode);
 
-  char* result = new char[output.length() + 1];
-  strcpy(result, output.c_str());
+  // A body can be large, so it gets a buffer by size class rather than from the internal heap.
+  char* result = (char*)heapAlloc(output.length() + 1);
+  if (result) memcpy(result, output.c_str(), output.length() + 1);
   return result;
 }
 
@@ -204,15 +163,29 @@ const char* getResponse(HTTPClient *HTTP, int httpCode) {
  * Got gist of everything from klucsik at:
  * https://gist.github.com/klucsik/711a4f072d7194842840d725090fd0a7
  */
-const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp, uint8_t* buf, size_t len) {
+const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp, uint8_t* buf, size_t len, int* httpCode) {
   https -> setConnectTimeout(READ_TIMEOUT);
   https -> addHeader(network -> headers.CONTENT_TYPE, network -> mimetypes.IMAGE_JPG);
   https -> addHeader(network -> headers.MAC_ADDRESS, WiFi.macAddress());
   https -> addHeader(network -> headers.TIMESTAMP, timestamp);
 
-  const int httpCode = https -> POST(buf, len);
+  *httpCode = https -> POST(buf, len);
 
-  return getResponse(https, httpCode);  
+  return getResponse(https, *httpCode);  
+}
+
+/**
+ * Send a byte stream to server via HTTPClient, as it is read.
+ */
+const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp, Stream* stream, size_t len, int* httpCode) {
+  https -> setConnectTimeout(READ_TIMEOUT);
+  https -> addHeader(network -> headers.CONTENT_TYPE, network -> mimetypes.IMAGE_JPG);
+  https -> addHeader(network -> headers.MAC_ADDRESS, WiFi.macAddress());
+  https -> addHeader(network -> headers.TIMESTAMP, timestamp);
+
+  *httpCode = https -> sendRequest("POST", stream, len);
+
+  return getResponse(https, *httpCode);
 }
 
 /**
@@ -220,15 +193,15 @@ const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp,
  * Got gist of everything from klucsik at:
  * https://gist.github.com/klucsik/711a4f072d7194842840d725090fd0a7
  */
-const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp) {
+const char* send(HTTPClient* https, NetworkInfo* network, const char* timestamp, int* httpCode) {
     https -> setConnectTimeout(READ_TIMEOUT);
     https -> addHeader(network -> headers.CONTENT_TYPE, network -> mimetypes.APP_FORM);
     https -> addHeader(network -> headers.MAC_ADDRESS, WiFi.macAddress());
     https -> addHeader(network -> headers.TIMESTAMP, timestamp);
 
-    const int httpCode = https -> GET();
+    *httpCode = https -> GET();
 
-    return getResponse(https, httpCode);
+    return getResponse(https, *httpCode);
 }
 
 /**
@@ -268,41 +241,52 @@ bool websiteReachable(HTTPClient* https, NetworkInfo* network, const char* times
  * @param network: NetworkInfo struct to hold network details.
  * @param stat: Sensors::Status struct to hold the status of the sensors.
  * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
  */
-void sendStats(HTTPClient* https, NetworkInfo* network, Sensors::Status *stat, const char* timestamp) {
+int sendStats(HTTPClient* https, NetworkInfo* network, Sensors::Status *stat, const char* timestamp) {
     debugln("\n[STATUS]");
 
     const char* const sht = stat -> SHT ? "true" : "false";
     const char* const bmp = stat -> BMP ? "true" : "false";
     const char* const cam = stat -> CAM ? "true" : "false";
+    char skipped[12];
+    snprintf(skipped, sizeof(skipped), "%u", stat -> SKIPPED_BYTES);
 
-    size_t length = strlen("sht=") + strlen(sht) + 
-                    strlen("&bmp=") + strlen(bmp) +
-                    strlen("&cam=") + strlen(cam) + 1;
-    
-    char values[length];
-    strcpy(values, "sht=");
-    strcat(values, sht);
-    strcat(values, "&bmp=");
-    strcat(values, bmp);
-    strcat(values, "&cam=");
-    strcat(values, cam);
-
-    size_t len = strlen(network -> HOST) + strlen(network -> routes.STATUS) + length + 2;
-    char url[len];
-    strcpy(url, network -> HOST);
-    strcat(url, network -> routes.STATUS);
-    strcat(url, "?");
-    strcat(url, values);
+    // Profiles of the wakes since the last status, see profile.h for the record layout.
+    char profile[PROFILE_ENCODED_MAX];
+    const bool profiled = PROFILER.encode(profile, sizeof(profile)) > 0;
 
-    https -> begin(url, network -> CERT);
+    // Straight into the URL: with the profiles, a second copy of the query would cost as much stack again.
+    const char* format = "%s%s?sht=%s&bmp=%s&cam=%s&skipped_bytes=%s%s%s";
+    const char* profileField = profiled ? "&profile=" : "";
+    const char* profileValue = profiled ? profile : "";
+    char url[snprintf(nullptr, 0, format, network -> HOST, network -> routes.STATUS, sht, bmp, cam, skipped, profileField, profileValue) + 1];
+    snprintf(url, sizeof(url), format, network -> HOST, network -> routes.STATUS, sht, bmp, cam, skipped, profileField, profileValue);
 
-    debugln(url);
+    https -> begin(url, network -> CERT);
 
-    const char* reply = send(https, network, timestamp);
+    int httpCode;
+    const char* reply = send(https, network, timestamp, &httpCode);
     debugln(reply);
-    delete[] reply;
+    heapFree(reply);
     https -> end();
+    return httpCode;
+}
+
+/**
+ * Build the URL a reading is sent to: the reading route with the reading as query parameters.
+ */
+size_t readingsUrl(NetworkInfo* network, Reading* readings, char* url, size_t len) {
+  // Sky statistics are only there if the image could be analysed.
+  char skyBuffer[64] = "";
+  if (readings->cloudFraction != UNDEFINED) {
+    snprintf(skyBuffer, sizeof(skyBuffer), "&cloud_fraction=%.4f&brightness=%.2f", readings->cloudFraction, readings->brightness);
+  }
+
+  return snprintf(url, len, "%s%s?temperature=%.5f&humidity=%.5f&pressure=%.5f&dewpoint=%.5f%s",
+                  network -> HOST, network -> routes.READING,
+                  readings->temperature, readings->humidity, readings->pressure, readings->dewpoint, skyBuffer);
 }
 
 /**
@@ -310,53 +294,23 @@ void sendStats(HTTPClient* https, NetworkInfo* network, Sensors::Status *stat, c
  * @param https: HTTPClient object to use for the request.
  * @param network: NetworkInfo struct to hold network details.
  * @param readings: Reading struct to hold the readings from the sensors.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
  */
-void sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings) {
+int sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings) {
   debugln("\n[READING]");
 
-  // Temporary buffers to store the formatted values
-  char tempBuffer[20];
-  char humBuffer[20];
-  char presBuffer[20];
-  char dewBuffer[20];
-
-  // Format each double value into the temporary buffers with snprintf
-  snprintf(tempBuffer, sizeof(tempBuffer), "%.5f", readings->temperature);
-  snprintf(humBuffer, sizeof(humBuffer), "%.5f", readings->humidity);
-  snprintf(presBuffer, sizeof(presBuffer), "%.5f", readings->pressure);
-  snprintf(dewBuffer, sizeof(dewBuffer), "%.5f", readings->dewpoint);
-
-  // Calculate the total length by summing up the lengths of all strings
-  size_t length = strlen("temperature=") + strlen(tempBuffer) + 
-                  strlen("&humidity=") + strlen(humBuffer) +
-                  strlen("&pressure=") + strlen(presBuffer) +
-                  strlen("&dewpoint=") + strlen(dewBuffer) + 1;
-  
-  char values[length];
-  strcpy(values, "temperature=");
-  strcat(values, tempBuffer);
-  strcat(values, "&humidity=");
-  strcat(values, humBuffer);
-  strcat(values, "&pressure=");
-  strcat(values, presBuffer);
-  strcat(values, "&dewpoint=");
-  strcat(values, dewBuffer);
-
-  size_t len = strlen(network -> HOST) + strlen(network -> routes.READING) + length + 2;
-  char url[len];
-  strcpy(url, network -> HOST);
-  strcat(url, network -> routes.READING);
-  strcat(url, "?");
-  strcat(url, values);
+  char url[readingsUrl(network, readings, nullptr, 0) + 1];
+  readingsUrl(network, readings, url, sizeof(url));
 
   https -> begin(url, network->CERT);
-
-  debugln(url);
   
-  const char* reply = send(https, network, readings -> timestamp);
+  int httpCode;
+  const char* reply = send(https, network, readings -> timestamp, &httpCode);
   debugln(reply);
-  delete[] reply;
+  heapFree(reply);
   https -> end();
+  return httpCode;
 }
 
 /**
@@ -365,7 +319,7 @@ void sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings) {
  * @return The QNH value in hPa.
  */
 double parseQNH(const char* json) {
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
 
   // Deserialize the JSON document
   DeserializationError error = deserializeJson(doc, json);
@@ -397,8 +351,9 @@ double getQNH(NetworkInfo* network) {
   const char* const airport = "ESMX";
 
   const char* metarinfo = readFile(SD_MMC, NETWORK_FILE);
-  JsonDocument jsoninfo;
+  JsonDocument jsoninfo(&JSON_ARENA);
   DeserializationError error = deserializeJson(jsoninfo, metarinfo);
+  heapFree(metarinfo);
   if (error) {
     debug("Failed to read metarinfo file error :-> ");
     debugln(error.f_str());
@@ -434,16 +389,27 @@ double getQNH(NetworkInfo* network) {
   strcat(url, values);
 
   https.begin(url);
-  debugln(url);
   const int httpCode = https.GET();
   const char* reply = getResponse(&https, httpCode);
   debugln(reply);
   double out = parseQNH(reply);
-  delete[] reply;
+  heapFree(reply);
   https.end();
   return out;
 }
 
+/**
+ * Start a request to the image route.
+ */
+static void beginImage(HTTPClient* https, NetworkInfo* network) {
+  size_t length = (strlen(network -> HOST) + strlen(network -> routes.IMAGE) + 2);
+  char url[length];
+  strcpy(url, network -> HOST);
+  strcat(url, network -> routes.IMAGE);
+  
+  https -> begin(url, network -> CERT);
+}
+
 /**
  * Send image from weather station to server. 
  * @param https: HTTPClient object to use for the request.
@@ -451,22 +417,41 @@ double getQNH(NetworkInfo* network) {
  * @param buf: The image buffer to send.
  * @param len: The length of the image buffer.
  * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
  */
-void sendImage(HTTPClient* https, NetworkInfo* network, uint8_t* buf, size_t len, const char* timestamp) {
+int sendImage(HTTPClient* https, NetworkInfo* network, uint8_t* buf, size_t len, const char* timestamp) {
   debugln("\n[IMAGE]");
-  size_t length = (strlen(network -> HOST) + strlen(network -> routes.IMAGE) + 2);
-  char url[length];
-  strcpy(url, network -> HOST);
-  strcat(url, network -> routes.IMAGE);
-  
-  https -> begin(url, network -> CERT);
+  beginImage(https, network);
+
+  int httpCode;
+  const char* reply = send(https, network, timestamp, buf, len, &httpCode);
+  debugln(reply);
+  heapFree(reply);
+  https -> end();
+  return httpCode;
+}
 
-  debugln(url);
+/**
+ * Send an image from weather station to server as it is read, e.g. straight from a file.
+ * @param https: HTTPClient object to use for the request.
+ * @param network: NetworkInfo struct to hold network details.
+ * @param stream: The image to send.
+ * @param len: The length of the image.
+ * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
+ */
+int sendImage(HTTPClient* https, NetworkInfo* network, Stream* stream, size_t len, const char* timestamp) {
+  debugf("\n[IMAGE] %u bytes streamed\n", len);
+  beginImage(https, network);
 
-  const char* reply = send(https, network, timestamp, buf, len);
+  int httpCode;
+  const char* reply = send(https, network, timestamp, stream, len, &httpCode);
   debugln(reply);
-  delete[] reply;
+  heapFree(reply);
   https -> end();
+  return httpCode;
 }
 
 /**
@@ -485,8 +470,7 @@ void OTAUpdate(NetworkInfo* network, const char* firmware_version) {
   WiFiClient* client = network -> CLIENT;
 
   // Start the OTA update process
-  debug("Grabbing updates from: ");
-  debugln(url);
+  debugln("Grabbing updates");
 
   // Connect to the update server
   t_httpUpdate_return ret = httpUpdate.update(*client, url, firmware_version);
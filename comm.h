@@ -2,6 +2,8 @@
 #define COMM_H
 
 #include "sensors.h"
+#include "solar.h"
+#include "profile.h"
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <HTTPUpdate.h>
@@ -101,6 +103,14 @@ struct NetworkInfo {
   } headers;
 };
 
+/**
+ * Whether the server took a request: only then may what was sent be dropped.
+ * @param httpCode: The result of a send function.
+ */
+inline bool httpOk(int httpCode) {
+  return httpCode >= 200 && httpCode < 300;
+}
+
 /**
  * Set the internal clock of the ESP32 to the current time using NTP AND fill the timeinfo struct with that time.
  * Big thanks to Andreas Spiess.
@@ -121,13 +131,10 @@ void setClock(tm *timeinfo);
 void getTime(tm *timeinfo, int timer);
 
 /**
- * Check if the current time is between 5 PM and 6 AM.
- * If so, enter deep sleep mode until 6 AM.
- * @param timeinfo: tm struct to hold the current time information.
- * @param wakeHour: The hour to wake up at.
- * @param sleepHour: The hour to sleep at.
+ * Go straight back to sleep if the sun is down, before anything is powered up.
+ * @param now: The current time.
  */
-void checkAndSleep(tm *timeinfo, uint8_t wakeHour = 6, uint8_t sleepHour = 21);
+void checkAndSleep(time_t now);
 
 /**
  * Connect to wifi Network and apply SSL certificate.
@@ -156,16 +163,31 @@ bool websiteReachable(HTTPClient* https, NetworkInfo* network, const char* times
  * @param network: NetworkInfo struct to hold network details.
  * @param stat: Sensors::Status struct to hold the status of the sensors.
  * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
+ */
+int sendStats(HTTPClient* https, NetworkInfo* network, Sensors::Status *stat, const char* timestamp);
+
+/**
+ * Build the URL a reading is sent to.
+ * @param network: NetworkInfo struct with the host and routes.
+ * @param readings: The reading to send.
+ * @param url: Where to write the URL, may be nullptr if len is 0.
+ * @param len: The size of url.
+ *
+ * @return The length of the whole URL, as snprintf: url was too short if this is len or more.
  */
-void sendStats(HTTPClient* https, NetworkInfo* network, Sensors::Status *stat, const char* timestamp);
+size_t readingsUrl(NetworkInfo* network, Reading* readings, char* url, size_t len);
 
 /**
  * Send readings from weather sensors to HOST on specified PORT. 
  * @param https: HTTPClient object to use for the request.
  * @param network: NetworkInfo struct to hold network details.
  * @param readings: Reading struct to hold the readings from the sensors.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
  */
-void sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings);
+int sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings);
 
 /**
  * Send image from weather station to server. 
@@ -174,8 +196,22 @@ void sendReadings(HTTPClient* https, NetworkInfo* network, Reading* readings);
  * @param buf: The image buffer to send.
  * @param len: The length of the image buffer.
  * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
+ */
+int sendImage(HTTPClient* https, NetworkInfo* network, uint8_t* buf, size_t len, const char* timestamp);
+
+/**
+ * Send an image from weather station to server as it is read, e.g. straight from a file.
+ * @param https: HTTPClient object to use for the request.
+ * @param network: NetworkInfo struct to hold network details.
+ * @param stream: The image to send.
+ * @param len: The length of the image.
+ * @param timestamp: The timestamp to use for the request header.
+ *
+ * @return The HTTP status code, or a negative HTTPClient error.
  */
-void sendImage(HTTPClient* https, NetworkInfo* network, uint8_t* buf, size_t len, const char* timestamp);
+int sendImage(HTTPClient* https, NetworkInfo* network, Stream* stream, size_t len, const char* timestamp);
 
 /**
  * Parse the QNH from the server response.
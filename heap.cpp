@@ -0,0 +1,244 @@
+#include "heap.h"
+#include "io.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+
+static portMUX_TYPE heapLock = portMUX_INITIALIZER_UNLOCKED;
+#define HEAP_LOCK() portENTER_CRITICAL(&heapLock)
+#define HEAP_UNLOCK() portEXIT_CRITICAL(&heapLock)
+#else
+#define HEAP_LOCK()
+#define HEAP_UNLOCK()
+#endif
+
+#define INTERNAL_CAPS (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define PSRAM_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+
+static const char* const CLASS_NAMES[HEAP_CLASSES] = {"small", "medium", "large", "pinned"};
+
+HeapTracker HEAP;
+
+/**
+ * Bytes the allocator gave a block, rounding included.
+ */
+static size_t blockSize(void* p) {
+    return heap_caps_get_allocated_size(p);
+}
+
+/**
+ * The largest block of internal RAM malloc could hand out now.
+ */
+static uint32_t largestFreeBlock() {
+    return heap_caps_get_largest_free_block(INTERNAL_CAPS);
+}
+
+uint16_t heapKb(uint32_t bytes) {
+    bytes = (bytes + 1023) / 1024;
+    return bytes < 0xFFFF ? bytes : 0xFFFE;
+}
+
+/**
+ * Start a wake: clear the counts, but not what is live.
+ */
+void HeapTracker::begin() {
+    HEAP_LOCK();
+    for (uint8_t p = 0; p <= PROFILE_PHASES; p++) {
+        phases[p] = {};
+        phases[p].largest = 0xFFFFFFFF;
+    }
+    memset(classes, 0, sizeof(classes));
+    depth = 0;
+    skipped = 0;
+    peakBytes = liveBytes;
+    HEAP_UNLOCK();
+}
+
+void HeapTracker::enter(ProfilePhase phase) {
+    HEAP_LOCK();
+    if (depth < HEAP_DEPTH) stack[depth++] = phase;
+    else skipped++;
+    if (current().peak < liveBytes) current().peak = liveBytes;
+    HEAP_UNLOCK();
+    sample();
+}
+
+void HeapTracker::leave(ProfilePhase phase) {
+    sample();
+    HEAP_LOCK();
+    if (skipped) {
+        skipped--;
+    } else {
+        // Phases are left in order, but a subsystem started on first use may close under another.
+        for (uint8_t i = depth; i-- > 0; ) {
+            if (stack[i] != phase) continue;
+            memmove(stack + i, stack + i + 1, depth - i - 1);
+            depth--;
+            break;
+        }
+    }
+    HEAP_UNLOCK();
+}
+
+void HeapTracker::allocated(size_t size) {
+    HEAP_LOCK();
+    HeapPhase& p = current();
+    p.allocs++;
+    p.bytes += size;
+    liveBytes += size;
+    if (liveBytes > peakBytes) peakBytes = liveBytes;
+    if (liveBytes > p.peak) p.peak = liveBytes;
+    HEAP_UNLOCK();
+    if (size >= HEAP_SAMPLE_BYTES) sample();
+}
+
+void HeapTracker::released(size_t size) {
+    HEAP_LOCK();
+    current().frees++;
+    liveBytes -= size < liveBytes ? size : liveBytes;
+    HEAP_UNLOCK();
+}
+
+/**
+ * Sample the largest free internal block into the current phase.
+ */
+void HeapTracker::sample() {
+    const uint32_t largest = largestFreeBlock();
+    HEAP_LOCK();
+    if (largest < current().largest) current().largest = largest;
+    HEAP_UNLOCK();
+}
+
+void HeapTracker::placed(HeapClass cls, size_t size, bool psram, bool fallback) {
+    HEAP_LOCK();
+    HeapClassCount& c = classes[cls];
+    c.allocs++;
+    c.bytes += size;
+    if (psram) c.psram++;
+    if (fallback) c.fallbacks++;
+    HEAP_UNLOCK();
+}
+
+void HeapTracker::failed(HeapClass cls) {
+    HEAP_LOCK();
+    classes[cls].failures++;
+    HEAP_UNLOCK();
+}
+
+/**
+ * Print this wake's allocations per phase, and where heapAlloc put them.
+ */
+void HeapTracker::report() const {
+    debugf("Heap: %lu bytes live, at most %lu\n", (unsigned long)liveBytes, (unsigned long)peakBytes);
+    for (uint8_t i = 0; i <= PROFILE_PHASES; i++) {
+        const HeapPhase& p = phases[i];
+        if (!p.allocs && !p.frees) continue;
+        debugf("  %-8s %5lu new, %5lu delete, %7lu bytes, peak %7lu, largest free %ld\n",
+               i < PROFILE_PHASES ? PROFILE_NAMES[i] : "other", (unsigned long)p.allocs, (unsigned long)p.frees,
+               (unsigned long)p.bytes, (unsigned long)p.peak, p.largest == 0xFFFFFFFF ? -1L : (long)p.largest);
+    }
+    for (uint8_t i = 0; i < HEAP_CLASSES; i++) {
+        const HeapClassCount& c = classes[i];
+        if (!c.allocs && !c.failures) continue;
+        debugf("  %-8s %5lu blocks, %7lu bytes, %5lu in PSRAM, %lu fell back, %lu failed\n", CLASS_NAMES[i],
+               (unsigned long)c.allocs, (unsigned long)c.bytes, (unsigned long)c.psram,
+               (unsigned long)c.fallbacks, (unsigned long)c.failures);
+    }
+}
+
+HeapClass heapClass(size_t size) {
+    if (size < HEAP_SMALL_BYTES) return HEAP_SMALL;
+    return size < HEAP_LARGE_BYTES ? HEAP_MEDIUM : HEAP_LARGE;
+}
+
+void* heapAlloc(size_t size, bool pinned) {
+    const HeapClass cls = pinned ? HEAP_PINNED : heapClass(size);
+    if (!size) size = 1;
+
+    // Only medium and large blocks may go to the memory their class doesn't prefer.
+    const bool large = cls == HEAP_LARGE;
+    void* p = heap_caps_malloc(size, large ? PSRAM_CAPS : INTERNAL_CAPS);
+    const bool fallback = !p && (large || cls == HEAP_MEDIUM);
+    if (fallback) p = heap_caps_malloc(size, large ? INTERNAL_CAPS : PSRAM_CAPS);
+
+    if (!p) {
+        HEAP.failed(cls);
+        debugf("No room for a %u byte %s block\n", (unsigned)size, CLASS_NAMES[cls]);
+        return nullptr;
+    }
+    HEAP.placed(cls, size, esp_ptr_external_ram(p), fallback);
+    HEAP.allocated(blockSize(p));
+    return p;
+}
+
+void heapFree(const void* ptr) {
+    if (!ptr) return;
+    HEAP.released(blockSize((void*)ptr));
+    heap_caps_free((void*)ptr);
+}
+
+#if HEAP_TRACKING
+
+/**
+ * The global allocation functions, counting into HEAP. The sized and aligned forms are left to
+ * the library: sized delete ends up here, and nothing in the firmware over-aligns.
+ */
+static void* track(void* p) {
+    if (p) HEAP.allocated(blockSize(p));
+    return p;
+}
+
+static void untrack(void* p) {
+    if (!p) return;
+    HEAP.released(blockSize(p));
+    free(p);
+}
+
+static void* allocate(size_t size) {
+    void* p = track(malloc(size ? size : 1));
+#if __cpp_exceptions
+    if (!p) throw std::bad_alloc();
+#else
+    if (!p) abort();
+#endif
+    return p;
+}
+
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return track(malloc(size ? size : 1));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return track(malloc(size ? size : 1));
+}
+
+void operator delete(void* p) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void* p) noexcept {
+    untrack(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    untrack(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    untrack(p);
+}
+
+#endif
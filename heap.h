@@ -0,0 +1,175 @@
+#pragma once
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "profile.h"
+
+/**
+ * Whether the global operator new and delete count allocations. Off, the counts stay at 0.
+ */
+#ifndef HEAP_TRACKING
+#define HEAP_TRACKING 1
+#endif
+
+/**
+ * Allocations of at least this many bytes also sample the largest free block, as they are the
+ * ones that split the heap. Phase boundaries always sample it.
+ */
+#define HEAP_SAMPLE_BYTES 1024
+
+/**
+ * Nesting of profiler phases the tracker follows. Deeper scopes count to the last one it follows.
+ */
+#define HEAP_DEPTH 8
+
+/**
+ * Size classes of heapAlloc. Small blocks stay in internal RAM, where they are quickest to reach;
+ * blocks of at least HEAP_LARGE_BYTES go to PSRAM, where they don't split the internal heap.
+ */
+#define HEAP_SMALL_BYTES 256
+#define HEAP_LARGE_BYTES 4096
+
+/**
+ * Heap use of one phase of a wake, or of the time outside every phase.
+ */
+struct HeapPhase {
+    uint32_t allocs;            // Allocations made
+    uint32_t frees;             // Allocations given back, whoever made them
+    uint32_t bytes;             // Bytes the allocations took, with the allocator's rounding
+    uint32_t peak;              // Most bytes live at once, counted from boot
+    uint32_t largest;           // Smallest largest free internal block seen, 0xFFFFFFFF if never sampled
+};
+
+/**
+ * Where heapAlloc put a block, and what it asked for.
+ */
+enum HeapClass : uint8_t {
+    HEAP_SMALL = 0,         // Under HEAP_SMALL_BYTES: internal RAM only
+    HEAP_MEDIUM,            // Internal RAM, PSRAM if internal RAM has no room
+    HEAP_LARGE,             // HEAP_LARGE_BYTES and up: PSRAM, internal RAM if there is no PSRAM or no room
+    HEAP_PINNED,            // Internal RAM only, whatever the size, for buffers on a hot path or DMA
+    HEAP_CLASSES
+};
+
+struct HeapClassCount {
+    uint32_t allocs;            // Blocks handed out
+    uint32_t bytes;             // Bytes asked for
+    uint32_t psram;             // Blocks that went to PSRAM
+    uint32_t fallbacks;         // Blocks that went to the other memory than the class prefers
+    uint32_t failures;          // Allocations neither memory had room for
+};
+
+/**
+ * Counts what goes through the global operator new and delete and heapAlloc, and attributes it
+ * to the innermost profiler phase: the buffers of readFile, getResponse and readLog, formattime's
+ * new[], and every object made with new. String and ArduinoJson allocate with malloc, so they
+ * only show in the largest free block and the profiler's low water marks.
+ * Other tasks' allocations count to whatever phase the main task is in.
+ */
+class HeapTracker {
+public:
+    /**
+     * Start a wake: clear the counts, but not what is live.
+     */
+    void begin();
+
+    /**
+     * Follow the profiler into and out of a phase.
+     */
+    void enter(ProfilePhase phase);
+    void leave(ProfilePhase phase);
+
+    /**
+     * Count an allocation of size bytes, or the release of one.
+     */
+    void allocated(size_t size);
+    void released(size_t size);
+
+    /**
+     * Sample the largest free internal block into the current phase.
+     */
+    void sample();
+
+    /**
+     * Count a heapAlloc of a class.
+     * @param psram: Whether the block went to PSRAM, false if it went to internal RAM.
+     * @param fallback: Whether that is not the memory the class prefers.
+     */
+    void placed(HeapClass cls, size_t size, bool psram, bool fallback);
+    void failed(HeapClass cls);
+
+    /**
+     * What heapAlloc did with a class this wake.
+     */
+    const HeapClassCount& placement(HeapClass cls) const {
+        return classes[cls < HEAP_CLASSES ? cls : HEAP_PINNED];
+    }
+
+    /**
+     * What a phase did this wake, PROFILE_PHASES for the time outside every phase.
+     */
+    const HeapPhase& phase(uint8_t phase) const {
+        return phases[phase < PROFILE_PHASES ? phase : (uint8_t)PROFILE_PHASES];
+    }
+
+    /**
+     * Bytes live now, and at most, counted from boot.
+     */
+    uint32_t live() const {
+        return liveBytes;
+    }
+
+    uint32_t peak() const {
+        return peakBytes;
+    }
+
+    /**
+     * Print this wake's allocations per phase.
+     */
+    void report() const;
+
+private:
+    HeapPhase& current() {
+        return phases[depth ? stack[depth - 1] : (uint8_t)PROFILE_PHASES];
+    }
+
+    HeapPhase phases[PROFILE_PHASES + 1] = {};
+    HeapClassCount classes[HEAP_CLASSES] = {};
+    uint8_t stack[HEAP_DEPTH] = {};
+    uint8_t depth = 0;
+    uint8_t skipped = 0;        // Scopes entered past HEAP_DEPTH
+    uint32_t liveBytes = 0;
+    uint32_t peakBytes = 0;
+};
+
+extern HeapTracker HEAP;
+
+/**
+ * A phase's counts squeezed into the profile record: KiB, saturating at 0xFFFE.
+ */
+uint16_t heapKb(uint32_t bytes);
+
+/**
+ * The class heapAlloc puts a block of size bytes in, unless it is pinned.
+ */
+HeapClass heapClass(size_t size);
+
+/**
+ * Allocate a buffer in the memory its size class prefers: large transient buffers, such as
+ * file contents, responses and backlogs, in PSRAM, small ones in internal RAM. Falls back to
+ * the other memory when the preferred one has no room, except for small and pinned blocks.
+ * @param size: The number of bytes needed.
+ * @param pinned: Keep the buffer in internal RAM whatever its size.
+ *
+ * @return The buffer, or nullptr if there was no room. Give it back with heapFree.
+ */
+void* heapAlloc(size_t size, bool pinned = false);
+
+/**
+ * Give back a buffer from heapAlloc. Null is ignored.
+ */
+void heapFree(const void* ptr);
+
+#endif
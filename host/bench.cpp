@@ -0,0 +1,374 @@
+/**
+ * Microbenchmarks of the station's data path: the statistics a reading is made from, the
+ * sky analysis, hash, crop and thumbnail of its image, the string helpers, and the log, cache and URL work a wake
+ * does around them. Image benchmarks run on the fixtures make_fixtures.py generates.
+ *
+ * File system benchmarks run against SD_MMC on a scratch directory, so they measure the
+ * firmware's own code over the host's page cache, not the card. Compare runs across commits
+ * with bench_compare.py:
+ *
+ *     ./station_bench --benchmark_out=before.json --benchmark_out_format=json
+ *     python3 host/bench_compare.py before.json after.json
+ */
+#include <Arduino.h>
+#include <SD_MMC.h>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <unistd.h>
+#include "../comm.h"
+#include "../image_hash.h"
+#include "../io.h"
+#include "../roi.h"
+#include "../sensors.h"
+#include "../sky.h"
+#include "../thumbnail.h"
+#include "fixture.h"
+
+/**
+ * A reading as a wake takes it, with the sky analysed.
+ */
+static Reading sampleReading() {
+    return Reading("2026-06-21 12:00:00", 18.4, 62.5, 101325.0, 11.1, 12.0, 0.4375, 131.25);
+}
+
+/**
+ * A log file holding count readings, written the way appendReading writes them.
+ */
+static void writeLog(size_t count) {
+    String json = "{\"readings\":[";
+    for (size_t i = 0; i < count; i++) {
+        if (i) json += ",";
+        json += "{\"timestamp\":\"2026-06-21 12:00:00\",\"temperature\":18.4,\"humidity\":62.5,"
+                "\"pressure\":101325,\"dewpoint\":11.1,\"cloud_fraction\":0.4375,\"brightness\":131.25}";
+    }
+    json += "]}";
+    File file = SD_MMC.open(LOG_FILE, FILE_WRITE);
+    file.print(json);
+    file.close();
+}
+
+static void writeCache() {
+    File file = SD_MMC.open(CACHE_FILE, FILE_WRITE);
+    file.print("{\"NTP\":\"2026-06-21 06:00:00\",\"QNH\":{\"value\":1013.25,\"timestamp\":\"2026-06-21 06:00:00\"},"
+               "\"UPDATE\":\"2026-06-21 06:00:00\"}");
+    file.close();
+}
+
+/**
+ * Samples around a mean with a few outliers, as the sensors deliver them.
+ */
+static std::vector<double> samples(size_t count) {
+    std::mt19937 rng(count);
+    std::normal_distribution<double> noise(1013.25, 0.05);
+    std::vector<double> out(count);
+    for (size_t i = 0; i < count; i++) out[i] = noise(rng);
+    for (size_t i = 0; i < count; i += 17) out[i] += 5.0;
+    return out;
+}
+
+static void BM_removeOutliersandGetMean(benchmark::State& state) {
+    const std::vector<double> source = samples(state.range(0));
+    std::vector<double> data(source.size());
+    // It sorts in place, so every run starts from unsorted samples; the copy is part of the cost.
+    for (auto _ : state) {
+        data = source;
+        benchmark::DoNotOptimize(removeOutliersandGetMean(data.data(), data.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_removeOutliersandGetMean)->Arg(16)->Arg(SAMPLES)->Arg(256)->Arg(1024);
+
+static void BM_calcDP(benchmark::State& state) {
+    double temperature = 18.4;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(temperature);
+        benchmark::DoNotOptimize(calcDP(temperature, 62.5, 1013.25, 12.0));
+    }
+}
+BENCHMARK(BM_calcDP);
+
+static void BM_str_replace(benchmark::State& state) {
+    String source;
+    for (int i = 0; i < state.range(0); i++) source += "a b ";
+    char oldchars[] = " ";
+    char newchars[] = "%20";
+    char buf[MAX_STRING_LENGTH];
+    for (auto _ : state) {
+        strcpy(buf, source.c_str());
+        str_replace(buf, oldchars, newchars);
+        benchmark::DoNotOptimize(buf);
+    }
+}
+BENCHMARK(BM_str_replace)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_formattime(benchmark::State& state) {
+    time_t now = 1782043200;
+    tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    for (auto _ : state) {
+        char* timestamp = formattime(&timeinfo);
+        benchmark::DoNotOptimize(timestamp);
+        delete[] timestamp;
+    }
+}
+BENCHMARK(BM_formattime);
+
+static void BM_readFile(benchmark::State& state) {
+    const String content(std::string(state.range(0), 'x').c_str());
+    File file = SD_MMC.open("/bench.txt", FILE_WRITE);
+    file.print(content);
+    file.close();
+    for (auto _ : state) {
+        const char* read = readFile(SD_MMC, "/bench.txt");
+        benchmark::DoNotOptimize(read);
+        heapFree(read);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    SD_MMC.remove("/bench.txt");
+}
+BENCHMARK(BM_readFile)->Arg(256)->Arg(4 << 10)->Arg(64 << 10);
+
+static void BM_appendReading(benchmark::State& state) {
+    Reading reading = sampleReading();
+    for (auto _ : state) {
+        state.PauseTiming();
+        writeLog(state.range(0));
+        state.ResumeTiming();
+        appendReading(SD_MMC, &reading);
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_appendReading)->RangeMultiplier(4)->Range(1, 256)->Complexity();
+
+static void BM_readLog(benchmark::State& state) {
+    writeLog(state.range(0));
+    for (auto _ : state) {
+        ReadingLog log = readLog(SD_MMC);
+        benchmark::DoNotOptimize(log.readings);
+        freeLog(&log);
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_readLog)->RangeMultiplier(4)->Range(1, 256)->Complexity();
+
+static void BM_updateCacheTimestamp(benchmark::State& state) {
+    writeCache();
+    char timestamp[] = "2026-06-21 12:00:00";
+    for (auto _ : state) updateCache(SD_MMC, timestamp, "NTP");
+}
+BENCHMARK(BM_updateCacheTimestamp);
+
+static void BM_updateCacheValue(benchmark::State& state) {
+    writeCache();
+    for (auto _ : state) updateCache(SD_MMC, 1013.25, "QNH");
+}
+BENCHMARK(BM_updateCacheValue);
+
+/**
+ * The URL sendReadings builds: sized, then written.
+ */
+static void BM_readingsUrl(benchmark::State& state) {
+    NetworkInfo network;
+    Reading reading = sampleReading();
+    if (!state.range(0)) reading.cloudFraction = UNDEFINED;
+    for (auto _ : state) {
+        char url[readingsUrl(&network, &reading, nullptr, 0) + 1];
+        readingsUrl(&network, &reading, url, sizeof(url));
+        benchmark::DoNotOptimize(url[0]);
+    }
+}
+BENCHMARK(BM_readingsUrl)->ArgName("sky")->Arg(0)->Arg(1);
+
+/**
+ * RGB888 pixels of sky, some clear and some cloud, as the classifier sees them.
+ */
+static std::vector<uint8_t> skyPixels(size_t count) {
+    std::mt19937 rng(count);
+    std::uniform_int_distribution<int> channel(0, 255);
+    std::vector<uint8_t> rgb(count * 3);
+    for (uint8_t& c : rgb) c = channel(rng);
+    return rgb;
+}
+
+/**
+ * The classification kernel over one run of pixels, a row of a preview up to a full frame row.
+ */
+static void BM_skyClassifyRun(benchmark::State& state) {
+    const std::vector<uint8_t> rgb = skyPixels(state.range(0));
+    for (auto _ : state) {
+        SkyCounts counts;
+        skyClassifyRun(rgb.data(), state.range(0), &counts);
+        benchmark::DoNotOptimize(counts);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_skyClassifyRun)->Arg(160)->Arg(1280)->Arg(2560);
+
+/**
+ * Classification of a whole image inside the fisheye mask, at the size of a 1/8 preview of QHD.
+ */
+static void BM_skyClassify(benchmark::State& state) {
+    const uint16_t width = 320, height = 180;
+    const std::vector<uint8_t> rgb = skyPixels((size_t)width * height);
+    const SkyMask mask = SkyMask::forImage(width, height);
+    const uint32_t inside = skyClassify(rgb.data(), width, height, mask).pixels;
+    for (auto _ : state) benchmark::DoNotOptimize(skyClassify(rgb.data(), width, height, mask));
+    state.SetItemsProcessed(state.iterations() * inside);
+}
+BENCHMARK(BM_skyClassify);
+
+/**
+ * The whole analysis of a captured frame: DC decode at 1/8 scale, then classification.
+ */
+static void BM_skyAnalyse(benchmark::State& state) {
+    std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    const ImageBuffer img = ImageBuffer::mapped(jpg.data(), jpg.size());
+    SkyStats stats;
+    for (auto _ : state) {
+        if (!skyAnalyse(img, &stats)) {
+            state.SkipWithError("Could not analyse the fixture");
+            break;
+        }
+        benchmark::DoNotOptimize(stats);
+    }
+    state.SetLabel(FIXTURES[state.range(0)]);
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+}
+BENCHMARK(BM_skyAnalyse)->DenseRange(0, FIXTURE_COUNT - 1);
+
+/**
+ * The duplicate filter's hash of a captured frame, from the DC coefficients of its luma.
+ */
+static void BM_imageHash(benchmark::State& state) {
+    const std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    uint64_t hash;
+    for (auto _ : state) {
+        if (!imageHash(jpg.data(), jpg.size(), &hash)) {
+            state.SkipWithError("Could not hash the fixture");
+            break;
+        }
+        benchmark::DoNotOptimize(hash);
+    }
+    state.SetLabel(FIXTURES[state.range(0)]);
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+}
+BENCHMARK(BM_imageHash)->DenseRange(0, FIXTURE_COUNT - 1);
+
+/**
+ * The compressed domain crop of a captured frame to the fisheye circle, with and without
+ * blanking the blocks outside it, reporting the size of the crop against the frame.
+ */
+static void BM_jpegCrop(benchmark::State& state) {
+    const std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    ImageRoi roi;
+    roi.shape = ROI_CIRCLE;
+    roi.blank = state.range(1);
+    std::vector<uint8_t> out(jpg.size());
+    size_t len = 0;
+    for (auto _ : state) {
+        len = jpegCrop(jpg.data(), jpg.size(), roi, out.data(), out.size());
+        if (!len) {
+            state.SkipWithError("Could not crop the fixture");
+            break;
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetLabel(std::string(FIXTURES[state.range(0)]) + (roi.blank ? " blanked" : ""));
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+    state.counters["crop_bytes"] = len;
+    state.counters["crop_ratio"] = (double)len / jpg.size();
+}
+BENCHMARK(BM_jpegCrop)->ArgsProduct({benchmark::CreateDenseRange(0, FIXTURE_COUNT - 1, 1), {0, 1}});
+
+/**
+ * A full decode of a captured frame with libjpeg, what the previews are measured against.
+ */
+static void BM_decodeFull(benchmark::State& state) {
+    const std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    for (auto _ : state) benchmark::DoNotOptimize(decodeJpeg(jpg).rgb.data());
+    state.SetLabel(FIXTURES[state.range(0)]);
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+}
+BENCHMARK(BM_decodeFull)->DenseRange(0, FIXTURE_COUNT - 1);
+
+/**
+ * A preview of a captured frame, from the DC alone or with the first AC terms, into a preallocated buffer.
+ */
+static void BM_decodePreview(benchmark::State& state) {
+    const std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    const uint8_t scale = state.range(1);
+    uint16_t w, h;
+    if (!previewSize(jpg.data(), jpg.size(), scale, &w, &h)) {
+        state.SkipWithError("Could not read the fixture");
+        return;
+    }
+    std::vector<uint8_t> rgb((size_t)w * h * 3);
+    for (auto _ : state) {
+        if (!decodePreview(jpg.data(), jpg.size(), scale, rgb.data(), rgb.size(), &w, &h)) {
+            state.SkipWithError("Could not decode the fixture");
+            break;
+        }
+        benchmark::DoNotOptimize(rgb.data());
+    }
+    state.SetLabel(std::string(FIXTURES[state.range(0)]) + (scale == PREVIEW_DC ? " dc" : " dc+ac"));
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+}
+BENCHMARK(BM_decodePreview)->ArgsProduct({benchmark::CreateDenseRange(0, FIXTURE_COUNT - 1, 1), {PREVIEW_DC, PREVIEW_DC_AC}});
+
+/**
+ * A backlog thumbnail of a captured frame: preview decode, then re-encode.
+ */
+static void BM_makeThumbnail(benchmark::State& state) {
+    std::vector<uint8_t> jpg = readFixture(FIXTURES[state.range(0)]);
+    const ImageBuffer img = ImageBuffer::mapped(jpg.data(), jpg.size());
+    size_t size = 0;
+    for (auto _ : state) {
+        ImageBuffer thumb = makeThumbnail(img);
+        if (!thumb) {
+            state.SkipWithError("Could not make a thumbnail of the fixture");
+            break;
+        }
+        size = thumb.size();
+    }
+    state.SetLabel(FIXTURES[state.range(0)]);
+    state.SetBytesProcessed(state.iterations() * jpg.size());
+    state.counters["thumbnail_bytes"] = size;
+}
+BENCHMARK(BM_makeThumbnail)->DenseRange(0, FIXTURE_COUNT - 1);
+
+/**
+ * The commit the benchmarks were built from, so result files say what they measured.
+ */
+static std::string commit() {
+    char buf[64] = "";
+    FILE* git = popen("git -C " STATION_DIR " describe --always --dirty 2>/dev/null", "r");
+    if (!git) return "";
+    if (!fgets(buf, sizeof(buf), git)) buf[0] = '\0';
+    pclose(git);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    char root[] = "/tmp/station_bench.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    HOST_HAL.root = root;
+    if (!SD_MMC.begin()) {
+        fprintf(stderr, "Could not mount %s\n", root);
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::AddCustomContext("commit", commit());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    SD_MMC.remove(LOG_FILE);
+    SD_MMC.remove(CACHE_FILE);
+    rmdir(root);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Compare two station_bench result files (Google Benchmark JSON), benchmark by benchmark.
+
+Uses the median aggregate where the runs were repeated, the single run otherwise, and exits
+non-zero if any benchmark got slower by more than the threshold.
+
+    ./station_bench --benchmark_out=before.json --benchmark_out_format=json
+    python3 host/bench_compare.py before.json after.json --threshold 10
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Benchmark name -> (cpu time in ns, commit) for one result file."""
+    with open(path) as f:
+        doc = json.load(f)
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    times = {}
+    medians = set()
+    for b in doc.get("benchmarks", []):
+        if b.get("run_type") == "aggregate" and b.get("aggregate_name") != "median":
+            continue
+        if "cpu_time" not in b:
+            continue
+        name = b.get("run_name", b["name"])
+        median = b.get("run_type") == "aggregate"
+        if name in medians and not median:
+            continue
+        if median:
+            medians.add(name)
+        times[name] = b["cpu_time"] * scale.get(b.get("time_unit", "ns"), 1.0)
+    return times, doc.get("context", {}).get("commit", "?")
+
+
+def human(ns):
+    for unit, div in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= div:
+            return "%.3g %s" % (ns / div, unit)
+    return "%.3g ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0, help="percent slower that counts as a regression")
+    args = parser.parse_args()
+
+    before, a = load(args.before)
+    after, b = load(args.after)
+    print("%-40s %12s %12s %8s   (%s -> %s)" % ("benchmark", "before", "after", "change", a, b))
+    regressed = []
+    # In run order: dicts keep it, and both files list benchmarks in registration order.
+    for name in list(before) + [n for n in after if n not in before]:
+        if name not in before or name not in after:
+            print("%-40s %12s %12s" % (name, human(before[name]) if name in before else "-",
+                                       human(after[name]) if name in after else "-"))
+            continue
+        change = (after[name] / before[name] - 1.0) * 100.0 if before[name] else 0.0
+        mark = " <" if change > args.threshold else ""
+        print("%-40s %12s %12s %+7.1f%%%s" % (name, human(before[name]), human(after[name]), change, mark))
+        if change > args.threshold:
+            regressed.append(name)
+
+    if regressed:
+        print("%d slower by more than %.0f%%" % (len(regressed), args.threshold), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * Checks for the host tests. A failed check prints where it is and carries on; the test
+ * exits with checkExit(), which fails it for ctest if anything did.
+ */
+static int CHECK_FAILURES = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            CHECK_FAILURES++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+    do { \
+        const double v_ = (value), e_ = (expected); \
+        if (!(fabs(v_ - e_) <= (tolerance))) { \
+            fprintf(stderr, "%s:%d: %s is %g, expected %g within %g\n", __FILE__, __LINE__, #value, v_, e_, (double)(tolerance)); \
+            CHECK_FAILURES++; \
+        } \
+    } while (0)
+
+/**
+ * @return The exit status of the test.
+ */
+static inline int checkExit() {
+    if (CHECK_FAILURES) fprintf(stderr, "%d check(s) failed\n", CHECK_FAILURES);
+    return CHECK_FAILURES ? 1 : 0;
+}
+
+#endif
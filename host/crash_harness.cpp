@@ -0,0 +1,363 @@
+/**
+ * Cuts the power at every point of the station's storage work, and checks what boot makes of it.
+ *
+ * The storage work of a wake is a script: the cache updates, appending the reading, writing its
+ * image and a bracket frame, then clearing the log after an upload. It runs once to count its
+ * storage operations (each byte written, open for writing, remove and rename is one), then once
+ * per cut point, in a child process whose power goes before that operation. After each cut the
+ * harness boots the file system as the station does, and checks that every file holds what it
+ * held before the interrupted step or what it holds after it, and that no replacement is left over.
+ *
+ *     ./crash_harness --readings 48 --stride 4
+ */
+#include <Arduino.h>
+#include <SD_MMC.h>
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <getopt.h>
+#include <map>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../io.h"
+#include "../sensors.h"
+
+/**
+ * Points this close to the start or end of a step are always cut at, whatever the stride:
+ * that is where the opens, removes and renames are.
+ */
+#define CUT_EDGE 8
+
+struct Options {
+    int readings = 48;              // Readings in the log before the script
+    size_t imageBytes = 4096;       // Size of the image and bracket frame written
+    uint32_t stride = 1;            // Cut at every this many operations inside a step
+    bool verbose = false;           // Print every cut that went wrong
+};
+
+static Options options;
+static tm timestamp = {};
+static std::vector<uint8_t> image;
+
+/**
+ * The files the script touches, and what they held at some point. Missing files are absent.
+ */
+typedef std::map<std::string, std::string> Snapshot;
+static std::vector<std::string> tracked;
+
+struct Step {
+    const char* name;
+    void (*run)();
+};
+
+static const Step STEPS[] = {
+    {"ntp", [] {
+        char ts[] = "2026-06-21 12:00:00";
+        updateCache(SD_MMC, ts, "NTP");
+    }},
+    {"qnh", [] {
+        cacheUpdate update = {1013.25, "2026-06-21 12:00:00"};
+        updateCache(SD_MMC, &update, "QNH");
+    }},
+    {"append", [] {
+        Reading reading("2026-06-21 12:00:00", 18.4, 62.5, 101325.0, 11.1, 12.0, 0.4375, 131.25);
+        appendReading(SD_MMC, &reading);
+    }},
+    {"image", [] {
+        writejpg(SD_MMC, &timestamp, ImageBuffer::mapped(image.data(), image.size()));
+    }},
+    {"bracket", [] {
+        writeBracket(SD_MMC, &timestamp, 0, ImageBuffer::mapped(image.data(), image.size()));
+    }},
+    {"clear", [] {
+        clearLog(SD_MMC);
+    }},
+};
+static const size_t STEP_COUNT = sizeof(STEPS) / sizeof(STEPS[0]);
+
+static bool readHost(const std::string& host, std::string* out) {
+    std::ifstream in(host, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream s;
+    s << in.rdbuf();
+    *out = s.str();
+    return true;
+}
+
+static void writeHost(const std::string& path, const std::string& content) {
+    std::ofstream out(hostPath(path.c_str()), std::ios::binary | std::ios::trunc);
+    out << content;
+}
+
+static Snapshot snapshot() {
+    Snapshot s;
+    for (const std::string& path : tracked) {
+        std::string content;
+        if (readHost(hostPath(path.c_str()), &content)) s[path] = content;
+    }
+    return s;
+}
+
+/**
+ * Files in the root, as the station sees them.
+ */
+static std::vector<std::string> listRoot() {
+    std::vector<std::string> names;
+    DIR* dir = opendir(HOST_HAL.root.c_str());
+    if (!dir) return names;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (entry -> d_name[0] != '.') names.push_back(std::string("/") + entry -> d_name);
+    }
+    closedir(dir);
+    return names;
+}
+
+/**
+ * The card before the script: a backlog of readings, a cache, and nothing else.
+ */
+static void seed() {
+    for (const std::string& name : listRoot()) unlink(hostPath(name.c_str()).c_str());
+    std::string log = "{\"readings\":[";
+    for (int i = 0; i < options.readings; i++) {
+        if (i) log += ",";
+        log += "{\"timestamp\":\"2026-06-21 06:00:00\",\"temperature\":18.4,\"humidity\":62.5,"
+               "\"pressure\":101325,\"dewpoint\":11.1,\"cloud_fraction\":0.4375,\"brightness\":131.25}";
+    }
+    writeHost(LOG_FILE, log + "]}");
+    writeHost(CACHE_FILE, "{\"NTP\":\"2026-06-21 06:00:00\",\"SERVER\":\"None\","
+                          "\"QNH\":{\"value\":1012,\"timestamp\":\"2026-06-21 06:00:00\"}}");
+}
+
+/**
+ * Readings in a log file's contents, -1 if it doesn't parse.
+ */
+static int readingsIn(const Snapshot& s) {
+    auto it = s.find(LOG_FILE);
+    if (it == s.end()) return 0;
+    JsonDocument doc;
+    if (deserializeJson(doc, it -> second)) return -1;
+    return doc["readings"].size();
+}
+
+/**
+ * What booting after a cut found.
+ */
+struct Boot {
+    uint64_t us;            // Host time from mounting to having read the log
+    uint64_t ops;           // Storage operations recovery did
+    uint64_t bytesRead;
+    size_t interrupted;     // Replacements recoverFiles found
+    size_t readings;        // Readings readLog returned
+};
+
+/**
+ * Boot as startStorage does, then read the backlog as the upload does.
+ */
+static Boot boot() {
+    const HostCounters before = HOST_HAL.counters;
+    const auto start = std::chrono::steady_clock::now();
+    Boot b = {};
+    b.interrupted = recoverFiles(SD_MMC);
+    initLogFile(SD_MMC);
+    initCacheFile(SD_MMC);
+    ReadingLog log = readLog(SD_MMC);
+    b.readings = log.size;
+    freeLog(&log);
+    b.us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    b.ops = HOST_HAL.counters.storageOps - before.storageOps;
+    b.bytesRead = HOST_HAL.counters.bytesRead - before.bytesRead;
+    return b;
+}
+
+/**
+ * Run the script in a child process with the power going before operation cut.
+ * @return True if the power went, false if the script finished first.
+ */
+static bool runCut(uint64_t cut) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        HOST_HAL.counters.storageOps = 0;
+        HOST_HAL.cutAt = cut;
+        for (const Step& step : STEPS) step.run();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == HOST_POWER_CUT_EXIT) return true;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) return false;
+    fprintf(stderr, "Cut at %llu: the script died with status %d\n", (unsigned long long)cut, status);
+    exit(1);
+}
+
+struct StepResult {
+    uint32_t cuts = 0;
+    uint32_t inconsistent = 0;      // Cuts after which a file held neither the old nor the new contents
+    uint32_t leftovers = 0;         // Cuts after which a replacement was still lying around
+    uint32_t readingsLost = 0;      // Readings gone, over every cut
+    uint32_t worstLoss = 0;         // Most readings one cut lost
+    uint32_t imagesLost = 0;        // Images neither whole nor absent as before
+};
+
+static uint64_t percentile(std::vector<uint64_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --readings N       readings in the log before the script (48)\n"
+            "  --image-bytes N    size of the image and bracket frame (4096)\n"
+            "  --stride N         cut at every Nth operation inside a step, edges always (1)\n"
+            "  --root DIR         scratch directory backing the card (a new one in /tmp)\n"
+            "  --verbose          print every cut that went wrong\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    static const struct option longOptions[] = {
+        {"readings", required_argument, nullptr, 'n'},
+        {"image-bytes", required_argument, nullptr, 'i'},
+        {"stride", required_argument, nullptr, 's'},
+        {"root", required_argument, nullptr, 'r'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {nullptr, 0, nullptr, 0},
+    };
+    char root[] = "/tmp/station_crash.XXXXXX";
+    HOST_HAL.root.clear();
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'n': options.readings = atoi(optarg); break;
+            case 'i': options.imageBytes = strtoul(optarg, nullptr, 10); break;
+            case 's': options.stride = std::max(1, atoi(optarg)); break;
+            case 'r': HOST_HAL.root = optarg; break;
+            case 'v': options.verbose = true; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (HOST_HAL.root.empty()) {
+        if (!mkdtemp(root)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        HOST_HAL.root = root;
+    }
+    if (!SD_MMC.begin()) {
+        fprintf(stderr, "Could not mount %s\n", HOST_HAL.root.c_str());
+        return 1;
+    }
+
+    // A JPEG's markers around noise, so a torn one is told apart from a whole one.
+    image.resize(std::max<size_t>(options.imageBytes, 4));
+    for (size_t i = 0; i < image.size(); i++) image[i] = (uint8_t)(i * 2654435761u >> 13);
+    image[0] = 0xFF, image[1] = 0xD8, image[image.size() - 2] = 0xFF, image[image.size() - 1] = 0xD9;
+    timestamp.tm_year = 2026 - 1900, timestamp.tm_mon = 5, timestamp.tm_mday = 21, timestamp.tm_hour = 12;
+
+    char path[MAX_PATH_LENGTH];
+    tracked = {LOG_FILE, CACHE_FILE};
+    strftime(path, sizeof(path), "/%Y_%m_%d_%H_%M_%S.jpg", &timestamp);
+    tracked.push_back(path);
+    strftime(path, sizeof(path), "/%Y_%m_%d_%H_%M_%S_b0.jpg", &timestamp);
+    tracked.push_back(path);
+
+    // The run without a cut: where each step starts, and what the files hold after it.
+    seed();
+    std::vector<uint64_t> starts;
+    std::vector<Snapshot> states = {snapshot()};
+    HOST_HAL.counters.storageOps = 0;
+    for (const Step& step : STEPS) {
+        starts.push_back(HOST_HAL.counters.storageOps);
+        step.run();
+        states.push_back(snapshot());
+    }
+    starts.push_back(HOST_HAL.counters.storageOps);
+
+    std::vector<StepResult> results(STEP_COUNT);
+    std::vector<uint64_t> bootUs, bootOps, bootBytes;
+    size_t interrupted = 0;
+    for (size_t s = 0; s < STEP_COUNT; s++) {
+        for (uint64_t cut = starts[s]; cut < starts[s + 1]; cut++) {
+            const uint64_t into = cut - starts[s];
+            if (into >= CUT_EDGE && cut + CUT_EDGE < starts[s + 1] && into % options.stride) continue;
+
+            seed();
+            if (!runCut(cut)) continue;
+            const Boot b = boot();
+            const Snapshot after = snapshot();
+            StepResult& r = results[s];
+            r.cuts++;
+            bootUs.push_back(b.us);
+            bootOps.push_back(b.ops);
+            bootBytes.push_back(b.bytesRead);
+            interrupted += b.interrupted;
+
+            bool consistent = true;
+            for (const std::string& file : tracked) {
+                auto now = after.find(file);
+                auto old = states[s].find(file);
+                auto done = states[s + 1].find(file);
+                const bool same = now == after.end() ? old == states[s].end() || done == states[s + 1].end()
+                                  : (old != states[s].end() && old -> second == now -> second) ||
+                                    (done != states[s + 1].end() && done -> second == now -> second);
+                if (same) continue;
+                consistent = false;
+                if (file != LOG_FILE && file != CACHE_FILE) r.imagesLost++;
+                if (options.verbose) printf("cut %llu in %s: %s is torn\n", (unsigned long long)cut, STEPS[s].name, file.c_str());
+            }
+            if (!consistent) r.inconsistent++;
+
+            for (const std::string& name : listRoot()) {
+                if (name.size() > REPLACE_SUFFIX_LENGTH &&
+                    (name.compare(name.size() - REPLACE_SUFFIX_LENGTH, REPLACE_SUFFIX_LENGTH, REPLACE_TMP) == 0 ||
+                     name.compare(name.size() - REPLACE_SUFFIX_LENGTH, REPLACE_SUFFIX_LENGTH, REPLACE_NEW) == 0)) {
+                    r.leftovers++;
+                    if (options.verbose) printf("cut %llu in %s: %s left over\n", (unsigned long long)cut, STEPS[s].name, name.c_str());
+                    break;
+                }
+            }
+
+            const int least = std::min(readingsIn(states[s]), readingsIn(states[s + 1]));
+            if (least > (int)b.readings) {
+                const uint32_t lost = least - b.readings;
+                r.readingsLost += lost;
+                r.worstLoss = std::max(r.worstLoss, lost);
+                if (options.verbose) printf("cut %llu in %s: %u readings lost\n", (unsigned long long)cut, STEPS[s].name, lost);
+            }
+        }
+    }
+
+    printf("%zu steps, %llu storage operations, %d readings in the log, %zu byte images\n\n", STEP_COUNT,
+           (unsigned long long)starts[STEP_COUNT], options.readings, image.size());
+    printf("step       ops   cuts  torn  leftover  readings lost  worst  images lost\n");
+    uint32_t failures = 0;
+    for (size_t s = 0; s < STEP_COUNT; s++) {
+        const StepResult& r = results[s];
+        printf("%-8s %5llu  %5u  %4u  %8u  %13u  %5u  %11u\n", STEPS[s].name,
+               (unsigned long long)(starts[s + 1] - starts[s]), r.cuts, r.inconsistent, r.leftovers,
+               r.readingsLost, r.worstLoss, r.imagesLost);
+        failures += r.inconsistent + r.leftovers;
+    }
+    printf("\nboot after a cut: p50 %llu us, p99 %llu us, max %llu us; p50 %llu storage operations, %llu bytes read, "
+           "max %llu bytes read; %zu interrupted replacements\n",
+           (unsigned long long)percentile(bootUs, 0.5), (unsigned long long)percentile(bootUs, 0.99),
+           (unsigned long long)percentile(bootUs, 1.0), (unsigned long long)percentile(bootOps, 0.5),
+           (unsigned long long)percentile(bootBytes, 0.5), (unsigned long long)percentile(bootBytes, 1.0), interrupted);
+
+    if (root == HOST_HAL.root) {
+        for (const std::string& name : listRoot()) unlink(hostPath(name.c_str()).c_str());
+        rmdir(root);
+    }
+    return failures ? 1 : 0;
+}
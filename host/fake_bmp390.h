@@ -0,0 +1,196 @@
+#pragma once
+#ifndef FAKE_BMP390_H
+#define FAKE_BMP390_H
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include "../bmp390.h"
+
+/**
+ * Register level stand-in for a BMP390, for driving the bmp390.h driver on the host.
+ * Holds a register file and a FIFO which fills with temperature + pressure frames as
+ * simulated time passes in normal mode, with deterministic noise on the raw values.
+ * After a soft reset it NACKs everything until its startup time has passed.
+ *
+ * The calibration data is made up, but with the default raw values it compensates
+ * to roughly 20 deg C and 101325 Pa.
+ */
+class FakeBMP390 {
+public:
+    /**
+     * Bus handle handed to the driver. Holds a pointer so the driver can keep it by value.
+     */
+    struct Port {
+        FakeBMP390 *dev;
+
+        bool write(uint8_t addr, const uint8_t* data, size_t len) {
+            return dev -> write(addr, data, len);
+        }
+
+        bool read(uint8_t addr, uint8_t* data, size_t len) {
+            return dev -> read(addr, data, len);
+        }
+
+        bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+            return dev -> write(addr, tx, txLen) && dev -> read(addr, rx, rxLen);
+        }
+
+        bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count) {
+            return i2cSequence(*this, addr, transfers, count);
+        }
+
+        void wait(uint32_t ms) {
+            dev -> advance(ms);
+        }
+    };
+
+    uint32_t rawTemperature = 8050000;
+    uint32_t rawPressure = 6010789;
+    uint32_t noise = 200;           // Peak raw noise added to each value
+    uint32_t nacks = 0;             // Number of upcoming transactions to fail
+    uint32_t transactions = 0;      // Transactions seen so far
+
+    FakeBMP390(uint8_t address = BMP390_ADDRESS) : addr(address) {
+        reset();
+    }
+
+    Port port() {
+        return Port{this};
+    }
+
+    /**
+     * Let simulated time pass, queueing a FIFO frame for every elapsed sample period.
+     */
+    void advance(uint32_t ms) {
+        starting = ms < starting ? starting - ms : 0;
+        if ((regs[BMP390_REG_PWR_CTRL] & BMP390_MODE_NORMAL) != BMP390_MODE_NORMAL) return;
+        if (!(regs[BMP390_REG_FIFO_CONFIG1] & BMP390_FIFO_MODE)) return;
+
+        const uint32_t period = 5u << (regs[BMP390_REG_ODR] & 0x1F);
+        elapsed += ms;
+        while (elapsed >= period) {
+            elapsed -= period;
+            pushFrame();
+        }
+    }
+
+    size_t fifoLength() const {
+        return fifo.size();
+    }
+
+private:
+    uint8_t addr;
+    uint8_t regs[128];
+    uint8_t pointer = 0;
+    uint32_t elapsed = 0;
+    uint32_t starting = 0;          // Milliseconds until the sensor is up after a reset
+    uint32_t seed = 0x1234567;
+    std::deque<uint8_t> fifo;
+
+    void reset() {
+        memset(regs, 0, sizeof(regs));
+        regs[BMP390_REG_CHIP_ID] = BMP390_CHIP_ID;
+        regs[BMP390_REG_ODR] = BMP390_ODR_25;
+
+        const int16_t calib[] = {27000, 19000, -10, -2000, -3000, 35, 1, 25000, 30000, 3, -6, 15000, 10, -55};
+        const uint8_t widths[] = {2, 2, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 1, 1};
+        uint8_t at = BMP390_REG_CALIB;
+        for (size_t i = 0; i < sizeof(widths); i++) {
+            regs[at++] = (uint8_t)(calib[i] & 0xFF);
+            if (widths[i] == 2) regs[at++] = (uint8_t)((calib[i] >> 8) & 0xFF);
+        }
+
+        fifo.clear();
+        elapsed = 0;
+    }
+
+    uint32_t jitter() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        if (noise == 0) return 0;
+        return (seed % (2 * noise + 1)) - noise;
+    }
+
+    void pushFrame() {
+        const bool stopOnFull = regs[BMP390_REG_FIFO_CONFIG1] & BMP390_FIFO_STOP_FULL;
+        if (fifo.size() + BMP390_FRAME_LEN > BMP390_FIFO_SIZE) {
+            if (stopOnFull) return;
+            for (int i = 0; i < BMP390_FRAME_LEN; i++) fifo.pop_front();
+        }
+
+        const uint32_t t = rawTemperature + jitter();
+        const uint32_t p = rawPressure + jitter();
+        fifo.push_back(BMP390_FRAME_TEMP_PRESS);
+        for (int i = 0; i < 3; i++) fifo.push_back((uint8_t)(t >> (8 * i)));
+        for (int i = 0; i < 3; i++) fifo.push_back((uint8_t)(p >> (8 * i)));
+    }
+
+    bool nack(uint8_t address) {
+        transactions++;
+        if (address != addr || starting > 0) return true;
+        if (nacks > 0) {
+            nacks--;
+            return true;
+        }
+        return false;
+    }
+
+    bool write(uint8_t address, const uint8_t* data, size_t len) {
+        if (nack(address) || len == 0) return false;
+        pointer = data[0];
+
+        // Writes come as register / value pairs.
+        if (len >= 2) writeReg(data[0], data[1]);
+        for (size_t i = 2; i + 1 < len; i += 2) writeReg(data[i], data[i + 1]);
+        return true;
+    }
+
+    void writeReg(uint8_t reg, uint8_t value) {
+        if (reg == BMP390_REG_CMD) {
+            if (value == BMP390_CMD_SOFTRESET) {
+                reset();
+                starting = 2;   // Datasheet t_startup
+            } else if (value == BMP390_CMD_FIFO_FLUSH) {
+                fifo.clear();
+            }
+            return;
+        }
+        if (reg >= sizeof(regs) || reg == BMP390_REG_CHIP_ID) return;
+
+        const bool wasNormal = (regs[BMP390_REG_PWR_CTRL] & BMP390_MODE_NORMAL) == BMP390_MODE_NORMAL;
+        regs[reg] = value;
+
+        // The sensor marks the point where a new configuration takes effect.
+        if (reg == BMP390_REG_PWR_CTRL && !wasNormal && (value & BMP390_MODE_NORMAL) == BMP390_MODE_NORMAL &&
+            (regs[BMP390_REG_FIFO_CONFIG1] & BMP390_FIFO_MODE)) {
+            fifo.push_back(BMP390_FRAME_CFG_CHANGE);
+            fifo.push_back(0x00);
+        }
+    }
+
+    bool read(uint8_t address, uint8_t* data, size_t len) {
+        if (nack(address)) return false;
+
+        for (size_t i = 0; i < len; i++) {
+            if (pointer == BMP390_REG_FIFO_DATA) {
+                if (fifo.empty()) {
+                    data[i] = BMP390_FRAME_EMPTY;
+                } else {
+                    data[i] = fifo.front();
+                    fifo.pop_front();
+                }
+                continue;
+            }
+
+            if (pointer == BMP390_REG_FIFO_LENGTH) data[i] = (uint8_t)(fifo.size() & 0xFF);
+            else if (pointer == BMP390_REG_FIFO_LENGTH + 1) data[i] = (uint8_t)(fifo.size() >> 8);
+            else data[i] = pointer < sizeof(regs) ? regs[pointer] : 0;
+            pointer++;
+        }
+        return true;
+    }
+};
+
+#endif
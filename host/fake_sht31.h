@@ -0,0 +1,165 @@
+#pragma once
+#ifndef FAKE_SHT31_H
+#define FAKE_SHT31_H
+
+#include <stdint.h>
+#include "../sht31.h"
+
+/**
+ * Command level stand-in for an SHT31, for driving the sht31.h driver on the host.
+ * In periodic mode a new measurement becomes ready every sample period of simulated
+ * time. Fetching without a new measurement NACKs like the real sensor does, and every
+ * corruptEvery-th frame can be sent with a broken CRC. Like the real sensor it only takes
+ * a fetch or a break in periodic mode, and no command for a millisecond after a break.
+ */
+class FakeSHT31 {
+public:
+    /**
+     * Bus handle handed to the driver. Holds a pointer so the driver can keep it by value.
+     */
+    struct Port {
+        FakeSHT31 *dev;
+
+        bool write(uint8_t addr, const uint8_t* data, size_t len) {
+            return dev -> write(addr, data, len);
+        }
+
+        bool read(uint8_t addr, uint8_t* data, size_t len) {
+            return dev -> read(addr, data, len);
+        }
+
+        bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+            return dev -> write(addr, tx, txLen) && dev -> read(addr, rx, rxLen);
+        }
+
+        bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count) {
+            return i2cSequence(*this, addr, transfers, count);
+        }
+
+        void wait(uint32_t ms) {
+            dev -> advance(ms);
+        }
+    };
+
+    double temperature = 20.0;      // Simulated temperature in degrees Celsius
+    double humidity = 55.0;         // Simulated humidity as percentage
+    double noise = 0.05;            // Peak noise added to each value
+    uint32_t corruptEvery = 0;      // Corrupt the CRC of every n-th frame, 0 to disable
+    uint32_t conversions = 0;       // Measurements performed so far
+    uint32_t transactions = 0;      // Transactions seen so far
+
+    FakeSHT31(uint8_t address = SHT31_ADDRESS) : addr(address) {}
+
+    Port port() {
+        return Port{this};
+    }
+
+    /**
+     * Let simulated time pass, producing a new measurement every sample period.
+     */
+    void advance(uint32_t ms) {
+        busy = ms < busy ? busy - ms : 0;
+        if (period == 0) return;
+        elapsed += ms;
+        while (elapsed >= period) {
+            elapsed -= period;
+            measure();
+        }
+    }
+
+private:
+    enum Pending { NONE, STATUS, FETCH };
+
+    uint8_t addr;
+    uint32_t period = 0;
+    uint32_t elapsed = 0;
+    uint32_t busy = 0;              // Milliseconds until the next command is taken
+    uint32_t seed = 0x7654321;
+    bool ready = false;
+    Pending pending = NONE;
+    uint8_t frame[SHT31_FRAME_LEN] = {};
+
+    double jitter() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return noise * (((double)(seed % 2001) / 1000.0) - 1.0);
+    }
+
+    void measure() {
+        conversions++;
+
+        double t = temperature + jitter();
+        double h = humidity + jitter();
+        if (h < 0) h = 0;
+        if (h > 100) h = 100;
+
+        const uint16_t rawT = (uint16_t)((t + 45.0) / 175.0 * 65535.0 + 0.5);
+        const uint16_t rawH = (uint16_t)(h / 100.0 * 65535.0 + 0.5);
+        frame[0] = rawT >> 8;
+        frame[1] = rawT & 0xFF;
+        frame[2] = SHT31<Port>::crc8(frame, 2);
+        frame[3] = rawH >> 8;
+        frame[4] = rawH & 0xFF;
+        frame[5] = SHT31<Port>::crc8(frame + 3, 2);
+        if (corruptEvery && conversions % corruptEvery == 0) frame[5] ^= 0x5A;
+        ready = true;
+    }
+
+    bool write(uint8_t address, const uint8_t* data, size_t len) {
+        transactions++;
+        if (address != addr || len != 2 || busy > 0) return false;
+        const uint16_t cmd = (uint16_t)(data[0] << 8 | data[1]);
+        if (period && cmd != SHT31_CMD_FETCH && cmd != SHT31_CMD_BREAK) return false;
+
+        switch (cmd) {
+            case SHT31_CMD_BREAK:
+            case SHT31_CMD_SOFTRESET:
+                period = 0;
+                ready = false;
+                pending = NONE;
+                busy = 1;
+                return true;
+            case SHT31_CMD_STATUS:
+                pending = STATUS;
+                return true;
+            case SHT31_CMD_FETCH:
+                pending = FETCH;
+                return true;
+            case SHT31_CMD_ART:
+                period = 250;
+                return true;
+            case SHT31_MPS_0_5: period = 2000; return true;
+            case SHT31_MPS_1: period = 1000; return true;
+            case SHT31_MPS_2: period = 500; return true;
+            case SHT31_MPS_4: period = 250; return true;
+            case SHT31_MPS_10: period = 100; return true;
+            default:
+                return false;
+        }
+    }
+
+    bool read(uint8_t address, uint8_t* data, size_t len) {
+        transactions++;
+        if (address != addr) return false;
+        const Pending what = pending;
+        pending = NONE;
+
+        if (what == STATUS && len == 3) {
+            data[0] = 0x80;
+            data[1] = 0x10;
+            data[2] = SHT31<Port>::crc8(data, 2);
+            return true;
+        }
+
+        if (what == FETCH && len == SHT31_FRAME_LEN && ready) {
+            for (size_t i = 0; i < SHT31_FRAME_LEN; i++) data[i] = frame[i];
+            ready = false;
+            return true;
+        }
+
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <jpeglib.h>
+
+/**
+ * The sky fixtures make_fixtures.py generates, from clear to overcast.
+ */
+static const char* const FIXTURES[] = {"00_clear", "01_scattered", "02_broken", "03_overcast"};
+#define FIXTURE_COUNT (sizeof(FIXTURES) / sizeof(FIXTURES[0]))
+
+/**
+ * Read a fixture JPEG from HOST_FIXTURES.
+ * @param name: The fixture, without its .jpg.
+ *
+ * @return Its bytes, empty if it could not be read.
+ */
+static inline std::vector<uint8_t> readFixture(const char* name) {
+    std::vector<uint8_t> jpg;
+    const std::string path = std::string(HOST_FIXTURES) + "/" + name + ".jpg";
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return jpg;
+    fseek(f, 0, SEEK_END);
+    jpg.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    if (fread(jpg.data(), 1, jpg.size(), f) != jpg.size()) jpg.clear();
+    fclose(f);
+    return jpg;
+}
+
+/**
+ * A decoded image, RGB888 rows.
+ */
+struct RgbImage {
+    std::vector<uint8_t> rgb;
+    uint16_t width = 0;
+    uint16_t height = 0;
+};
+
+/**
+ * Decode a whole JPEG with libjpeg, as the reference the firmware's partial decoders are measured against.
+ * @param jpg: The JPEG.
+ * @param smooth: Interpolate chroma across blocks. Without, every MCU decodes on its own,
+ *                so an MCU aligned crop decodes to exactly the pixels it was cut from.
+ *
+ * @return The image, empty if the JPEG could not be decoded.
+ */
+static inline RgbImage decodeJpeg(const std::vector<uint8_t>& jpg, bool smooth = true) {
+    RgbImage img;
+    jpeg_decompress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpg.data(), jpg.size());
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return img;
+    }
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.do_fancy_upsampling = smooth;
+    jpeg_start_decompress(&cinfo);
+    img.width = cinfo.output_width;
+    img.height = cinfo.output_height;
+    img.rgb.resize((size_t)img.width * img.height * 3);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = img.rgb.data() + (size_t)cinfo.output_scanline * img.width * 3;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return img;
+}
+
+/**
+ * Encode an image the way the OV5640 does: baseline, 4:2:2, no restart markers.
+ */
+static inline std::vector<uint8_t> encodeJpeg(const RgbImage& img, int quality) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    unsigned char* out = nullptr;
+    unsigned long len = 0;
+    jpeg_mem_dest(&cinfo, &out, &len);
+    cinfo.image_width = img.width;
+    cinfo.image_height = img.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)img.rgb.data() + (size_t)cinfo.next_scanline * img.width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    std::vector<uint8_t> jpg(out, out + len);
+    jpeg_destroy_compress(&cinfo);
+    free(out);
+    return jpg;
+}
+
+#endif
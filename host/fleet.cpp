@@ -0,0 +1,421 @@
+/**
+ * Load generator for the ingest server: a fleet of simulated stations in one process, each
+ * sending its status, readings and images through the firmware's own request code in comm.cpp.
+ *
+ * Every station wakes on its interval, and on the wakes its radio comes up sends a status, then
+ * the readings and images queued since. Now and then a station finds no network and comes back
+ * with a backlog; --outage-at takes the whole fleet off the network at once, as a server outage
+ * does, so the burst when it comes back can be sized. Wakes with the radio up are coroutines on
+ * one thread, switched whenever the HTTP client waits on its socket, so thousands of stations
+ * cost a stack each only while they talk to the server.
+ *
+ *     python3 host/test_server.py &
+ *     ./fleet --stations 2000 --interval 600 --speedup 60 --duration 60
+ */
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <poll.h>
+#include <queue>
+#include <random>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include "../comm.h"
+
+/**
+ * Stack of a station talking to the server. Only touched pages are backed.
+ */
+#define FLEET_STACK_BYTES (256 * 1024)
+
+struct Options {
+    uint32_t stations = 100;        // Stations in the fleet
+    uint32_t interval = 600;        // Station seconds between wakes
+    uint32_t radioEvery = 3;        // The radio comes up every this many wakes
+    double speedup = 60;            // Station seconds per real second
+    double duration = 60;           // Real seconds to start wakes for
+    uint32_t concurrency = 512;     // Most stations talking to the server at once
+    double imageKb = 120;           // Median image size
+    double imageSpread = 0.35;      // Spread of the log of image sizes
+    double images = 0.9;            // Fraction of readings with an image
+    uint32_t maxImages = 24;        // Images a station spools before it drops the oldest
+    double outage = 0.02;           // Chance a radio wake finds no network
+    uint32_t outageWakes = 12;      // Most wakes a station's outage lasts
+    double outageAt = -1;           // Real seconds in when the whole fleet loses the network, -1 for never
+    double outageFor = 10;          // Real seconds the fleet's outage lasts
+    uint32_t seed = 1;
+};
+
+static Options options;
+static std::mt19937_64 rng;
+
+enum Route : uint8_t { ROUTE_STATUS = 0, ROUTE_READING, ROUTE_IMAGE, ROUTES };
+static const char* const ROUTE_NAMES[ROUTES] = {"/api/status", "/api/reading", "/api/images"};
+
+struct RouteStats {
+    std::vector<uint32_t> us;       // Latency of every request, connect to last byte
+    uint32_t failed = 0;            // Requests without a 2xx reply
+    uint64_t bytesUp = 0;           // Request bodies sent
+};
+
+static RouteStats stats[ROUTES];
+
+struct Station {
+    uint32_t id;
+    std::string mac;
+    uint32_t wake = 0;
+    uint32_t readings = 0;          // Readings queued for upload
+    uint32_t images = 0;            // Images spooled for upload
+    uint32_t offline = 0;           // Wakes left without a network
+};
+
+/**
+ * A station's wake with the radio up, running as a coroutine.
+ */
+struct Task {
+    ucontext_t ctx;
+    Station* station = nullptr;
+    uint8_t* stack = nullptr;
+    uint64_t startedUs = 0;
+    int fd = -1;                    // Socket waited on, -1 if runnable
+    short events = 0;
+    uint64_t deadlineUs = 0;
+    bool ready = false;             // Whether the socket became ready before the deadline
+    bool finished = false;
+};
+
+struct Due {
+    uint64_t us;
+    Station* station;
+    bool operator>(const Due& o) const { return us > o.us; }
+};
+
+static ucontext_t scheduler;
+static Task* running = nullptr;
+static std::vector<uint8_t*> stacks;
+static std::vector<uint8_t> image;
+static const auto started = std::chrono::steady_clock::now();
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+static uint64_t realUs(double stationSeconds) {
+    return stationSeconds / options.speedup * 1e6;
+}
+
+/**
+ * HOST_HAL.waitFd for the fleet: park the running station until its socket is ready or times out.
+ */
+static bool parkOn(int fd, short events, int32_t timeoutMs) {
+    Task* t = running;
+    t -> fd = fd;
+    t -> events = events;
+    t -> deadlineUs = nowUs() + (uint64_t)timeoutMs * 1000;
+    t -> ready = false;
+    swapcontext(&t -> ctx, &scheduler);
+    t -> fd = -1;
+    return t -> ready;
+}
+
+static void resume(Task* t) {
+    running = t;
+    HOST_HAL.mac = t -> station -> mac;
+    swapcontext(&scheduler, &t -> ctx);
+    running = nullptr;
+}
+
+/**
+ * Time one request through comm.cpp and count it against its route.
+ */
+template <typename Send>
+static bool timed(Route route, size_t bytes, Send send) {
+    const uint64_t start = nowUs();
+    const bool ok = httpOk(send());
+    RouteStats& s = stats[route];
+    s.us.push_back(nowUs() - start);
+    s.bytesUp += bytes;
+    if (!ok) s.failed++;
+    return ok;
+}
+
+/**
+ * The station's wall clock at its current wake, as the readings' timestamps.
+ */
+static void stationTime(const Station& s, char* out, size_t len) {
+    const time_t t = HOST_HAL.epoch + (time_t)s.wake * options.interval;
+    tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+    strftime(out, len, "%Y-%m-%d %H:%M:%S", &timeinfo);
+}
+
+/**
+ * What a station sends when its radio is up: its status, then its backlog, oldest first.
+ * A failed request leaves the rest of the backlog for the next radio wake.
+ */
+static void upload(Station& station) {
+    NetworkInfo network;
+    HTTPClient http;
+    Sensors::Status status;
+    status.SHT = status.BMP = status.CAM = status.WIFI = true;
+    char timestamp[20];
+    stationTime(station, timestamp, sizeof(timestamp));
+
+    timed(ROUTE_STATUS, 0, [&] { return sendStats(&http, &network, &status, timestamp); });
+
+    std::uniform_real_distribution<double> unit(0, 1);
+    while (station.readings) {
+        Reading reading(timestamp, 14 + 10 * unit(rng), 40 + 50 * unit(rng), 100500 + 1500 * unit(rng), 8.5, UNDEFINED,
+                        unit(rng), 255 * unit(rng));
+        if (!timed(ROUTE_READING, 0, [&] { return sendReadings(&http, &network, &reading); })) return;
+        station.readings--;
+    }
+
+    std::lognormal_distribution<double> size(log(options.imageKb * 1024), options.imageSpread);
+    while (station.images) {
+        const size_t len = std::min(image.size(), std::max<size_t>(4, size(rng)));
+        if (!timed(ROUTE_IMAGE, len, [&] { return sendImage(&http, &network, image.data(), len, timestamp); })) return;
+        station.images--;
+    }
+}
+
+static void taskMain() {
+    Task* t = running;
+    upload(*t -> station);
+    t -> finished = true;
+}
+
+static uint8_t* takeStack() {
+    if (!stacks.empty()) {
+        uint8_t* s = stacks.back();
+        stacks.pop_back();
+        return s;
+    }
+    void* s = mmap(nullptr, FLEET_STACK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (s == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    // A guard page below, so an overflow faults instead of running into the next stack.
+    mprotect(s, 4096, PROT_NONE);
+    return (uint8_t*)s;
+}
+
+static Task* start(Station* station) {
+    Task* t = new Task;
+    t -> station = station;
+    t -> stack = takeStack();
+    t -> startedUs = nowUs();
+    getcontext(&t -> ctx);
+    t -> ctx.uc_stack.ss_sp = t -> stack;
+    t -> ctx.uc_stack.ss_size = FLEET_STACK_BYTES;
+    t -> ctx.uc_link = &scheduler;
+    makecontext(&t -> ctx, taskMain, 0);
+    resume(t);
+    return t;
+}
+
+static uint64_t percentile(std::vector<uint32_t>& v, double p) {
+    if (v.empty()) return 0;
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void printRoute(const char* name, std::vector<uint32_t>& us, uint32_t failed, uint64_t bytes, double seconds) {
+    std::sort(us.begin(), us.end());
+    printf("%-13s %9zu %7u %8.1f %9.1f %8.2f %8.2f %8.2f %9.2f %8.2f\n", name, us.size(), failed, us.size() / seconds,
+           bytes / 1048576.0, percentile(us, 0.5) / 1e3, percentile(us, 0.9) / 1e3, percentile(us, 0.99) / 1e3,
+           percentile(us, 0.999) / 1e3, us.empty() ? 0.0 : us.back() / 1e3);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --stations N       stations in the fleet (100)\n"
+            "  --interval S       station seconds between wakes (600)\n"
+            "  --radio-every N    the radio comes up every N wakes (3)\n"
+            "  --speedup X        station seconds per real second (60)\n"
+            "  --duration S       real seconds to start wakes for (60)\n"
+            "  --concurrency N    most stations talking to the server at once (512)\n"
+            "  --image-kb KB      median image size (120)\n"
+            "  --images F         fraction of readings with an image (0.9)\n"
+            "  --outage P         chance a radio wake finds no network (0.02)\n"
+            "  --outage-wakes N   most wakes a station's outage lasts (12)\n"
+            "  --outage-at S      real seconds in when the whole fleet loses the network (never)\n"
+            "  --outage-for S     real seconds the fleet's outage lasts (10)\n"
+            "  --server URL       where requests go (http://127.0.0.1:8080)\n"
+            "  --timeout MS       connect and read timeout (5000)\n"
+            "  --seed N           random seed (1)\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    static const struct option longOptions[] = {
+        {"stations", required_argument, nullptr, 'n'},
+        {"interval", required_argument, nullptr, 'i'},
+        {"radio-every", required_argument, nullptr, 'r'},
+        {"speedup", required_argument, nullptr, 'x'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"concurrency", required_argument, nullptr, 'c'},
+        {"image-kb", required_argument, nullptr, 'k'},
+        {"images", required_argument, nullptr, 'g'},
+        {"outage", required_argument, nullptr, 'o'},
+        {"outage-wakes", required_argument, nullptr, 'w'},
+        {"outage-at", required_argument, nullptr, 'a'},
+        {"outage-for", required_argument, nullptr, 'f'},
+        {"server", required_argument, nullptr, 's'},
+        {"timeout", required_argument, nullptr, 't'},
+        {"seed", required_argument, nullptr, 'e'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'n': options.stations = std::max(1, atoi(optarg)); break;
+            case 'i': options.interval = std::max(1, atoi(optarg)); break;
+            case 'r': options.radioEvery = std::max(1, atoi(optarg)); break;
+            case 'x': options.speedup = std::max(1e-3, atof(optarg)); break;
+            case 'd': options.duration = atof(optarg); break;
+            case 'c': options.concurrency = std::max(1, atoi(optarg)); break;
+            case 'k': options.imageKb = std::max(0.01, atof(optarg)); break;
+            case 'g': options.images = atof(optarg); break;
+            case 'o': options.outage = atof(optarg); break;
+            case 'w': options.outageWakes = std::max(1, atoi(optarg)); break;
+            case 'a': options.outageAt = atof(optarg); break;
+            case 'f': options.outageFor = atof(optarg); break;
+            case 's': HOST_HAL.server = optarg; break;
+            case 't': HOST_HAL.httpTimeoutMs = std::max(1, atoi(optarg)); break;
+            case 'e': options.seed = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    rng.seed(options.seed);
+
+    // A socket per station in a wake, and then some.
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // Every station is on the network as far as the HTTP client goes; outages skip the upload.
+    HOST_HAL.epoch = 1782028800;    // 2026-06-21 08:00 UTC
+    HOST_HAL.associateMs = 0;
+    HOST_HAL.networks.push_back("fleet");
+    HOST_HAL.waitFd = parkOn;
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("fleet", "");
+
+    image.resize(std::max<size_t>(4, options.imageKb * 1024 * 8));
+    for (size_t i = 0; i < image.size(); i++) image[i] = (uint8_t)(i * 2654435761u >> 13);
+    image[0] = 0xFF;
+    image[1] = 0xD8;
+
+    // Wakes spread evenly over the interval, as stations switched on at random times would be.
+    std::vector<Station> fleet(options.stations);
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (uint32_t i = 0; i < options.stations; i++) {
+        char mac[18];
+        snprintf(mac, sizeof(mac), "24:0A:C4:%02X:%02X:%02X", (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+        fleet[i].id = i;
+        fleet[i].mac = mac;
+        fleet[i].wake = rng() % options.radioEvery;
+        due.push({realUs(unit(rng) * options.interval), &fleet[i]});
+    }
+
+    const uint64_t endUs = options.duration * 1e6;
+    const uint64_t outageStart = options.outageAt < 0 ? UINT64_MAX : options.outageAt * 1e6;
+    const uint64_t outageEnd = options.outageAt < 0 ? 0 : (options.outageAt + options.outageFor) * 1e6;
+    std::vector<Task*> tasks;
+    std::vector<uint32_t> lagUs;
+    uint32_t wakes = 0, radioWakes = 0, offlineWakes = 0, mostInWake = 0, largestBacklog = 0;
+
+    for (;;) {
+        uint64_t now = nowUs();
+        if (now >= endUs && tasks.empty()) break;
+
+        // Wakes which are due, as long as there is room to talk to the server.
+        while (!due.empty() && due.top().us <= now && now < endUs && tasks.size() < options.concurrency) {
+            const Due d = due.top();
+            due.pop();
+            Station& s = *d.station;
+            due.push({d.us + realUs(options.interval), &s});
+            wakes++;
+            s.wake++;
+            s.readings++;
+            if (unit(rng) < options.images) s.images = std::min(s.images + 1, options.maxImages);
+            if (s.wake % options.radioEvery) continue;
+
+            radioWakes++;
+            if (!s.offline && unit(rng) < options.outage) s.offline = 1 + rng() % options.outageWakes;
+            if (s.offline || (now >= outageStart && now < outageEnd)) {
+                if (s.offline) s.offline--;
+                offlineWakes++;
+                continue;
+            }
+            lagUs.push_back(now - d.us);
+            largestBacklog = std::max(largestBacklog, s.readings);
+            Task* t = start(&s);
+            if (t -> finished) {
+                stacks.push_back(t -> stack);
+                delete t;
+            } else {
+                tasks.push_back(t);
+            }
+            mostInWake = std::max<uint32_t>(mostInWake, tasks.size());
+        }
+
+        // Wait for a socket, a timeout, or the next wake.
+        uint64_t wakeAt = due.empty() || now >= endUs || tasks.size() >= options.concurrency ? UINT64_MAX : due.top().us;
+        std::vector<struct pollfd> fds;
+        fds.reserve(tasks.size());
+        for (Task* t : tasks) {
+            fds.push_back({t -> fd, t -> events, 0});
+            wakeAt = std::min(wakeAt, t -> deadlineUs);
+        }
+        const int timeoutMs = wakeAt == UINT64_MAX ? 100 : wakeAt > now ? std::min<uint64_t>(100, (wakeAt - now + 999) / 1000) : 0;
+        poll(fds.data(), fds.size(), timeoutMs);
+
+        now = nowUs();
+        std::vector<Task*> waiting;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            Task* t = tasks[i];
+            if (fds[i].revents || now >= t -> deadlineUs) {
+                t -> ready = fds[i].revents != 0;
+                resume(t);
+            }
+            if (t -> finished) {
+                stacks.push_back(t -> stack);
+                delete t;
+            } else {
+                waiting.push_back(t);
+            }
+        }
+        tasks.swap(waiting);
+    }
+    const double seconds = nowUs() / 1e6;
+
+    printf("%u stations for %.1f s at %gx: %u wakes, %u with the radio up, %u of them offline\n\n",
+           options.stations, seconds, options.speedup, wakes, radioWakes, offlineWakes);
+    printf("route          requests  failed    req/s    MiB up   p50 ms   p90 ms   p99 ms  p99.9 ms   max ms\n");
+    std::vector<uint32_t> all;
+    uint32_t failed = 0;
+    uint64_t bytes = 0;
+    for (uint8_t r = 0; r < ROUTES; r++) {
+        all.insert(all.end(), stats[r].us.begin(), stats[r].us.end());
+        failed += stats[r].failed;
+        bytes += stats[r].bytesUp;
+        printRoute(ROUTE_NAMES[r], stats[r].us, stats[r].failed, stats[r].bytesUp, seconds);
+    }
+    printRoute("all", all, failed, bytes, seconds);
+
+    std::sort(lagUs.begin(), lagUs.end());
+    printf("\nwake start lag p50 %.2f ms, p99 %.2f ms; at most %u stations talking at once, largest backlog %u readings\n",
+           percentile(lagUs, 0.5) / 1e3, percentile(lagUs, 0.99) / 1e3, mostInWake, largestBacklog);
+    return 0;
+}
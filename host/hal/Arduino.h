@@ -0,0 +1,209 @@
+#pragma once
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include "esp_err.h"
+#include "esp_sleep.h"
+#include "host_hal.h"
+
+using std::min;
+using std::max;
+
+/**
+ * RTC memory is a section of its own, which the wake runner carries from one wake to the next.
+ */
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define IRAM_ATTR
+
+class __FlashStringHelper;
+#define F(literal) (reinterpret_cast<const __FlashStringHelper*>(literal))
+
+#define DEC 10
+#define HEX 16
+
+/**
+ * Arduino String, over std::string.
+ */
+class String {
+public:
+    String() {}
+    String(const char* s) : s(s ? s : "") {}
+    String(const __FlashStringHelper* s) : String(reinterpret_cast<const char*>(s)) {}
+    String(const std::string& s) : s(s) {}
+    String(const char* s, size_t n) : s(s ? std::string(s, n) : "") {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v, unsigned char base = DEC) : s(format(base == HEX ? "%x" : "%d", v)) {}
+    explicit String(unsigned int v, unsigned char base = DEC) : s(format(base == HEX ? "%x" : "%u", v)) {}
+    explicit String(long v, unsigned char base = DEC) : s(format(base == HEX ? "%lx" : "%ld", v)) {}
+    explicit String(unsigned long v, unsigned char base = DEC) : s(format(base == HEX ? "%lx" : "%lu", v)) {}
+    explicit String(double v, unsigned int decimals = 2) : s(format("%.*f", decimals, v)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    size_t length() const { return s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(size_t n) { s.reserve(n); return true; }
+    char charAt(size_t i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](size_t i) const { return charAt(i); }
+
+    bool concat(const String& o) { s += o.s; return true; }
+    bool concat(const char* c) { if (c) s += c; return true; }
+    bool concat(const char* c, size_t n) { if (c) s.append(c, n); return true; }
+    bool concat(char c) { s += c; return true; }
+    bool concat(int v) { return concat(String(v)); }
+    bool concat(unsigned int v) { return concat(String(v)); }
+    bool concat(long v) { return concat(String(v)); }
+    bool concat(unsigned long v) { return concat(String(v)); }
+    bool concat(double v) { return concat(String(v)); }
+
+    template <typename T>
+    String& operator+=(const T& v) { concat(v); return *this; }
+
+    int indexOf(char c, size_t from = 0) const { size_t i = s.find(c, from); return i == std::string::npos ? -1 : (int)i; }
+    int indexOf(const String& o, size_t from = 0) const { size_t i = s.find(o.s, from); return i == std::string::npos ? -1 : (int)i; }
+    String substring(size_t from, size_t to = (size_t)-1) const { return from >= s.size() ? String() : String(s.substr(from, to - from)); }
+    bool startsWith(const String& o) const { return s.compare(0, o.s.size(), o.s) == 0; }
+    bool endsWith(const String& o) const { return s.size() >= o.s.size() && s.compare(s.size() - o.s.size(), o.s.size(), o.s) == 0; }
+    long toInt() const { return atol(s.c_str()); }
+    double toDouble() const { return atof(s.c_str()); }
+
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* c) const { return s == (c ? c : ""); }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator!=(const char* c) const { return !(*this == c); }
+    bool operator<(const String& o) const { return s < o.s; }
+
+private:
+    std::string s;
+
+    template <typename... Args>
+    static std::string format(const char* fmt, Args... args) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), fmt, args...);
+        return buf;
+    }
+};
+
+/**
+ * The type of a concatenation, as in the core.
+ */
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& s) : String(s) {}
+    StringSumHelper(const char* s) : String(s) {}
+};
+
+template <typename T>
+inline StringSumHelper operator+(const StringSumHelper& a, const T& b) {
+    StringSumHelper r(a);
+    r.concat(b);
+    return r;
+}
+
+inline StringSumHelper operator+(const String& a, const String& b) { StringSumHelper r(a); r.concat(b); return r; }
+inline StringSumHelper operator+(const String& a, const char* b) { StringSumHelper r(a); r.concat(b); return r; }
+inline StringSumHelper operator+(const char* a, const String& b) { StringSumHelper r(a); r.concat(b); return r; }
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+/**
+ * Text output on top of write(), as in the core.
+ */
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) {
+        size_t n = 0;
+        while (len-- && write(*data++)) n++;
+        return n;
+    }
+    size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+    virtual void flush() {}
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write(reinterpret_cast<const char*>(s)); }
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned int v, int base = DEC) { return print(String(v, base)); }
+    size_t print(long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(long long v) { return print(String((long)v)); }
+    size_t print(unsigned long long v) { return print(String((unsigned long)v)); }
+    size_t print(double v, int decimals = 2) { return print(String(v, decimals)); }
+    size_t print(const Printable& p) { return p.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& v) { return print(v) + println(); }
+
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/**
+ * Byte input on top of available() / read(), without the core's timeouts.
+ */
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char* buf, size_t len) {
+        size_t n = 0;
+        int c;
+        while (n < len && (c = read()) >= 0) buf[n++] = (char)c;
+        return n;
+    }
+
+    size_t readBytes(uint8_t* buf, size_t len) {
+        return readBytes((char*)buf, len);
+    }
+
+    void setTimeout(unsigned long) {}
+};
+
+/**
+ * Serial goes to stderr when HOST_HAL.serial is set, and nowhere otherwise.
+ */
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+bool psramFound();
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+
+#endif
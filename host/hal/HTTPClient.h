@@ -0,0 +1,56 @@
+#pragma once
+#ifndef HOST_HTTP_CLIENT_H
+#define HOST_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <vector>
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+/**
+ * HTTP/1.1 client over POSIX sockets. Whatever the URL says, requests go to HOST_HAL.server
+ * with the URL's path and query, so the station talks to a local test server. One request per
+ * connection, and only while WiFi is connected.
+ */
+class HTTPClient {
+public:
+    bool begin(const String& url);
+    bool begin(const String& url, const char* caCert) { return begin(url); }
+    void end();
+
+    void setConnectTimeout(int32_t ms) { connectTimeout = ms; }
+    void setTimeout(uint16_t ms) { readTimeout = ms; }
+    void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+
+    int GET();
+    int POST(uint8_t* payload, size_t size);
+    int POST(const String& payload) { return POST((uint8_t*)payload.c_str(), payload.length()); }
+    int sendRequest(const char* method, const uint8_t* payload, size_t size);
+    int sendRequest(const char* method, Stream* stream, size_t size);
+
+    String getString() { return body; }
+    int getSize() { return body.length(); }
+    static String errorToString(int error);
+
+private:
+    int exchange(const char* method, const uint8_t* payload, Stream* stream, size_t size);
+
+    String target;
+    std::vector<std::pair<String, String>> headers;
+    int32_t connectTimeout = -1;
+    int32_t readTimeout = -1;
+    String body;
+};
+
+#endif
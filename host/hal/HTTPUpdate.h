@@ -0,0 +1,23 @@
+#pragma once
+#ifndef HOST_HTTP_UPDATE_H
+#define HOST_HTTP_UPDATE_H
+
+#include "WiFi.h"
+
+typedef enum { HTTP_UPDATE_FAILED, HTTP_UPDATE_NO_UPDATES, HTTP_UPDATE_OK } t_httpUpdate_return;
+
+/**
+ * Firmware updates. There is nothing to flash on the host, so there is never an update.
+ */
+class HTTPUpdate {
+public:
+    t_httpUpdate_return update(WiFiClient& client, const String& url, const String& currentVersion = "") {
+        return HTTP_UPDATE_NO_UPDATES;
+    }
+    int getLastError() { return 0; }
+    String getLastErrorString() { return String(); }
+};
+
+extern HTTPUpdate httpUpdate;
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+/**
+ * The flash file system, on HOST_HAL.root, for when there is no SD card.
+ */
+class LittleFSFS : public fs::FS {
+public:
+    LittleFSFS() : FS("LittleFS") {}
+
+    bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char* partitionLabel = "spiffs") {
+        return mount(formatOnFail);
+    }
+    void end() { mounted = false; }
+    size_t totalBytes() { return 1536 * 1024; }
+    size_t usedBytes() { return used(); }
+};
+
+extern LittleFSFS LittleFS;
+
+#endif
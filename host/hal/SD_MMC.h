@@ -0,0 +1,31 @@
+#pragma once
+#ifndef HOST_SD_MMC_H
+#define HOST_SD_MMC_H
+
+#include "FS.h"
+
+#define SDMMC_FREQ_DEFAULT 20000
+#define SDMMC_FREQ_HIGHSPEED 40000
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+/**
+ * The SD card, on HOST_HAL.root. Mounts only if HOST_HAL.sdCard is set.
+ */
+class SDMMCFS : public fs::FS {
+public:
+    SDMMCFS() : FS("SD_MMC") {}
+
+    bool setPins(int clk, int cmd, int d0) { return true; }
+    bool begin(const char* mountpoint = "/sdcard", bool mode1bit = false, bool formatOnFail = false,
+               int sdmmcFrequency = SDMMC_FREQ_DEFAULT, uint8_t maxOpenFiles = 5);
+    void end() { mounted = false; }
+    sdcard_type_t cardType() { return mounted ? CARD_SDHC : CARD_NONE; }
+    uint64_t cardSize() { return 32ull << 30; }
+    uint64_t totalBytes() { return cardSize(); }
+    uint64_t usedBytes() { return used(); }
+};
+
+extern SDMMCFS SD_MMC;
+
+#endif
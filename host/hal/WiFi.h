@@ -0,0 +1,67 @@
+#pragma once
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+    WL_NO_SHIELD = 255
+} wl_status_t;
+
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    uint8_t operator[](int i) const { return bytes[i]; }
+    String toString() const;
+
+private:
+    uint8_t bytes[4] = {};
+};
+
+/**
+ * The radio. Networks in HOST_HAL.networks are in range, and joining one of them connects
+ * HOST_HAL.associateMs later, unless HOST_HAL.wifi is cleared.
+ */
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t m);
+    wifi_mode_t getMode() const { return current; }
+    bool setSleep(bool enabled) { return true; }
+    bool disconnect(bool wifioff = false, bool eraseap = false);
+    int16_t scanNetworks();
+    String SSID(uint8_t i) const;
+    String SSID() const { return joined; }
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr);
+    wl_status_t status();
+    String macAddress() const { return HOST_HAL.mac.c_str(); }
+    IPAddress localIP() const { return IPAddress(127, 0, 0, 1); }
+
+private:
+    wifi_mode_t current = WIFI_OFF;
+    String joined;
+    bool joining = false;
+    uint64_t joinedUs = 0;
+};
+
+extern WiFiClass WiFi;
+
+/**
+ * Plain client. Only a handle here: HTTPClient opens its own sockets.
+ */
+class WiFiClient {
+public:
+    virtual ~WiFiClient() {}
+    void setTimeout(uint32_t seconds) {}
+};
+
+#endif
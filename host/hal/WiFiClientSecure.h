@@ -0,0 +1,16 @@
+#pragma once
+#ifndef HOST_WIFI_CLIENT_SECURE_H
+#define HOST_WIFI_CLIENT_SECURE_H
+
+#include "WiFi.h"
+
+/**
+ * TLS client. The local test server speaks plain HTTP, so certificates are only taken.
+ */
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char* cert) {}
+    void setInsecure() {}
+};
+
+#endif
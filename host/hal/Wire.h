@@ -0,0 +1,49 @@
+#pragma once
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <Arduino.h>
+
+#define I2C_BUFFER_LENGTH 128
+
+/**
+ * TwoWire over the devices in HOST_HAL.i2c. Each transaction first lets the devices catch up
+ * with the time passed since the last one, so the fakes fill their FIFOs as the real parts would.
+ */
+class TwoWire : public Stream {
+public:
+    TwoWire(uint8_t bus) : bus(bus) {}
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool end();
+    bool setClock(uint32_t frequency) { return true; }
+
+    void beginTransmission(uint16_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    size_t requestFrom(uint16_t address, size_t size, bool sendStop = true);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+
+private:
+    uint8_t bus;
+    bool started = false;
+    uint16_t target = 0;
+    uint8_t tx[I2C_BUFFER_LENGTH];
+    size_t txLen = 0;
+    bool txOverflow = false;
+    uint8_t rx[I2C_BUFFER_LENGTH];
+    size_t rxLen = 0;
+    size_t rxPos = 0;
+    uint64_t lastUs = 0;
+
+    HostI2CDevice* device(uint16_t address);
+};
+
+extern TwoWire Wire;
+
+#endif
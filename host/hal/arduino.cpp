@@ -0,0 +1,119 @@
+#include <Arduino.h>
+#include <stdarg.h>
+#include "esp_timer.h"
+#include "../../power.h"
+
+HostHal HOST_HAL;
+HardwareSerial Serial;
+
+/**
+ * The station clock is the power meter's, so simulated waits move it on like real ones.
+ */
+uint64_t hostMicros() {
+    return POWER.now();
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)hostMicros();
+}
+
+unsigned long millis() {
+    return hostMicros() / 1000;
+}
+
+unsigned long micros() {
+    return hostMicros();
+}
+
+/**
+ * The core's delay() is a task delay, which light sleeps like a metered wait.
+ */
+void delay(uint32_t ms) {
+    POWER.wait(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+    POWER.wait(us / 1000);
+}
+
+void yield() {}
+
+/**
+ * Deterministic for a given boot time, so a run can be repeated.
+ */
+static uint64_t randomState = 0;
+
+void randomSeed(unsigned long seed) {
+    randomState = seed ? seed : 1;
+}
+
+long random(long max) {
+    if (!randomState) randomSeed(HOST_HAL.epoch);
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return max > 0 ? (long)((randomState * 0x2545F4914F6CDD1Dull) >> 33) % max : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+/**
+ * The wall clock is simulated and always set, so there is nothing to sync.
+ */
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2, const char* server3) {}
+
+/**
+ * time() for the whole program, through -Wl,--wrap=time: the boot time HOST_HAL.epoch, plus time since boot.
+ */
+extern "C" time_t __wrap_time(time_t* out) {
+    const time_t now = HOST_HAL.epoch + (time_t)(hostMicros() / 1000000);
+    if (out) *out = now;
+    return now;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t len) {
+    if (HOST_HAL.serial) fwrite(data, 1, len, stderr);
+    return len;
+}
+
+size_t Print::printf(const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return 0;
+    return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+const char* esp_err_to_name(esp_err_t err) {
+    switch (err) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+    HOST_HAL.sleepUs = us;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+    if (HOST_HAL.deepSleep) HOST_HAL.deepSleep(HOST_HAL.sleepUs);
+    fflush(stdout);
+    fflush(stderr);
+    exit(0);
+}
@@ -0,0 +1,274 @@
+#include "esp_camera.h"
+#include <Arduino.h>
+#include <dirent.h>
+#include <vector>
+#include "../../power.h"
+
+/**
+ * Where auto exposure settles, in lines, and the average luminance there.
+ */
+#define FAKE_AEC_TARGET 400
+#define FAKE_LUMA_TARGET 118
+#define FAKE_FB_MAX 2
+
+struct FakeFrame {
+    camera_fb_t fb;
+    bool lent;
+};
+
+static bool initialised = false;
+static sensor_t sensor;
+static std::vector<uint8_t> jpeg;
+static FakeFrame frames[FAKE_FB_MAX];
+static size_t frameCount = 0;
+static uint32_t exposure = 0;       // Lines, in 1/16ths
+static uint16_t gain = 16;          // In 1/16ths
+static uint8_t luma = 0;
+
+/**
+ * Width and height from the first start of frame marker.
+ */
+static bool jpegSize(const std::vector<uint8_t>& j, size_t* width, size_t* height) {
+    size_t i = 2;
+    while (i + 9 < j.size()) {
+        if (j[i] != 0xFF) return false;
+        const uint8_t marker = j[i + 1];
+        const size_t len = (j[i + 2] << 8) | j[i + 3];
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            *height = (j[i + 5] << 8) | j[i + 6];
+            *width = (j[i + 7] << 8) | j[i + 8];
+            return true;
+        }
+        i += 2 + len;
+    }
+    return false;
+}
+
+/**
+ * The JPEG fixtures, in name order.
+ */
+static std::vector<std::string> fixtures() {
+    std::vector<std::string> names;
+    DIR* dir = opendir(HOST_HAL.fixtures.c_str());
+    if (!dir) return names;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        const size_t n = strlen(entry -> d_name);
+        if (n > 4 && strcasecmp(entry -> d_name + n - 4, ".jpg") == 0) names.push_back(entry -> d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+static bool loadFixture() {
+    const std::vector<std::string> names = fixtures();
+    if (names.empty()) return false;
+    const std::string path = HOST_HAL.fixtures + "/" + names[HOST_HAL.fixture % names.size()];
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    jpeg.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    const bool ok = fread(jpeg.data(), 1, jpeg.size(), f) == jpeg.size();
+    fclose(f);
+    return ok;
+}
+
+/**
+ * One frame of auto exposure: halve the distance to the target, with gain taking what exposure can't.
+ * Hunting, as under flickering light, it lands a quarter over or under the target in turn.
+ */
+static void exposeFrame() {
+    const uint32_t target = FAKE_AEC_TARGET * 16;
+    if (sensor.status.aec && HOST_HAL.aeHunts) exposure = HOST_HAL.counters.frames % 2 ? target * 5 / 4 : target * 3 / 4;
+    else if (sensor.status.aec) exposure += ((int32_t)target - (int32_t)exposure) / 2;
+    if (sensor.status.agc) gain = 16;
+    const uint32_t level = (exposure / 16) * gain / 16;
+    const uint32_t l = (uint32_t)FAKE_LUMA_TARGET * level / FAKE_AEC_TARGET;
+    luma = l > 255 ? 255 : l;
+}
+
+#define FAKE_SETTER(setter, field) \
+    static int setter(sensor_t* s, int value) { s -> status.field = value; return 0; }
+
+FAKE_SETTER(fakeBrightness, brightness)
+FAKE_SETTER(fakeContrast, contrast)
+FAKE_SETTER(fakeSaturation, saturation)
+FAKE_SETTER(fakeSharpness, sharpness)
+FAKE_SETTER(fakeDenoise, denoise)
+FAKE_SETTER(fakeQuality, quality)
+FAKE_SETTER(fakeSpecialEffect, special_effect)
+FAKE_SETTER(fakeWhitebal, awb)
+FAKE_SETTER(fakeAwbGain, awb_gain)
+FAKE_SETTER(fakeWbMode, wb_mode)
+FAKE_SETTER(fakeExposureCtrl, aec)
+FAKE_SETTER(fakeAec2, aec2)
+FAKE_SETTER(fakeAeLevel, ae_level)
+FAKE_SETTER(fakeGainCtrl, agc)
+FAKE_SETTER(fakeBpc, bpc)
+FAKE_SETTER(fakeWpc, wpc)
+FAKE_SETTER(fakeRawGma, raw_gma)
+FAKE_SETTER(fakeLenc, lenc)
+FAKE_SETTER(fakeHmirror, hmirror)
+FAKE_SETTER(fakeVflip, vflip)
+FAKE_SETTER(fakeDcw, dcw)
+FAKE_SETTER(fakeColorbar, colorbar)
+
+static int fakeFramesize(sensor_t* s, framesize_t size) {
+    s -> status.framesize = size;
+    return 0;
+}
+
+static int fakeGainceiling(sensor_t* s, gainceiling_t ceiling) {
+    s -> status.gainceiling = ceiling;
+    return 0;
+}
+
+static int fakeAecValue(sensor_t* s, int value) {
+    s -> status.aec_value = value;
+    if (!s -> status.aec) exposure = value * 16;
+    return 0;
+}
+
+static int fakeAgcGain(sensor_t* s, int value) {
+    s -> status.agc_gain = value;
+    if (!s -> status.agc) gain = 16 + value * 16;
+    return 0;
+}
+
+/**
+ * The OV5640 registers camera.cpp follows auto exposure with.
+ */
+static int fakeGetReg(sensor_t* s, int reg, int mask) {
+    int v = 0;
+    switch (reg) {
+        case 0x3500: v = exposure >> 16; break;
+        case 0x3501: v = exposure >> 8; break;
+        case 0x3502: v = exposure; break;
+        case 0x350A: v = gain >> 8; break;
+        case 0x350B: v = gain; break;
+        case 0x56A1: v = luma; break;
+    }
+    return v & mask;
+}
+
+static int fakeSetReg(sensor_t* s, int reg, int mask, int value) {
+    return 0;
+}
+
+/**
+ * Load this wake's fixture and reset the sensor to its defaults. With no fixtures, there is no camera.
+ */
+esp_err_t esp_camera_init(const camera_config_t* config) {
+    if (initialised) return ESP_ERR_INVALID_STATE;
+    if (!loadFixture()) return ESP_ERR_NOT_FOUND;
+
+    size_t width = 0, height = 0;
+    jpegSize(jpeg, &width, &height);
+    frameCount = config -> fb_count < 1 ? 1 : config -> fb_count > FAKE_FB_MAX ? FAKE_FB_MAX : config -> fb_count;
+    for (size_t i = 0; i < frameCount; i++) {
+        camera_fb_t& fb = frames[i].fb;
+        fb.buf = (uint8_t*)malloc(jpeg.size());
+        if (!fb.buf) return ESP_ERR_NO_MEM;
+        fb.len = jpeg.size();
+        fb.width = width;
+        fb.height = height;
+        fb.format = PIXFORMAT_JPEG;
+        frames[i].lent = false;
+    }
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.pixformat = config -> pixel_format;
+    sensor.status.framesize = config -> frame_size;
+    sensor.status.quality = config -> jpeg_quality;
+    sensor.status.awb = 1;
+    sensor.status.awb_gain = 1;
+    sensor.status.aec = 1;
+    sensor.status.agc = 1;
+    sensor.status.bpc = 1;
+    sensor.status.wpc = 1;
+    sensor.status.raw_gma = 1;
+    sensor.status.lenc = 1;
+    sensor.status.dcw = 1;
+    sensor.set_framesize = fakeFramesize;
+    sensor.set_quality = fakeQuality;
+    sensor.set_brightness = fakeBrightness;
+    sensor.set_contrast = fakeContrast;
+    sensor.set_saturation = fakeSaturation;
+    sensor.set_sharpness = fakeSharpness;
+    sensor.set_denoise = fakeDenoise;
+    sensor.set_special_effect = fakeSpecialEffect;
+    sensor.set_whitebal = fakeWhitebal;
+    sensor.set_awb_gain = fakeAwbGain;
+    sensor.set_wb_mode = fakeWbMode;
+    sensor.set_exposure_ctrl = fakeExposureCtrl;
+    sensor.set_aec2 = fakeAec2;
+    sensor.set_ae_level = fakeAeLevel;
+    sensor.set_aec_value = fakeAecValue;
+    sensor.set_gain_ctrl = fakeGainCtrl;
+    sensor.set_agc_gain = fakeAgcGain;
+    sensor.set_gainceiling = fakeGainceiling;
+    sensor.set_bpc = fakeBpc;
+    sensor.set_wpc = fakeWpc;
+    sensor.set_raw_gma = fakeRawGma;
+    sensor.set_lenc = fakeLenc;
+    sensor.set_hmirror = fakeHmirror;
+    sensor.set_vflip = fakeVflip;
+    sensor.set_dcw = fakeDcw;
+    sensor.set_colorbar = fakeColorbar;
+    sensor.get_reg = fakeGetReg;
+    sensor.set_reg = fakeSetReg;
+
+    // Waking up, the sensor starts far from the right exposure.
+    exposure = FAKE_AEC_TARGET * 16 / 8;
+    gain = 16;
+    luma = 0;
+    initialised = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit() {
+    if (!initialised) return ESP_ERR_INVALID_STATE;
+    for (size_t i = 0; i < frameCount; i++) {
+        free(frames[i].fb.buf);
+        frames[i].fb.buf = nullptr;
+        frames[i].lent = false;
+    }
+    frameCount = 0;
+    jpeg.clear();
+    initialised = false;
+    return ESP_OK;
+}
+
+/**
+ * The next frame, one frame time later. Fails, as the driver times out, when every buffer is lent.
+ */
+camera_fb_t* esp_camera_fb_get() {
+    if (!initialised) return nullptr;
+    FakeFrame* frame = nullptr;
+    for (size_t i = 0; i < frameCount && !frame; i++) {
+        if (!frames[i].lent) frame = &frames[i];
+    }
+    if (!frame) return nullptr;
+
+    POWER.wait(HOST_HAL.frameMs);
+    exposeFrame();
+    memcpy(frame -> fb.buf, jpeg.data(), jpeg.size());
+    const uint64_t now = hostMicros();
+    frame -> fb.timestamp.tv_sec = now / 1000000;
+    frame -> fb.timestamp.tv_usec = now % 1000000;
+    frame -> lent = true;
+    HOST_HAL.counters.frames++;
+    return &frame -> fb;
+}
+
+void esp_camera_fb_return(camera_fb_t* fb) {
+    for (size_t i = 0; i < frameCount; i++) {
+        if (&frames[i].fb == fb) frames[i].lent = false;
+    }
+}
+
+sensor_t* esp_camera_sensor_get() {
+    return initialised ? &sensor : nullptr;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+/**
+ * Two simulated heaps, internal RAM and PSRAM, of HOST_HAL.internalHeap and HOST_HAL.psram bytes.
+ * They are first fit with block headers, so free sizes, largest free blocks and low water marks
+ * move like the station's. Only heap_caps allocations use them: malloc and new stay on the host heap.
+ * MALLOC_CAP_SPIRAM takes PSRAM, anything else internal RAM, with MALLOC_CAP_DEFAULT and 8BIT
+ * falling back to PSRAM when internal RAM has no room.
+ */
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+
+size_t heap_caps_get_allocated_size(void* ptr);
+size_t heap_caps_get_total_size(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+/**
+ * Whether a pointer is in the simulated PSRAM.
+ */
+bool esp_ptr_external_ram(const void* ptr);
+
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+#ifndef HOST_ESP_MEMORY_UTILS_H
+#define HOST_ESP_MEMORY_UTILS_H
+
+#include "esp_heap_caps.h"
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef HOST_ESP_SLEEP_H
+#define HOST_ESP_SLEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Remember the wake up timer, for HOST_HAL.deepSleep.
+ */
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us);
+
+/**
+ * Hand the wake up timer to HOST_HAL.deepSleep and end the process, as the station would reset.
+ */
+[[noreturn]] void esp_deep_sleep_start();
+
+#endif
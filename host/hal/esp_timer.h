@@ -0,0 +1,12 @@
+#pragma once
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * Microseconds since boot, including simulated waits.
+ */
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,292 @@
+#include "FS.h"
+#include "SD_MMC.h"
+#include "LittleFS.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SDMMCFS SD_MMC;
+LittleFSFS LittleFS;
+
+/**
+ * Station paths are absolute and never climb out of the root. Anything else the station's VFS refuses.
+ */
+std::string hostPath(const char* path) {
+    if (!path || path[0] != '/' || strstr(path, "/..")) return std::string();
+    return HOST_HAL.root + path;
+}
+
+/**
+ * Make every missing directory above a host path.
+ */
+static bool makeParents(const std::string& host) {
+    for (size_t i = HOST_HAL.root.size() + 1; (i = host.find('/', i)) != std::string::npos; i++) {
+        if (::mkdir(host.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+static bool isDir(const std::string& host) {
+    struct stat st;
+    return stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * How many of the next units of storage work may happen before the power goes: bytes written
+ * count one each, as do opens for writing, removes and renames. See HostHal::cutAt.
+ */
+static size_t beforeCut(size_t units) {
+    uint64_t& done = HOST_HAL.counters.storageOps;
+    if (HOST_HAL.cutAt >= 0 && done + units > (uint64_t)HOST_HAL.cutAt) {
+        units = (uint64_t)HOST_HAL.cutAt > done ? HOST_HAL.cutAt - done : 0;
+    }
+    done += units;
+    return units;
+}
+
+/**
+ * Lose power: everything written so far is on the disk, nothing after it.
+ */
+[[noreturn]] static void cutPower() {
+    fflush(nullptr);
+    if (HOST_HAL.powerCut) HOST_HAL.powerCut();
+    _exit(HOST_POWER_CUT_EXIT);
+}
+
+/**
+ * One unit of storage work other than a byte, or the power going before it.
+ */
+static void operation() {
+    if (!beforeCut(1)) cutPower();
+}
+
+namespace fs {
+
+struct FileImpl {
+    std::string path;
+    std::string host;
+    FILE* file = nullptr;
+    DIR* dir = nullptr;
+    long length = -1;               // Size of a file opened for reading, which can't change under it
+    long offset = 0;                // Position in a file opened for reading, saving an lseek per byte
+
+    ~FileImpl() {
+        close();
+    }
+
+    void close() {
+        if (file) fclose(file);
+        if (dir) closedir(dir);
+        file = nullptr;
+        dir = nullptr;
+    }
+};
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* data, size_t len) {
+    if (!impl || !impl -> file) return 0;
+    const size_t allowed = beforeCut(len);
+    const size_t n = fwrite(data, 1, allowed, impl -> file);
+    HOST_HAL.counters.bytesWritten += n;
+    if (allowed < len) cutPower();
+    return n;
+}
+
+int File::available() {
+    if (!impl || !impl -> file) return 0;
+    return size() - position();
+}
+
+int File::read() {
+    if (!impl || !impl -> file) return -1;
+    const int c = fgetc(impl -> file);
+    if (c == EOF) return -1;
+    HOST_HAL.counters.bytesRead++;
+    impl -> offset++;
+    return c;
+}
+
+int File::peek() {
+    if (!impl || !impl -> file) return -1;
+    const int c = fgetc(impl -> file);
+    if (c == EOF) return -1;
+    ungetc(c, impl -> file);
+    return c;
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+    if (!impl || !impl -> file) return 0;
+    const size_t n = fread(buf, 1, len, impl -> file);
+    HOST_HAL.counters.bytesRead += n;
+    impl -> offset += n;
+    return n;
+}
+
+void File::flush() {
+    if (impl && impl -> file) fflush(impl -> file);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    if (!impl || !impl -> file) return false;
+    if (fseek(impl -> file, pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) != 0) return false;
+    impl -> offset = ftell(impl -> file);
+    return true;
+}
+
+size_t File::position() const {
+    if (!impl || !impl -> file) return 0;
+    if (impl -> length >= 0) return impl -> offset;
+    const long p = ftell(impl -> file);
+    return p < 0 ? 0 : p;
+}
+
+size_t File::size() const {
+    if (!impl || !impl -> file) return 0;
+    if (impl -> length >= 0) return impl -> length;
+    fflush(impl -> file);
+    struct stat st;
+    return fstat(fileno(impl -> file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() {
+    if (impl) impl -> close();
+    impl.reset();
+}
+
+File::operator bool() const {
+    return impl && (impl -> file || impl -> dir);
+}
+
+const char* File::path() const {
+    return impl ? impl -> path.c_str() : nullptr;
+}
+
+const char* File::name() const {
+    if (!impl) return nullptr;
+    const size_t slash = impl -> path.rfind('/');
+    return impl -> path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+bool File::isDirectory() const {
+    return impl && impl -> dir;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!impl || !impl -> dir) return File();
+    struct dirent* entry;
+    while ((entry = readdir(impl -> dir))) {
+        if (strcmp(entry -> d_name, ".") == 0 || strcmp(entry -> d_name, "..") == 0) continue;
+        std::shared_ptr<FileImpl> next = std::make_shared<FileImpl>();
+        next -> path = (impl -> path == "/" ? "" : impl -> path) + "/" + entry -> d_name;
+        next -> host = impl -> host + "/" + entry -> d_name;
+        if (isDir(next -> host)) next -> dir = opendir(next -> host.c_str());
+        else next -> file = fopen(next -> host.c_str(), mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb");
+        if (!next -> file && !next -> dir) continue;
+        HOST_HAL.counters.filesOpened++;
+        return File(next);
+    }
+    return File();
+}
+
+void File::rewindDirectory() {
+    if (impl && impl -> dir) rewinddir(impl -> dir);
+}
+
+File FS::open(const char* path, const char* mode, const bool create) {
+    const std::string host = hostPath(path);
+    if (!mounted || host.empty()) return File();
+
+    std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+    impl -> path = path;
+    impl -> host = host;
+    if (isDir(host)) {
+        impl -> dir = opendir(host.c_str());
+    } else {
+        if (create && mode[0] != 'r' && !makeParents(host)) return File();
+        if (mode[0] != 'r') operation();
+        impl -> file = fopen(host.c_str(), mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb");
+    }
+    if (!impl -> file && !impl -> dir) return File();
+    if (impl -> file && mode[0] == 'r') {
+        struct stat st;
+        if (fstat(fileno(impl -> file), &st) == 0) impl -> length = st.st_size;
+    }
+    HOST_HAL.counters.filesOpened++;
+    return File(impl);
+}
+
+bool FS::exists(const char* path) {
+    const std::string host = hostPath(path);
+    struct stat st;
+    return mounted && !host.empty() && stat(host.c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    const std::string host = hostPath(path);
+    if (!mounted || host.empty()) return false;
+    operation();
+    return ::unlink(host.c_str()) == 0;
+}
+
+/**
+ * FAT, which the card is, won't rename onto an existing file, so neither does the host.
+ */
+bool FS::rename(const char* from, const char* to) {
+    const std::string a = hostPath(from);
+    const std::string b = hostPath(to);
+    if (!mounted || a.empty() || b.empty()) return false;
+    struct stat st;
+    if (stat(b.c_str(), &st) == 0) return false;
+    operation();
+    return ::rename(a.c_str(), b.c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    const std::string host = hostPath(path);
+    return mounted && !host.empty() && (::mkdir(host.c_str(), 0755) == 0 || isDir(host));
+}
+
+bool FS::rmdir(const char* path) {
+    const std::string host = hostPath(path);
+    return mounted && !host.empty() && ::rmdir(host.c_str()) == 0;
+}
+
+/**
+ * A missing root is an unformatted card: formatting makes it.
+ */
+bool FS::mount(bool format) {
+    if (!isDir(HOST_HAL.root) && !(format && ::mkdir(HOST_HAL.root.c_str(), 0755) == 0)) return false;
+    mounted = true;
+    return true;
+}
+
+static uint64_t usedBelow(const std::string& host) {
+    DIR* dir = opendir(host.c_str());
+    if (!dir) return 0;
+    uint64_t total = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry -> d_name, ".") == 0 || strcmp(entry -> d_name, "..") == 0) continue;
+        const std::string child = host + "/" + entry -> d_name;
+        struct stat st;
+        if (stat(child.c_str(), &st) != 0) continue;
+        total += S_ISDIR(st.st_mode) ? usedBelow(child) : st.st_size;
+    }
+    closedir(dir);
+    return total;
+}
+
+uint64_t FS::used() {
+    return mounted ? usedBelow(HOST_HAL.root) : 0;
+}
+
+}
+
+bool SDMMCFS::begin(const char* mountpoint, bool mode1bit, bool formatOnFail, int sdmmcFrequency, uint8_t maxOpenFiles) {
+    if (!HOST_HAL.sdCard) return false;
+    return mount(true);
+}
@@ -0,0 +1,186 @@
+#include "esp_heap_caps.h"
+#include <Arduino.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Blocks are aligned, and preceded by a header, to this many bytes.
+ */
+#define SIM_ALIGN 16
+
+/**
+ * One simulated heap: a region of host memory carved into blocks, each headed by its size and
+ * whether it is taken. Allocation is first fit, splitting the block it takes; freeing merges the
+ * block with free neighbours, so fragmentation shows in the largest free block as on the station.
+ */
+struct SimHeap {
+    struct Block {
+        size_t size;        // Bytes after the header
+        size_t taken;       // Bytes asked for, 0 if free
+    };
+
+    size_t HostHal::*capacity;
+    uint8_t* region = nullptr;
+    size_t total = 0;
+    size_t free = 0;
+    size_t least = 0;
+
+    /**
+     * Map the region, on first use, at the size HOST_HAL asks for.
+     */
+    bool begin() {
+        if (region) return true;
+        total = HOST_HAL.*capacity & ~(size_t)(SIM_ALIGN - 1);
+        if (total <= sizeof(Block) + SIM_ALIGN) return false;
+        region = (uint8_t*)aligned_alloc(SIM_ALIGN, total);
+        if (!region) return false;
+        Block* first = (Block*)region;
+        first -> size = total - SIM_ALIGN;
+        first -> taken = 0;
+        free = least = first -> size;
+        return true;
+    }
+
+    Block* next(Block* b) const {
+        Block* n = (Block*)((uint8_t*)b + SIM_ALIGN + b -> size);
+        return (uint8_t*)n < region + total ? n : nullptr;
+    }
+
+    bool owns(const void* p) const {
+        return region && (const uint8_t*)p >= region + SIM_ALIGN && (const uint8_t*)p < region + total;
+    }
+
+    static Block* header(void* p) {
+        return (Block*)((uint8_t*)p - SIM_ALIGN);
+    }
+
+    void* malloc(size_t size) {
+        if (!begin()) return nullptr;
+        const size_t need = (size + SIM_ALIGN - 1) & ~(size_t)(SIM_ALIGN - 1);
+        for (Block* b = (Block*)region; b; b = next(b)) {
+            if (b -> taken || b -> size < need) continue;
+            if (b -> size >= need + 2 * SIM_ALIGN) {
+                Block* rest = (Block*)((uint8_t*)b + SIM_ALIGN + need);
+                rest -> size = b -> size - need - SIM_ALIGN;
+                rest -> taken = 0;
+                b -> size = need;
+                free -= SIM_ALIGN;
+            }
+            b -> taken = size ? size : 1;
+            free -= b -> size;
+            if (free < least) least = free;
+            return (uint8_t*)b + SIM_ALIGN;
+        }
+        return nullptr;
+    }
+
+    void release(void* p) {
+        Block* b = header(p);
+        if (!b -> taken) return;
+        b -> taken = 0;
+        free += b -> size;
+        // Merge every run of free blocks; the walk is short for the few blocks a wake keeps.
+        for (Block* a = (Block*)region; a; a = next(a)) {
+            if (a -> taken) continue;
+            for (Block* n = next(a); n && !n -> taken; n = next(a)) {
+                a -> size += SIM_ALIGN + n -> size;
+                free += SIM_ALIGN;
+            }
+        }
+    }
+
+    size_t largest() {
+        if (!begin()) return 0;
+        size_t best = 0;
+        for (Block* b = (Block*)region; b; b = next(b)) {
+            if (!b -> taken && b -> size > best) best = b -> size;
+        }
+        return best;
+    }
+};
+
+static SimHeap internal = {&HostHal::internalHeap};
+static SimHeap psram = {&HostHal::psram};
+
+static SimHeap* heapOf(const void* p) {
+    if (internal.owns(p)) return &internal;
+    if (psram.owns(p)) return &psram;
+    return nullptr;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    if (caps & MALLOC_CAP_SPIRAM) return psram.malloc(size);
+    void* p = internal.malloc(size);
+    // As with the core's malloc, the default heap spills into PSRAM once internal RAM is short.
+    if (!p && !(caps & (MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA))) p = psram.malloc(size);
+    return p;
+}
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    if (size && n > SIZE_MAX / size) return nullptr;
+    void* p = heap_caps_malloc(n * size, caps);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+    if (!ptr) return heap_caps_malloc(size, caps);
+    if (!heapOf(ptr)) return realloc(ptr, size);
+    const size_t old = SimHeap::header(ptr) -> taken;
+    if (size <= SimHeap::header(ptr) -> size) {
+        SimHeap::header(ptr) -> taken = size ? size : 1;
+        return ptr;
+    }
+    void* moved = heap_caps_malloc(size, caps);
+    if (!moved) return nullptr;
+    memcpy(moved, ptr, old);
+    heap_caps_free(ptr);
+    return moved;
+}
+
+/**
+ * Pointers from neither heap came from the host's malloc.
+ */
+void heap_caps_free(void* ptr) {
+    if (!ptr) return;
+    SimHeap* heap = heapOf(ptr);
+    if (heap) heap -> release(ptr);
+    else free(ptr);
+}
+
+size_t heap_caps_get_allocated_size(void* ptr) {
+    if (!ptr) return 0;
+    return heapOf(ptr) ? SimHeap::header(ptr) -> size : malloc_usable_size(ptr);
+}
+
+static SimHeap& heapFor(uint32_t caps) {
+    return caps & MALLOC_CAP_SPIRAM ? psram : internal;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    SimHeap& heap = heapFor(caps);
+    return heap.begin() ? heap.total : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    SimHeap& heap = heapFor(caps);
+    return heap.begin() ? heap.free : 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    SimHeap& heap = heapFor(caps);
+    return heap.begin() ? heap.least : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heapFor(caps).largest();
+}
+
+bool esp_ptr_external_ram(const void* ptr) {
+    return psram.owns(ptr);
+}
+
+bool psramFound() {
+    return HOST_HAL.psram > 0;
+}
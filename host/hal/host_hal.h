@@ -0,0 +1,87 @@
+#pragma once
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+/**
+ * Stand-ins for the ESP32 Arduino core, so the station firmware builds and runs on Linux.
+ * Every stand-in takes its setup from HOST_HAL, and counts what it did there so a wake
+ * can be measured. The clock is the power meter's: real time plus simulated waits.
+ */
+
+/**
+ * A device on the stand-in I2C bus. Same shape as the register level fakes' ports.
+ */
+struct HostI2CDevice {
+    uint8_t addr;
+    void* dev;
+    bool (*write)(void* dev, uint8_t addr, const uint8_t* data, size_t len);
+    bool (*read)(void* dev, uint8_t addr, uint8_t* data, size_t len);
+    void (*advance)(void* dev, uint32_t ms);
+};
+
+/**
+ * What the stand-ins did during a wake.
+ */
+struct HostCounters {
+    uint32_t requests = 0;          // HTTP requests made
+    uint32_t failedRequests = 0;    // HTTP requests which got no response
+    uint64_t bytesUp = 0;           // HTTP bytes sent, headers included
+    uint64_t bytesDown = 0;         // HTTP bytes received, headers included
+    uint64_t bytesWritten = 0;      // File system bytes written
+    uint64_t bytesRead = 0;         // File system bytes read
+    uint32_t filesOpened = 0;       // File system opens which succeeded
+    uint32_t frames = 0;            // Camera frames handed out
+    uint32_t i2cTransactions = 0;   // I2C transactions, NACKed ones included
+    uint64_t storageOps = 0;        // File system bytes written, plus opens for writing, removes and renames
+};
+
+struct HostHal {
+    std::string root = "station_fs";            // Directory backing SD_MMC and LittleFS
+    bool sdCard = true;                         // Whether SD_MMC mounts, else LittleFS is used
+    std::string server = "http://127.0.0.1:8080"; // Where every HTTP request goes, whatever its URL
+    uint32_t httpTimeoutMs = 5000;              // Default connect and read timeout
+    std::vector<std::string> networks;          // SSIDs in range
+    bool wifi = true;                           // Whether joining a network in range works
+    uint32_t associateMs = 1200;                // Time WiFi takes to connect
+    std::string mac = "24:0A:C4:00:00:01";      // WiFi MAC address, which the server tells stations apart by
+    bool (*waitFd)(int fd, short events, int32_t timeoutMs) = nullptr; // Waits on a socket instead of poll(), true once ready
+    std::string fixtures;                       // Directory of JPEGs the camera serves
+    uint32_t frameMs = 67;                      // Time between camera frames
+    bool aeHunts = false;                       // Auto exposure swings either side of its target and never settles
+    uint32_t fixture = 0;                       // Index of the fixture served this wake
+    std::vector<HostI2CDevice> i2c;             // Devices on the bus
+    time_t epoch = 0;                           // Wall clock at boot
+    size_t internalHeap = 320 * 1024;           // Internal RAM heap_caps allocations share
+    size_t psram = 8 * 1024 * 1024;             // PSRAM, 0 for a board without any
+    bool serial = false;                        // Echo Serial to stderr
+    uint64_t sleepUs = 0;                       // Set by esp_sleep_enable_timer_wakeup
+    void (*deepSleep)(uint64_t us) = nullptr;   // Called by esp_deep_sleep_start, before the process exits
+    int64_t cutAt = -1;                         // Storage operation power is cut before, -1 for never
+    void (*powerCut)() = nullptr;               // Called when it is, after what was written reached the disk
+    HostCounters counters;
+};
+
+extern HostHal HOST_HAL;
+
+/**
+ * Microseconds since boot, including simulated waits.
+ */
+uint64_t hostMicros();
+
+/**
+ * Where a path on the station lands on the host. Empty if the station would reject it.
+ */
+std::string hostPath(const char* path);
+
+/**
+ * Exit status of a process whose power was cut and which had no powerCut callback, or whose callback returned.
+ */
+#define HOST_POWER_CUT_EXIT 86
+
+#endif
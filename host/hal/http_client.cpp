@@ -0,0 +1,231 @@
+#include "HTTPClient.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Everything after the authority of a URL: its path and query.
+ */
+static std::string requestTarget(const char* url) {
+    const char* p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    p = strchr(p, '/');
+    return p ? p : "/";
+}
+
+/**
+ * Wait until a socket is ready, through HOST_HAL.waitFd if something shares the thread.
+ * @return False on timeout.
+ */
+static bool waitFor(int fd, short events, int32_t timeoutMs) {
+    if (HOST_HAL.waitFd) return HOST_HAL.waitFd(fd, events, timeoutMs);
+    struct pollfd p = {fd, events, 0};
+    return poll(&p, 1, timeoutMs) == 1;
+}
+
+/**
+ * Connect to HOST_HAL.server, giving up after timeoutMs. The socket is left non-blocking.
+ * @return The socket, or -1.
+ */
+static int connectServer(std::string* host, int32_t timeoutMs) {
+    const char* s = HOST_HAL.server.c_str();
+    const char* scheme = strstr(s, "://");
+    s = scheme ? scheme + 3 : s;
+    std::string authority(s, strcspn(s, "/"));
+    *host = authority;
+
+    std::string port = "80";
+    const size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        port = authority.substr(colon + 1);
+        authority.resize(colon);
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* found = nullptr;
+    if (getaddrinfo(authority.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo* a = found; a && fd < 0; a = a -> ai_next) {
+        fd = socket(a -> ai_family, a -> ai_socktype, a -> ai_protocol);
+        if (fd < 0) continue;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int err = connect(fd, a -> ai_addr, a -> ai_addrlen) == 0 ? 0 : errno;
+        if (err == EINPROGRESS) {
+            socklen_t len = sizeof(err);
+            if (!waitFor(fd, POLLOUT, timeoutMs) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = ETIMEDOUT;
+        }
+        if (err) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+static bool sendAll(int fd, const void* data, size_t len, int32_t timeoutMs) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (len > 0) {
+        const ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitFor(fd, POLLOUT, timeoutMs)) return false;
+            continue;
+        }
+        if (n <= 0) return false;
+        HOST_HAL.counters.bytesUp += n;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool HTTPClient::begin(const String& url) {
+    target = url;
+    headers.clear();
+    body = String();
+    return true;
+}
+
+void HTTPClient::end() {
+    headers.clear();
+}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool first, bool replace) {
+    if (replace) {
+        for (auto& h : headers) {
+            if (h.first == name) {
+                h.second = value;
+                return;
+            }
+        }
+    }
+    if (first) headers.insert(headers.begin(), std::make_pair(name, value));
+    else headers.push_back(std::make_pair(name, value));
+}
+
+int HTTPClient::GET() {
+    return exchange("GET", nullptr, nullptr, 0);
+}
+
+int HTTPClient::POST(uint8_t* payload, size_t size) {
+    return sendRequest("POST", payload, size);
+}
+
+int HTTPClient::sendRequest(const char* method, const uint8_t* payload, size_t size) {
+    return exchange(method, payload, nullptr, size);
+}
+
+int HTTPClient::sendRequest(const char* method, Stream* stream, size_t size) {
+    return exchange(method, nullptr, stream, size);
+}
+
+/**
+ * Send size bytes of a stream, a TCP segment at a time as the core does.
+ */
+static bool sendStream(int fd, Stream* stream, size_t size, int32_t timeoutMs) {
+    uint8_t buf[1460];
+    while (size > 0) {
+        const size_t n = stream -> readBytes(buf, size < sizeof(buf) ? size : sizeof(buf));
+        if (!n || !sendAll(fd, buf, n, timeoutMs)) return false;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * One request on a fresh connection, reading the reply until the server closes or its body is in.
+ * The payload comes from memory, or from a stream if there is one.
+ * @return The status code, or a negative HTTPC_ERROR_ code.
+ */
+int HTTPClient::exchange(const char* method, const uint8_t* payload, Stream* stream, size_t size) {
+    body = String();
+    HOST_HAL.counters.requests++;
+    if (WiFi.status() != WL_CONNECTED) {
+        HOST_HAL.counters.failedRequests++;
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    std::string host;
+    const int32_t timeout = connectTimeout > 0 ? connectTimeout : HOST_HAL.httpTimeoutMs;
+    const int fd = connectServer(&host, timeout);
+    if (fd < 0) {
+        HOST_HAL.counters.failedRequests++;
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    const int32_t wait = readTimeout > 0 ? readTimeout : HOST_HAL.httpTimeoutMs;
+
+    std::string head = std::string(method) + " " + requestTarget(target.c_str()) + " HTTP/1.1\r\n";
+    head += "Host: " + host + "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: close\r\n";
+    for (const auto& h : headers) head += std::string(h.first.c_str()) + ": " + h.second.c_str() + "\r\n";
+    if (payload || stream || strcmp(method, "GET") != 0) head += "Content-Length: " + std::to_string(size) + "\r\n";
+    head += "\r\n";
+
+    if (!sendAll(fd, head.data(), head.size(), wait)) {
+        close(fd);
+        HOST_HAL.counters.failedRequests++;
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    if (size && !(stream ? sendStream(fd, stream, size, wait) : sendAll(fd, payload, size, wait))) {
+        close(fd);
+        HOST_HAL.counters.failedRequests++;
+        return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+
+    std::string reply;
+    size_t bodyAt = std::string::npos;
+    size_t length = std::string::npos;
+    char buf[4096];
+    for (;;) {
+        const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (waitFor(fd, POLLIN, wait)) continue;
+            close(fd);
+            HOST_HAL.counters.failedRequests++;
+            return HTTPC_ERROR_READ_TIMEOUT;
+        }
+        if (n <= 0) break;
+        HOST_HAL.counters.bytesDown += n;
+        reply.append(buf, n);
+
+        if (bodyAt == std::string::npos && (bodyAt = reply.find("\r\n\r\n")) != std::string::npos) {
+            bodyAt += 4;
+            const char* cl = strcasestr(reply.c_str(), "\r\nContent-Length:");
+            if (cl && cl < reply.c_str() + bodyAt) length = strtoul(cl + 17, nullptr, 10);
+        }
+        if (bodyAt != std::string::npos && length != std::string::npos && reply.size() >= bodyAt + length) break;
+    }
+    close(fd);
+
+    int code = 0;
+    if (bodyAt == std::string::npos || sscanf(reply.c_str(), "HTTP/%*s %d", &code) != 1) {
+        HOST_HAL.counters.failedRequests++;
+        return HTTPC_ERROR_NO_HTTP_SERVER;
+    }
+    body = String(reply.c_str() + bodyAt, length == std::string::npos ? reply.size() - bodyAt : length);
+    return code;
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+        case HTTPC_ERROR_CONNECTION_REFUSED: return F("connection refused");
+        case HTTPC_ERROR_SEND_HEADER_FAILED: return F("send header failed");
+        case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return F("send payload failed");
+        case HTTPC_ERROR_NOT_CONNECTED: return F("not connected");
+        case HTTPC_ERROR_CONNECTION_LOST: return F("connection lost");
+        case HTTPC_ERROR_NO_STREAM: return F("no stream");
+        case HTTPC_ERROR_NO_HTTP_SERVER: return F("no HTTP server");
+        case HTTPC_ERROR_TOO_LESS_RAM: return F("too less ram");
+        case HTTPC_ERROR_ENCODING: return F("Transfer-Encoding not supported");
+        case HTTPC_ERROR_STREAM_WRITE: return F("Stream write error");
+        case HTTPC_ERROR_READ_TIMEOUT: return F("read Timeout");
+        default: return String();
+    }
+}
@@ -0,0 +1,76 @@
+#include "img_converters.h"
+#include <stdio.h>
+#include <jpeglib.h>
+
+#define ENCODER_CHUNK 1024
+
+/**
+ * A libjpeg destination handing each full chunk to the callback, as the camera's encoder does.
+ */
+struct CallbackDestination {
+    jpeg_destination_mgr mgr;
+    jpg_out_cb cb;
+    void* arg;
+    size_t index;
+    bool failed;
+    JOCTET chunk[ENCODER_CHUNK];
+};
+
+static bool emit(CallbackDestination* dest, size_t len) {
+    if (dest -> failed || !len) return !dest -> failed;
+    if (dest -> cb(dest -> arg, dest -> index, dest -> chunk, len) != len) dest -> failed = true;
+    dest -> index += len;
+    return !dest -> failed;
+}
+
+static void initDestination(j_compress_ptr cinfo) {
+    CallbackDestination* dest = (CallbackDestination*)cinfo -> dest;
+    dest -> mgr.next_output_byte = dest -> chunk;
+    dest -> mgr.free_in_buffer = ENCODER_CHUNK;
+}
+
+static boolean emptyOutput(j_compress_ptr cinfo) {
+    CallbackDestination* dest = (CallbackDestination*)cinfo -> dest;
+    emit(dest, ENCODER_CHUNK);
+    initDestination(cinfo);
+    return TRUE;
+}
+
+static void termDestination(j_compress_ptr cinfo) {
+    CallbackDestination* dest = (CallbackDestination*)cinfo -> dest;
+    emit(dest, ENCODER_CHUNK - dest -> mgr.free_in_buffer);
+}
+
+bool fmt2jpg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+                uint8_t quality, jpg_out_cb cb, void* arg) {
+    const int components = format == PIXFORMAT_RGB888 ? 3 : format == PIXFORMAT_GRAYSCALE ? 1 : 0;
+    if (!src || !cb || !components || src_len < (size_t)width * height * components) return false;
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    CallbackDestination dest = {};
+    dest.mgr.init_destination = initDestination;
+    dest.mgr.empty_output_buffer = emptyOutput;
+    dest.mgr.term_destination = termDestination;
+    dest.cb = cb;
+    dest.arg = arg;
+    cinfo.dest = &dest.mgr;
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = components;
+    cinfo.in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = src + (size_t)cinfo.next_scanline * width * components;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return !dest.failed;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef HOST_IMG_CONVERTERS_H
+#define HOST_IMG_CONVERTERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_camera.h"
+
+/**
+ * The esp32-camera JPEG encoder, over libjpeg.
+ */
+
+/**
+ * Where the encoder streams its output.
+ * @return The number of bytes taken, anything short of len stops the encode.
+ */
+typedef size_t (*jpg_out_cb)(void* arg, size_t index, const void* data, size_t len);
+
+/**
+ * Encode a frame to JPEG, streaming it through a callback. Only RGB888 and GRAYSCALE on the host.
+ */
+bool fmt2jpg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format,
+                uint8_t quality, jpg_out_cb cb, void* arg);
+
+#endif
@@ -0,0 +1,53 @@
+#include "WiFi.h"
+#include "HTTPUpdate.h"
+
+WiFiClass WiFi;
+HTTPUpdate httpUpdate;
+
+String IPAddress::toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buf);
+}
+
+bool WiFiClass::mode(wifi_mode_t m) {
+    current = m;
+    if (m == WIFI_OFF) disconnect();
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap) {
+    joined = String();
+    joining = false;
+    if (wifioff) current = WIFI_OFF;
+    return true;
+}
+
+int16_t WiFiClass::scanNetworks() {
+    if (current == WIFI_OFF) return -2;
+    return HOST_HAL.networks.size();
+}
+
+String WiFiClass::SSID(uint8_t i) const {
+    return i < HOST_HAL.networks.size() ? String(HOST_HAL.networks[i]) : String();
+}
+
+/**
+ * Start joining. The network has to be in range, and the connection only comes up after HOST_HAL.associateMs.
+ */
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase) {
+    if (current == WIFI_OFF) current = WIFI_STA;
+    joined = ssid;
+    joining = false;
+    for (const std::string& network : HOST_HAL.networks) {
+        if (network == ssid) joining = HOST_HAL.wifi;
+    }
+    joinedUs = hostMicros() + (uint64_t)HOST_HAL.associateMs * 1000;
+    return status();
+}
+
+wl_status_t WiFiClass::status() {
+    if (current == WIFI_OFF) return WL_DISCONNECTED;
+    if (!joining) return joined.isEmpty() ? WL_IDLE_STATUS : WL_DISCONNECTED;
+    return hostMicros() >= joinedUs ? WL_CONNECTED : WL_DISCONNECTED;
+}
@@ -0,0 +1,88 @@
+#include <Wire.h>
+
+TwoWire Wire(0);
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    started = true;
+    lastUs = hostMicros();
+    return true;
+}
+
+bool TwoWire::end() {
+    started = false;
+    return true;
+}
+
+/**
+ * The device at an address, after letting every device catch up with the time passed.
+ */
+HostI2CDevice* TwoWire::device(uint16_t address) {
+    const uint64_t now = hostMicros();
+    const uint32_t ms = (now - lastUs) / 1000;
+    if (ms) {
+        lastUs += (uint64_t)ms * 1000;
+        for (HostI2CDevice& d : HOST_HAL.i2c) {
+            if (d.advance) d.advance(d.dev, ms);
+        }
+    }
+
+    HOST_HAL.counters.i2cTransactions++;
+    for (HostI2CDevice& d : HOST_HAL.i2c) {
+        if (d.addr == address) return &d;
+    }
+    return nullptr;
+}
+
+void TwoWire::beginTransmission(uint16_t address) {
+    target = address;
+    txLen = 0;
+    txOverflow = false;
+}
+
+/**
+ * @return 0 on success, 1 if the data did not fit the buffer, 2 on an address NACK, 3 on a data NACK.
+ */
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    if (!started) return 4;
+    if (txOverflow) return 1;
+    HostI2CDevice* d = device(target);
+    if (!d) return 2;
+    return d -> write(d -> dev, target, tx, txLen) ? 0 : 3;
+}
+
+size_t TwoWire::requestFrom(uint16_t address, size_t size, bool sendStop) {
+    rxLen = 0;
+    rxPos = 0;
+    if (!started || size > I2C_BUFFER_LENGTH) return 0;
+    HostI2CDevice* d = device(address);
+    if (!d || !d -> read(d -> dev, address, rx, size)) return 0;
+    rxLen = size;
+    return size;
+}
+
+size_t TwoWire::write(uint8_t c) {
+    if (txLen >= I2C_BUFFER_LENGTH) {
+        txOverflow = true;
+        return 0;
+    }
+    tx[txLen++] = c;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len) {
+    size_t n = 0;
+    while (n < len && write(data[n])) n++;
+    return n;
+}
+
+int TwoWire::available() {
+    return rxLen - rxPos;
+}
+
+int TwoWire::read() {
+    return rxPos < rxLen ? rx[rxPos++] : -1;
+}
+
+int TwoWire::peek() {
+    return rxPos < rxLen ? rx[rxPos] : -1;
+}
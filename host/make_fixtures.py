@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Make the fixtures in host/fixtures. The JPEGs the host camera serves are synthetic fisheye skies, from
+clear to overcast, encoded like the OV5640 does it (baseline, 4:2:2, no restart markers); they need Pillow,
+listed in host/requirements.txt. weather.csv is a synthetic day of weather the cadence replay test runs on.
+
+    pip install -r host/requirements.txt
+    python3 host/make_fixtures.py host/fixtures
+"""
+
+import argparse
+import math
+import os
+import random
+import sys
+
+SKIES = [
+    ("clear", 0.0),
+    ("scattered", 0.35),
+    ("broken", 1.5),
+    ("overcast", 4.0),
+]
+
+
+def sky(width, height, cover, seed):
+    """A fisheye sky: blue deepening towards the zenith, clouds at the given density, black outside the lens."""
+    from PIL import Image, ImageDraw, ImageFilter
+
+    rng = random.Random(seed)
+    img = Image.new("RGB", (width, height))
+    px = img.load()
+    cx, cy, r = width / 2, height / 2, height * 0.95 / 2 * (width / height) ** 0.5
+    for y in range(height):
+        for x in range(width):
+            d = math.hypot(x - cx, y - cy) / r
+            if d > 1:
+                continue
+            px[x, y] = (int(70 + 90 * d), int(120 + 80 * d), int(235 - 10 * d))
+
+    clouds = Image.new("L", (width, height))
+    draw = ImageDraw.Draw(clouds)
+    for _ in range(int(120 * cover)):
+        x, y = rng.uniform(0, width), rng.uniform(0, height)
+        s = rng.uniform(0.02, 0.07) * width
+        draw.ellipse((x - s, y - s * 0.6, x + s, y + s * 0.6), fill=rng.randint(150, 255))
+    clouds = clouds.filter(ImageFilter.GaussianBlur(width / 160))
+
+    white = Image.new("RGB", (width, height), (235, 235, 240))
+    img = Image.composite(white, img, clouds)
+    lens = Image.new("L", (width, height))
+    ImageDraw.Draw(lens).ellipse((cx - r, cy - r, cx + r, cy + r), fill=255)
+    return Image.composite(img, Image.new("RGB", (width, height)), lens)
+
+
+# The day weather.csv describes, as (hour, pressure Pa, temperature C, cloud fraction) at the
+# ends of straight segments: a settled night, a morning warming up under falling pressure, a squall
+# line passing from noon, and clearing behind it. Readings are every five minutes, the shortest
+# cadence; the barometer drops out for an hour in the evening and those pressures are empty.
+WEATHER = [
+    (0.0, 101800, 14.0, 0.10),
+    (8.0, 101720, 13.0, 0.10),
+    (12.0, 101600, 19.0, 0.30),
+    (12.5, 101500, 18.5, 0.65),
+    (13.0, 101400, 13.0, 1.00),
+    (13.5, 101300, 12.5, 1.00),
+    (15.0, 101450, 14.0, 0.60),
+    (24.0, 101630, 12.0, 0.20),
+]
+WEATHER_STEP = 5
+WEATHER_DROPOUT = (18.0, 19.0)
+
+
+def weather(path):
+    """Write the day of weather, one reading per WEATHER_STEP minutes, linearly between the segment ends."""
+    with open(path, "w") as f:
+        f.write("minute,pressure,temperature,cloud_fraction\n")
+        for minute in range(0, 24 * 60 + 1, WEATHER_STEP):
+            hour = minute / 60
+            for (h0, p0, t0, c0), (h1, p1, t1, c1) in zip(WEATHER, WEATHER[1:]):
+                if h0 <= hour <= h1:
+                    a = (hour - h0) / (h1 - h0)
+                    break
+            pressure = "" if WEATHER_DROPOUT[0] <= hour < WEATHER_DROPOUT[1] else "%.1f" % (p0 + (p1 - p0) * a)
+            f.write("%d,%s,%.2f,%.3f\n" % (minute, pressure, t0 + (t1 - t0) * a, c0 + (c1 - c0) * a))
+    print("%s: %d readings" % (path, 24 * 60 // WEATHER_STEP + 1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("out", help="directory to write the fixtures to")
+    parser.add_argument("--width", type=int, default=1280)
+    parser.add_argument("--height", type=int, default=720)
+    parser.add_argument("--quality", type=int, default=80)
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    weather(os.path.join(args.out, "weather.csv"))
+    for i, (name, cover) in enumerate(SKIES):
+        path = os.path.join(args.out, "%02d_%s.jpg" % (i, name))
+        sky(args.width, args.height, cover, i).save(path, "JPEG", quality=args.quality, subsampling=1, optimize=False)
+        print("%s: %d bytes" % (path, os.path.getsize(path)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
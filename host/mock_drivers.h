@@ -0,0 +1,219 @@
+#pragma once
+#ifndef MOCK_DRIVERS_H
+#define MOCK_DRIVERS_H
+
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include "../sensors.h"
+
+/**
+ * Deterministic pseudo random source for the mocks (xorshift64*), so that a given
+ * seed reproduces the same noise, outliers and dropouts on every run.
+ */
+struct MockRandom {
+    uint64_t state;
+
+    MockRandom(uint64_t seed = 0x9E3779B97F4A7C15ull) : state(seed ? seed : 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+
+    /**
+     * Uniform in [0, 1).
+     */
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Standard normal, via Box-Muller.
+     */
+    double gaussian() {
+        double u1 = uniform();
+        if (u1 < 1e-300) u1 = 1e-300;
+        return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * uniform());
+    }
+};
+
+/**
+ * How a mocked quantity behaves.
+ */
+struct MockSignal {
+    double mean;                // True value
+    double noise;               // Standard deviation of the per-sample noise
+    double outliers = 0.0;      // Probability of a sample being a spike
+    double spike = 0.0;         // Size of a spike
+};
+
+/**
+ * How a mocked sensor behaves as a whole.
+ */
+struct MockBehaviour {
+    double dropout = 0.0;       // Probability of a whole sample failing
+    uint32_t latencyUs = 0;     // Time a sample takes
+    bool realtime = false;      // Actually sleep for latencyUs, rather than only account for it
+    uint16_t samples = SAMPLES; // Raw samples averaged per reading, like the real drivers
+    bool failInit = false;      // Refuse to come up
+};
+
+/**
+ * Shared machinery of the mock drivers: latency, dropouts, and noisy samples
+ * reduced with the same robust estimator as the station drivers.
+ */
+struct MockSensor {
+    MockBehaviour behaviour;
+    MockRandom rng;
+    uint64_t elapsedUs = 0;     // Simulated time spent sampling
+    uint32_t dropped = 0;       // Samples failed through dropouts
+
+    MockSensor() {}
+    MockSensor(MockBehaviour b, uint64_t seed) : behaviour(b), rng(seed) {}
+
+    void wait() {
+        elapsedUs += behaviour.latencyUs;
+        if (behaviour.realtime && behaviour.latencyUs) {
+            std::this_thread::sleep_for(std::chrono::microseconds(behaviour.latencyUs));
+        }
+    }
+
+    bool drop() {
+        if (rng.uniform() >= behaviour.dropout) return false;
+        dropped++;
+        return true;
+    }
+
+    double measure(const MockSignal& signal) {
+        double values[SAMPLES];
+        const uint16_t n = behaviour.samples > SAMPLES ? SAMPLES : behaviour.samples;
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = signal.mean + signal.noise * rng.gaussian();
+            if (rng.uniform() < signal.outliers) values[i] += (rng.uniform() < 0.5 ? -1 : 1) * signal.spike;
+        }
+        return removeOutliersandGetMean(values, n);
+    }
+};
+
+/**
+ * Mock barometer: fills in pressure and temperature.
+ */
+class MockBarometer : public SensorDriver<MockBarometer>, public MockSensor {
+    friend class SensorDriver<MockBarometer>;
+
+public:
+    MockSignal pressure = {101325.0, 2.0};
+    MockSignal temperature = {20.0, 0.01};
+
+    MockBarometer() {}
+    MockBarometer(MockBehaviour b, uint64_t seed = 1) : MockSensor(b, seed) {}
+
+private:
+    bool initImpl() {
+        return !behaviour.failInit;
+    }
+
+    bool sampleImpl(Reading *reading) {
+        wait();
+        if (drop()) return false;
+        reading -> pressure = measure(pressure);
+        reading -> temperature = measure(temperature);
+        return true;
+    }
+};
+
+/**
+ * Mock hygrometer: fills in humidity and temperature.
+ */
+class MockHygrometer : public SensorDriver<MockHygrometer>, public MockSensor {
+    friend class SensorDriver<MockHygrometer>;
+
+public:
+    MockSignal humidity = {55.0, 0.1};
+    MockSignal temperature = {20.0, 0.02};
+
+    MockHygrometer() {}
+    MockHygrometer(MockBehaviour b, uint64_t seed = 2) : MockSensor(b, seed) {}
+
+private:
+    bool initImpl() {
+        return !behaviour.failInit;
+    }
+
+    bool sampleImpl(Reading *reading) {
+        wait();
+        if (drop()) return false;
+        reading -> humidity = measure(humidity);
+        reading -> temperature = measure(temperature);
+        return true;
+    }
+};
+
+/**
+ * Mock camera: hands out a caller provided JPEG as its frame.
+ */
+class MockCamera : public SensorDriver<MockCamera>, public MockSensor {
+    friend class SensorDriver<MockCamera>;
+
+public:
+    camera_fb_t frame = {};
+    uint8_t bracketFrames = 0;      // Frames per bracket, 0 to never bracket
+
+    MockCamera() {}
+    MockCamera(MockBehaviour b, uint64_t seed = 3) : MockSensor(b, seed) {}
+
+    /**
+     * Set the JPEG returned by capture(). The buffer is not copied.
+     */
+    void setImage(uint8_t* jpg, size_t len, size_t width, size_t height) {
+        frame.buf = jpg;
+        frame.len = len;
+        frame.width = width;
+        frame.height = height;
+        frame.format = PIXFORMAT_JPEG;
+    }
+
+    /**
+     * @return The image set with setImage(), mapped rather than copied.
+     */
+    ImageBuffer capture() {
+        if (!up) return ImageBuffer();
+        wait();
+        if (drop() || !frame.buf) return ImageBuffer();
+        return ImageBuffer::mapped(frame.buf, frame.len, frame.width, frame.height);
+    }
+
+    /**
+     * A bracket of bracketFrames copies of the image set with setImage().
+     */
+    bool wantsBracket() const {
+        return bracketFrames > 0;
+    }
+
+    uint8_t bracket(BracketSink sink, void* ctx) {
+        uint8_t taken = 0;
+        for (uint8_t i = 0; i < bracketFrames; i++) {
+            ImageBuffer img = capture();
+            if (!img || !sink(ctx, i, img, 0)) break;
+            taken++;
+        }
+        return taken;
+    }
+
+private:
+    bool initImpl() {
+        return !behaviour.failInit;
+    }
+
+    bool sampleImpl(Reading *) {
+        return true;
+    }
+};
+
+typedef SensorSuite<MockBarometer, MockHygrometer, MockCamera> MockSensors;
+
+#endif
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Per phase latency histograms from the wake profiles stations upload with their status.
+
+Reads the `profile` values of status requests, one per line, either bare or anywhere in a
+line as `profile=<value>` (server access logs work as they are), from files or stdin.
+The record layout is described in profile.h and must match PROFILE_VERSION.
+
+    python3 host/profile_histogram.py access.log
+    grep status access.log | python3 host/profile_histogram.py --csv > wakes.csv
+"""
+
+import argparse
+import base64
+import re
+import struct
+import sys
+
+PROFILE_VERSION = 3
+PHASES = ["mount", "wifi", "clock", "qnh", "sample", "capture", "analyse", "spool", "upload", "backlog"]
+NEVER_RAN = 0xFFFF
+
+FIELDS = 7
+RECORD = struct.Struct("<HIIHH" + "IHHHHHH" * len(PHASES))
+FIELD = re.compile(r"(?:^|[?&\s])profile=([A-Za-z0-9_-]+)")
+BARE = re.compile(r"^[A-Za-z0-9_-]+$")
+
+
+def decode(text):
+    """Decode one uploaded value into wake dicts."""
+    raw = base64.urlsafe_b64decode(text + "=" * (-len(text) % 4))
+    if len(raw) < 2:
+        raise ValueError("truncated header")
+    version, count = raw[0], raw[1]
+    if version != PROFILE_VERSION:
+        raise ValueError("profile version %d, expected %d" % (version, PROFILE_VERSION))
+    if len(raw) != 2 + count * RECORD.size:
+        raise ValueError("%d bytes for %d records" % (len(raw), count))
+
+    wakes = []
+    for i in range(count):
+        fields = RECORD.unpack_from(raw, 2 + i * RECORD.size)
+        seq, time, wall, json_peak, json_spills = fields[:5]
+        phases = {}
+        for p, name in enumerate(PHASES):
+            us, heap, psram, allocs, alloc_kb, peak_kb, largest_kb = fields[5 + FIELDS * p: 5 + FIELDS * (p + 1)]
+            if heap != NEVER_RAN:
+                phases[name] = (us, heap, psram, allocs, alloc_kb, peak_kb, largest_kb)
+        wakes.append({"seq": seq, "time": time, "wall": wall, "json_peak": json_peak, "json_spills": json_spills,
+                      "phases": phases})
+    return wakes
+
+
+def values(lines):
+    for line in lines:
+        line = line.strip()
+        found = FIELD.findall(line)
+        if found:
+            yield from found
+        elif BARE.match(line):
+            yield line
+
+
+def percentile(sorted_values, q):
+    if not sorted_values:
+        return 0
+    i = min(len(sorted_values) - 1, int(round(q * (len(sorted_values) - 1))))
+    return sorted_values[i]
+
+
+def histogram(samples, width):
+    """Power of two buckets in microseconds, as text rows."""
+    buckets = {}
+    for us in samples:
+        b = max(us, 1).bit_length() - 1
+        buckets[b] = buckets.get(b, 0) + 1
+    peak = max(buckets.values())
+    rows = []
+    for b in range(min(buckets), max(buckets) + 1):
+        n = buckets.get(b, 0)
+        low = 1 << b
+        label = "%s - %s" % (human(low), human(low * 2))
+        rows.append("    %-21s %6d %s" % (label, n, "#" * (n * width // peak if n else 0)))
+    return rows
+
+
+def human(us):
+    if us >= 1000000:
+        return "%.3g s" % (us / 1e6)
+    if us >= 1000:
+        return "%.3g ms" % (us / 1e3)
+    return "%d us" % us
+
+
+def report(wakes, width):
+    print("%d wakes" % len(wakes))
+    walls = sorted(w["wall"] for w in wakes)
+    print("wake      p50 %-9s p90 %-9s p99 %-9s max %s" % (
+        human(percentile(walls, 0.5)), human(percentile(walls, 0.9)), human(percentile(walls, 0.99)), human(walls[-1])))
+    peaks = sorted(w["json_peak"] for w in wakes)
+    print("JSON arena p50 %d bytes, max %d bytes; %d allocations spilled to the heap" % (
+        percentile(peaks, 0.5), peaks[-1], sum(w["json_spills"] for w in wakes)))
+
+    for name in PHASES:
+        ran = [w["phases"][name] for w in wakes if name in w["phases"]]
+        if not ran:
+            continue
+        times = sorted(r[0] for r in ran)
+        print()
+        print("%-9s ran in %d wakes, p50 %s, p90 %s, p99 %s, max %s; heap low %d KiB, PSRAM low %d KiB" % (
+            name, len(ran), human(percentile(times, 0.5)), human(percentile(times, 0.9)),
+            human(percentile(times, 0.99)), human(times[-1]), min(r[1] for r in ran), min(r[2] for r in ran)))
+        largest = [r[6] for r in ran if r[6] != NEVER_RAN]
+        print("          allocations p50 %d, max %d; p50 %d KiB, max %d KiB; peak live %d KiB; largest free block %s" % (
+            percentile(sorted(r[3] for r in ran), 0.5), max(r[3] for r in ran),
+            percentile(sorted(r[4] for r in ran), 0.5), max(r[4] for r in ran), max(r[5] for r in ran),
+            "%d KiB" % min(largest) if largest else "not measured"))
+        for row in histogram(times, width):
+            print(row)
+
+
+def csv(wakes):
+    header = ["seq", "time", "wall_us", "json_peak", "json_spills"]
+    for name in PHASES:
+        header += [name + "_us", name + "_heap_kib", name + "_psram_kib", name + "_allocs", name + "_alloc_kib",
+                   name + "_peak_kib", name + "_largest_kib"]
+    print(",".join(header))
+    for w in wakes:
+        row = [w["seq"], w["time"], w["wall"], w["json_peak"], w["json_spills"]]
+        for name in PHASES:
+            row += list(w["phases"].get(name, ("",) * FIELDS))
+        print(",".join(str(v) for v in row))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("files", nargs="*", help="Files to read, stdin if none")
+    parser.add_argument("--csv", action="store_true", help="Print one row per wake instead of histograms")
+    parser.add_argument("--width", type=int, default=40, help="Width of the longest histogram bar")
+    args = parser.parse_args()
+
+    streams = [open(f) for f in args.files] or [sys.stdin]
+    wakes = {}
+    for stream in streams:
+        for value in values(stream):
+            try:
+                for w in decode(value):
+                    # A station resends nothing, but logs may repeat requests.
+                    wakes[(w["seq"], w["time"])] = w
+            except ValueError as e:
+                print("skipping record: %s" % e, file=sys.stderr)
+
+    ordered = sorted(wakes.values(), key=lambda w: (w["time"], w["seq"]))
+    if not ordered:
+        print("no profiles found", file=sys.stderr)
+        return 1
+    if args.csv:
+        csv(ordered)
+    else:
+        report(ordered, args.width)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
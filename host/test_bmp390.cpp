@@ -0,0 +1,160 @@
+/**
+ * The BMP390 register driver on the register level fake: startup, the FIFO frames it parses,
+ * draining a full FIFO, and compensation.
+ */
+#include "check.h"
+#include "fake_bmp390.h"
+
+typedef BMP390<FakeBMP390::Port> Driver;
+
+/**
+ * A port whose waits let no time pass, as a driver reading straight after a reset would.
+ */
+struct NoWaitPort : FakeBMP390::Port {
+    void wait(uint32_t ms) {
+        (void)ms;
+    }
+};
+
+static void pushFrame(uint8_t* at, uint32_t t, uint32_t p) {
+    at[0] = BMP390_FRAME_TEMP_PRESS;
+    for (int i = 0; i < 3; i++) at[1 + i] = (uint8_t)(t >> (8 * i));
+    for (int i = 0; i < 3; i++) at[4 + i] = (uint8_t)(p >> (8 * i));
+}
+
+/**
+ * The calibration is only read once the sensor is up after its soft reset.
+ */
+static void startup() {
+    FakeBMP390 fake;
+    Driver bmp(fake.port());
+    CHECK(bmp.begin());
+
+    FakeBMP390 hasty;
+    BMP390<NoWaitPort> rushed(NoWaitPort{hasty.port()});
+    CHECK(!rushed.begin());
+}
+
+/**
+ * Raw values through the datasheet's floating point compensation (section 8.5), worked out by hand
+ * from the fake's calibration words.
+ */
+static void compensation() {
+    FakeBMP390 fake;
+    fake.noise = 0;
+    Driver bmp(fake.port());
+    CHECK(bmp.begin());
+
+    const struct { uint32_t t, p; double celsius, pascals; } cases[] = {
+        {8050000, 6010789, 20.091047503, 101325.001381},
+        {8400000, 6500000, 26.251689633, 94107.967955},
+        {7700000, 5500000, 13.921701225, 108722.853146},
+    };
+    for (const auto& c : cases) {
+        fake.rawTemperature = c.t;
+        fake.rawPressure = c.p;
+        CHECK(bmp.startFifo(BMP390_OS_8X, BMP390_OS_1X, BMP390_IIR_3, BMP390_ODR_25));
+        fake.advance(bmp.samplePeriodMs());
+
+        BMP390Sample samples[BMP390_FIFO_FRAMES];
+        CHECK(bmp.readFifo(samples) == 1);
+        CHECK_NEAR(samples[0].temperature, c.celsius, 1e-6);
+        CHECK_NEAR(samples[0].pressure, c.pascals, 1e-4);
+        CHECK(bmp.stop());
+    }
+}
+
+/**
+ * Starting the FIFO queues a two byte configuration change frame ahead of the samples,
+ * which is skipped. It is also skipped between samples.
+ */
+static void configChangeFrame() {
+    FakeBMP390 fake;
+    Driver bmp(fake.port());
+    CHECK(bmp.begin());
+    CHECK(bmp.startFifo(BMP390_OS_8X, BMP390_OS_1X, BMP390_IIR_3, BMP390_ODR_25));
+    CHECK(fake.fifoLength() == 2);
+
+    BMP390Sample samples[BMP390_FIFO_FRAMES];
+    CHECK(bmp.readFifo(samples) == 0);
+    CHECK(fake.fifoLength() == 0);
+
+    fake.advance(3 * bmp.samplePeriodMs());
+    CHECK(bmp.readFifo(samples) == 3);
+
+    uint8_t raw[2 * BMP390_FRAME_LEN + 2];
+    pushFrame(raw, 8050000, 6010789);
+    raw[BMP390_FRAME_LEN] = BMP390_FRAME_CFG_CHANGE;
+    raw[BMP390_FRAME_LEN + 1] = 0x00;
+    pushFrame(raw + BMP390_FRAME_LEN + 2, 8050000, 6010789);
+    CHECK(bmp.parseFifo(raw, sizeof(raw), samples, BMP390_FIFO_FRAMES) == 2);
+    CHECK_NEAR(samples[1].pressure, 101325.0, 0.01);
+}
+
+/**
+ * The sensor answers 0x80 once there is nothing left, and parsing ends there.
+ */
+static void emptyFrame() {
+    FakeBMP390 fake;
+    Driver bmp(fake.port());
+    CHECK(bmp.begin());
+
+    BMP390Sample samples[BMP390_FIFO_FRAMES];
+    uint8_t raw[2 * BMP390_FRAME_LEN + 2];
+    pushFrame(raw, 8050000, 6010789);
+    raw[BMP390_FRAME_LEN] = BMP390_FRAME_EMPTY;
+    raw[BMP390_FRAME_LEN + 1] = 0x00;
+    pushFrame(raw + BMP390_FRAME_LEN + 2, 8050000, 6010789);
+    CHECK(bmp.parseFifo(raw, sizeof(raw), samples, BMP390_FIFO_FRAMES) == 1);
+
+    // A frame cut short is dropped rather than read past the data.
+    CHECK(bmp.parseFifo(raw, BMP390_FRAME_LEN - 1, samples, BMP390_FIFO_FRAMES) == 0);
+
+    // Nothing queued: the length reads zero and no data is read.
+    const uint32_t before = fake.transactions;
+    CHECK(bmp.readFifo(samples) == 0);
+    CHECK(fake.transactions - before == 2);
+}
+
+/**
+ * A FIFO left to fill up stops at the last frame which fits, and is drained in one burst of
+ * chunked reads with every frame returned.
+ */
+static void fullFifo() {
+    FakeBMP390 fake;
+    Driver bmp(fake.port());
+    CHECK(bmp.begin());
+    CHECK(bmp.startFifo(BMP390_OS_8X, BMP390_OS_1X, BMP390_IIR_3, BMP390_ODR_25));
+    fake.advance(200 * bmp.samplePeriodMs());
+
+    const size_t frames = (BMP390_FIFO_SIZE - 2) / BMP390_FRAME_LEN;
+    CHECK(fake.fifoLength() == 2 + frames * BMP390_FRAME_LEN);
+    CHECK(fake.fifoLength() > BMP390_FIFO_SIZE - BMP390_FRAME_LEN);
+
+    BMP390Sample samples[BMP390_FIFO_FRAMES];
+    const uint32_t before = fake.transactions;
+    const int got = bmp.readFifo(samples);
+    CHECK(got == (int)frames);
+    CHECK(fake.fifoLength() == 0);
+
+    // The length, then five register reads of at most 126 bytes, each a write and a read.
+    CHECK(fake.transactions - before == 2 + 5 * 2);
+    for (int i = 0; i < got; i++) {
+        CHECK_NEAR(samples[i].temperature, 20.09, 0.01);
+        CHECK_NEAR(samples[i].pressure, 101325.0, 5.0);
+    }
+
+    // A NACK is a bus error, not an empty FIFO.
+    fake.advance(10 * bmp.samplePeriodMs());
+    fake.nacks = 1;
+    CHECK(bmp.readFifo(samples) == -1);
+}
+
+int main() {
+    startup();
+    compensation();
+    configChangeFrame();
+    emptyFrame();
+    fullFifo();
+    return checkExit();
+}
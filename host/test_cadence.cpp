@@ -0,0 +1,153 @@
+/**
+ * The adaptive cadence replayed on a day of weather: fixtures/weather.csv, a synthetic day with
+ * a squall line passing at noon, which make_fixtures.py writes. Each wake reads the series at
+ * the time the cadence set, as the station would.
+ */
+#include <string>
+#include <vector>
+#include "check.h"
+#include "../cadence.h"
+
+#define HOUR 3600
+
+/**
+ * One row of the series.
+ */
+struct Weather {
+    time_t at;                  // Seconds into the day
+    double pressure;            // UNDEFINED where the barometer dropped out
+    double temperature;
+    double cloudFraction;
+};
+
+static std::vector<Weather> readSeries() {
+    std::vector<Weather> series;
+    const std::string path = std::string(HOST_FIXTURES) + "/weather.csv";
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) return series;
+    char line[128];
+    fgets(line, sizeof(line), f);       // Header
+    while (fgets(line, sizeof(line), f)) {
+        int minute;
+        char pressure[32] = "";
+        double temperature, cloud;
+        if (sscanf(line, "%d,%31[^,],%lf,%lf", &minute, pressure, &temperature, &cloud) == 4) {
+            series.push_back({(time_t)minute * 60, atof(pressure), temperature, cloud});
+        } else if (sscanf(line, "%d,,%lf,%lf", &minute, &temperature, &cloud) == 3) {
+            series.push_back({(time_t)minute * 60, UNDEFINED, temperature, cloud});
+        }
+    }
+    fclose(f);
+    return series;
+}
+
+static double lerp(double a, double b, double t) {
+    return a == UNDEFINED || b == UNDEFINED ? UNDEFINED : a + (b - a) * t;
+}
+
+/**
+ * The weather at a time into the day, between the rows either side of it.
+ */
+static Weather weatherAt(const std::vector<Weather>& series, time_t at) {
+    for (size_t i = 1; i < series.size(); i++) {
+        if (series[i].at < at) continue;
+        const Weather& a = series[i - 1];
+        const Weather& b = series[i];
+        const double t = (double)(at - a.at) / (b.at - a.at);
+        return {at, lerp(a.pressure, b.pressure, t), lerp(a.temperature, b.temperature, t), lerp(a.cloudFraction, b.cloudFraction, t)};
+    }
+    return series.back();
+}
+
+/**
+ * A wake of the replay: when it was, and the interval the cadence set after it.
+ */
+struct Wake {
+    time_t at;
+    uint32_t interval;
+};
+
+/**
+ * Wake through the day at the intervals the cadence sets.
+ * @param backlog: Bytes of offline backlog at the first wake, and added every wake after.
+ */
+static std::vector<Wake> replay(const std::vector<Weather>& series, uint32_t backlog = 0, uint32_t growth = 0) {
+    std::vector<Wake> wakes;
+    Cadence cadence;
+    for (time_t at = 0; at <= series.back().at; at += cadence.interval) {
+        const Weather w = weatherAt(series, at);
+        const CadenceInput in = {at, w.pressure, w.temperature, w.cloudFraction, -1, backlog};
+        wakes.push_back({at, cadence.update(in)});
+        backlog += growth;
+    }
+    return wakes;
+}
+
+/**
+ * The interval in force at a time: the one set by the last wake before it.
+ */
+static uint32_t intervalAt(const std::vector<Wake>& wakes, time_t at) {
+    uint32_t interval = CADENCE_DEFAULT_SECS;
+    for (const Wake& w : wakes) {
+        if (w.at > at) break;
+        interval = w.interval;
+    }
+    return interval;
+}
+
+static size_t wakesBetween(const std::vector<Wake>& wakes, time_t from, time_t to) {
+    size_t n = 0;
+    for (const Wake& w : wakes) n += w.at >= from && w.at < to;
+    return n;
+}
+
+static void squallDay() {
+    const std::vector<Weather> series = readSeries();
+    CHECK(series.size() == 24 * 12 + 1);
+    if (series.empty()) return;
+    const std::vector<Wake> wakes = replay(series);
+
+    // The settled night backs off all the way, and the warming morning holds its interval.
+    CHECK(intervalAt(wakes, 6 * HOUR) == CADENCE_MAX_SECS);
+    CHECK(intervalAt(wakes, 12 * HOUR) == CADENCE_MAX_SECS);
+
+    // The squall is caught at the first wake into it, and followed at the shortest cadence.
+    CHECK(intervalAt(wakes, 13 * HOUR) < CADENCE_MAX_SECS / 2);
+    CHECK(intervalAt(wakes, 13 * HOUR + HOUR / 2) == CADENCE_MIN_SECS);
+    CHECK(wakesBetween(wakes, 12 * HOUR, 15 * HOUR) > 3 * 60 / SLEEP_MINS);
+
+    // Clearing behind it, the cadence backs off again, through the barometer dropping out.
+    CHECK(intervalAt(wakes, 20 * HOUR) == CADENCE_MAX_SECS);
+    for (const Wake& w : wakes) {
+        if (w.at >= 18 * HOUR && w.at < 19 * HOUR + HOUR / 2) CHECK(w.interval >= intervalAt(wakes, 17 * HOUR));
+    }
+
+    // Fewer wakes in all than at the fixed cadence.
+    CHECK(wakes.size() < 24 * 60 / SLEEP_MINS);
+}
+
+/**
+ * A large, growing backlog lengthens the interval whatever the sky does; a large one
+ * which is not growing does not.
+ */
+static void backlog() {
+    const std::vector<Weather> series = readSeries();
+    if (series.empty()) return;
+    const std::vector<Wake> growing = replay(series, CADENCE_BACKLOG_BYTES + 1, 4096);
+    const std::vector<Wake> steady = replay(series, CADENCE_BACKLOG_BYTES + 1, 0);
+    const std::vector<Wake> none = replay(series);
+
+    CHECK(growing.size() < none.size());
+    CHECK(steady.size() == none.size());
+    CHECK(intervalAt(growing, 13 * HOUR + HOUR / 2) > CADENCE_MIN_SECS);
+    for (size_t i = 1; i < growing.size(); i++) {
+        const uint32_t backoff = growing[i - 1].interval + growing[i - 1].interval / 2;
+        CHECK(growing[i].interval >= (backoff < CADENCE_MAX_SECS ? backoff : CADENCE_MAX_SECS));
+    }
+}
+
+int main() {
+    squallDay();
+    backlog();
+    return checkExit();
+}
@@ -0,0 +1,61 @@
+/**
+ * The camera driver on the fake esp_camera: capture waits for auto exposure to settle, and
+ * gives up at its frame cap when it never does.
+ */
+#include "check.h"
+#include "../camera.h"
+
+/**
+ * Frames a capture pulled from the camera, and the capture itself.
+ */
+static uint32_t capture(CameraDriver* cam, ImageBuffer* img) {
+    const uint32_t before = HOST_HAL.counters.frames;
+    *img = cam -> capture();
+    return HOST_HAL.counters.frames - before;
+}
+
+/**
+ * Auto exposure closing in on its target settles well within the cap, and the frame it
+ * settled on is the one kept.
+ */
+static void settles() {
+    HOST_HAL.aeHunts = false;
+    CameraDriver cam;
+    CHECK(cam.init());
+
+    ImageBuffer img;
+    const uint32_t frames = capture(&cam, &img);
+    CHECK(img && img.size() > 0);
+    CHECK(cam.settleFrames > CAMERA_SETTLE_FRAMES && cam.settleFrames < CAMERA_SETTLE_MAX_FRAMES);
+    CHECK(frames == cam.settleFrames);
+    img = ImageBuffer();
+    CHECK(cam.teardown());
+}
+
+/**
+ * Auto exposure which never settles costs CAMERA_SETTLE_MAX_FRAMES frames, then the next is kept.
+ */
+static void hunts() {
+    ExposureSettle settle;
+    for (int i = 0; i < 4 * CAMERA_SETTLE_MAX_FRAMES; i++) CHECK(!settle.update(i % 2 ? 500 : 300, 16, 118));
+
+    HOST_HAL.aeHunts = true;
+    CameraDriver cam;
+    CHECK(cam.init());
+
+    ImageBuffer img;
+    const uint32_t frames = capture(&cam, &img);
+    CHECK(img && img.size() > 0);
+    CHECK(cam.settleFrames == CAMERA_SETTLE_MAX_FRAMES);
+    CHECK(frames == CAMERA_SETTLE_MAX_FRAMES + 1);
+    img = ImageBuffer();
+    CHECK(cam.teardown());
+    HOST_HAL.aeHunts = false;
+}
+
+int main() {
+    HOST_HAL.fixtures = HOST_FIXTURES;
+    settles();
+    hunts();
+    return checkExit();
+}
@@ -0,0 +1,155 @@
+/**
+ * The compressed domain crop on the sky fixtures: what is kept decodes to exactly the pixels
+ * it was cut from, what is blanked is black, and the crop is smaller than the frame.
+ */
+#include <string.h>
+#include "check.h"
+#include "fixture.h"
+#include "../roi.h"
+#include "../sky.h"
+
+/**
+ * Room for a crop: never more than the frame and its tables.
+ */
+#define CROP_SLACK 1024
+
+static ImageRoi rect(uint16_t left, uint16_t top, uint16_t right, uint16_t bottom, bool blank = false) {
+    ImageRoi roi;
+    roi.shape = ROI_RECT;
+    roi.left = left;
+    roi.top = top;
+    roi.right = right;
+    roi.bottom = bottom;
+    roi.blank = blank;
+    return roi;
+}
+
+static ImageRoi circle(bool blank) {
+    ImageRoi roi;
+    roi.shape = ROI_CIRCLE;
+    roi.blank = blank;
+    return roi;
+}
+
+static std::vector<uint8_t> crop(const std::vector<uint8_t>& jpg, const ImageRoi& roi) {
+    std::vector<uint8_t> out(jpg.size() + CROP_SLACK);
+    out.resize(jpegCrop(jpg.data(), jpg.size(), roi, out.data(), out.size()));
+    return out;
+}
+
+/**
+ * Whether a crop decodes to the pixels at (x, y) of the original.
+ */
+static bool samePixels(const RgbImage& frame, const RgbImage& cropped, uint16_t x, uint16_t y) {
+    for (uint16_t row = 0; row < cropped.height; row++) {
+        const uint8_t* a = frame.rgb.data() + ((size_t)(y + row) * frame.width + x) * 3;
+        const uint8_t* b = cropped.rgb.data() + (size_t)row * cropped.width * 3;
+        if (memcmp(a, b, (size_t)cropped.width * 3)) return false;
+    }
+    return true;
+}
+
+/**
+ * The whole frame, cropped, is the frame.
+ */
+static void wholeFrame() {
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        const std::vector<uint8_t> jpg = readFixture(FIXTURES[i]);
+        const std::vector<uint8_t> out = crop(jpg, rect(0, 0, 1000, 1000));
+        CHECK(!out.empty());
+        const RgbImage frame = decodeJpeg(jpg, false);
+        const RgbImage cropped = decodeJpeg(out, false);
+        CHECK(cropped.width == frame.width && cropped.height == frame.height);
+        CHECK(samePixels(frame, cropped, 0, 0));
+    }
+}
+
+/**
+ * A rectangle snaps outwards to whole 16 x 8 MCUs and keeps them bit for bit.
+ */
+static void rectangle() {
+    const ImageRoi roi = rect(260, 130, 740, 870);
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        const std::vector<uint8_t> jpg = readFixture(FIXTURES[i]);
+        const RgbImage frame = decodeJpeg(jpg, false);
+
+        // 1280 x 720: columns [332, 947) snap to [320, 960), rows [93, 626) to [88, 632).
+        uint16_t w, h;
+        CHECK(cropSize(jpg.data(), jpg.size(), roi, &w, &h));
+        CHECK(w == 640 && h == 544);
+
+        const std::vector<uint8_t> out = crop(jpg, roi);
+        const RgbImage cropped = decodeJpeg(out, false);
+        CHECK(cropped.width == w && cropped.height == h);
+        CHECK(samePixels(frame, cropped, 320, 88));
+        CHECK(out.size() < jpg.size() / 2);
+    }
+}
+
+/**
+ * The fisheye circle: its bounding MCUs are kept, and with blanking, the blocks outside
+ * the circle are black and cost next to nothing.
+ */
+static void fisheye() {
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        const std::vector<uint8_t> jpg = readFixture(FIXTURES[i]);
+        const RgbImage frame = decodeJpeg(jpg, false);
+        const SkyMask mask = SkyMask::forImage(frame.width, frame.height);
+        const uint16_t x0 = (mask.cx - mask.radius) / 16 * 16;
+        const uint16_t y0 = (mask.cy - mask.radius < 0 ? 0 : mask.cy - mask.radius) / 8 * 8;
+
+        const std::vector<uint8_t> kept = crop(jpg, circle(false));
+        const std::vector<uint8_t> blanked = crop(jpg, circle(true));
+        const RgbImage keptImg = decodeJpeg(kept, false);
+        const RgbImage blankImg = decodeJpeg(blanked, false);
+        CHECK(keptImg.width == blankImg.width && keptImg.height == blankImg.height);
+        CHECK(keptImg.width < frame.width);
+        CHECK(samePixels(frame, keptImg, x0, y0));
+
+        // The centre is untouched, the corners blank.
+        const size_t centre = ((size_t)(mask.cy - y0) * blankImg.width + (mask.cx - x0)) * 3;
+        CHECK(blankImg.rgb[centre] == keptImg.rgb[centre]);
+        const size_t corners[] = {0, (size_t)(blankImg.width - 1) * 3, (size_t)(blankImg.height - 1) * blankImg.width * 3,
+                                  blankImg.rgb.size() - 3};
+        for (size_t corner : corners) {
+            for (int c = 0; c < 3; c++) CHECK(blankImg.rgb[corner + c] <= 4);
+        }
+
+        CHECK(blanked.size() < kept.size());
+        CHECK(kept.size() < jpg.size());
+        printf("%s: %zu bytes, circle %zu, blanked %zu (%.0f%%)\n", FIXTURES[i], jpg.size(), kept.size(),
+               blanked.size(), 100.0 * blanked.size() / jpg.size());
+    }
+}
+
+static void failures() {
+    const std::vector<uint8_t> jpg = readFixture(FIXTURES[0]);
+    uint16_t w, h;
+    CHECK(!cropSize(jpg.data(), jpg.size(), rect(500, 0, 500, 1000), &w, &h));
+    CHECK(!cropSize(jpg.data(), 100, circle(true), &w, &h));
+
+    std::vector<uint8_t> out(jpg.size() / 4);
+    CHECK(jpegCrop(jpg.data(), jpg.size(), circle(false), out.data(), out.size()) == 0);
+    CHECK(jpegCrop(jpg.data(), jpg.size(), circle(false), nullptr, 0) == 0);
+}
+
+/**
+ * The crop a capture gets, into the image pool.
+ */
+static void captured() {
+    std::vector<uint8_t> jpg = readFixture(FIXTURES[1]);
+    const ImageBuffer img = ImageBuffer::mapped(jpg.data(), jpg.size());
+    const ImageBuffer cropped = cropImage(img);
+    CHECK((bool)cropped);
+    CHECK(cropped.size() < img.size());
+    CHECK(cropped.width() < 1280 && cropped.height() <= 720);
+}
+
+int main() {
+    wholeFrame();
+    rectangle();
+    fisheye();
+    failures();
+    captured();
+    return checkExit();
+}
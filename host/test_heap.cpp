@@ -0,0 +1,219 @@
+/**
+ * The heap tracker behind the global operator new and delete: what each profiler phase
+ * allocated and gave back, the bytes it took and its peak, and the time outside every phase.
+ * Then heapAlloc's size classes on small simulated heaps, down to both memories running out.
+ */
+#include <Arduino.h>
+#include "check.h"
+#include "../heap.h"
+#include "esp_heap_caps.h"
+
+#define OTHER PROFILE_PHASES
+
+/**
+ * Where allocations are kept, so the compiler can't drop a new and delete pair.
+ */
+static void* volatile sink;
+
+static char* make(size_t size) {
+    char* p = new char[size];
+    sink = p;
+    return p;
+}
+
+static size_t sizeOf(void* p) {
+    return heap_caps_get_allocated_size(p);
+}
+
+/**
+ * Allocations count to the innermost phase and frees to the phase they happen in, whoever
+ * made the block. Peaks are bytes live from boot, so a phase's peak takes in its outer phases' blocks.
+ */
+static void phases() {
+    HEAP.begin();
+    const uint32_t base = HEAP.live();
+
+    char* outside = make(100);
+    const size_t o = sizeOf(outside);
+    HEAP.enter(PROFILE_SAMPLE);
+    char* a = make(1000);
+    char* b = make(3000);
+    const size_t ab = sizeOf(a) + sizeOf(b);
+    delete[] outside;
+
+    HEAP.enter(PROFILE_SPOOL);
+    char* c = make(5000);
+    const size_t cs = sizeOf(c);
+    delete[] c;
+    HEAP.leave(PROFILE_SPOOL);
+
+    delete[] a;
+    HEAP.leave(PROFILE_SAMPLE);
+    delete[] b;
+
+    const HeapPhase& other = HEAP.phase(OTHER);
+    CHECK(other.allocs == 1 && other.frees == 1);
+    CHECK(other.bytes == o);
+
+    const HeapPhase& sample = HEAP.phase(PROFILE_SAMPLE);
+    CHECK(sample.allocs == 2 && sample.frees == 2);
+    CHECK(sample.bytes == ab);
+    CHECK(sample.peak == base + o + ab);
+
+    const HeapPhase& spool = HEAP.phase(PROFILE_SPOOL);
+    CHECK(spool.allocs == 1 && spool.frees == 1);
+    CHECK(spool.bytes == cs);
+    CHECK(spool.peak == base + ab + cs);
+
+    for (uint8_t p = 0; p < PROFILE_PHASES; p++) {
+        if (p == PROFILE_SAMPLE || p == PROFILE_SPOOL) continue;
+        CHECK(HEAP.phase(p).allocs == 0 && HEAP.phase(p).frees == 0);
+    }
+    CHECK(HEAP.live() == base);
+    CHECK(HEAP.peak() == spool.peak);
+}
+
+/**
+ * Sampled phases keep their smallest largest free block; phases which never ran say so.
+ */
+static void largest() {
+    HEAP.begin();
+    HEAP.enter(PROFILE_CAPTURE);
+    HEAP.leave(PROFILE_CAPTURE);
+    CHECK(HEAP.phase(PROFILE_CAPTURE).largest == heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    CHECK(HEAP.phase(PROFILE_QNH).largest == 0xFFFFFFFF);
+}
+
+/**
+ * A subsystem started on first use may be left under the phase that started it, and scopes past
+ * HEAP_DEPTH count to the last one followed. A new wake clears the counts, but not what is live.
+ */
+static void nesting() {
+    HEAP.begin();
+    HEAP.enter(PROFILE_UPLOAD);
+    HEAP.enter(PROFILE_WIFI);
+    HEAP.enter(PROFILE_ANALYSE);
+    HEAP.leave(PROFILE_WIFI);
+    delete[] make(10);
+    CHECK(HEAP.phase(PROFILE_ANALYSE).allocs == 1);
+    HEAP.leave(PROFILE_ANALYSE);
+    delete[] make(10);
+    CHECK(HEAP.phase(PROFILE_UPLOAD).allocs == 1);
+    CHECK(HEAP.phase(PROFILE_WIFI).allocs == 0);
+    HEAP.leave(PROFILE_UPLOAD);
+
+    for (int i = 0; i < HEAP_DEPTH - 1; i++) HEAP.enter(PROFILE_BACKLOG);
+    HEAP.enter(PROFILE_MOUNT);
+    HEAP.enter(PROFILE_CLOCK);
+    delete[] make(10);
+    HEAP.leave(PROFILE_CLOCK);
+    HEAP.leave(PROFILE_MOUNT);
+    CHECK(HEAP.phase(PROFILE_MOUNT).allocs == 1 && HEAP.phase(PROFILE_CLOCK).allocs == 0);
+    for (int i = 0; i < HEAP_DEPTH - 1; i++) HEAP.leave(PROFILE_BACKLOG);
+    delete[] make(10);
+    CHECK(HEAP.phase(OTHER).allocs == 1);
+
+    char* kept = make(2000);
+    const size_t k = sizeOf(kept);
+    const uint32_t live = HEAP.live();
+    HEAP.begin();
+    CHECK(HEAP.phase(OTHER).allocs == 0 && HEAP.phase(PROFILE_UPLOAD).allocs == 0);
+    CHECK(HEAP.live() == live && HEAP.peak() == live);
+    delete[] kept;
+    CHECK(HEAP.phase(OTHER).frees == 1);
+    CHECK(HEAP.live() == live - k);
+}
+
+/**
+ * Small and medium blocks go to internal RAM, large ones to PSRAM, and pinned ones stay internal
+ * whatever their size.
+ */
+static void routing() {
+    HEAP.begin();
+    const uint32_t base = HEAP.live();
+
+    void* small = heapAlloc(100);
+    void* medium = heapAlloc(1000);
+    void* large = heapAlloc(HEAP_LARGE_BYTES);
+    void* pinned = heapAlloc(8192, true);
+    CHECK(small && medium && large && pinned);
+    CHECK(!esp_ptr_external_ram(small) && !esp_ptr_external_ram(medium));
+    CHECK(esp_ptr_external_ram(large));
+    CHECK(!esp_ptr_external_ram(pinned));
+    CHECK(HEAP.live() == base + sizeOf(small) + sizeOf(medium) + sizeOf(large) + sizeOf(pinned));
+
+    CHECK(heapClass(HEAP_SMALL_BYTES - 1) == HEAP_SMALL && heapClass(HEAP_SMALL_BYTES) == HEAP_MEDIUM);
+    CHECK(heapClass(HEAP_LARGE_BYTES - 1) == HEAP_MEDIUM && heapClass(HEAP_LARGE_BYTES) == HEAP_LARGE);
+    for (uint8_t cls = 0; cls < HEAP_CLASSES; cls++) {
+        const HeapClassCount& c = HEAP.placement((HeapClass)cls);
+        CHECK(c.allocs == 1 && c.fallbacks == 0 && c.failures == 0);
+        CHECK(c.psram == (cls == HEAP_LARGE ? 1u : 0u));
+    }
+    CHECK(HEAP.placement(HEAP_LARGE).bytes == HEAP_LARGE_BYTES);
+
+    heapFree(small);
+    heapFree(medium);
+    heapFree(large);
+    heapFree(pinned);
+    heapFree(nullptr);
+    CHECK(HEAP.live() == base);
+}
+
+/**
+ * Large blocks fall back to internal RAM once PSRAM is full, and medium ones to PSRAM once
+ * internal RAM is. Small and pinned blocks never leave internal RAM: with it full they fail.
+ */
+static void fallback() {
+    HEAP.begin();
+    const uint32_t base = HEAP.live();
+    static void* held[4096];
+    size_t count = 0;
+
+    // Fill PSRAM; the first large block it has no room for goes to internal RAM.
+    void* p;
+    while ((p = heapAlloc(8192)) && esp_ptr_external_ram(p)) held[count++] = p;
+    CHECK(p != nullptr);
+    held[count++] = p;
+    const HeapClassCount& large = HEAP.placement(HEAP_LARGE);
+    CHECK(large.allocs == count && large.psram == count - 1 && large.fallbacks == 1);
+    CHECK(heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) < 8192);
+
+    // Fill internal RAM down to the smallest block, leaving some room in PSRAM.
+    for (size_t size : {8192, 256, 16}) {
+        while (count < 4096 && (p = heapAlloc(size, true))) held[count++] = p;
+    }
+    CHECK(HEAP.placement(HEAP_PINNED).failures == 3);
+    CHECK(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) < 16);
+    heapFree(held[0]);
+
+    CHECK(heapAlloc(100) == nullptr);
+    CHECK(HEAP.placement(HEAP_SMALL).failures == 1 && HEAP.placement(HEAP_SMALL).allocs == 0);
+    CHECK(heapAlloc(1000, true) == nullptr);
+
+    void* medium = heapAlloc(1000);
+    CHECK(medium && esp_ptr_external_ram(medium));
+    const HeapClassCount& m = HEAP.placement(HEAP_MEDIUM);
+    CHECK(m.allocs == 1 && m.psram == 1 && m.fallbacks == 1);
+
+    // Neither memory has room for a large block now.
+    CHECK(heapAlloc(64 * 1024) == nullptr);
+    CHECK(HEAP.placement(HEAP_LARGE).failures == 1);
+
+    heapFree(medium);
+    for (size_t i = 1; i < count; i++) heapFree(held[i]);
+    CHECK(HEAP.live() == base);
+    CHECK(heap_caps_get_free_size(MALLOC_CAP_SPIRAM) == heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+}
+
+int main() {
+    // Heaps small enough to fill, set before anything maps them.
+    HOST_HAL.internalHeap = 64 * 1024;
+    HOST_HAL.psram = 64 * 1024;
+
+    phases();
+    largest();
+    nesting();
+    routing();
+    fallback();
+    return checkExit();
+}
@@ -0,0 +1,242 @@
+/**
+ * The I2C transaction queue on a simulated bus: inline and batched jobs, the order they run in,
+ * a NACK partway through a batch, and sensor threads sharing a worker like the station's tasks do.
+ */
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "../i2c_queue.h"
+
+/**
+ * One transaction as the simulated bus saw it.
+ */
+struct SimTransfer {
+    uint8_t addr;
+    I2COp op;
+    size_t txLen;
+    size_t rxLen;
+};
+
+/**
+ * Bus which records every transaction and NACKs the one at nackAt.
+ * Reads return a running byte count, so each read can be told apart.
+ */
+struct SimBus {
+    std::vector<SimTransfer>* log = nullptr;
+    int64_t nackAt = -1;
+    uint8_t next = 0;
+
+    bool record(uint8_t addr, I2COp op, size_t txLen, uint8_t* rx, size_t rxLen) {
+        const bool ok = (int64_t)log -> size() != nackAt;
+        log -> push_back({addr, op, txLen, rxLen});
+        for (size_t i = 0; ok && i < rxLen; i++) rx[i] = next++;
+        return ok;
+    }
+
+    bool write(uint8_t addr, const uint8_t* data, size_t len) {
+        (void)data;
+        return record(addr, I2C_OP_WRITE, len, nullptr, 0);
+    }
+
+    bool read(uint8_t addr, uint8_t* data, size_t len) {
+        return record(addr, I2C_OP_READ, 0, data, len);
+    }
+
+    bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+        (void)tx;
+        return record(addr, I2C_OP_WRITE_READ, txLen, rx, rxLen);
+    }
+
+    bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count) {
+        return i2cSequence(*this, addr, transfers, count);
+    }
+
+    void wait(uint32_t ms) {
+        (void)ms;
+    }
+};
+
+typedef I2CQueue<SimBus, 8> Queue;
+
+/**
+ * With no hooks, waiting on a job runs the queue inline.
+ */
+static void inlineJobs() {
+    std::vector<SimTransfer> log;
+    Queue queue(SimBus{&log});
+    QueuedBus<Queue> bus(&queue);
+
+    const uint8_t reg = 0x10;
+    uint8_t rx[3] = {};
+    CHECK(bus.write(0x40, &reg, 1));
+    CHECK(bus.writeRead(0x40, &reg, 1, rx, 3));
+    CHECK(rx[0] == 0 && rx[2] == 2);
+    CHECK(log.size() == 2 && log[1].op == I2C_OP_WRITE_READ && log[1].rxLen == 3);
+    CHECK(queue.completed == 2 && queue.failed == 0 && queue.pending() == 0);
+}
+
+static void record(I2CJob* job, bool ok, void* ctx) {
+    (void)ok;
+    ((std::vector<uint8_t>*)ctx) -> push_back(job -> addr);
+}
+
+/**
+ * Jobs run in the order they were queued, and a batch goes in whole or not at all.
+ */
+static void ordering() {
+    std::vector<SimTransfer> log;
+    Queue queue(SimBus{&log});
+    std::vector<uint8_t> order;
+
+    I2CJob jobs[8];
+    uint8_t byte = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        jobs[i].write(0x20 + i, &byte, 1);
+        jobs[i].onDone = record;
+        jobs[i].ctx = &order;
+    }
+    I2CJob* first[2] = {&jobs[0], &jobs[1]};
+    I2CJob* second[3] = {&jobs[2], &jobs[3], &jobs[4]};
+    I2CJob* third[3] = {&jobs[5], &jobs[6], &jobs[7]};
+    CHECK(queue.submitBatch(first, 2));
+    CHECK(queue.submitBatch(second, 3));
+    CHECK(!queue.submitBatch(third, 4));
+    CHECK(queue.pending() == 5);
+    CHECK(queue.submitBatch(third, 3));
+    CHECK(!queue.submit(&jobs[0]));
+
+    CHECK(queue.service(3) == 3);
+    CHECK(queue.service() == 5);
+    CHECK(order.size() == 8);
+    for (uint8_t i = 0; i < order.size(); i++) CHECK(order[i] == 0x20 + i);
+    for (I2CJob& job : jobs) CHECK(job.ok());
+}
+
+/**
+ * A NACK partway through a batch fails it, and the rest of the batch is not put on the bus.
+ * The next batch runs as usual.
+ */
+static void nackInBatch() {
+    std::vector<SimTransfer> log;
+    Queue queue(SimBus{&log});
+    QueuedBus<Queue> bus(&queue);
+
+    const uint8_t reg = 0x14;
+    uint8_t rx[4][8];
+    const I2CTransfer transfers[4] = {
+        {&reg, 1, rx[0], 8}, {&reg, 1, rx[1], 8}, {&reg, 1, rx[2], 8}, {&reg, 1, rx[3], 8}
+    };
+    queue.bus.nackAt = 1;
+    CHECK(!bus.sequence(0x77, transfers, 4));
+    CHECK(log.size() == 2);
+    CHECK(queue.completed == 1 && queue.failed == 3);
+
+    CHECK(bus.sequence(0x77, transfers, 4));
+    CHECK(log.size() == 6);
+    CHECK(queue.completed == 5);
+
+    // A batch is one submitter's: a NACK in it does not fail the next one.
+    queue.bus.nackAt = 6;
+    I2CJob a, b, c;
+    a.read(0x44, rx[0], 1);
+    b.read(0x44, rx[1], 1);
+    c.read(0x45, rx[2], 1);
+    I2CJob* batch[2] = {&a, &b};
+    CHECK(queue.submitBatch(batch, 2));
+    CHECK(queue.submit(&c));
+    queue.service();
+    CHECK(!a.ok() && !b.ok() && c.ok());
+    CHECK(log.size() == 8);
+}
+
+/**
+ * Platform glue for threads, shaped like the station's task notifications: every thread
+ * has a notification count it parks on, and the worker is kicked through its own.
+ */
+struct Notify {
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned count = 0;
+
+    void give() {
+        std::lock_guard<std::mutex> lock(mutex);
+        count++;
+        cv.notify_one();
+    }
+
+    void take() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, std::chrono::milliseconds(10), [this] { return count > 0; });
+        count = 0;
+    }
+};
+
+static thread_local Notify self;
+static Notify kick;
+
+/**
+ * Sensor threads run sequences through one worker: each runs back to back, and every
+ * thread gets its own bytes back. The station's queue depth takes every thread's batch at once.
+ */
+static void threads() {
+    typedef I2CQueue<SimBus> StationQueue;
+    std::vector<SimTransfer> log;
+    StationQueue queue(SimBus{&log});
+
+    StationQueue::Hooks hooks;
+    hooks.kick = [](void*) { kick.give(); };
+    hooks.self = [](void*) -> void* { return &self; };
+    hooks.wake = [](void* waiter, void*) { ((Notify*)waiter) -> give(); };
+    hooks.park = [](void*) { self.take(); };
+    hooks.yield = [](void*) { std::this_thread::yield(); };
+    queue.setHooks(hooks);
+
+    std::atomic<bool> stop{false};
+    std::thread worker([&] {
+        while (!stop.load()) {
+            kick.take();
+            while (queue.service() > 0) {}
+        }
+    });
+
+    const int THREADS = 4;
+    const int ROUNDS = 200;
+    std::atomic<int> failures{0};
+    std::vector<std::thread> sensors;
+    for (int t = 0; t < THREADS; t++) {
+        sensors.emplace_back([&, t] {
+            QueuedBus<StationQueue> bus(&queue);
+            const uint8_t reg = 0x14;
+            for (int r = 0; r < ROUNDS; r++) {
+                uint8_t rx[3][2];
+                const I2CTransfer transfers[3] = {{&reg, 1, rx[0], 2}, {&reg, 1, rx[1], 2}, {&reg, 1, rx[2], 2}};
+                // The worker hands out consecutive bytes, so a batch run back to back reads a run.
+                if (!bus.sequence(0x30 + t, transfers, 3)) failures++;
+                for (int i = 1; i < 6; i++) {
+                    if ((uint8_t)(rx[i / 2][i % 2] - rx[0][0]) != i) failures++;
+                }
+            }
+        });
+    }
+    for (std::thread& s : sensors) s.join();
+    stop.store(true);
+    kick.give();
+    worker.join();
+
+    CHECK(failures.load() == 0);
+    CHECK(log.size() == (size_t)(THREADS * ROUNDS * 3));
+    for (size_t i = 0; i + 2 < log.size(); i += 3) {
+        CHECK(log[i].addr == log[i + 1].addr && log[i].addr == log[i + 2].addr);
+    }
+    CHECK(queue.completed == log.size() && queue.failed == 0);
+}
+
+int main() {
+    inlineJobs();
+    ordering();
+    nackInBatch();
+    threads();
+    return checkExit();
+}
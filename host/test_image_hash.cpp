@@ -0,0 +1,133 @@
+/**
+ * The duplicate image filter on sequences of sky images: re-encoded, re-exposed and noisy
+ * frames of one sky are duplicates, other skies are not, and slow change is still caught.
+ */
+#include <random>
+#include "check.h"
+#include "fixture.h"
+#include "../image_hash.h"
+
+static uint64_t hashOf(const std::vector<uint8_t>& jpg) {
+    uint64_t hash = 0;
+    CHECK(imageHash(jpg.data(), jpg.size(), &hash));
+    return hash;
+}
+
+/**
+ * The same sky, as another exposure of it would come out: brighter, noisier, a little shifted.
+ */
+static RgbImage jitter(const RgbImage& img, int brightness, int noise, uint16_t shift, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> n(-noise, noise);
+    RgbImage out = img;
+    for (uint16_t y = 0; y < img.height; y++) {
+        for (uint16_t x = 0; x < img.width; x++) {
+            const uint16_t from = x < shift ? 0 : x - shift;
+            for (int c = 0; c < 3; c++) {
+                const int v = img.rgb[((size_t)y * img.width + from) * 3 + c] + brightness + n(rng);
+                out.rgb[((size_t)y * img.width + x) * 3 + c] = v < 0 ? 0 : v > 255 ? 255 : v;
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * An image part way from one sky to another.
+ */
+static RgbImage blend(const RgbImage& a, const RgbImage& b, int tenths) {
+    RgbImage out = a;
+    for (size_t i = 0; i < a.rgb.size(); i++) out.rgb[i] = (a.rgb[i] * (10 - tenths) + b.rgb[i] * tenths) / 10;
+    return out;
+}
+
+static void skiesDiffer() {
+    uint64_t hashes[FIXTURE_COUNT];
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) hashes[i] = hashOf(readFixture(FIXTURES[i]));
+    for (size_t a = 0; a < FIXTURE_COUNT; a++) {
+        CHECK(hashDistance(hashes[a], hashes[a]) == 0);
+        for (size_t b = a + 1; b < FIXTURE_COUNT; b++) CHECK(hashDistance(hashes[a], hashes[b]) > IMAGE_HASH_DUPLICATE);
+    }
+}
+
+static void sameSkyIsDuplicate() {
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        const std::vector<uint8_t> jpg = readFixture(FIXTURES[i]);
+        const uint64_t hash = hashOf(jpg);
+        const RgbImage img = decodeJpeg(jpg);
+        CHECK(hashDistance(hash, hashOf(encodeJpeg(img, 60))) <= IMAGE_HASH_DUPLICATE);
+        CHECK(hashDistance(hash, hashOf(encodeJpeg(img, 95))) <= IMAGE_HASH_DUPLICATE);
+        CHECK(hashDistance(hash, hashOf(encodeJpeg(jitter(img, 5, 0, 0, i), 80))) <= IMAGE_HASH_DUPLICATE);
+        CHECK(hashDistance(hash, hashOf(encodeJpeg(jitter(img, 0, 4, 0, i), 80))) <= IMAGE_HASH_DUPLICATE);
+        CHECK(hashDistance(hash, hashOf(encodeJpeg(jitter(img, 0, 0, 4, i), 80))) <= IMAGE_HASH_DUPLICATE);
+    }
+}
+
+static void corruptRejected() {
+    std::vector<uint8_t> jpg = readFixture(FIXTURES[0]);
+    uint64_t hash;
+    CHECK(!imageHash(jpg.data(), 200, &hash));
+    jpg[0] = 0;
+    CHECK(!imageHash(jpg.data(), jpg.size(), &hash));
+}
+
+/**
+ * A steady overcast morning: one frame in IMAGE_HASH_MAX_SKIPS + 1 is kept, and every skipped byte counted.
+ */
+static void steadySky() {
+    const RgbImage sky = decodeJpeg(readFixture(FIXTURES[3]));
+    ImageDedup dedup;
+    size_t kept = 0, skippedBytes = 0;
+    for (uint32_t frame = 0; frame < 12; frame++) {
+        const std::vector<uint8_t> jpg = encodeJpeg(jitter(sky, frame % 3, 3, 0, frame), 80);
+        if (keepImage(&dedup, hashOf(jpg), jpg.size())) {
+            CHECK(frame % (IMAGE_HASH_MAX_SKIPS + 1) == 0);
+            kept++;
+        } else {
+            skippedBytes += jpg.size();
+        }
+    }
+    CHECK(kept == 2);
+    CHECK(dedup.skippedBytes == skippedBytes);
+}
+
+/**
+ * Cloud building up slowly: no single step is a change, but the drift from the last kept frame is.
+ */
+static void cloudBuilding() {
+    const RgbImage from = decodeJpeg(readFixture(FIXTURES[1]));
+    const RgbImage to = decodeJpeg(readFixture(FIXTURES[3]));
+    ImageDedup dedup;
+    size_t kept = 0;
+    uint64_t hash = 0;
+    for (int tenths = 0; tenths <= 10; tenths++) {
+        const std::vector<uint8_t> jpg = encodeJpeg(blend(from, to, tenths), 80);
+        hash = hashOf(jpg);
+        if (keepImage(&dedup, hash, jpg.size())) kept++;
+        // Never more than a duplicate's distance from what the server last got.
+        CHECK(hashDistance(dedup.reference, hash) <= IMAGE_HASH_DUPLICATE);
+    }
+    CHECK(kept >= 2 && kept < 11);
+}
+
+/**
+ * Skies which keep changing are all kept.
+ */
+static void changingSky() {
+    ImageDedup dedup;
+    for (int frame = 0; frame < 8; frame++) {
+        const std::vector<uint8_t> jpg = readFixture(FIXTURES[frame % 2 ? 3 : 0]);
+        CHECK(keepImage(&dedup, hashOf(jpg), jpg.size()));
+    }
+    CHECK(dedup.skippedBytes == 0);
+}
+
+int main() {
+    skiesDiffer();
+    sameSkyIsDuplicate();
+    corruptRejected();
+    steadySky();
+    cloudBuilding();
+    changingSky();
+    return checkExit();
+}
@@ -0,0 +1,144 @@
+/**
+ * The sensor suite on the mock drivers: readings, retries, sensors going down, and the camera.
+ */
+#include "check.h"
+#include "mock_drivers.h"
+
+/**
+ * A suite with the given barometer behaviour and well behaved other sensors.
+ */
+static MockSensors suite(MockBehaviour baro, MockBehaviour hygro = {}) {
+    return MockSensors(MockBarometer(baro), MockHygrometer(hygro), MockCamera());
+}
+
+static void healthy() {
+    MockSensors sensors = suite({});
+    CHECK(sensors.begin());
+    CHECK(sensors.status.BMP && sensors.status.SHT && sensors.status.CAM);
+
+    Reading reading;
+    sensors.read(&reading, 1013.25);
+    CHECK_NEAR(reading.pressure, 101325.0, 1.0);
+    CHECK_NEAR(reading.humidity, 55.0, 0.1);
+    // The hygrometer temperature wins over the barometer's.
+    CHECK_NEAR(reading.temperature, 20.0, 0.02);
+    CHECK(reading.altitude != UNDEFINED && reading.dewpoint != UNDEFINED);
+    CHECK(sensors.baro.health() == SENSOR_OK);
+}
+
+/**
+ * Outliers are removed before averaging, and the same seed gives the same reading.
+ */
+static void outliersAndDeterminism() {
+    MockSensors a = suite({});
+    MockSensors b = suite({});
+    a.baro.pressure = b.baro.pressure = {101325.0, 2.0, 0.05, 500.0};
+    a.begin();
+    b.begin();
+
+    Reading ra, rb;
+    a.read(&ra, 1013.25);
+    b.read(&rb, 1013.25);
+    CHECK_NEAR(ra.pressure, 101325.0, 2.0);
+    CHECK(ra.pressure == rb.pressure && ra.humidity == rb.humidity);
+}
+
+/**
+ * Occasional dropouts are retried within the sample, and the sensor stays up.
+ */
+static void dropoutsRetried() {
+    MockBehaviour flaky;
+    flaky.dropout = 0.1;
+    MockSensors sensors = suite(flaky);
+    sensors.begin();
+
+    bool degraded = false;
+    for (int wake = 0; wake < 100; wake++) {
+        Reading reading;
+        sensors.read(&reading, 1013.25);
+        CHECK(reading.pressure != UNDEFINED);
+        degraded |= sensors.baro.health() == SENSOR_DEGRADED;
+    }
+    CHECK(sensors.baro.dropped > 0);
+    CHECK(degraded);
+    CHECK(sensors.status.BMP);
+}
+
+/**
+ * A sensor failing every try goes down within the one sample a wake takes.
+ */
+static void deadSensorGoesDown() {
+    MockBehaviour dead;
+    dead.dropout = 1.0;
+    MockSensors sensors = suite(dead);
+    CHECK(sensors.begin());
+    CHECK(sensors.status.BMP);
+
+    Reading reading;
+    sensors.read(&reading, 1013.25);
+    CHECK(sensors.baro.health() == SENSOR_DOWN);
+    CHECK(!sensors.status.BMP);
+    CHECK(sensors.baro.dropped == SENSOR_MAX_FAILURES);
+    CHECK(reading.pressure == UNDEFINED);
+    CHECK(reading.altitude == UNDEFINED && reading.dewpoint == UNDEFINED);
+    // The hygrometer still reads.
+    CHECK_NEAR(reading.humidity, 55.0, 0.1);
+
+    // Down sensors are not sampled again until they are initialized.
+    sensors.read(&reading, 1013.25);
+    CHECK(sensors.baro.dropped == SENSOR_MAX_FAILURES);
+    CHECK(sensors.baro.init());
+    CHECK(sensors.baro.health() == SENSOR_OK);
+}
+
+/**
+ * Without the hygrometer, the barometer's temperature is used.
+ */
+static void hygrometerMissing() {
+    MockBehaviour missing;
+    missing.failInit = true;
+    MockSensors sensors = suite({}, missing);
+    sensors.baro.temperature = {21.5, 0.0};
+    CHECK(sensors.begin());
+    CHECK(sensors.status.BMP && !sensors.status.SHT);
+
+    Reading reading;
+    sensors.read(&reading, 1013.25);
+    CHECK_NEAR(reading.temperature, 21.5, 1e-9);
+    CHECK(reading.humidity == UNDEFINED && reading.dewpoint == UNDEFINED);
+}
+
+static bool countFrame(void* ctx, uint8_t index, const ImageBuffer& frame, uint32_t exposure) {
+    (void)exposure;
+    CHECK(frame.size() == 4);
+    *(uint8_t*)ctx = index + 1;
+    return true;
+}
+
+static void camera() {
+    uint8_t jpg[4] = {0xFF, 0xD8, 0xFF, 0xD9};
+    MockSensors sensors = suite({});
+    sensors.cam.setImage(jpg, sizeof(jpg), 640, 480);
+    sensors.cam.bracketFrames = 3;
+    sensors.begin();
+
+    ImageBuffer img = sensors.read_cam();
+    CHECK(img && img.data() == jpg && img.width() == 640);
+    uint8_t frames = 0;
+    CHECK(sensors.read_bracket(countFrame, &frames) == 3);
+    CHECK(frames == 3);
+
+    sensors.cameraTeardown();
+    CHECK(!sensors.status.CAM);
+    CHECK(!sensors.read_cam());
+}
+
+int main() {
+    healthy();
+    outliersAndDeterminism();
+    dropoutsRetried();
+    deadSensorGoesDown();
+    hygrometerMissing();
+    camera();
+    return checkExit();
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the station server and the METAR API, for the host build (host/CMakeLists.txt).
+The host HTTPClient sends every request here, whatever host its URL names.
+
+Answers the index, the /api routes and /metar, taking JPEG uploads, and logs each request as an
+access log line on stderr, which profile_histogram.py reads as it is.
+
+    python3 host/test_server.py --port 8080 2> access.log
+"""
+
+import argparse
+import json
+import random
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlparse
+
+
+class Station(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    latency = 0.0
+    qnh = 1013.25
+    fail_rate = 0.0
+
+    def reply(self, code, body, kind="text/plain"):
+        time.sleep(self.latency)
+        data = body.encode()
+        self.send_response(code)
+        self.send_header("Content-Type", kind)
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(data)
+
+    def refused(self, path):
+        """Whether to turn an upload away, as an overloaded server would."""
+        return path in ("/api/reading", "/api/images") and random.random() < self.fail_rate
+
+    def do_GET(self):
+        path = urlparse(self.path).path
+        if self.refused(path):
+            self.reply(503, "Busy")
+        elif path == "/metar":
+            self.reply(200, json.dumps({"metar": {"qnh": self.qnh}}), "application/json")
+        elif path == "/" or path.startswith("/api/"):
+            self.reply(200, "OK")
+        else:
+            self.reply(404, "Not found")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        if self.refused(urlparse(self.path).path):
+            self.reply(503, "Busy")
+        elif urlparse(self.path).path == "/api/images" and body[:2] != b"\xff\xd8":
+            self.reply(400, "Not a JPEG")
+        else:
+            self.reply(200, "OK")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--latency", type=float, default=0.0, help="seconds to wait before each reply")
+    parser.add_argument("--qnh", type=float, default=1013.25, help="QNH the METAR API reports, in hPa")
+    parser.add_argument("--fail-rate", type=float, default=0.0, help="fraction of readings and images answered 503")
+    args = parser.parse_args()
+
+    Station.latency = args.latency
+    Station.qnh = args.qnh
+    Station.fail_rate = args.fail_rate
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Station)
+    print("Serving on 127.0.0.1:%d" % args.port, file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
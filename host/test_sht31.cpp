@@ -0,0 +1,121 @@
+/**
+ * The SHT31 command driver on the command level fake: CRCs, fetches before a measurement
+ * is ready, periodic mode, and coming up on a sensor left in it.
+ */
+#include "check.h"
+#include "fake_sht31.h"
+
+typedef SHT31<FakeSHT31::Port> Driver;
+
+/**
+ * The datasheet's CRC example, and frames with a broken word or checksum refused.
+ */
+static void crc() {
+    const uint8_t example[2] = {0xBE, 0xEF};
+    CHECK(Driver::crc8(example, 2) == 0x92);
+
+    uint8_t frame[SHT31_FRAME_LEN] = {0x66, 0x66, 0, 0x8C, 0xCC, 0};
+    frame[2] = Driver::crc8(frame, 2);
+    frame[5] = Driver::crc8(frame + 3, 2);
+    SHT31Sample sample;
+    CHECK(Driver::parseFrame(frame, &sample));
+    CHECK_NEAR(sample.temperature, 25.0, 0.01);
+    CHECK_NEAR(sample.humidity, 55.0, 0.01);
+
+    for (size_t i = 0; i < SHT31_FRAME_LEN; i++) {
+        uint8_t broken[SHT31_FRAME_LEN];
+        for (size_t j = 0; j < SHT31_FRAME_LEN; j++) broken[j] = frame[j];
+        broken[i] ^= 0x01;
+        CHECK(!Driver::parseFrame(broken, &sample));
+    }
+
+    FakeSHT31 fake;
+    fake.corruptEvery = 2;
+    Driver sht(fake.port());
+    CHECK(sht.begin());
+    CHECK(sht.startPeriodic(SHT31_MPS_10));
+    fake.advance(sht.samplePeriodMs());
+    CHECK(sht.fetch(&sample) == 1);
+    fake.advance(sht.samplePeriodMs());
+    CHECK(sht.fetch(&sample) == -1);
+}
+
+/**
+ * The sensor NACKs a fetch with no new measurement, which is "not yet", not an error.
+ */
+static void notReady() {
+    FakeSHT31 fake;
+    Driver sht(fake.port());
+    CHECK(sht.begin());
+    CHECK(sht.startPeriodic(SHT31_MPS_10));
+
+    SHT31Sample sample;
+    CHECK(sht.fetch(&sample) == 0);
+    fake.advance(sht.samplePeriodMs() / 2);
+    CHECK(sht.fetch(&sample) == 0);
+    fake.advance(sht.samplePeriodMs() / 2);
+    CHECK(sht.fetch(&sample) == 1);
+
+    // Each measurement is fetched once.
+    CHECK(sht.fetch(&sample) == 0);
+}
+
+/**
+ * In periodic mode a fetch returns the latest measurement, whatever was missed before it.
+ */
+static void periodic() {
+    FakeSHT31 fake;
+    fake.noise = 0;
+    Driver sht(fake.port());
+    CHECK(sht.begin());
+    CHECK(sht.startPeriodic(SHT31_MPS_2));
+    CHECK(sht.samplePeriodMs() == 500);
+
+    SHT31Sample sample;
+    fake.temperature = 10.0;
+    fake.humidity = 40.0;
+    fake.advance(500);
+    fake.temperature = 30.0;
+    fake.humidity = 70.0;
+    fake.advance(1000);
+    CHECK(fake.conversions == 3);
+    CHECK(sht.fetch(&sample) == 1);
+    CHECK_NEAR(sample.temperature, 30.0, 0.01);
+    CHECK_NEAR(sample.humidity, 70.0, 0.01);
+
+    fake.temperature = -20.0;
+    fake.advance(500);
+    CHECK(sht.fetch(&sample) == 1);
+    CHECK_NEAR(sample.temperature, -20.0, 0.01);
+
+    CHECK(sht.stop());
+    fake.advance(1000);
+    CHECK(sht.fetch(&sample) == 0);
+}
+
+/**
+ * A sensor left in periodic mode only takes a break, and then nothing for a millisecond.
+ * begin() sends the break and waits that out on the bus.
+ */
+static void leftPeriodic() {
+    FakeSHT31 fake;
+    Driver sht(fake.port());
+    CHECK(sht.begin());
+    CHECK(sht.startPeriodic(SHT31_MPS_1));
+    CHECK(!sht.startART());
+
+    Driver again(fake.port());
+    CHECK(again.begin());
+    CHECK(again.startPeriodic(SHT31_MPS_10));
+    fake.advance(again.samplePeriodMs());
+    SHT31Sample sample;
+    CHECK(again.fetch(&sample) == 1);
+}
+
+int main() {
+    crc();
+    notReady();
+    periodic();
+    leftPeriodic();
+    return checkExit();
+}
@@ -0,0 +1,258 @@
+/**
+ * The solar schedule at polar, mid and equatorial latitudes, at both solstices of 2026:
+ * elevations and band changes against the textbook hour angle formula, and a day of
+ * wakes planned one after the other.
+ */
+#include <math.h>
+#include "check.h"
+#include "../solar.h"
+
+#define DEG (M_PI / 180.0)
+
+/**
+ * Declination and equation of time, in minutes, on the day of each solstice.
+ */
+#define JUNE_DECLINATION 23.44
+#define JUNE_EQ_TIME -1.7
+#define DECEMBER_DECLINATION -23.44
+#define DECEMBER_EQ_TIME 1.7
+
+struct Place {
+    const char* name;
+    double latitude;
+    double longitude;
+};
+
+static const Place LONGYEARBYEN = {"Longyearbyen", 78.22, 15.65};
+static const Place STATION = {"station", STATION_LATITUDE, STATION_LONGITUDE};
+static const Place QUITO = {"Quito", -0.18, -78.47};
+static const Place HOBART = {"Hobart", -42.88, 147.33};
+
+static time_t utc(int year, int month, int day, int hour = 0, int minute = 0) {
+    struct tm tm = {};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    return timegm(&tm);
+}
+
+static const time_t JUNE = utc(2026, 6, 21);
+static const time_t DECEMBER = utc(2026, 12, 21);
+
+/**
+ * Solar noon on a day, as the longitude and equation of time put it.
+ */
+static time_t solarNoon(time_t day, const Place& at, double eqTime) {
+    return day + (time_t)((720.0 - 4.0 * at.longitude - eqTime) * 60.0);
+}
+
+/**
+ * Seconds either side of solar noon the sun is above an elevation, from the hour angle formula.
+ * @return -1 if it never gets there, 86400 if it never leaves.
+ */
+static double halfArc(const Place& at, double declination, double elevation) {
+    const double lat = at.latitude * DEG, dec = declination * DEG;
+    const double c = (sin(elevation * DEG) - sin(lat) * sin(dec)) / (cos(lat) * cos(dec));
+    if (c > 1) return -1;
+    if (c < -1) return 86400;
+    return acos(c) / DEG * 240.0;
+}
+
+/**
+ * The highest sun is 90 degrees less the angle between latitude and declination, at solar noon.
+ */
+static void noonElevation(const Place& at) {
+    CHECK_NEAR(solarElevation(solarNoon(JUNE, at, JUNE_EQ_TIME), at.latitude, at.longitude),
+               90.0 - fabs(at.latitude - JUNE_DECLINATION), 0.05);
+    CHECK_NEAR(solarElevation(solarNoon(DECEMBER, at, DECEMBER_EQ_TIME), at.latitude, at.longitude),
+               90.0 - fabs(at.latitude - DECEMBER_DECLINATION), 0.05);
+}
+
+/**
+ * Every band change through a day comes where the hour angle formula puts it, to within
+ * a couple of minutes, and lands on the boundary it crosses.
+ */
+static void bandChanges(const Place& at, time_t day, double declination, double eqTime) {
+    const time_t noon = solarNoon(day, at, eqTime);
+    const double boundaries[] = {SOLAR_NIGHT_ELEVATION, SOLAR_DAY_ELEVATION};
+
+    for (double boundary : boundaries) {
+        const double arc = halfArc(at, declination, boundary);
+        if (arc < 0 || arc >= 86400) {
+            // Above or below the boundary all day: no change anywhere near it.
+            const time_t change = nextPhaseChange(noon - 43200, at.latitude, at.longitude, 86400);
+            const double elevation = change ? solarElevation(change, at.latitude, at.longitude) : 0;
+            CHECK(!change || fabs(elevation - boundary) > 1.0);
+            continue;
+        }
+
+        // Rising: search from before, closer than the other boundary at the equator, and land
+        // within the precision after the crossing.
+        const time_t rise = noon - (time_t)arc;
+        const time_t up = nextPhaseChange(rise - 1200, at.latitude, at.longitude, 2400);
+        CHECK(up != 0);
+        CHECK_NEAR((double)(up - rise), 0.0, 120.0);
+        CHECK(solarElevation(up, at.latitude, at.longitude) >= boundary);
+        CHECK(solarElevation(up - SCHEDULE_SEARCH_PRECISION, at.latitude, at.longitude) < boundary);
+
+        // Setting, the same way.
+        const time_t set = noon + (time_t)arc;
+        const time_t down = nextPhaseChange(set - 1200, at.latitude, at.longitude, 2400);
+        CHECK(down != 0);
+        CHECK_NEAR((double)(down - set), 0.0, 120.0);
+        CHECK(solarElevation(down, at.latitude, at.longitude) < boundary);
+    }
+}
+
+/**
+ * Wakes planned in each band, indexed by SolarPhase.
+ */
+struct WakeCounts {
+    uint32_t phases[4];
+};
+
+/**
+ * Seconds a day the sun spends above an elevation, near a solstice.
+ */
+static double above(const Place& at, double declination, double elevation) {
+    const double arc = halfArc(at, declination, elevation);
+    return arc < 0 ? 0 : arc >= 86400 ? 86400 : 2 * arc;
+}
+
+/**
+ * Plan wake after wake through two days, as the station would. No wake sleeps through a band
+ * change, and the wakes in each band are about what the time spent in it at its cadence comes to.
+ */
+static WakeCounts replay(const Place& at, time_t start, double declination) {
+    WakeCounts counts = {};
+    const uint32_t cadence = SCHEDULE_DAY_MINS * 60;
+    for (time_t now = start; now < start + 2 * 86400;) {
+        const WakePlan plan = planWake(now, cadence, at.latitude, at.longitude);
+        CHECK(plan.phase == solarPhase(solarElevation(now, at.latitude, at.longitude)));
+        CHECK(plan.sleepSecs >= SCHEDULE_SEARCH_PRECISION);
+        if (plan.phase == SOLAR_DAY) CHECK(plan.sleepSecs <= cadence);
+        if (plan.phase == SOLAR_TWILIGHT) CHECK(plan.sleepSecs <= SCHEDULE_TWILIGHT_MINS * 60);
+        CHECK(plan.sleepSecs <= SCHEDULE_MAX_SLEEP_MINS * 60);
+        counts.phases[plan.phase]++;
+
+        // The band holds, bar the last few seconds, until the wake.
+        for (time_t t = now + 60; t < now + (time_t)plan.sleepSecs - SCHEDULE_SEARCH_PRECISION; t += 60) {
+            if (solarPhase(solarElevation(t, at.latitude, at.longitude)) != plan.phase) {
+                fprintf(stderr, "%s: slept through a band change at %ld\n", at.name, (long)t);
+                CHECK(false);
+                break;
+            }
+        }
+        now += plan.sleepSecs;
+    }
+
+    // Sleeps longer than the twilight cadence are cut short for drift, and each band change
+    // costs a wake or two more than the cadence alone.
+    const double day = 2 * above(at, declination, SOLAR_DAY_ELEVATION);
+    const double twilight = 2 * above(at, declination, SOLAR_NIGHT_ELEVATION) - day;
+    const double night = 2 * 86400 - day - twilight;
+    const double drift = (1000 - SCHEDULE_DRIFT_PERMILLE) / 1000.0;
+    CHECK_NEAR((double)counts.phases[SOLAR_DAY], day / (cadence * drift), 6);
+    CHECK_NEAR((double)counts.phases[SOLAR_TWILIGHT], twilight / (SCHEDULE_TWILIGHT_MINS * 60), 6);
+    CHECK(counts.phases[SOLAR_NIGHT] <= 2 * (ceil(night / 2 / (SCHEDULE_MAX_SLEEP_MINS * 60 * drift)) + 3));
+    CHECK((counts.phases[SOLAR_NIGHT] > 0) == (night > 0));
+    return counts;
+}
+
+/**
+ * Midsummer at the station: a short night, twilight at both ends of it, and a long day.
+ */
+static void stationSummer() {
+    noonElevation(STATION);
+    bandChanges(STATION, JUNE, JUNE_DECLINATION, JUNE_EQ_TIME);
+
+    replay(STATION, JUNE, JUNE_DECLINATION);
+
+    // Midnight is night, and the station sleeps until twilight, no later.
+    const time_t midnight = solarNoon(JUNE, STATION, JUNE_EQ_TIME) + 43200;
+    const WakePlan night = planWake(midnight, SCHEDULE_DAY_MINS * 60, STATION.latitude, STATION.longitude);
+    CHECK(night.phase == SOLAR_NIGHT);
+    const time_t dawn = midnight + (time_t)(43200 - halfArc(STATION, JUNE_DECLINATION, SOLAR_NIGHT_ELEVATION));
+    CHECK(midnight + (time_t)night.sleepSecs <= dawn + 120);
+    CHECK(midnight + (time_t)night.sleepSecs >= dawn - 120 - (time_t)(dawn - midnight) * SCHEDULE_DRIFT_PERMILLE / 1000);
+}
+
+/**
+ * Midwinter at the station: a short day and a long night, slept in a few long sleeps.
+ */
+static void stationWinter() {
+    bandChanges(STATION, DECEMBER, DECEMBER_DECLINATION, DECEMBER_EQ_TIME);
+    const WakeCounts counts = replay(STATION, DECEMBER, DECEMBER_DECLINATION);
+    CHECK(counts.phases[SOLAR_DAY] < counts.phases[SOLAR_TWILIGHT]);
+}
+
+/**
+ * Svalbard: the sun never sets in June and never rises in December.
+ */
+static void polar() {
+    noonElevation(LONGYEARBYEN);
+    bandChanges(LONGYEARBYEN, JUNE, JUNE_DECLINATION, JUNE_EQ_TIME);
+    bandChanges(LONGYEARBYEN, DECEMBER, DECEMBER_DECLINATION, DECEMBER_EQ_TIME);
+
+    CHECK(nextPhaseChange(JUNE, LONGYEARBYEN.latitude, LONGYEARBYEN.longitude, 86400) == 0);
+    const WakeCounts summer = replay(LONGYEARBYEN, JUNE, JUNE_DECLINATION);
+    CHECK(summer.phases[SOLAR_NIGHT] == 0 && summer.phases[SOLAR_TWILIGHT] == 0);
+
+    // The polar night is slept through at the longest sleep there is.
+    CHECK(nextPhaseChange(DECEMBER, LONGYEARBYEN.latitude, LONGYEARBYEN.longitude, 86400) == 0);
+    const WakePlan night = planWake(DECEMBER, SCHEDULE_DAY_MINS * 60, LONGYEARBYEN.latitude, LONGYEARBYEN.longitude);
+    CHECK(night.phase == SOLAR_NIGHT);
+    CHECK(night.sleepSecs == SCHEDULE_MAX_SLEEP_MINS * 60 * (1000 - SCHEDULE_DRIFT_PERMILLE) / 1000);
+    const WakeCounts winter = replay(LONGYEARBYEN, DECEMBER, DECEMBER_DECLINATION);
+    CHECK(winter.phases[SOLAR_DAY] == 0 && winter.phases[SOLAR_TWILIGHT] == 0);
+    CHECK(winter.phases[SOLAR_NIGHT] == 2 * 86400 / night.sleepSecs + 1);
+}
+
+/**
+ * The equator: twelve hour days all year, and twilight quickly over.
+ */
+static void equatorial() {
+    noonElevation(QUITO);
+    bandChanges(QUITO, JUNE, JUNE_DECLINATION, JUNE_EQ_TIME);
+    bandChanges(QUITO, DECEMBER, DECEMBER_DECLINATION, DECEMBER_EQ_TIME);
+
+    // Twilight is under an hour at each end of the day, whatever the season.
+    CHECK(above(QUITO, JUNE_DECLINATION, SOLAR_NIGHT_ELEVATION) - above(QUITO, JUNE_DECLINATION, SOLAR_DAY_ELEVATION) < 2 * 3600);
+    const WakeCounts june = replay(QUITO, JUNE, JUNE_DECLINATION);
+    const WakeCounts december = replay(QUITO, DECEMBER, DECEMBER_DECLINATION);
+    CHECK(june.phases[SOLAR_DAY] == december.phases[SOLAR_DAY]);
+}
+
+/**
+ * The southern hemisphere has its seasons the other way round.
+ */
+static void southern() {
+    noonElevation(HOBART);
+    bandChanges(HOBART, JUNE, JUNE_DECLINATION, JUNE_EQ_TIME);
+    bandChanges(HOBART, DECEMBER, DECEMBER_DECLINATION, DECEMBER_EQ_TIME);
+    CHECK(halfArc(HOBART, JUNE_DECLINATION, 0) < halfArc(HOBART, DECEMBER_DECLINATION, 0));
+    const WakeCounts june = replay(HOBART, JUNE, JUNE_DECLINATION);
+    const WakeCounts december = replay(HOBART, DECEMBER, DECEMBER_DECLINATION);
+    CHECK(june.phases[SOLAR_DAY] < december.phases[SOLAR_DAY]);
+}
+
+/**
+ * Before the clock is set there is no sun to go by.
+ */
+static void noClock() {
+    const WakePlan plan = planWake(1000, 600);
+    CHECK(plan.phase == SOLAR_UNKNOWN);
+    CHECK(plan.sleepSecs == 600);
+}
+
+int main() {
+    stationSummer();
+    stationWinter();
+    polar();
+    equatorial();
+    southern();
+    noClock();
+    return checkExit();
+}
@@ -0,0 +1,169 @@
+/**
+ * The trace ring: what a flush writes, the oldest records overwritten once the ring is full,
+ * tasks tracing at once, and a format of its own for each debug / debugln call site.
+ */
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "check.h"
+#include "../io.h"
+#include "SD_MMC.h"
+
+/**
+ * One flush as trace_decode.py reads it, with each record's first argument if it is an int.
+ */
+struct Flush {
+    uint32_t used = 0;
+    uint32_t dropped = 0;
+    std::vector<uint32_t> formats;
+    std::vector<int32_t> firsts;
+};
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * The flushes in TRACE_FILE, which is removed for the next test.
+ */
+static std::vector<Flush> flushes() {
+    const std::string path = HOST_HAL.root + TRACE_FILE;
+    std::vector<uint8_t> data;
+    if (FILE* f = fopen(path.c_str(), "rb")) {
+        uint8_t buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) data.insert(data.end(), buf, buf + n);
+        fclose(f);
+    }
+    unlink(path.c_str());
+
+    std::vector<Flush> out;
+    for (size_t i = 0; i + 16 <= data.size();) {
+        CHECK(memcmp(&data[i], TRACE_MAGIC, 4) == 0);
+        Flush flush;
+        flush.used = get32(&data[i + 8]);
+        flush.dropped = get32(&data[i + 12]);
+        i += 16;
+        const size_t end = i + flush.used;
+        CHECK(end <= data.size());
+        while (i < end && end <= data.size()) {
+            const uint8_t len = data[i];
+            CHECK(len >= TRACE_HEADER && i + len <= end && data[i + 1] <= TRACE_DEBUG);
+            if (len < TRACE_HEADER) break;
+            flush.formats.push_back(get32(&data[i + 2]));
+            flush.firsts.push_back(len >= TRACE_HEADER + 5 && data[i + TRACE_HEADER] == 'i' ? (int32_t)get32(&data[i + TRACE_HEADER + 1]) : -1);
+            i += len;
+        }
+        i = end;
+        out.push_back(flush);
+    }
+    return out;
+}
+
+/**
+ * A flush writes the records in order, and only when there are any.
+ */
+static void flush() {
+    CHECK(traceFlush(SD_MMC, 0));
+    CHECK(flushes().empty());
+
+    for (int i = 0; i < 3; i++) tracef(TRACE_INFO, "record %d", i);
+    CHECK(traceDropped() == 0);
+    CHECK(traceFlush(SD_MMC, 1000));
+    tracef(TRACE_WARN, "record %d", 3);
+    CHECK(traceFlush(SD_MMC, 2000));
+
+    const std::vector<Flush> f = flushes();
+    CHECK(f.size() == 2);
+    if (f.size() != 2) return;
+    CHECK(f[0].firsts == (std::vector<int32_t>{0, 1, 2}) && f[0].dropped == 0);
+    CHECK(f[0].used == 3 * (TRACE_HEADER + 5));
+    CHECK(f[1].firsts == (std::vector<int32_t>{3}));
+}
+
+/**
+ * Once the ring is full the oldest records go a segment at a time, and the flush counts them.
+ * A record too long to trace is counted too.
+ */
+static void wraps() {
+    const int COUNT = 2000;
+    for (int i = 0; i < COUNT; i++) tracef(TRACE_INFO, "record %d", i);
+    const String longest(std::string(TRACE_MAX_STRING, 'x').c_str());
+    tracef(TRACE_INFO, "%s %s %s %s", longest, longest, longest, longest);
+    const uint32_t dropped = traceDropped();
+    CHECK(traceFlush(SD_MMC, 0));
+
+    const std::vector<Flush> f = flushes();
+    CHECK(f.size() == 1);
+    if (f.size() != 1) return;
+    const std::vector<int32_t>& kept = f[0].firsts;
+    const size_t perSegment = TRACE_BUFFER_SIZE / TRACE_SEGMENTS / (TRACE_HEADER + 5);
+    CHECK(kept.size() > (TRACE_SEGMENTS - 1) * perSegment && kept.size() <= TRACE_SEGMENTS * perSegment);
+    CHECK(f[0].dropped == dropped && dropped == COUNT + 1 - kept.size());
+    for (size_t i = 0; i < kept.size(); i++) CHECK(kept[i] == COUNT - (int32_t)kept.size() + (int32_t)i);
+}
+
+/**
+ * Tasks tracing at once each keep their records whole and in order, and every record is
+ * either flushed or counted.
+ */
+static void threads() {
+    const int THREADS = 4;
+    const int ROUNDS = 1000;
+    std::vector<std::thread> tasks;
+    for (int t = 0; t < THREADS; t++) {
+        tasks.emplace_back([t] {
+            for (int i = 0; i < ROUNDS; i++) tracef(TRACE_INFO, "task %d %d", t * ROUNDS + i, t);
+        });
+    }
+    for (std::thread& task : tasks) task.join();
+    CHECK(traceFlush(SD_MMC, 0));
+
+    const std::vector<Flush> f = flushes();
+    CHECK(f.size() == 1);
+    if (f.size() != 1) return;
+    int32_t last[THREADS];
+    for (int32_t& l : last) l = -1;
+    for (int32_t n : f[0].firsts) {
+        CHECK(n >= 0 && n < THREADS * ROUNDS);
+        if (n < 0 || n >= THREADS * ROUNDS) continue;
+        CHECK(n > last[n / ROUNDS]);
+        last[n / ROUNDS] = n;
+    }
+    CHECK(f[0].firsts.size() + f[0].dropped == THREADS * ROUNDS);
+}
+
+/**
+ * Free text is traced under a format for its call site: "%s" or "%s\n", then file and line.
+ */
+static void sites() {
+    const char* here = TRACE_SITE("%s");
+    const int line = __LINE__ - 1;
+    CHECK(strcmp(here, "%s") == 0);
+    CHECK(std::string(here + 3) == "test_trace.cpp:" + std::to_string(line));
+
+    debug("free");
+    debug("text");
+    debugln("line");
+    debugln();
+    CHECK(traceFlush(SD_MMC, 0));
+    const std::vector<Flush> f = flushes();
+    CHECK(f.size() == 1);
+    if (f.size() != 1) return;
+    CHECK(f[0].formats.size() == 4);
+    for (size_t i = 0; i < f[0].formats.size(); i++) {
+        for (size_t j = 0; j < i; j++) CHECK(f[0].formats[i] != f[0].formats[j]);
+    }
+}
+
+int main() {
+    char root[] = "/tmp/test_trace.XXXXXX";
+    HOST_HAL.root = mkdtemp(root);
+    CHECK(SD_MMC.begin());
+    flush();
+    wraps();
+    threads();
+    sites();
+    rmdir(root);
+    return checkExit();
+}
@@ -0,0 +1,301 @@
+/**
+ * The upload queue kept in RTC memory: when it brings the radio up, draining it against a server
+ * which turns readings away, backlog images sent without PSRAM, and the queue carried through
+ * deep sleep into a fresh wake process.
+ */
+#include <arpa/inet.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+#include "check.h"
+#include "../wrapper.h"
+#include "../solar.h"
+
+bool sendPending(fs::FS &fs, HTTPClient* http, NetworkInfo* network);
+
+/**
+ * The RTC memory section, see RTC_DATA_ATTR in hal/Arduino.h.
+ */
+extern char __start_rtc_data[] __attribute__((weak));
+extern char __stop_rtc_data[] __attribute__((weak));
+
+#define NOON 1782043200         // 2026-06-21 12:00 UTC
+
+static_assert(std::is_trivially_copyable<UploadQueue>::value, "RTC memory is carried over byte for byte");
+
+static void push(UploadQueue* q, time_t taken, float temperature = 20) {
+    char timestamp[UPLOAD_TIMESTAMP_LENGTH];
+    tm t;
+    gmtime_r(&taken, &t);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &t);
+    CHECK(q -> push(Reading(timestamp, temperature, 50, 101325, 9.3, UNDEFINED, UNDEFINED, UNDEFINED), taken));
+}
+
+/**
+ * Wakes with the radio off queue their reading; the radio comes up every UPLOAD_EVERY_WAKES.
+ */
+static void everyN() {
+    UploadQueue q;
+    CHECK(q.radioDue(NOON));
+    CHECK(q.radioDue(0));
+    q.sessionEnded(true);
+
+    std::vector<int> radioWakes;
+    time_t now = NOON;
+    for (int wake = 1; wake <= 3 * UPLOAD_EVERY_WAKES; wake++, now += 300) {
+        if (q.radioDue(now)) {
+            radioWakes.push_back(wake);
+            while (!q.empty()) q.pop();
+            q.sessionEnded(true);
+        } else {
+            push(&q, now);
+            q.stayedOffline(0);
+        }
+    }
+    CHECK(radioWakes == (std::vector<int>{UPLOAD_EVERY_WAKES, 2 * UPLOAD_EVERY_WAKES, 3 * UPLOAD_EVERY_WAKES}));
+
+    // Without a clock only the network can set it, whatever the count.
+    CHECK(q.radioDue(SCHEDULE_VALID_EPOCH - 1));
+}
+
+/**
+ * A full ring, an old reading or a large spool brings the radio up early, but not during a backoff.
+ */
+static void early() {
+    UploadQueue q;
+    q.sessionEnded(true);
+    for (int i = 0; i < UPLOAD_RING_SIZE - 1; i++) push(&q, NOON);
+    CHECK(!q.radioDue(NOON));
+    push(&q, NOON);
+    CHECK(q.radioDue(NOON));
+    CHECK(!q.push(q.front().toReading(), NOON));
+    CHECK(q.count == UPLOAD_RING_SIZE);
+
+    UploadQueue old;
+    old.sessionEnded(true);
+    push(&old, NOON);
+    CHECK(!old.radioDue(NOON + UPLOAD_MAX_AGE_SECS - 1));
+    CHECK(old.radioDue(NOON + UPLOAD_MAX_AGE_SECS));
+
+    UploadQueue spooled;
+    spooled.sessionEnded(true);
+    spooled.stayedOffline(UPLOAD_BACKLOG_BYTES - 1);
+    CHECK(!spooled.radioDue(NOON));
+    spooled.stayedOffline(1);
+    CHECK(spooled.radioDue(NOON));
+
+    // A failed session doubles the wakes to the next one, and nothing else brings the radio back.
+    q.sessionEnded(false);
+    int wakes = 1;
+    for (; !q.radioDue(NOON) && wakes < 100; wakes++) q.stayedOffline(0);
+    CHECK(wakes == 2 * UPLOAD_EVERY_WAKES);
+    CHECK(q.count == UPLOAD_RING_SIZE);
+
+    // A good session ends the backoff, and drops the spooled bytes.
+    q.sessionEnded(true);
+    spooled.sessionEnded(true);
+    CHECK(!spooled.radioDue(NOON));
+}
+
+/**
+ * A server on a loopback port answering readings with the codes in turn, 200 once they run out.
+ * It keeps the bodies of the images it is sent.
+ */
+struct Server {
+    int fd = -1;
+    std::vector<int> codes;
+    std::vector<std::string> readings;
+    std::vector<std::string> images;
+    std::thread thread;
+
+    void start() {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd, (sockaddr*)&addr, len);
+        listen(fd, 4);
+        getsockname(fd, (sockaddr*)&addr, &len);
+        HOST_HAL.server = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+        thread = std::thread([this] { serve(); });
+    }
+
+    void serve() {
+        for (int client; (client = accept(fd, nullptr, nullptr)) >= 0; close(client)) {
+            std::string request;
+            char buf[1024];
+            ssize_t n;
+            while (request.find("\r\n\r\n") == std::string::npos && (n = recv(client, buf, sizeof(buf), 0)) > 0) {
+                request.append(buf, n);
+            }
+            int code = 200;
+            const size_t body = request.find("\r\n\r\n") + 4;
+            if (request.find(" /api/images") != std::string::npos) {
+                const size_t length = std::stoul(request.substr(request.find("Content-Length: ") + 16));
+                while (request.size() - body < length && (n = recv(client, buf, sizeof(buf), 0)) > 0) {
+                    request.append(buf, n);
+                }
+                images.push_back(request.substr(body));
+            }
+            if (request.find(" /api/reading") != std::string::npos) {
+                const size_t at = request.find("temperature=");
+                readings.push_back(request.substr(at, request.find('&', at) - at));
+                if (readings.size() <= codes.size()) code = codes[readings.size() - 1];
+            }
+            const std::string reply = "HTTP/1.1 " + std::to_string(code) + " X\r\nContent-Length: 2\r\n\r\nok";
+            send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+        }
+    }
+
+    void stop() {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+        thread.join();
+    }
+};
+
+/**
+ * Readings leave the queue only once the server took them, and the first it turns away ends
+ * the drain with it and the rest kept, oldest first.
+ */
+static void acknowledged() {
+    Server server;
+    server.codes = {200, 200, 503};
+    server.start();
+    HOST_HAL.networks = {"station"};
+    HOST_HAL.associateMs = 0;
+    WiFi.begin("station", "");
+
+    NetworkInfo network;
+    HTTPClient http;
+    while (!UPLOADS.empty()) UPLOADS.pop();
+    for (int i = 0; i < 5; i++) push(&UPLOADS, NOON + 300 * i, 10 + i);
+
+    CHECK(!sendPending(SD_MMC, &http, &network));
+    CHECK(server.readings.size() == 3);
+    CHECK(UPLOADS.count == 3);
+    CHECK(UPLOADS.front().temperature == 12);
+
+    CHECK(sendPending(SD_MMC, &http, &network));
+    CHECK(UPLOADS.empty());
+    CHECK(server.readings.size() == 6);
+    const char* const sent[6] = {"10.00", "11.00", "12.00", "12.00", "13.00", "14.00"};
+    for (size_t i = 0; i < server.readings.size(); i++) {
+        CHECK(server.readings[i].find(sent[i]) != std::string::npos);
+    }
+    server.stop();
+}
+
+/**
+ * Without PSRAM there is no image pool to reload backlog images into, so they go to the server
+ * straight from the card, and are deleted once it took them.
+ */
+static void streamed() {
+    Server server;
+    server.start();
+    NetworkInfo network;
+    HTTPClient http;
+    while (!UPLOADS.empty()) UPLOADS.pop();
+
+    std::string jpeg[2];
+    for (int i = 0; i < 2; i++) {
+        const time_t taken = NOON + 300 * i;
+        push(&UPLOADS, taken);
+        jpeg[i].assign(40000 + 5000 * i, '\0');
+        for (size_t b = 0; b < jpeg[i].size(); b++) jpeg[i][b] = (char)(b * 7 + i);
+        tm t;
+        gmtime_r(&taken, &t);
+        writejpg(SD_MMC, &t, ImageBuffer::mapped((uint8_t*)&jpeg[i][0], jpeg[i].size()));
+    }
+    CHECK(!IMAGE_POOL.begin());
+
+    CHECK(sendPending(SD_MMC, &http, &network));
+    CHECK(UPLOADS.empty());
+    CHECK(server.images.size() == 2);
+    for (size_t i = 0; i < server.images.size() && i < 2; i++) CHECK(server.images[i] == jpeg[i]);
+    for (int i = 0; i < 2; i++) {
+        tm t;
+        const time_t taken = NOON + 300 * i;
+        gmtime_r(&taken, &t);
+        CHECK(!openjpg(SD_MMC, &t));
+    }
+    server.stop();
+}
+
+/**
+ * The queue as a wake leaves it, in a file standing for RTC memory through deep sleep.
+ */
+static const char* rtcFile() {
+    static std::string path = std::string(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp") +
+                              "/test_upload_rtc." + std::to_string(getpid());
+    return path.c_str();
+}
+
+/**
+ * The next wake, in a fresh process: RTC memory as the last wake left it.
+ */
+static int wake(const char* rtc) {
+    CHECK(UPLOADS.empty() && !UPLOADS.primed);
+    FILE* f = fopen(rtc, "rb");
+    CHECK(f != nullptr);
+    if (!f) return checkExit();
+    CHECK(fread(__start_rtc_data, 1, __stop_rtc_data - __start_rtc_data, f) == (size_t)(__stop_rtc_data - __start_rtc_data));
+    fclose(f);
+
+    CHECK(UPLOADS.primed && UPLOADS.count == 3 && UPLOADS.wakes == 3 && UPLOADS.spooledBytes == 3000);
+    CHECK(UPLOADS.front().time == NOON && strcmp(UPLOADS.front().timestamp, "2026-06-21 12:00:00") == 0);
+    CHECK(UPLOADS.radioDue(NOON + 900));
+    for (int i = 0; i < 3; i++, UPLOADS.pop()) CHECK(UPLOADS.front().temperature == 20 + i);
+    return checkExit();
+}
+
+/**
+ * Deep sleep keeps the queue: three offline wakes' readings reach the wake which brings the radio up.
+ */
+static void deepSleep(const char* self) {
+    while (!UPLOADS.empty()) UPLOADS.pop();
+    UPLOADS.sessionEnded(true);
+    for (int i = 0; i < 3; i++) {
+        CHECK(!UPLOADS.radioDue(NOON + 300 * i));
+        push(&UPLOADS, NOON + 300 * i, 20 + i);
+        UPLOADS.stayedOffline(1000);
+    }
+
+    FILE* f = fopen(rtcFile(), "wb");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fwrite(__start_rtc_data, 1, __stop_rtc_data - __start_rtc_data, f);
+    fclose(f);
+
+    const pid_t child = fork();
+    if (child == 0) {
+        execl(self, self, "--wake", rtcFile(), (char*)nullptr);
+        _exit(127);
+    }
+    int status = -1;
+    waitpid(child, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    unlink(rtcFile());
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "--wake") == 0) return wake(argv[2]);
+
+    // A board without PSRAM, set before anything maps it.
+    HOST_HAL.psram = 0;
+    char root[] = "/tmp/test_upload.XXXXXX";
+    HOST_HAL.root = mkdtemp(root);
+    CHECK(SD_MMC.begin());
+    everyN();
+    early();
+    acknowledged();
+    streamed();
+    deepSleep("/proc/self/exe");
+    rmdir(root);
+    return checkExit();
+}
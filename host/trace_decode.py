@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""
+Decode the binary trace a station writes to /trace.bin, against the firmware ELF it ran.
+
+Records carry the address of their format string instead of the text, see trace.h, so the
+ELF must be the exact build that wrote the trace.
+
+    python3 host/trace_decode.py build/station-revamp.ino.elf trace.bin
+    python3 host/trace_decode.py --level warn firmware.elf trace.old trace.bin
+    python3 host/trace_decode.py --sites firmware.elf trace.bin
+"""
+
+import argparse
+import datetime
+import re
+import struct
+import sys
+
+MAGIC = b"TRC1"
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+LEVEL_NAMES = {"error": 1, "warn": 2, "info": 3, "debug": 4}
+HEADER = 10
+SITE = re.compile(r"[\w./+-]+:\d+")
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|L|z|j|t)?([diouxXeEfFgGcsp%])")
+
+SHT_NOBITS = 8
+SHF_ALLOC = 2
+
+
+class Elf:
+    """Just enough of an ELF reader to find C strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        wide = self.data[4] == 2
+        end = "<" if self.data[5] == 1 else ">"
+        if wide:
+            shoff, = struct.unpack_from(end + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(end + "HH", self.data, 0x3A)
+            entry = struct.Struct(end + "IIQQQQIIQQ")
+        else:
+            shoff, = struct.unpack_from(end + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(end + "HH", self.data, 0x2E)
+            entry = struct.Struct(end + "IIIIIIIIII")
+
+        self.sections = []
+        for i in range(shnum):
+            _, kind, flags, addr, offset, size = entry.unpack_from(self.data, shoff + i * shentsize)[:6]
+            if flags & SHF_ALLOC and kind != SHT_NOBITS and size:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                stop = self.data.index(b"\0", start, offset + size)
+                return self.data[start:stop].decode("utf-8", "replace")
+        return None
+
+    def site(self, address):
+        """The file and line after a TRACE_SITE format's terminator, or None for other formats."""
+        fmt = self.string(address)
+        if fmt is None:
+            return None
+        after = self.string(address + len(fmt.encode("utf-8")) + 1)
+        return after if after and SITE.fullmatch(after) else None
+
+
+def arguments(payload):
+    args = []
+    i = 0
+    while i < len(payload):
+        tag = chr(payload[i])
+        i += 1
+        if tag == "i":
+            args.append(struct.unpack_from("<i", payload, i)[0])
+            i += 4
+        elif tag == "q":
+            args.append(struct.unpack_from("<q", payload, i)[0])
+            i += 8
+        elif tag == "d":
+            args.append(struct.unpack_from("<d", payload, i)[0])
+            i += 8
+        elif tag == "s":
+            n = payload[i]
+            args.append(payload[i + 1:i + 1 + n].decode("utf-8", "replace"))
+            i += 1 + n
+        else:
+            raise ValueError("unknown argument tag %r" % tag)
+    return args
+
+
+def render(fmt, args):
+    """printf, with the C length modifiers and 32 bit integers of the station."""
+    out = []
+    pos = 0
+    queue = list(args)
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, _, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if width == "*":
+            width = str(queue.pop(0)) if queue else ""
+        if precision == "*":
+            precision = str(queue.pop(0)) if queue else ""
+        if not queue:
+            out.append(m.group(0))
+            continue
+        value = queue.pop(0)
+        spec = "%" + (flags or "") + (width or "") + ("." + precision if precision is not None else "")
+        if conv in "uxXo" and isinstance(value, int) and value < 0:
+            value &= 0xFFFFFFFF if value >= -(1 << 31) else 0xFFFFFFFFFFFFFFFF
+        if conv in "diu":
+            out.append((spec + "d") % int(value))
+        elif conv in "xXo":
+            out.append((spec + conv) % int(value))
+        elif conv == "c":
+            out.append(chr(value & 0xFF) if isinstance(value, int) else str(value))
+        elif conv == "p":
+            out.append("0x%x" % (int(value) & 0xFFFFFFFF))
+        elif conv == "s":
+            out.append((spec + "s") % value)
+        else:
+            out.append((spec + conv) % float(value))
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def flushes(data):
+    i = 0
+    while i + 16 <= len(data):
+        if data[i:i + 4] != MAGIC:
+            # Skip to the next flush, e.g. after a torn write.
+            j = data.find(MAGIC, i + 1)
+            if j < 0:
+                return
+            print("skipped %d bytes of damaged trace" % (j - i), file=sys.stderr)
+            i = j
+            continue
+        time, used, dropped = struct.unpack_from("<III", data, i + 4)
+        yield time, dropped, data[i + 16:i + 16 + used]
+        i += 16 + used
+
+
+def records(block):
+    i = 0
+    while i + HEADER <= len(block):
+        length, level, address, us = struct.unpack_from("<BBII", block, i)
+        if length < HEADER or i + length > len(block):
+            print("damaged record at %d" % i, file=sys.stderr)
+            return
+        yield level, address, us, block[i + HEADER:i + length]
+        i += length
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("elf", help="Firmware ELF the trace was written by")
+    parser.add_argument("traces", nargs="+", help="Trace files, oldest first")
+    parser.add_argument("--level", choices=LEVEL_NAMES, default="debug", help="Most verbose level to print")
+    parser.add_argument("--sites", action="store_true", help="Start free text lines with their call site")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    most = LEVEL_NAMES[args.level]
+    for path in args.traces:
+        with open(path, "rb") as f:
+            data = f.read()
+        for time, dropped, block in flushes(data):
+            stamp = datetime.datetime.fromtimestamp(time, datetime.timezone.utc).strftime("%Y-%m-%d %H:%M:%S") if time else "unknown time"
+            print("=== wake %s%s" % (stamp, ", %d records dropped" % dropped if dropped else ""))
+            line = ""
+            for level, address, us, payload in records(block):
+                if level > most:
+                    continue
+                fmt = elf.string(address)
+                if fmt is None:
+                    text = "<unknown format 0x%08x>\n" % address
+                else:
+                    try:
+                        text = render(fmt, arguments(payload))
+                    except (ValueError, TypeError, struct.error) as e:
+                        text = "<%s: %s>\n" % (fmt.strip(), e)
+                if not line:
+                    line = "[%10.6f] %s " % (us / 1e6, LEVELS.get(level, "?"))
+                    site = elf.site(address) if args.sites else None
+                    if site:
+                        line += "%s: " % site
+                line += text
+                while "\n" in line:
+                    done, line = line.split("\n", 1)
+                    print(done)
+                    if line:
+                        line = "[%10.6f] %s " % (us / 1e6, LEVELS.get(level, "?")) + line
+            if line:
+                print(line)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,363 @@
+/**
+ * Runs the station firmware on Linux, wake after wake, and measures each wake.
+ *
+ * Every wake is a fresh process, as every wake is a reset on the station: the runner re-executes
+ * itself per wake, carrying the RTC memory section over in a file, and moving the simulated wall
+ * clock on by the time spent awake and asleep. The file system lives in a host directory, HTTP
+ * goes to a local test server (host/test_server.py), the camera serves host/fixtures, and the
+ * BMP390 and SHT31 are the register level fakes.
+ *
+ *     python3 host/test_server.py &
+ *     ./wake_cycle --wakes 24 --start "2026-06-21 06:00"
+ */
+#include <Arduino.h>
+#include <chrono>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "fake_bmp390.h"
+#include "fake_sht31.h"
+#include "../power.h"
+
+void setup();
+void loop();
+
+/**
+ * The RTC memory section, see RTC_DATA_ATTR in hal/Arduino.h.
+ */
+extern char __start_rtc_data[] __attribute__((weak));
+extern char __stop_rtc_data[] __attribute__((weak));
+
+/**
+ * What one wake did, as the wake process reports it to the runner.
+ */
+struct WakeResult {
+    unsigned wake = 0;
+    long long epoch = 0;
+    unsigned long long sleepUs = 0;
+    unsigned long long awakeUs = 0;
+    unsigned long long realUs = 0;
+    unsigned long long activeUs = 0;
+    unsigned long long idleUs = 0;
+    unsigned long long lightSleepUs = 0;
+    unsigned long long radioUs = 0;
+    unsigned long long cameraUs = 0;
+    double chargeUah = 0;
+    unsigned requests = 0;
+    unsigned failedRequests = 0;
+    unsigned long long bytesUp = 0;
+    unsigned long long bytesDown = 0;
+    unsigned long long bytesWritten = 0;
+    unsigned long long bytesRead = 0;
+    unsigned frames = 0;
+    unsigned i2c = 0;
+    long rssKb = 0;
+};
+
+#define WAKE_FORMAT "wake=%u epoch=%lld sleep_us=%llu awake_us=%llu real_us=%llu active_us=%llu idle_us=%llu " \
+                    "light_sleep_us=%llu radio_us=%llu camera_us=%llu charge_uah=%lf requests=%u failed=%u " \
+                    "bytes_up=%llu bytes_down=%llu bytes_written=%llu bytes_read=%llu frames=%u i2c=%u rss_kb=%ld"
+#define WAKE_FIELDS(r, p) p r.wake, p r.epoch, p r.sleepUs, p r.awakeUs, p r.realUs, p r.activeUs, p r.idleUs, \
+                    p r.lightSleepUs, p r.radioUs, p r.cameraUs, p r.chargeUah, p r.requests, p r.failedRequests, \
+                    p r.bytesUp, p r.bytesDown, p r.bytesWritten, p r.bytesRead, p r.frames, p r.i2c, p r.rssKb
+
+struct Options {
+    unsigned wakes = 24;
+    time_t start = 1782021600;      // 2026-06-21 06:00 UTC
+    std::string rtc;
+    int wake = -1;                  // Set in a wake process
+    bool csv = false;
+};
+
+static Options options;
+static WakeResult result;
+static std::chrono::steady_clock::time_point bootReal;
+
+/**
+ * The RTC section of the last wake, if there was one and it is from this build.
+ */
+static void loadRtc() {
+    const size_t size = __stop_rtc_data - __start_rtc_data;
+    FILE* f = fopen(options.rtc.c_str(), "rb");
+    if (!f) return;
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && (size_t)st.st_size == size && fread(__start_rtc_data, 1, size, f) != size) {
+        fprintf(stderr, "RTC memory truncated, starting cold\n");
+    }
+    fclose(f);
+}
+
+static void saveRtc() {
+    FILE* f = fopen(options.rtc.c_str(), "wb");
+    if (!f) return;
+    fwrite(__start_rtc_data, 1, __stop_rtc_data - __start_rtc_data, f);
+    fclose(f);
+}
+
+static void keepReport(void* ctx, const PowerReport& r) {
+    result.activeUs = r.activeUs;
+    result.idleUs = r.idleUs;
+    result.lightSleepUs = r.sleepUs;
+    result.radioUs = r.radioUs;
+    result.cameraUs = r.cameraUs;
+    result.chargeUah = r.chargeUah;
+}
+
+/**
+ * Deep sleep ends the wake process: keep RTC memory and tell the runner how the wake went.
+ */
+static void deepSleep(uint64_t us) {
+    result.realUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootReal).count();
+    result.awakeUs = hostMicros();
+    result.sleepUs = us;
+    const HostCounters& c = HOST_HAL.counters;
+    result.requests = c.requests;
+    result.failedRequests = c.failedRequests;
+    result.bytesUp = c.bytesUp;
+    result.bytesDown = c.bytesDown;
+    result.bytesWritten = c.bytesWritten;
+    result.bytesRead = c.bytesRead;
+    result.frames = c.frames;
+    result.i2c = c.i2cTransactions;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) result.rssKb = usage.ru_maxrss;
+
+    saveRtc();
+    printf(WAKE_FORMAT "\n", WAKE_FIELDS(result, ));
+}
+
+template <typename Fake>
+static HostI2CDevice attach(Fake* fake, uint8_t addr) {
+    HostI2CDevice d;
+    d.addr = addr;
+    d.dev = fake;
+    d.write = [](void* dev, uint8_t a, const uint8_t* data, size_t len) { return ((Fake*)dev) -> port().write(a, data, len); };
+    d.read = [](void* dev, uint8_t a, uint8_t* data, size_t len) { return ((Fake*)dev) -> port().read(a, data, len); };
+    d.advance = [](void* dev, uint32_t ms) { ((Fake*)dev) -> advance(ms); };
+    return d;
+}
+
+/**
+ * One wake, in this process. Ends in esp_deep_sleep_start, which exits.
+ */
+static int runWake() {
+    static FakeBMP390 bmp;
+    static FakeSHT31 sht;
+
+    // A mild day: warmest mid afternoon.
+    const double hour = (options.start % 86400) / 3600.0;
+    sht.temperature = 16.0 + 6.0 * sin((hour - 9.0) * M_PI / 12.0);
+    HOST_HAL.i2c.push_back(attach(&bmp, BMP390_ADDRESS));
+    HOST_HAL.i2c.push_back(attach(&sht, SHT31_ADDRESS));
+
+    HOST_HAL.epoch = options.start;
+    HOST_HAL.fixture = options.wake;
+    HOST_HAL.deepSleep = deepSleep;
+    result.wake = options.wake;
+    result.epoch = options.start;
+    loadRtc();
+    POWER.setHook(keepReport);
+
+    bootReal = std::chrono::steady_clock::now();
+    setup();
+    for (;;) loop();
+}
+
+/**
+ * Write the networks file the station joins from, unless the file system already has one.
+ */
+static void seedNetworks(const char* ssid) {
+    mkdir(HOST_HAL.root.c_str(), 0755);
+    const std::string path = HOST_HAL.root + "/networks.json";
+    if (access(path.c_str(), F_OK) == 0) return;
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return;
+    fprintf(f, "{\"networks\":[{\"SSID\":\"%s\",\"PASS\":\"station\"}],\"metar_api_key\":\"host\"}", ssid);
+    fclose(f);
+}
+
+/**
+ * Run a wake in a fresh process.
+ * @return False if the wake did not end in deep sleep.
+ */
+static bool spawnWake(char* self, std::vector<std::string> args, unsigned wake, time_t epoch, WakeResult* out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    args.push_back("--wake=" + std::to_string(wake));
+    args.push_back("--start=" + std::to_string((long long)epoch));
+    args.push_back("--rtc=" + options.rtc);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char*> argv;
+        argv.push_back(self);
+        for (std::string& a : args) argv.push_back(&a[0]);
+        argv.push_back(nullptr);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    close(fds[1]);
+
+    std::string output;
+    char buf[512];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) output.append(buf, n);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    const char* line = strstr(output.c_str(), "wake=");
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && line && sscanf(line, WAKE_FORMAT, WAKE_FIELDS((*out), &)) == 20;
+}
+
+static void printRow(const WakeResult& r) {
+    if (options.csv) {
+        printf("%u,%lld,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%u,%u,%llu,%llu,%llu,%llu,%u,%u,%ld,%.0f\n",
+               r.wake, r.epoch, r.awakeUs / 1e6, r.realUs / 1e3, r.activeUs / 1e6, r.idleUs / 1e6, r.lightSleepUs / 1e6,
+               r.radioUs / 1e6, r.cameraUs / 1e6, r.chargeUah, r.awakeUs ? r.chargeUah * 3.6e6 / r.awakeUs : 0.0,
+               r.requests, r.failedRequests, r.bytesUp, r.bytesDown, r.bytesWritten, r.bytesRead, r.frames, r.i2c,
+               r.rssKb, r.sleepUs / 1e6);
+        return;
+    }
+
+    char when[32];
+    const time_t t = r.epoch;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M", gmtime(&t));
+    printf("%4u  %s  %7.2f  %8.1f  %8.1f  %6.1f  %4u/%-2u  %8.1f  %8.1f  %3u  %6.0f\n",
+           r.wake, when, r.awakeUs / 1e6, r.realUs / 1e3, r.chargeUah,
+           r.awakeUs ? r.chargeUah * 3.6e6 / r.awakeUs : 0.0, r.requests, r.failedRequests,
+           r.bytesUp / 1024.0, r.bytesWritten / 1024.0, r.frames, r.sleepUs / 1e6);
+}
+
+static void usage(const char* self) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --wakes N          wakes to run (24)\n"
+            "  --start TIME       wall clock at the first boot, \"YYYY-MM-DD HH:MM\" UTC or epoch seconds\n"
+            "  --root DIR         directory backing the file system (station_fs)\n"
+            "  --server URL       where HTTP requests go (http://127.0.0.1:8080)\n"
+            "  --fixtures DIR     JPEGs the camera serves (" HOST_FIXTURES ")\n"
+            "  --ssid NAME        network in range (station-host)\n"
+            "  --offline          the network never connects\n"
+            "  --no-sd            no SD card, so LittleFS is used\n"
+            "  --no-psram         a board without PSRAM, so large buffers fall back to internal RAM\n"
+            "  --serial           echo Serial to stderr\n"
+            "  --csv              one CSV row per wake\n",
+            self);
+}
+
+static bool parseTime(const char* s, time_t* out) {
+    char* end;
+    const long long epoch = strtoll(s, &end, 10);
+    if (*end == 0) {
+        *out = epoch;
+        return true;
+    }
+    struct tm tm = {};
+    if (!strptime(s, "%Y-%m-%d %H:%M", &tm)) return false;
+    *out = timegm(&tm);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    static const struct option longOptions[] = {
+        {"wakes", required_argument, nullptr, 'n'},
+        {"start", required_argument, nullptr, 't'},
+        {"root", required_argument, nullptr, 'r'},
+        {"server", required_argument, nullptr, 's'},
+        {"fixtures", required_argument, nullptr, 'f'},
+        {"ssid", required_argument, nullptr, 'i'},
+        {"offline", no_argument, nullptr, 'o'},
+        {"no-sd", no_argument, nullptr, 'd'},
+        {"no-psram", no_argument, nullptr, 'p'},
+        {"serial", no_argument, nullptr, 'v'},
+        {"csv", no_argument, nullptr, 'c'},
+        {"wake", required_argument, nullptr, 'w'},
+        {"rtc", required_argument, nullptr, 'm'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    // Everything but the runner's own options goes on to the wake processes.
+    std::vector<std::string> passOn;
+    std::string ssid = "station-host";
+    HOST_HAL.fixtures = HOST_FIXTURES;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'n': options.wakes = atoi(optarg); break;
+            case 't':
+                if (!parseTime(optarg, &options.start)) {
+                    fprintf(stderr, "Bad start time: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'r': HOST_HAL.root = optarg; passOn.push_back(std::string("--root=") + optarg); break;
+            case 's': HOST_HAL.server = optarg; passOn.push_back(std::string("--server=") + optarg); break;
+            case 'f': HOST_HAL.fixtures = optarg; passOn.push_back(std::string("--fixtures=") + optarg); break;
+            case 'i': ssid = optarg; passOn.push_back(std::string("--ssid=") + optarg); break;
+            case 'o': HOST_HAL.wifi = false; passOn.push_back("--offline"); break;
+            case 'd': HOST_HAL.sdCard = false; passOn.push_back("--no-sd"); break;
+            case 'p': HOST_HAL.psram = 0; passOn.push_back("--no-psram"); break;
+            case 'v': HOST_HAL.serial = true; passOn.push_back("--serial"); break;
+            case 'c': options.csv = true; break;
+            case 'w': options.wake = atoi(optarg); break;
+            case 'm': options.rtc = optarg; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    HOST_HAL.networks.push_back(ssid);
+
+    if (options.wake >= 0) return runWake();
+
+    seedNetworks(ssid.c_str());
+    char rtc[] = "/tmp/station_rtc_XXXXXX";
+    const int fd = mkstemp(rtc);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    options.rtc = rtc;
+
+    if (options.csv) {
+        printf("wake,epoch,awake_s,real_ms,active_s,idle_s,light_sleep_s,radio_s,camera_s,charge_uah,average_ma,"
+               "requests,failed,bytes_up,bytes_down,bytes_written,bytes_read,frames,i2c,rss_kb,sleep_s\n");
+    } else {
+        printf("wake  boot (UTC)        awake s   real ms      uAh      mA  req/fail   KiB up  KiB fs  frm  sleep s\n");
+    }
+
+    time_t epoch = options.start;
+    double charge = 0, realMs = 0;
+    uint64_t awakeUs = 0;
+    long rssKb = 0;
+    unsigned done = 0;
+    for (; done < options.wakes; done++) {
+        WakeResult r;
+        if (!spawnWake(argv[0], passOn, done, epoch, &r)) {
+            fprintf(stderr, "Wake %u did not reach deep sleep\n", done);
+            break;
+        }
+        printRow(r);
+        charge += r.chargeUah;
+        realMs += r.realUs / 1e3;
+        awakeUs += r.awakeUs;
+        if (r.rssKb > rssKb) rssKb = r.rssKb;
+        epoch += (r.awakeUs + r.sleepUs) / 1000000;
+    }
+    unlink(rtc);
+
+    if (!options.csv && done) {
+        const double hours = (epoch - options.start) / 3600.0;
+        printf("%u wakes over %.1f h: %.1f s awake, %.1f ms real per wake, %.1f uAh awake (%.3f mAh/day), peak RSS %ld KiB\n",
+               done, hours, awakeUs / 1e6, realMs / done, charge, hours > 0 ? charge / hours * 24 / 1000 : 0.0, rssKb);
+    }
+    return done == options.wakes ? 0 : 1;
+}
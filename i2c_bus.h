@@ -0,0 +1,115 @@
+#pragma once
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Wire.h>
+#include "power.h"
+
+/**
+ * Register level drivers (bmp390.h, ...) are templated on a bus type rather than
+ * calling TwoWire directly, so the same driver code runs against the hardware or
+ * a host side fake. A bus is held by value and must provide:
+ *
+ *   bool write(uint8_t addr, const uint8_t* data, size_t len);
+ *   bool read(uint8_t addr, uint8_t* data, size_t len);
+ *   bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen);
+ *   bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count);
+ *   void wait(uint32_t ms);
+ *
+ * writeRead is a write followed by a repeated start read, i.e. a register read.
+ * sequence runs up to I2C_SEQUENCE_MAX transactions back to back, as one batch where the
+ * bus queues its traffic, and is true if they all succeeded.
+ * wait lets time pass for the devices, e.g. a startup time after a reset.
+ */
+
+/**
+ * Most transactions in one sequence.
+ */
+#define I2C_SEQUENCE_MAX 8
+
+/**
+ * One transaction of a sequence: a write if only tx is set, a read if only rx is set,
+ * and a register read (writeRead) if both are.
+ */
+struct I2CTransfer {
+    const uint8_t* tx;
+    size_t txLen;
+    uint8_t* rx;
+    size_t rxLen;
+};
+
+/**
+ * Run a sequence one transaction at a time, for buses with no better way to.
+ * @return True if every transaction succeeded; the sequence stops at the first that fails.
+ */
+template <typename Bus>
+bool i2cSequence(Bus& bus, uint8_t addr, const I2CTransfer* transfers, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const I2CTransfer& t = transfers[i];
+        bool ok;
+        if (t.tx && t.rx) ok = bus.writeRead(addr, t.tx, t.txLen, t.rx, t.rxLen);
+        else if (t.rx) ok = bus.read(addr, t.rx, t.rxLen);
+        else ok = bus.write(addr, t.tx, t.txLen);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+/**
+ * Largest single read handed to TwoWire::requestFrom.
+ * The ESP32 core buffers at most I2C_BUFFER_LENGTH (128) bytes per transaction.
+ */
+#define I2C_CHUNK 128
+
+/**
+ * Bus implementation on top of an Arduino TwoWire instance.
+ */
+struct WireBus {
+    TwoWire *wire = nullptr;
+
+    WireBus() {}
+    WireBus(TwoWire *w) : wire(w) {}
+
+    bool write(uint8_t addr, const uint8_t* data, size_t len) {
+        if (!wire) return false;
+        wire -> beginTransmission(addr);
+        if (wire -> write(data, len) != len) {
+            wire -> endTransmission();
+            return false;
+        }
+        return wire -> endTransmission() == 0;
+    }
+
+    bool read(uint8_t addr, uint8_t* data, size_t len) {
+        if (!wire) return false;
+        while (len > 0) {
+            const size_t chunk = len > I2C_CHUNK ? I2C_CHUNK : len;
+            if (wire -> requestFrom((uint16_t)addr, chunk, true) != chunk) return false;
+            for (size_t i = 0; i < chunk; i++) data[i] = wire -> read();
+            data += chunk;
+            len -= chunk;
+        }
+        return true;
+    }
+
+    bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+        if (!wire) return false;
+        wire -> beginTransmission(addr);
+        wire -> write(tx, txLen);
+        if (wire -> endTransmission(false) != 0) return false;
+        if (rxLen > I2C_CHUNK) return false;
+        if (wire -> requestFrom((uint16_t)addr, rxLen, true) != rxLen) return false;
+        for (size_t i = 0; i < rxLen; i++) rx[i] = wire -> read();
+        return true;
+    }
+
+    bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count) {
+        return i2cSequence(*this, addr, transfers, count);
+    }
+
+    void wait(uint32_t ms) {
+        powerWait(ms);
+    }
+};
+
+#endif
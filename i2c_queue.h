@@ -0,0 +1,322 @@
+#pragma once
+#ifndef I2C_QUEUE_H
+#define I2C_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "i2c_bus.h"
+
+/**
+ * Maximum number of transactions waiting on the bus at once.
+ */
+#define I2C_QUEUE_DEPTH 16
+
+enum I2COp : uint8_t { I2C_OP_WRITE, I2C_OP_READ, I2C_OP_WRITE_READ };
+enum I2CState : uint8_t { I2C_JOB_IDLE, I2C_JOB_PENDING, I2C_JOB_DONE, I2C_JOB_FAILED };
+
+/**
+ * A single bus transaction. Jobs are owned by the submitter and must stay alive until done.
+ * A job either completes through its onDone callback (called from the servicing context just
+ * before the job reads done, so it must not reuse the job), or acts as a future which the
+ * submitter waits on with I2CQueue::await, which holds on to it until its waiter was woken.
+ */
+struct I2CJob {
+    I2COp op = I2C_OP_WRITE;
+    uint8_t addr = 0;
+    const uint8_t* tx = nullptr;
+    size_t txLen = 0;
+    uint8_t* rx = nullptr;
+    size_t rxLen = 0;
+    void (*onDone)(I2CJob* job, bool ok, void* ctx) = nullptr;
+    void* ctx = nullptr;
+    void* waiter = nullptr;
+    bool chained = false;               // Runs only if the job before it in its batch succeeded
+    std::atomic<uint8_t> state{I2C_JOB_IDLE};
+    std::atomic<bool> released{false};  // The servicing context is done with the job and its waiter
+
+    I2CJob() {}
+    I2CJob(const I2CJob&) = delete;
+    I2CJob& operator=(const I2CJob&) = delete;
+
+    void write(uint8_t address, const uint8_t* data, size_t len) {
+        op = I2C_OP_WRITE;
+        addr = address;
+        tx = data;
+        txLen = len;
+    }
+
+    void read(uint8_t address, uint8_t* data, size_t len) {
+        op = I2C_OP_READ;
+        addr = address;
+        rx = data;
+        rxLen = len;
+    }
+
+    void writeRead(uint8_t address, const uint8_t* out, size_t outLen, uint8_t* in, size_t inLen) {
+        op = I2C_OP_WRITE_READ;
+        addr = address;
+        tx = out;
+        txLen = outLen;
+        rx = in;
+        rxLen = inLen;
+    }
+
+    void transfer(uint8_t address, const I2CTransfer& t) {
+        if (t.tx && t.rx) writeRead(address, t.tx, t.txLen, t.rx, t.rxLen);
+        else if (t.rx) read(address, t.rx, t.rxLen);
+        else write(address, t.tx, t.txLen);
+    }
+
+    bool done() const {
+        const uint8_t s = state.load();
+        return s == I2C_JOB_DONE || s == I2C_JOB_FAILED;
+    }
+
+    bool ok() const {
+        return state.load() == I2C_JOB_DONE;
+    }
+};
+
+/**
+ * Queue of transactions in front of a bus (see i2c_bus.h), drained by whoever calls service().
+ * On the station a worker task services the queue while sensor tasks wait on their jobs;
+ * on the host, with no hooks installed, await() simply services the queue inline.
+ *
+ * @tparam Bus: The bus transactions are executed on.
+ * @tparam N: The queue capacity.
+ */
+template <typename Bus, size_t N = I2C_QUEUE_DEPTH>
+class I2CQueue {
+public:
+    /**
+     * Platform glue.
+     * kick: called after a submit, to wake the servicing context.
+     * self: returns a handle for the calling context, stored in jobs which have no callback.
+     * wake: called with that handle once its job is done.
+     * park: blocks the calling context until it is woken.
+     * yield: lets the servicing context run, while a job's waiter is still being woken.
+     * lock / unlock: guard the ring, defaulting to a spinlock when unset.
+     */
+    struct Hooks {
+        void (*lock)(void* ctx) = nullptr;
+        void (*unlock)(void* ctx) = nullptr;
+        void (*kick)(void* ctx) = nullptr;
+        void* (*self)(void* ctx) = nullptr;
+        void (*wake)(void* waiter, void* ctx) = nullptr;
+        void (*park)(void* ctx) = nullptr;
+        void (*yield)(void* ctx) = nullptr;
+        void* ctx = nullptr;
+    };
+
+    Bus bus;
+    uint32_t completed = 0;
+    uint32_t failed = 0;
+
+    I2CQueue() {}
+    I2CQueue(Bus b) : bus(b) {}
+
+    void setHooks(const Hooks& h) {
+        hooks = h;
+    }
+
+    /**
+     * Queue a single transaction.
+     * @return True if the job was queued, false if the queue was full.
+     */
+    bool submit(I2CJob* job) {
+        return submitBatch(&job, 1);
+    }
+
+    /**
+     * Queue several transactions, all or nothing. They run back to back on the bus, and stop
+     * at the first which fails: the jobs after it fail without running, as in i2cSequence.
+     * @return True if all jobs were queued, false if they did not fit.
+     */
+    bool submitBatch(I2CJob** jobs, size_t count) {
+        void* waiter = hooks.self ? hooks.self(hooks.ctx) : nullptr;
+
+        lock();
+        if (N - size < count) {
+            unlock();
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            jobs[i] -> waiter = jobs[i] -> onDone ? nullptr : waiter;
+            jobs[i] -> chained = i > 0;
+            jobs[i] -> released.store(false);
+            jobs[i] -> state.store(I2C_JOB_PENDING);
+            ring[(head + size) % N] = jobs[i];
+            size++;
+        }
+        unlock();
+
+        if (hooks.kick) hooks.kick(hooks.ctx);
+        return true;
+    }
+
+    /**
+     * Wait for a job to finish.
+     * @return True if the transaction succeeded.
+     */
+    bool await(I2CJob* job) {
+        while (!job -> done()) {
+            if (hooks.park) hooks.park(hooks.ctx);
+            else service();
+        }
+        // service() may still be waking this context for the job. Neither may go away before
+        // that, so the job is held until it is released; that is right after the wake.
+        while (job -> waiter && !job -> released.load()) {
+            if (hooks.yield) hooks.yield(hooks.ctx);
+        }
+        return job -> ok();
+    }
+
+    /**
+     * Execute queued transactions on the bus and complete them. Only one context may service at a time.
+     * @param max: The maximum number of jobs to execute.
+     * @return The number of jobs executed.
+     */
+    size_t service(size_t max = N) {
+        size_t n = 0;
+        while (n < max) {
+            I2CJob* job = pop();
+            if (!job) break;
+
+            // Once a job of a batch failed, the rest of the batch fails without touching the bus.
+            bool ok = false;
+            if (!job -> chained || !broken) {
+                switch (job -> op) {
+                    case I2C_OP_WRITE: ok = bus.write(job -> addr, job -> tx, job -> txLen); break;
+                    case I2C_OP_READ: ok = bus.read(job -> addr, job -> rx, job -> rxLen); break;
+                    case I2C_OP_WRITE_READ: ok = bus.writeRead(job -> addr, job -> tx, job -> txLen, job -> rx, job -> rxLen); break;
+                }
+            }
+
+            broken = !ok;
+            if (ok) completed++;
+            else failed++;
+
+            // Once a callback job reads done its owner may reuse or free it, so everything needed is
+            // taken from it first and publishing the state is the last access to it. An awaited job is
+            // held by await() until it is released, after its waiter was woken.
+            void (*onDone)(I2CJob*, bool, void*) = job -> onDone;
+            void* ctx = job -> ctx;
+            void* waiter = job -> waiter;
+            if (onDone) onDone(job, ok, ctx);
+            job -> state.store(ok ? I2C_JOB_DONE : I2C_JOB_FAILED);
+            if (waiter) {
+                if (hooks.wake) hooks.wake(waiter, hooks.ctx);
+                job -> released.store(true);
+            }
+            n++;
+        }
+        return n;
+    }
+
+    /**
+     * Number of jobs waiting to be executed.
+     */
+    size_t pending() {
+        lock();
+        const size_t n = size;
+        unlock();
+        return n;
+    }
+
+private:
+    I2CJob* ring[N] = {};
+    size_t head = 0;
+    size_t size = 0;
+    std::atomic_flag busy = ATOMIC_FLAG_INIT;
+    bool broken = false;                // The last job serviced failed, so the rest of its batch does
+    Hooks hooks;
+
+    void lock() {
+        if (hooks.lock) hooks.lock(hooks.ctx);
+        else while (busy.test_and_set(std::memory_order_acquire)) {}
+    }
+
+    void unlock() {
+        if (hooks.unlock) hooks.unlock(hooks.ctx);
+        else busy.clear(std::memory_order_release);
+    }
+
+    I2CJob* pop() {
+        lock();
+        I2CJob* job = nullptr;
+        if (size > 0) {
+            job = ring[head];
+            head = (head + 1) % N;
+            size--;
+        }
+        unlock();
+        return job;
+    }
+};
+
+/**
+ * Bus interface (see i2c_bus.h) on top of a queue, so the register level drivers run
+ * unchanged on the queue: each call submits a job and waits for it to finish.
+ *
+ * @tparam Queue: The I2CQueue type to submit to.
+ */
+template <typename Queue>
+struct QueuedBus {
+    Queue *queue = nullptr;
+
+    QueuedBus() {}
+    QueuedBus(Queue *q) : queue(q) {}
+
+    bool write(uint8_t addr, const uint8_t* data, size_t len) {
+        I2CJob job;
+        job.write(addr, data, len);
+        return run(&job);
+    }
+
+    bool read(uint8_t addr, uint8_t* data, size_t len) {
+        I2CJob job;
+        job.read(addr, data, len);
+        return run(&job);
+    }
+
+    bool writeRead(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+        I2CJob job;
+        job.writeRead(addr, tx, txLen, rx, rxLen);
+        return run(&job);
+    }
+
+    /**
+     * Submit the whole sequence as one batch, so it runs back to back on the bus and stops at the first failure.
+     */
+    bool sequence(uint8_t addr, const I2CTransfer* transfers, size_t count) {
+        if (!queue || count > I2C_SEQUENCE_MAX) return false;
+        I2CJob jobs[I2C_SEQUENCE_MAX];
+        I2CJob* batch[I2C_SEQUENCE_MAX];
+        for (size_t i = 0; i < count; i++) {
+            jobs[i].transfer(addr, transfers[i]);
+            batch[i] = &jobs[i];
+        }
+        if (!queue -> submitBatch(batch, count)) return false;
+
+        // The jobs live on this stack, so every one is waited for, even after one failed.
+        bool ok = true;
+        for (size_t i = 0; i < count; i++) ok = queue -> await(&jobs[i]) && ok;
+        return ok;
+    }
+
+    /**
+     * Waits on the queue's bus, in the calling context.
+     */
+    void wait(uint32_t ms) {
+        if (queue) queue -> bus.wait(ms);
+    }
+
+private:
+    bool run(I2CJob* job) {
+        if (!queue || !queue -> submit(job)) return false;
+        return queue -> await(job);
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#pragma once
+#ifndef IMAGE_BUFFER_H
+#define IMAGE_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "heap.h"
+
+#define IMAGE_POOL_ALLOC(len) heapAlloc(len)
+
+/**
+ * The image pool is carved into IMAGE_SLAB_COUNT slabs of IMAGE_SLAB_SIZE bytes.
+ * An image takes as many neighbouring slabs as it needs. A QHD JPEG at quality 10 fits in one or two.
+ */
+#define IMAGE_SLAB_SIZE (256 * 1024)
+#define IMAGE_SLAB_COUNT 6
+
+/**
+ * Who is responsible for giving an image's memory back.
+ */
+enum ImageOwner : uint8_t {
+    IMAGE_EMPTY = 0,        // Empty buffer
+    IMAGE_FROM_DRIVER,      // A frame lent by the camera driver, returned to it
+    IMAGE_FROM_POOL,        // Slabs from a SlabPool, released to it
+    IMAGE_FROM_MAPPING      // A region mapped or owned elsewhere, unmapped through its callback if any
+};
+
+/**
+ * Fixed pool of large slabs, allocated once on first use and then reused for every capture
+ * and backlog reload, so that image sized allocations never fragment the heap.
+ * Not thread safe: images are only handled from the main task.
+ *
+ * @tparam SlabSize: The size of one slab in bytes.
+ * @tparam Count: The number of slabs, at most 32.
+ */
+template <size_t SlabSize = IMAGE_SLAB_SIZE, uint8_t Count = IMAGE_SLAB_COUNT>
+class SlabPool {
+    static_assert(Count > 0 && Count <= 32, "A SlabPool holds between 1 and 32 slabs");
+
+public:
+    SlabPool() {}
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    /**
+     * Allocate the backing region, if not done already.
+     * @return True if the pool is usable.
+     */
+    bool begin() {
+        if (!region) region = (uint8_t*)IMAGE_POOL_ALLOC(SlabSize * Count);
+        return region != nullptr;
+    }
+
+    /**
+     * Take enough neighbouring slabs to hold len bytes.
+     * @param len: The number of bytes needed.
+     * @return The start of the block, or nullptr if the pool has no room.
+     */
+    uint8_t* acquire(size_t len) {
+        if (!len || !begin()) return nullptr;
+        const size_t need = (len + SlabSize - 1) / SlabSize;
+        if (need > Count) return nullptr;
+
+        const uint32_t run = need == 32 ? 0xFFFFFFFFu : ((1u << need) - 1);
+        for (uint8_t i = 0; i + need <= Count; i++) {
+            if (used & (run << i)) continue;
+            used |= run << i;
+            runs[i] = need;
+            if (__builtin_popcount(used) > peak) peak = __builtin_popcount(used);
+            return region + i * SlabSize;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Give back a block from acquire().
+     * @param block: The start of the block.
+     */
+    void release(uint8_t* block) {
+        if (!block || !region || block < region) return;
+        const size_t i = (block - region) / SlabSize;
+        if (i >= Count || !runs[i]) return;
+        const uint32_t run = runs[i] == 32 ? 0xFFFFFFFFu : ((1u << runs[i]) - 1);
+        used &= ~(run << i);
+        runs[i] = 0;
+    }
+
+    /**
+     * @return The most slabs ever in use at once.
+     */
+    uint8_t highWater() const {
+        return peak;
+    }
+
+    /**
+     * @return The largest block the pool could currently hand out, in bytes.
+     */
+    size_t largestFree() const {
+        uint8_t best = 0, current = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            current = (used >> i) & 1 ? 0 : current + 1;
+            if (current > best) best = current;
+        }
+        return best * SlabSize;
+    }
+
+    static constexpr size_t slabSize() {
+        return SlabSize;
+    }
+
+private:
+    uint8_t* region = nullptr;
+    uint32_t used = 0;
+    uint8_t runs[Count] = {};
+    uint8_t peak = 0;
+};
+
+typedef SlabPool<> ImagePool;
+
+/**
+ * Global image pool, shared by captures and backlog reloads.
+ */
+extern ImagePool IMAGE_POOL;
+
+/**
+ * A JPEG in memory, along with who owns it. Image buffers move but never copy, and give
+ * their memory back to the right owner when they go out of scope:
+ * a camera frame goes back to the driver, a pool block to its pool, a mapped region to its unmapper.
+ */
+class ImageBuffer {
+public:
+    typedef void (*Release)(void* ctx);
+
+    ImageBuffer() {}
+    ImageBuffer(const ImageBuffer&) = delete;
+    ImageBuffer& operator=(const ImageBuffer&) = delete;
+
+    ImageBuffer(ImageBuffer&& other) {
+        take(other);
+    }
+
+    ImageBuffer& operator=(ImageBuffer&& other) {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    ~ImageBuffer() {
+        reset();
+    }
+
+    /**
+     * Wrap a frame lent by a camera driver.
+     * @param buf: The frame data.
+     * @param len: The frame length.
+     * @param release: Gives the frame back to the driver, called with ctx.
+     * @param ctx: The driver's handle for the frame.
+     */
+    static ImageBuffer fromDriver(uint8_t* buf, size_t len, uint16_t width, uint16_t height, Release release, void* ctx) {
+        ImageBuffer img;
+        img.set(IMAGE_FROM_DRIVER, buf, len, width, height);
+        img.releaseFn = release;
+        img.ctx = ctx;
+        return img;
+    }
+
+    /**
+     * Allocate an image of len bytes from a slab pool.
+     * @return The image, empty if the pool had no room.
+     */
+    template <typename Pool>
+    static ImageBuffer fromPool(Pool* pool, size_t len, uint16_t width = 0, uint16_t height = 0) {
+        ImageBuffer img;
+        uint8_t* block = pool ? pool -> acquire(len) : nullptr;
+        if (!block) return img;
+        img.set(IMAGE_FROM_POOL, block, len, width, height);
+        img.ctx = pool;
+        img.poolRelease = [](void* p, uint8_t* b) { static_cast<Pool*>(p) -> release(b); };
+        return img;
+    }
+
+    /**
+     * Wrap a region mapped or owned elsewhere, such as a memory mapped partition or file.
+     * @param unmap: Called with ctx once the image is dropped, or nullptr if the region outlives the image.
+     */
+    static ImageBuffer mapped(uint8_t* buf, size_t len, uint16_t width = 0, uint16_t height = 0, Release unmap = nullptr, void* ctx = nullptr) {
+        ImageBuffer img;
+        img.set(IMAGE_FROM_MAPPING, buf, len, width, height);
+        img.releaseFn = unmap;
+        img.ctx = ctx;
+        return img;
+    }
+
+    /**
+     * Give the memory back to its owner and become empty.
+     */
+    void reset() {
+        if (owner_ == IMAGE_FROM_POOL && poolRelease) poolRelease(ctx, buf);
+        else if (owner_ != IMAGE_EMPTY && releaseFn) releaseFn(ctx);
+        clear();
+    }
+
+    /**
+     * Shorten the image to its first len bytes, e.g. after reading fewer bytes than reserved.
+     */
+    void truncate(size_t len) {
+        if (len < len_) len_ = len;
+    }
+
+    uint8_t* data() const { return buf; }
+    size_t size() const { return len_; }
+    uint16_t width() const { return width_; }
+    uint16_t height() const { return height_; }
+    ImageOwner owner() const { return owner_; }
+    explicit operator bool() const { return buf != nullptr && len_ > 0; }
+
+private:
+    uint8_t* buf = nullptr;
+    size_t len_ = 0;
+    uint16_t width_ = 0;
+    uint16_t height_ = 0;
+    ImageOwner owner_ = IMAGE_EMPTY;
+    Release releaseFn = nullptr;
+    void (*poolRelease)(void* pool, uint8_t* block) = nullptr;
+    void* ctx = nullptr;
+
+    void set(ImageOwner owner, uint8_t* data, size_t len, uint16_t width, uint16_t height) {
+        owner_ = owner;
+        buf = data;
+        len_ = len;
+        width_ = width;
+        height_ = height;
+    }
+
+    void clear() {
+        set(IMAGE_EMPTY, nullptr, 0, 0, 0);
+        releaseFn = nullptr;
+        poolRelease = nullptr;
+        ctx = nullptr;
+    }
+
+    void take(ImageBuffer& other) {
+        set(other.owner_, other.buf, other.len_, other.width_, other.height_);
+        releaseFn = other.releaseFn;
+        poolRelease = other.poolRelease;
+        ctx = other.ctx;
+        other.clear();
+    }
+};
+
+#endif
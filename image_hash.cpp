@@ -0,0 +1,82 @@
+#include "image_hash.h"
+#include "jpeg.h"
+
+/**
+ * Perceptual difference hash (dHash) of a JPEG, from the DC coefficients of its luma blocks.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param hash: The hash to fill in.
+ *
+ * @return False if the JPEG could not be decoded.
+ */
+bool imageHash(const uint8_t* jpg, size_t len, uint64_t* hash) {
+    static JpegDecoder decoder;
+    if (!hash || !decoder.begin(jpg, len)) return false;
+
+    int32_t sums[IMAGE_HASH_ROWS][IMAGE_HASH_COLS] = {};
+    uint32_t counts[IMAGE_HASH_ROWS][IMAGE_HASH_COLS] = {};
+    int16_t blocks[JPEG_MAX_BLOCKS][64];
+
+    // Luma blocks across and down the whole image, including the MCU padding.
+    const JpegComponent& y = decoder.comp[0];
+    const uint32_t blocksX = (uint32_t)decoder.mcusX * y.h;
+    const uint32_t blocksY = (uint32_t)decoder.mcusY * y.v;
+
+    while (decoder.mcu() < decoder.mcuCount()) {
+        const uint32_t mcu = decoder.mcu();
+        if (!decoder.decodeMcu(blocks, 1)) return false;
+
+        const uint32_t mx = mcu % decoder.mcusX;
+        const uint32_t my = mcu / decoder.mcusX;
+        for (uint8_t by = 0; by < y.v; by++) {
+            const uint32_t row = (my * y.v + by) * IMAGE_HASH_ROWS / blocksY;
+            for (uint8_t bx = 0; bx < y.h; bx++) {
+                const uint32_t col = (mx * y.h + bx) * IMAGE_HASH_COLS / blocksX;
+                sums[row][col] += blocks[by * y.h + bx][0];
+                counts[row][col]++;
+            }
+        }
+    }
+
+    // All cells share the one quantiser, so comparing quantised DC sums is enough.
+    uint64_t h = 0;
+    for (uint8_t r = 0; r < IMAGE_HASH_ROWS; r++) {
+        for (uint8_t c = 0; c < IMAGE_HASH_COLS - 1; c++) {
+            const int64_t left = (int64_t)sums[r][c] * counts[r][c + 1];
+            const int64_t right = (int64_t)sums[r][c + 1] * counts[r][c];
+            h = (h << 1) | (left < right);
+        }
+    }
+    *hash = h;
+    return true;
+}
+
+/**
+ * Number of differing bits between two hashes.
+ */
+uint8_t hashDistance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+/**
+ * Decide whether an image is worth sending or spooling, and update the state with the decision.
+ * @param state: What is known about the previously kept images.
+ * @param hash: The hash of the new image.
+ * @param len: The size of the new image.
+ *
+ * @return True to keep the image, false if it duplicates the reference.
+ */
+bool keepImage(ImageDedup* state, uint64_t hash, size_t len) {
+    if (state -> valid &&
+        state -> skips < IMAGE_HASH_MAX_SKIPS &&
+        hashDistance(state -> reference, hash) <= IMAGE_HASH_DUPLICATE) {
+        state -> skips++;
+        state -> skippedBytes += len;
+        return false;
+    }
+
+    state -> reference = hash;
+    state -> valid = true;
+    state -> skips = 0;
+    return true;
+}
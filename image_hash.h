@@ -0,0 +1,59 @@
+#pragma once
+#ifndef IMAGE_HASH_H
+#define IMAGE_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Images whose hashes differ in at most IMAGE_HASH_DUPLICATE of 64 bits show the same sky.
+ * After IMAGE_HASH_MAX_SKIPS duplicates in a row an image is kept anyway, so the server
+ * never goes long without a fresh one.
+ */
+#define IMAGE_HASH_DUPLICATE 4
+#define IMAGE_HASH_MAX_SKIPS 5
+
+/**
+ * The hash grid: 9 x 8 cells of averaged luma, compared left to right into 64 bits.
+ */
+#define IMAGE_HASH_COLS 9
+#define IMAGE_HASH_ROWS 8
+
+/**
+ * What the station remembers about the images it kept, across deep sleep: the hash the next
+ * image is compared with, and how much was skipped since the status last reported it.
+ */
+struct ImageDedup {
+    uint64_t reference = 0;     // Hash of the last image sent or spooled
+    bool valid = false;         // Whether reference holds a hash
+    uint8_t skips = 0;          // Images skipped since the reference
+    uint32_t skippedBytes = 0;  // Bytes skipped since last reported
+};
+
+/**
+ * Perceptual difference hash (dHash) of a JPEG, from the DC coefficients of its luma blocks.
+ * Only the entropy coded data is walked, there is no IDCT and nothing is dequantised but the DC.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param hash: The hash to fill in.
+ *
+ * @return False if the JPEG could not be decoded.
+ */
+bool imageHash(const uint8_t* jpg, size_t len, uint64_t* hash);
+
+/**
+ * Number of differing bits between two hashes.
+ */
+uint8_t hashDistance(uint64_t a, uint64_t b);
+
+/**
+ * Decide whether an image is worth sending or spooling, and update the state with the decision.
+ * @param state: What is known about the previously kept images.
+ * @param hash: The hash of the new image.
+ * @param len: The size of the new image.
+ *
+ * @return True to keep the image, false if it duplicates the reference.
+ */
+bool keepImage(ImageDedup* state, uint64_t hash, size_t len);
+
+#endif
@@ -1,5 +1,7 @@
 #include "io.h"
 
+ImagePool IMAGE_POOL;
+
 /**
  * Attempt to initialize the sdcard file system. 
  * @return True if the sdcard was successfully mounted, false otherwise.
@@ -57,16 +59,16 @@ void deepSleepMins(double mins) {
 void initLogFile (fs::FS &fs) {
   // Check if the log file exists, if not create it.
   if(fs.exists(LOG_FILE)) return;
-  File file = fs.open(LOG_FILE, FILE_WRITE, true);
+  File file = beginReplace(fs, LOG_FILE);
   if(!file){
     debugln("Failed to open log file for writing");
     return;
   }
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   doc.createNestedArray("readings");
-  if( serializeJson(doc, file) == 0) debugln("Failed to write to log file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, LOG_FILE, written)) debugln("Failed to write to log file");
   else debugln("Log file Initialised");
-  file.close();
 }
 
 /**
@@ -76,26 +78,26 @@ void initLogFile (fs::FS &fs) {
 void initCacheFile (fs::FS &fs) {
   // Check if the log file exists, if not create it.
   if(fs.exists(CACHE_FILE)) return;
-  File file = fs.open(CACHE_FILE, FILE_WRITE, true);
+  File file = beginReplace(fs, CACHE_FILE);
   if(!file){
     debugln("Failed to open log file for writing");
     return;
   }
   
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   doc["NTP"] = "None";
   doc["SERVER"] = "None";
   doc.createNestedObject("QNH");
   doc["QNH"]["value"] = 0;
   doc["QNH"]["timestamp"] = "None";
-  if( serializeJson(doc, file) == 0) debugln("Failed to write to log file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, CACHE_FILE, written)) debugln("Failed to write to log file");
   else debugln("Log file Initialised");
-  file.close();
 }
 
 /**
  * Read the conf file and return a dynamically allocated const char*.
- * WARNING: Dynamically allocated char array for file output.
+ * WARNING: Dynamically allocated char array for file output, freed with heapFree.
  * @param fs: The file system reference to use for the cache.
  * @param path: The path to the file to read.
  * 
@@ -104,7 +106,6 @@ void initCacheFile (fs::FS &fs) {
 const char* readFile(fs::FS &fs, const char * path) {
   debugf("\nReading file: %s\r\n", path);
 
-  String output;
   File file = fs.open(path);
 
   if (!file || file.isDirectory()) {
@@ -112,16 +113,104 @@ const char* readFile(fs::FS &fs, const char * path) {
     return nullptr;  // Return nullptr on failure
   }
 
-  while (file.available()) {
-    output.concat((char)file.read());
+  // Read straight into a buffer of the file's size, in PSRAM once the file is large.
+  const size_t size = file.size();
+  char* result = (char*)heapAlloc(size + 1);
+  if (!result) {
+    file.close();
+    return nullptr;
   }
+  const size_t length = file.read((uint8_t*)result, size);
+  result[length] = '\0';
+
+  file.close();
+  return result;  // Give it back with heapFree
+}
+
+/**
+ * Size of a file, without reading it.
+ * @param fs: The file system reference to use.
+ * @param path: The path to the file.
+ * 
+ * @return The size in bytes, 0 if the file doesn't exist.
+ */
+size_t fileSize(fs::FS &fs, const char * path) {
+  File file = fs.open(path);
+  if (!file || file.isDirectory()) return 0;
+  const size_t size = file.size();
+  file.close();
+  return size;
+}
+
+#define REPLACE_PATH_LENGTH (MAX_PATH_LENGTH + REPLACE_SUFFIX_LENGTH + 1)
+
+/**
+ * The name a file's replacement goes by.
+ * @param out: Where to put it, REPLACE_PATH_LENGTH long.
+ * @param suffix: REPLACE_TMP while it is written, REPLACE_NEW once it is complete.
+ *
+ * @return False if the path is too long.
+ */
+static bool replacementPath(char* out, const char* path, const char* suffix) {
+  const int n = snprintf(out, REPLACE_PATH_LENGTH, "%s%s", path, suffix);
+  return n > 0 && n < REPLACE_PATH_LENGTH;
+}
 
+/**
+ * Put a complete replacement in the file's place. FAT won't rename onto an existing file,
+ * so the old one goes first: from then on, only the replacement holds the contents.
+ */
+static bool promote(fs::FS &fs, const char* ready, const char* path) {
+  if (fs.exists(path) && !fs.remove(path)) return false;
+  return fs.rename(ready, path);
+}
+
+File beginReplace(fs::FS &fs, const char * path) {
+  char tmp[REPLACE_PATH_LENGTH];
+  if (!replacementPath(tmp, path, REPLACE_TMP)) return File();
+  return fs.open(tmp, FILE_WRITE, true);
+}
+
+bool endReplace(fs::FS &fs, File &file, const char * path, bool written) {
+  char tmp[REPLACE_PATH_LENGTH];
+  char ready[REPLACE_PATH_LENGTH];
   file.close();
+  if (!replacementPath(tmp, path, REPLACE_TMP) || !replacementPath(ready, path, REPLACE_NEW)) return false;
+  if (!written) {
+    fs.remove(tmp);
+    return false;
+  }
+
+  // Once renamed, the replacement is known to be complete, and boot finishes the job if this doesn't.
+  if (fs.exists(ready)) fs.remove(ready);
+  if (!fs.rename(tmp, ready)) {
+    fs.remove(tmp);
+    return false;
+  }
+  return promote(fs, ready, path);
+}
 
-  // Dynamically allocate memory to hold the return string
-  char* result = new char[output.length() + 1];
-  strcpy(result, output.c_str());
-  return result;  // Return the dynamically allocated memory
+size_t recoverFiles(fs::FS &fs) {
+  std::vector<String> found;
+  File root = fs.open("/");
+  if (!root || !root.isDirectory()) return 0;
+  for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+    const String name = file.path();
+    if (name.endsWith(REPLACE_TMP) || name.endsWith(REPLACE_NEW)) found.push_back(name);
+  }
+  root.close();
+
+  for (const String& name : found) {
+    const String path = name.substring(0, name.length() - REPLACE_SUFFIX_LENGTH);
+    if (name.endsWith(REPLACE_TMP)) {
+      debugf("Dropping the unfinished replacement of %s\n", path.c_str());
+      fs.remove(name);
+    } else {
+      debugf("Finishing the replacement of %s\n", path.c_str());
+      if (!promote(fs, name.c_str(), path.c_str())) debugf("- failed to replace %s\n", path.c_str());
+    }
+  }
+  return found.size();
 }
 
 /**
@@ -135,7 +224,7 @@ const char* readFile(fs::FS &fs, const char * path) {
  */
 char* formattime(tm* now) {
   char *timestamp = new char[30];
-  strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", now);
+  strftime(timestamp, 30, "%Y-%m-%d %H:%M:%S", now);
   return timestamp;
 }
 
@@ -148,9 +237,9 @@ char* formattime(tm* now) {
 void updateCache (fs::FS &fs, char* timestamp, const char* field) {
   const char* cache = readFile(fs, CACHE_FILE);
   debugf("Updating cache field: %s with timestamp: %s\n", field, timestamp);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
-  delete[] cache;
+  heapFree(cache);
   if (error) {
     debugln("Failed to read cache file");
     return;
@@ -158,14 +247,14 @@ void updateCache (fs::FS &fs, char* timestamp, const char* field) {
 
   doc[field] = timestamp;
 
-  File file = fs.open(CACHE_FILE, FILE_WRITE);
+  File file = beginReplace(fs, CACHE_FILE);
   if(!file){
     debugln("Failed to open cache file for writing");
     return;
   }
-  if( serializeJson(doc, file) == 0) debugln("Failed to update cache file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, CACHE_FILE, written)) debugln("Failed to update cache file");
   else debugln("Cache file updated");
-  file.close();
 }
 
 /**
@@ -182,8 +271,9 @@ void updateCache (fs::FS &fs, double value, const char* field) {
 
   String fld = String(field);
   const char* cache = readFile(fs, CACHE_FILE);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
+  heapFree(cache);
   if (error) {
     debugln("Failed to read cache file");
     return;
@@ -191,14 +281,14 @@ void updateCache (fs::FS &fs, double value, const char* field) {
 
   doc[fld] = value;
 
-  File file = fs.open(CACHE_FILE, FILE_WRITE);
+  File file = beginReplace(fs, CACHE_FILE);
   if(!file){
     debugln("Failed to open cache file for writing");
     return;
   }
-  if( serializeJson(doc, file) == 0) debugln("Failed to update cache file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, CACHE_FILE, written)) debugln("Failed to update cache file");
   else debugln("Cache file updated");
-  file.close();
 }
 
 /**
@@ -209,8 +299,9 @@ void updateCache (fs::FS &fs, double value, const char* field) {
  */
 void updateCache (fs::FS &fs, cacheUpdate* update, const char* field) {
   const char* cache = readFile(fs, CACHE_FILE);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
+  heapFree(cache);
   if (error) {
     debugln("Failed to read cache file");
     return;
@@ -223,40 +314,44 @@ void updateCache (fs::FS &fs, cacheUpdate* update, const char* field) {
 
   if (ts.length() > 0) doc[fld]["timestamp"] = ts;
 
-  File file = fs.open(CACHE_FILE, FILE_WRITE);
+  File file = beginReplace(fs, CACHE_FILE);
   if(!file){
     debugln("Failed to open cache file for writing");
     return;
   }
-  if( serializeJson(doc, file) == 0) debugln("Failed to update cache file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, CACHE_FILE, written)) debugln("Failed to update cache file");
   else debugln("Cache file updated");
-  file.close();
 }
 
 /**
- * Empty the "readings" array in the log file.
+ * Drop the oldest readings of the "readings" array in the log file, once they were sent.
  * @param fs: The file system reference to use.
+ * @param count: How many to drop, all of them by default.
  */
-void clearLog(fs::FS &fs) {
+void clearLog(fs::FS &fs, size_t count) {
   const char* cache = readFile(fs, LOG_FILE);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
+  heapFree(cache);
   if (error) {
     debugln("Failed to read log file");
     return;
   }
 
-  doc["readings"].clear();
+  JsonArray readings = doc["readings"];
+  if (count >= readings.size()) readings.clear();
+  else for (size_t i = 0; i < count; i++) readings.remove(0);
 
-  File file = fs.open(LOG_FILE, FILE_WRITE);
+  File file = beginReplace(fs, LOG_FILE);
   if(!file){
     debugln("Failed to open log file for writing");
     return;
   }
 
-  if( serializeJson(doc, file) == 0) debugln("Failed to clear log file");
+  const bool written = serializeJson(doc, file) > 0;
+  if (!endReplace(fs, file, LOG_FILE, written)) debugln("Failed to clear log file");
   else debugln("Log file cleared");
-  file.close();
 }
 
 /**
@@ -265,7 +360,7 @@ void clearLog(fs::FS &fs) {
  */
 void str_replace(char *src, char *oldchars, char *newchars) { // utility string function
   char *p = strstr(src, oldchars);
-  char buf[MAX_STRING_LENGTH];
+  char buf[MAX_STRING_LENGTH] = "";
   do {
     if (p) {
       memset(buf, '\0', strlen(buf));
@@ -283,24 +378,67 @@ void str_replace(char *src, char *oldchars, char *newchars) { // utility string
   } while (p && (p = strstr(src, oldchars)));
 }
 
+#define JPG_PATH_LENGTH 35
+
+/**
+ * The file a reading's image is kept in. Paths must be absolute, the VFS refuses anything else.
+ * @param path: Where to put the path, JPG_PATH_LENGTH long.
+ * @param timestamp: The time of the reading.
+ */
+static void jpgPath(char* path, tm* timestamp) {
+  strftime(path, JPG_PATH_LENGTH, "/%Y_%m_%d_%H_%M_%S.jpg", timestamp);
+}
+
 /**
  * Write a jpg file to the file system.
  * @param fs: The file system reference to use.
  * @param timestamp: The timestamp to use for the file name.
- * @param fb: The camera frame buffer to write to the file.
+ * @param img: The image to write to the file.
  */
-void writejpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb) {
-  char* path = formattime(timestamp);
-  File file = fs.open(path, FILE_WRITE);
-  delete[] path;
+void writejpg(fs::FS &fs, tm* timestamp, const ImageBuffer& img) {
+  if (!img) {
+    debugln("No image to write");
+    return;
+  }
+
+  char path[JPG_PATH_LENGTH];
+  jpgPath(path, timestamp);
+  File file = beginReplace(fs, path);
   if(!file){
     debugln("Failed to open file in writing mode");
     return;
   }
-  if (file.write(fb -> buf, fb -> len) != fb -> len) debugln("Failed to write to file");
+  const bool written = file.write(img.data(), img.size()) == img.size();
+  if (!endReplace(fs, file, path, written)) debugln("Failed to write to file");
   else debugln("File written successfully");
 }
 
+/**
+ * Write one frame of an exposure bracket to the file system, next to the reading's image.
+ * @param fs: The file system reference to use.
+ * @param timestamp: The timestamp of the reading the bracket belongs to.
+ * @param index: The position of the frame in the bracket.
+ * @param img: The frame to write.
+ * 
+ * @return True if the whole frame was written.
+ */
+bool writeBracket(fs::FS &fs, tm* timestamp, uint8_t index, const ImageBuffer& img) {
+  if (!img) return false;
+
+  char path[40];
+  const size_t n = strftime(path, sizeof(path), "/%Y_%m_%d_%H_%M_%S", timestamp);
+  snprintf(path + n, sizeof(path) - n, "_b%u.jpg", index);
+  File file = beginReplace(fs, path);
+  if (!file) {
+    debugf("Failed to open %s in writing mode\n", path);
+    return false;
+  }
+  const bool written = file.write(img.data(), img.size()) == img.size();
+  const bool ok = endReplace(fs, file, path, written);
+  if (!ok) debugf("Failed to write %s\n", path);
+  return ok;
+}
+
 /**
  * Delete a jpg file from the file system.
  * @param fs: The file system reference to use.
@@ -309,58 +447,45 @@ void writejpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb) {
  * @return True if the file was deleted successfully, false otherwise.
  */
 bool deletejpg(fs::FS &fs, tm* timestamp) {
-  char path[35];
-  strftime(path, sizeof(path), "/%Y_%m_%d_%H_%M_%S.jpg", timestamp);
+  char path[JPG_PATH_LENGTH];
+  jpgPath(path, timestamp);
   debugf("Deleting file: %s\n", path);
   return fs.remove(path);
 }
 
 /**
- * Read a jpg file from the file system.
+ * Open a jpg file on the file system for reading.
  * @param fs: The file system reference to use.
  * @param timestamp: The timestamp to use for the file name.
- * @param fb: The camera frame buffer to read the file to.
  * 
- * @return True if the file was read successfully, false otherwise.
- */  
-bool readjpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb) {
-  if (!fb) {
-    return false;
-  }
+ * @return The file, which is false if there is none.
+ */
+File openjpg(fs::FS &fs, tm* timestamp) {
+  char path[JPG_PATH_LENGTH];
+  jpgPath(path, timestamp);
+  return fs.open(path, FILE_READ);
+}
 
-  char* filename = formattime(timestamp);
-  File file = fs.open(filename, FILE_READ);
-  delete[] filename;
-  
-  if (!file) {
-    debugln("Failed to open file");
-    return false;
-  }
-  
+/**
+ * Read an open jpg file into a block from IMAGE_POOL, leaving the file at its start.
+ * @param file: The file to read.
+ * 
+ * @return The image, empty if the file could not be read or the pool had no room.
+ */  
+ImageBuffer readjpg(File &file) {
   size_t fileSize = file.size();
-  
-  // Clean up existing buffer if present
-  if (fb->buf) delete[] fb->buf;
-  
-  uint8_t* buffer = new uint8_t[fileSize];
-  if (!buffer) {
-    file.close();
-    return false;
-  }
-  
-  size_t bytesRead = file.read(buffer, fileSize);
-  file.close();
-  
-  if (bytesRead != fileSize) {
-    delete[] buffer;
-    return false;
+  ImageBuffer img = ImageBuffer::fromPool(&IMAGE_POOL, fileSize, 2560, 1440); // FRAMESIZE_QHD
+  if (!img) {
+    // Without PSRAM there is no room for the pool at all.
+    if (IMAGE_POOL.begin()) debugf("No room in the image pool for %u bytes\n", fileSize);
+    else debugf("No image pool for %u bytes\n", fileSize);
+    return img;
   }
   
-  fb->buf = buffer;
-  fb->len = fileSize;
-  fb->width = 2560;  // FRAMESIZE_QHD
-  fb->height = 1440;
-  fb->format = PIXFORMAT_JPEG;
+  size_t bytesRead = file.read(img.data(), fileSize);
+  file.seek(0);
   
-  return true;
+  // Dropping the image hands its block back to the pool.
+  if (bytesRead != fileSize) return ImageBuffer();
+  return img;
 }
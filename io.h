@@ -6,21 +6,38 @@
 #include <vector>
 #include <time.h>
 #include <ArduinoJson.h>
+#include "json_arena.h"
+#include "heap.h"
 #include "esp_camera.h"
 #include "FS.h"
 #include <LittleFS.h>
 #include "SD_MMC.h"
+#include "image_buffer.h"
+#include "trace.h"
 
-#define DEBUG 1
+/**
+ * 1 prints debug output on Serial as it happens, for the bench. Otherwise it goes to the
+ * trace ring at TRACE_DEBUG, which costs a copy instead of the UART time, see trace.h.
+ */
+#define DEBUG 0
 
 #if DEBUG == 1
 #define debug(...) Serial.print(__VA_ARGS__)
 #define debugln(...) Serial.println(__VA_ARGS__)
 #define debugf(...) Serial.printf(__VA_ARGS__)
 #else
-#define debug(...)
-#define debugln(...)
-#define debugf(...)
+#define debug(...) do { if (TRACE_DEBUG <= TRACE_LEVEL) TraceText{TRACE_DEBUG, TRACE_SITE("%s")}(__VA_ARGS__); } while (0)
+#define debugln(...) do { if (TRACE_DEBUG <= TRACE_LEVEL) TraceText{TRACE_DEBUG, TRACE_SITE("%s\n")}(__VA_ARGS__); } while (0)
+#define debugf(...) tracef(TRACE_DEBUG, __VA_ARGS__)
+#endif
+
+/**
+ * State kept in RTC memory survives deep sleep on the station. Elsewhere it is plain memory.
+ * It is only initialised on cold boot, and only if its initialisers are all constant: one that
+ * needs code to run at startup would reset it on every wake.
+ */
+#ifndef RTC_DATA_ATTR
+#define RTC_DATA_ATTR
 #endif
 
 #define MAX_STRING_LENGTH 256
@@ -34,6 +51,16 @@
 #define CACHE_FILE "/cache.json"
 #define NETWORK_FILE "/networks.json"
 
+/**
+ * Files are rewritten by writing the new contents next to them and renaming them into place,
+ * so that losing power part way leaves the old file or the new one, never half of one.
+ * A replacement being written ends in REPLACE_TMP, and one written in full, waiting to take
+ * the old file's place, in REPLACE_NEW. Both suffixes are REPLACE_SUFFIX_LENGTH long.
+ */
+#define REPLACE_TMP ".tmp"
+#define REPLACE_NEW ".new"
+#define REPLACE_SUFFIX_LENGTH 4
+
 /**
  * Struct to store some cached information.
  */
@@ -75,7 +102,7 @@ void initCacheFile (fs::FS &fs);
 
 /**
  * Read the conf file and return a dynamically allocated const char*.
- * WARNING: Dynamically allocated char array for file output.
+ * WARNING: Dynamically allocated char array for file output, freed with heapFree.
  * @param fs: The file system reference to use for the cache.
  * @param path: The path to the file to read.
  * 
@@ -83,6 +110,44 @@ void initCacheFile (fs::FS &fs);
  */
 const char* readFile (fs::FS &fs, const char * path);
 
+/**
+ * Size of a file, without reading it.
+ * @param fs: The file system reference to use.
+ * @param path: The path to the file.
+ * 
+ * @return The size in bytes, 0 if the file doesn't exist.
+ */
+size_t fileSize(fs::FS &fs, const char * path);
+
+/**
+ * Open a replacement for a file, to write its new contents to.
+ * @param fs: The file system reference to use.
+ * @param path: The path to the file to replace.
+ *
+ * @return The replacement, closed if it could not be opened.
+ */
+File beginReplace(fs::FS &fs, const char * path);
+
+/**
+ * Close a replacement from beginReplace and, if it was written in full, put it in the file's place.
+ * @param fs: The file system reference to use.
+ * @param file: The replacement.
+ * @param path: The path to the file to replace.
+ * @param written: Whether everything was written. If not, the replacement is dropped and the file left alone.
+ *
+ * @return True if the file now has the new contents.
+ */
+bool endReplace(fs::FS &fs, File &file, const char * path, bool written);
+
+/**
+ * Deal with the replacements losing power interrupted, before anything reads the files:
+ * finish those which were written in full, drop the others.
+ * @param fs: The file system reference to use.
+ *
+ * @return The number of interrupted replacements found.
+ */
+size_t recoverFiles(fs::FS &fs);
+
 /**
  * Format the timestamp as MySQL DATETIME.
  * If the year is 1970, return "None".
@@ -118,10 +183,11 @@ void updateCache (fs::FS &fs, double value, const char* field);
 void updateCache (fs::FS &fs, cacheUpdate* update, const char* field);
 
 /**
- * Empty the "readings" array in the log file.
+ * Drop the oldest readings of the "readings" array in the log file, once they were sent.
  * @param fs: The file system reference to use.
+ * @param count: How many to drop, all of them by default.
  */
-void clearLog(fs::FS &fs);
+void clearLog(fs::FS &fs, size_t count = SIZE_MAX);
 
 /**
  * Replace a substring with another substring in a char array.
@@ -136,9 +202,20 @@ void str_replace(char *src, char *oldchars, char *newchars);
  * Write a jpg file to the file system.
  * @param fs: The file system reference to use.
  * @param timestamp: The timestamp to use for the file name.
- * @param fb: The camera frame buffer to write to the file.
+ * @param img: The image to write to the file.
  */
-void writejpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb);
+void writejpg(fs::FS &fs, tm* timestamp, const ImageBuffer& img);
+
+/**
+ * Write one frame of an exposure bracket to the file system, next to the reading's image.
+ * @param fs: The file system reference to use.
+ * @param timestamp: The timestamp of the reading the bracket belongs to.
+ * @param index: The position of the frame in the bracket.
+ * @param img: The frame to write.
+ *
+ * @return True if the whole frame was written.
+ */
+bool writeBracket(fs::FS &fs, tm* timestamp, uint8_t index, const ImageBuffer& img);
 
 /**
  * Delete a jpg file from the file system.
@@ -150,13 +227,20 @@ void writejpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb);
 bool deletejpg(fs::FS &fs, tm* timestamp);
 
 /**
- * Read a jpg file from the file system.
+ * Open a jpg file on the file system for reading.
  * @param fs: The file system reference to use.
  * @param timestamp: The timestamp to use for the file name.
- * @param fb: The camera frame buffer to read the file to.
  * 
- * @return True if the file was read successfully, false otherwise.
+ * @return The file, which is false if there is none.
+ */
+File openjpg(fs::FS &fs, tm* timestamp);
+
+/**
+ * Read an open jpg file into a block from IMAGE_POOL, leaving the file at its start.
+ * @param file: The file to read.
+ * 
+ * @return The image, empty if the file could not be read or the pool had no room.
  */
-bool readjpg(fs::FS &fs, tm* timestamp, camera_fb_t* fb);
+ImageBuffer readjpg(File &file);
 
 #endif
\ No newline at end of file
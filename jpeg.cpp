@@ -0,0 +1,507 @@
+#include "jpeg.h"
+#include <string.h>
+
+const uint8_t JPEG_ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/**
+ * Standard Huffman tables from Annex K.3, for encoders which leave them out.
+ */
+static const uint8_t K3_DC_LUMA_BITS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t K3_DC_CHROMA_BITS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t K3_DC_VALS[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t K3_AC_LUMA_BITS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t K3_AC_LUMA_VALS[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t K3_AC_CHROMA_BITS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t K3_AC_CHROMA_VALS[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static inline uint16_t be16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+/**
+ * Set the table from DHT style counts and symbols, and build the decoding tables.
+ * @return False if the table is malformed.
+ */
+bool JpegHuffman::set(const uint8_t* bits, const uint8_t* vals) {
+    uint16_t total = 0;
+    for (uint8_t l = 0; l < 16; l++) total += bits[l];
+    if (total > 256) return false;
+
+    memcpy(counts, bits, 16);
+    memcpy(symbols, vals, total);
+    memset(lookLen, 0, sizeof(lookLen));
+
+    int32_t code = 0;
+    uint16_t k = 0;
+    for (uint8_t l = 1; l <= 16; l++) {
+        valoff[l] = k - code;
+        for (uint8_t i = 0; i < counts[l - 1]; i++, k++, code++) {
+            if (l <= JPEG_LOOKAHEAD) {
+                const uint16_t first = code << (JPEG_LOOKAHEAD - l);
+                const uint16_t n = 1 << (JPEG_LOOKAHEAD - l);
+                for (uint16_t j = 0; j < n; j++) {
+                    lookLen[first + j] = l;
+                    lookSym[first + j] = symbols[k];
+                }
+            }
+        }
+        maxcode[l] = counts[l - 1] ? code - 1 : -1;
+        if (code > (1 << l)) return false;
+        code <<= 1;
+    }
+    maxcode[17] = 0x7FFFFFFF;
+    present = true;
+    return true;
+}
+
+/**
+ * Parse the headers up to the start of the scan.
+ * @param data: The JPEG.
+ * @param len: Its length.
+ *
+ * @return False if the image is not a JPEG this decoder supports.
+ */
+bool JpegDecoder::begin(const uint8_t* jpg, size_t length) {
+    reset();
+    data = jpg;
+    len = length;
+    if (!data || len < 4 || data[0] != 0xFF || data[1] != JPEG_SOI) return false;
+
+    size_t p = 2;
+    while (p + 4 <= len) {
+        if (data[p] != 0xFF) return false;
+        const uint8_t type = data[p + 1];
+        if (type == 0xFF) {
+            p++;
+            continue;
+        }
+
+        const uint16_t n = be16(data + p + 2);
+        if (n < 2 || p + 2 + n > len) return false;
+        const uint8_t* seg = data + p + 4;
+        const uint16_t segLen = n - 2;
+
+        bool ok = true;
+        switch (type) {
+            case JPEG_SOF0:
+            case JPEG_SOF1: ok = parseSOF(seg, segLen); break;
+            case JPEG_DHT: ok = parseDHT(seg, segLen); break;
+            case JPEG_DQT: ok = parseDQT(seg, segLen); break;
+            case JPEG_DRI: ok = segLen >= 2; if (ok) restartInterval = be16(seg); break;
+            case JPEG_SOS:
+                sos = p;
+                if (!parseSOS(seg, segLen) || !fallbackTables()) return false;
+                scan = p + 2 + n;
+                pos = scan;
+                restartsLeft = restartInterval;
+                return true;
+            default:
+                // Progressive, lossless and arithmetic coded frames are not supported.
+                if ((type >= 0xC2 && type <= 0xC3) || (type >= 0xC5 && type <= 0xC7) ||
+                    (type >= 0xC9 && type <= 0xCB) || (type >= 0xCD && type <= 0xCF)) return false;
+                break;
+        }
+        if (!ok) return false;
+        p += 2 + n;
+    }
+    return false;
+}
+
+/**
+ * Forget any previous image.
+ */
+void JpegDecoder::reset() {
+    width = height = 0;
+    components = 0;
+    hmax = vmax = 1;
+    mcusX = mcusY = 0;
+    restartInterval = 0;
+    blocksPerMcu = 0;
+    for (uint8_t i = 0; i < JPEG_HUFFMAN_TABLES; i++) dc[i].present = ac[i].present = false;
+    data = nullptr;
+    len = pos = scan = sos = 0;
+    bits = 0;
+    bitCount = 0;
+    marker = false;
+    next = 0;
+    restartsLeft = 0;
+    expectedRst = 0;
+}
+
+bool JpegDecoder::parseSOF(const uint8_t* seg, uint16_t n) {
+    if (n < 6 || seg[0] != 8) return false;
+    height = be16(seg + 1);
+    width = be16(seg + 3);
+    components = seg[5];
+    if (!width || !height || !components || components > JPEG_MAX_COMPONENTS || n < 6 + 3 * components) return false;
+
+    hmax = vmax = 1;
+    blocksPerMcu = 0;
+    for (uint8_t c = 0; c < components; c++) {
+        const uint8_t* s = seg + 6 + 3 * c;
+        comp[c].id = s[0];
+        comp[c].h = s[1] >> 4;
+        comp[c].v = s[1] & 0x0F;
+        comp[c].tq = s[2] & 3;
+        if (!comp[c].h || !comp[c].v || comp[c].h > 4 || comp[c].v > 4) return false;
+        if (comp[c].h > hmax) hmax = comp[c].h;
+        if (comp[c].v > vmax) vmax = comp[c].v;
+        blocksPerMcu += comp[c].h * comp[c].v;
+    }
+    if (components == 1) {
+        // A single component scan is not interleaved: one block per MCU.
+        comp[0].h = comp[0].v = hmax = vmax = 1;
+        blocksPerMcu = 1;
+    }
+    if (blocksPerMcu > JPEG_MAX_BLOCKS) return false;
+
+    uint8_t b = 0;
+    for (uint8_t c = 0; c < components; c++) {
+        for (uint8_t i = 0; i < comp[c].h * comp[c].v; i++) blockComponent[b++] = c;
+    }
+    mcusX = (width + 8 * hmax - 1) / (8 * hmax);
+    mcusY = (height + 8 * vmax - 1) / (8 * vmax);
+    return true;
+}
+
+bool JpegDecoder::parseDHT(const uint8_t* seg, uint16_t n) {
+    uint16_t p = 0;
+    while (p + 17 <= n) {
+        const uint8_t tc = seg[p] >> 4;
+        const uint8_t th = seg[p] & 0x0F;
+        if (tc > 1 || th >= JPEG_HUFFMAN_TABLES) return false;
+        uint16_t total = 0;
+        for (uint8_t l = 0; l < 16; l++) total += seg[p + 1 + l];
+        if (p + 17 + total > n) return false;
+        if (!(tc ? ac[th] : dc[th]).set(seg + p + 1, seg + p + 17)) return false;
+        p += 17 + total;
+    }
+    return p == n;
+}
+
+bool JpegDecoder::parseDQT(const uint8_t* seg, uint16_t n) {
+    uint16_t p = 0;
+    while (p < n) {
+        const uint8_t precision = seg[p] >> 4;
+        const uint8_t tq = seg[p] & 0x0F;
+        if (tq > 3 || p + 1 + 64 * (precision + 1) > n) return false;
+        for (uint8_t i = 0; i < 64; i++) {
+            qt[tq][i] = precision ? be16(seg + p + 1 + 2 * i) : seg[p + 1 + i];
+        }
+        p += 1 + 64 * (precision + 1);
+    }
+    return true;
+}
+
+bool JpegDecoder::parseSOS(const uint8_t* seg, uint16_t n) {
+    if (!components || n < 1) return false;
+    const uint8_t count = seg[0];
+    // Only single scan, interleaved images: every component in the one scan.
+    if (count != components || n < 1 + 2 * count + 3) return false;
+    for (uint8_t i = 0; i < count; i++) {
+        const uint8_t id = seg[1 + 2 * i];
+        const uint8_t tables = seg[2 + 2 * i];
+        uint8_t c = 0;
+        while (c < components && comp[c].id != id) c++;
+        if (c != i) return false;
+        comp[c].td = tables >> 4;
+        comp[c].ta = tables & 0x0F;
+        if (comp[c].td >= JPEG_HUFFMAN_TABLES || comp[c].ta >= JPEG_HUFFMAN_TABLES) return false;
+        comp[c].pred = 0;
+    }
+    const uint8_t* s = seg + 1 + 2 * count;
+    return s[0] == 0 && s[1] == 63 && s[2] == 0;
+}
+
+/**
+ * Install the Annex K tables for any table the image references but does not define.
+ */
+bool JpegDecoder::fallbackTables() {
+    for (uint8_t c = 0; c < components; c++) {
+        JpegHuffman& d = dc[comp[c].td];
+        JpegHuffman& a = ac[comp[c].ta];
+        if (!d.present && !d.set(c ? K3_DC_CHROMA_BITS : K3_DC_LUMA_BITS, K3_DC_VALS)) return false;
+        if (!a.present && !a.set(c ? K3_AC_CHROMA_BITS : K3_AC_LUMA_BITS, c ? K3_AC_CHROMA_VALS : K3_AC_LUMA_VALS)) return false;
+    }
+    return true;
+}
+
+/**
+ * Top up the bit buffer to at least 25 bits, unstuffing 0xFF00.
+ * At a marker (or the end of the data) zeros are shifted in instead.
+ */
+void JpegDecoder::fill() {
+    while (bitCount <= 24) {
+        uint32_t b = 0;
+        if (!marker && pos < len) {
+            b = data[pos];
+            if (b == 0xFF) {
+                const uint8_t following = pos + 1 < len ? data[pos + 1] : 0;
+                if (following == 0x00) pos += 2;
+                else {
+                    marker = true;
+                    b = 0;
+                }
+            } else pos++;
+        }
+        bits |= b << (24 - bitCount);
+        bitCount += 8;
+    }
+}
+
+int32_t JpegDecoder::getBits(uint8_t n) {
+    if (!n) return 0;
+    if (bitCount < n) fill();
+    const int32_t v = bits >> (32 - n);
+    bits <<= n;
+    bitCount -= n;
+    return v;
+}
+
+int JpegDecoder::decode(const JpegHuffman& table) {
+    if (bitCount < 16) fill();
+
+    const uint32_t peek = bits >> (32 - JPEG_LOOKAHEAD);
+    const uint8_t l = table.lookLen[peek];
+    if (l) {
+        bits <<= l;
+        bitCount -= l;
+        return table.lookSym[peek];
+    }
+
+    int32_t code = getBits(JPEG_LOOKAHEAD);
+    uint8_t length = JPEG_LOOKAHEAD;
+    while (length < 16 && code > table.maxcode[length]) {
+        code = (code << 1) | getBits(1);
+        length++;
+    }
+    if (code > table.maxcode[length]) return -1;
+    return table.symbols[code + table.valoff[length]];
+}
+
+/**
+ * Skip to the next restart marker and reset the predictors.
+ */
+bool JpegDecoder::restart() {
+    bits = 0;
+    bitCount = 0;
+    marker = false;
+
+    while (pos + 1 < len && !(data[pos] == 0xFF && data[pos + 1] >= JPEG_RST0 && data[pos + 1] <= JPEG_RST0 + 7)) pos++;
+    if (pos + 1 >= len || data[pos + 1] != JPEG_RST0 + expectedRst) return false;
+    pos += 2;
+
+    expectedRst = (expectedRst + 1) & 7;
+    restartsLeft = restartInterval;
+    for (uint8_t c = 0; c < components; c++) comp[c].pred = 0;
+    return true;
+}
+
+/**
+ * Decode the next MCU.
+ * @param blocks: The blocks of the MCU, at least blocksPerMcu of them.
+ * @param coeffs: How many coefficients of each block to keep, 1 (DC only) to 64.
+ *
+ * @return False on corrupt data or once all MCUs were decoded.
+ */
+bool JpegDecoder::decodeMcu(int16_t (*blocks)[64], uint8_t coeffs) {
+    if (!data || next >= mcuCount()) return false;
+    if (coeffs < 1) coeffs = 1;
+    if (coeffs > 64) coeffs = 64;
+
+    if (restartInterval) {
+        if (!restartsLeft && !restart()) return false;
+        restartsLeft--;
+    }
+
+    for (uint8_t b = 0; b < blocksPerMcu; b++) {
+        JpegComponent& c = comp[blockComponent[b]];
+        int16_t* block = blocks[b];
+        memset(block, 0, coeffs * sizeof(int16_t));
+
+        const int s = decode(dc[c.td]);
+        if (s < 0 || s > 11) return false;
+        if (s) c.pred += jpegExtend(getBits(s), s);
+        block[0] = c.pred;
+
+        const JpegHuffman& table = ac[c.ta];
+        for (uint8_t k = 1; k < 64; k++) {
+            const int rs = decode(table);
+            if (rs < 0) return false;
+            const uint8_t r = rs >> 4;
+            const uint8_t size = rs & 0x0F;
+            if (!size) {
+                if (r != 15) break;     // End of block
+                k += 15;                // Run of 16 zeros
+                continue;
+            }
+            k += r;
+            if (k > 63) return false;
+            const int32_t v = getBits(size);
+            if (k < coeffs) block[k] = jpegExtend(v, size);
+        }
+    }
+
+    next++;
+    return true;
+}
+
+/**
+ * Assign the canonical codes of a decoding table.
+ */
+void JpegHuffmanCode::set(const JpegHuffman& table) {
+    memset(size, 0, sizeof(size));
+    uint16_t c = 0;
+    uint16_t k = 0;
+    for (uint8_t l = 1; l <= 16; l++) {
+        for (uint8_t i = 0; i < table.counts[l - 1]; i++, k++, c++) {
+            code[table.symbols[k]] = c;
+            size[table.symbols[k]] = l;
+        }
+        c <<= 1;
+    }
+}
+
+/**
+ * Start encoding with the tables and components of a decoder.
+ * @param decoder: A decoder which has begun an image.
+ * @param out: Where the JPEG goes.
+ * @param capacity: Its size.
+ */
+void JpegEncoder::begin(const JpegDecoder& decoder, uint8_t* buf, size_t cap) {
+    for (uint8_t i = 0; i < JPEG_HUFFMAN_TABLES; i++) {
+        dc[i].set(decoder.dc[i]);
+        ac[i].set(decoder.ac[i]);
+    }
+    for (uint8_t c = 0; c < decoder.components; c++) {
+        comp[c] = decoder.comp[c];
+        comp[c].pred = 0;
+    }
+    out = buf;
+    capacity = cap;
+    used = 0;
+    bits = 0;
+    bitCount = 0;
+    ok = out != nullptr;
+}
+
+/**
+ * Append bytes as they are. Only valid outside the scan.
+ * @return False if the output is full.
+ */
+bool JpegEncoder::write(const uint8_t* bytes, size_t n) {
+    if (!ok || used + n > capacity) return ok = false;
+    memcpy(out + used, bytes, n);
+    used += n;
+    return true;
+}
+
+void JpegEncoder::putByte(uint8_t b) {
+    if (used + (b == 0xFF ? 2 : 1) > capacity) {
+        ok = false;
+        return;
+    }
+    out[used++] = b;
+    if (b == 0xFF) out[used++] = 0x00;      // Stuffing, so scan data never looks like a marker
+}
+
+void JpegEncoder::putBits(uint32_t v, uint8_t n) {
+    bits = (bits << n) | (v & ((1u << n) - 1));
+    bitCount += n;
+    while (bitCount >= 8) {
+        bitCount -= 8;
+        putByte(bits >> bitCount);
+    }
+}
+
+bool JpegEncoder::putSymbol(const JpegHuffmanCode& table, uint8_t symbol) {
+    if (!table.size[symbol]) return ok = false;
+    putBits(table.code[symbol], table.size[symbol]);
+    return ok;
+}
+
+/**
+ * The low size bits of a value, negative values offset by one as JPEG stores them.
+ */
+void JpegEncoder::putValue(int32_t v, uint8_t size) {
+    if (size) putBits(v < 0 ? v - 1 : v, size);
+}
+
+/**
+ * Encode one block of the scan.
+ * @param block: 64 quantised coefficients in zigzag order, DC absolute.
+ * @param component: The component the block belongs to.
+ *
+ * @return False if a symbol is missing from the tables or the output is full.
+ */
+bool JpegEncoder::encodeBlock(const int16_t* block, uint8_t component) {
+    JpegComponent& c = comp[component];
+    const int32_t diff = block[0] - c.pred;
+    c.pred = block[0];
+    const uint8_t dcSize = jpegCategory(diff);
+    if (!putSymbol(dc[c.td], dcSize)) return false;
+    putValue(diff, dcSize);
+
+    const JpegHuffmanCode& table = ac[c.ta];
+    uint8_t run = 0;
+    for (uint8_t k = 1; k < 64; k++) {
+        const int16_t v = block[k];
+        if (!v) {
+            run++;
+            continue;
+        }
+        for (; run > 15; run -= 16) {
+            if (!putSymbol(table, 0xF0)) return false;      // Run of 16 zeros
+        }
+        const uint8_t size = jpegCategory(v);
+        if (!putSymbol(table, (run << 4) | size)) return false;
+        putValue(v, size);
+        run = 0;
+    }
+    if (run && !putSymbol(table, 0x00)) return false;       // End of block
+    return ok;
+}
+
+/**
+ * Pad the scan to a whole byte with ones.
+ * @return False if the output is full.
+ */
+bool JpegEncoder::finish() {
+    if (bitCount) putBits(0x7F, 8 - bitCount);
+    return ok;
+}
@@ -0,0 +1,261 @@
+#pragma once
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Entropy level decoder for the baseline JPEGs the camera produces.
+ * It stops short of dequantisation and the IDCT: blocks come out as quantised coefficients
+ * in zigzag order, of which only as many as the caller asks for are kept.
+ * That is enough for DC based hashing, 1/8 and 1/4 scale previews, and lossless crops,
+ * all far cheaper than a full decode. JpegEncoder codes such coefficients back out.
+ *
+ * Supported: baseline sequential Huffman (SOF0 / SOF1), 8 bit, 1 to 3 components,
+ * any sampling factors up to JPEG_MAX_BLOCKS blocks per MCU, restart intervals.
+ * Missing Huffman tables fall back to the standard ones from Annex K.
+ */
+
+#define JPEG_MAX_COMPONENTS 3
+#define JPEG_MAX_BLOCKS 10
+#define JPEG_HUFFMAN_TABLES 2
+#define JPEG_LOOKAHEAD 8
+
+/**
+ * JPEG markers.
+ */
+#define JPEG_SOI  0xD8
+#define JPEG_EOI  0xD9
+#define JPEG_SOF0 0xC0
+#define JPEG_SOF1 0xC1
+#define JPEG_DHT  0xC4
+#define JPEG_RST0 0xD0
+#define JPEG_SOS  0xDA
+#define JPEG_DQT  0xDB
+#define JPEG_DRI  0xDD
+
+/**
+ * Zigzag index to natural (row major) index within a block.
+ */
+extern const uint8_t JPEG_ZIGZAG[64];
+
+/**
+ * A Huffman table, with a lookup table for codes of up to JPEG_LOOKAHEAD bits.
+ */
+struct JpegHuffman {
+    bool present = false;
+    uint8_t counts[16] = {};        // Number of codes of each length 1 to 16
+    uint8_t symbols[256] = {};
+    int32_t maxcode[18] = {};       // Largest code of each length, -1 if none
+    int32_t valoff[17] = {};        // Index of a code's symbol, minus the code
+    uint8_t lookLen[1 << JPEG_LOOKAHEAD] = {};
+    uint8_t lookSym[1 << JPEG_LOOKAHEAD] = {};
+
+    /**
+     * Set the table from DHT style counts and symbols, and build the decoding tables.
+     * @return False if the table is malformed.
+     */
+    bool set(const uint8_t* bits, const uint8_t* vals);
+};
+
+/**
+ * A component of the frame, and its part in each MCU.
+ */
+struct JpegComponent {
+    uint8_t id;
+    uint8_t h;                      // Horizontal sampling factor
+    uint8_t v;                      // Vertical sampling factor
+    uint8_t tq;                     // Quantisation table
+    uint8_t td;                     // DC Huffman table
+    uint8_t ta;                     // AC Huffman table
+    int16_t pred;                   // DC predictor
+};
+
+/**
+ * Decodes the entropy coded data of a JPEG, one MCU at a time.
+ * The decoder only reads from the buffer it is given, which must outlive it.
+ * With its tables it takes about 4 KB, so keep it off small task stacks.
+ */
+class JpegDecoder {
+public:
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint8_t components = 0;
+    JpegComponent comp[JPEG_MAX_COMPONENTS] = {};
+    uint8_t hmax = 1;
+    uint8_t vmax = 1;
+    uint16_t mcusX = 0;             // MCUs per row
+    uint16_t mcusY = 0;             // MCU rows
+    uint16_t restartInterval = 0;   // MCUs between restart markers, 0 if none
+    uint8_t blocksPerMcu = 0;
+    uint8_t blockComponent[JPEG_MAX_BLOCKS] = {};   // Component of each block of an MCU
+    uint16_t qt[4][64] = {};        // Quantisation tables, zigzag order
+    JpegHuffman dc[JPEG_HUFFMAN_TABLES];
+    JpegHuffman ac[JPEG_HUFFMAN_TABLES];
+
+    /**
+     * Parse the headers up to the start of the scan.
+     * @param data: The JPEG.
+     * @param len: Its length.
+     *
+     * @return False if the image is not a JPEG this decoder supports.
+     */
+    bool begin(const uint8_t* data, size_t len);
+
+    /**
+     * Decode the next MCU.
+     * Blocks are in scan order: the v x h blocks of the first component row by row, then the next component.
+     * Each block gets its first coeffs coefficients in zigzag order, with the DC already un-predicted.
+     * The remaining coefficients are skipped without being stored, and left untouched.
+     * @param blocks: The blocks of the MCU, at least blocksPerMcu of them.
+     * @param coeffs: How many coefficients of each block to keep, 1 (DC only) to 64.
+     *
+     * @return False on corrupt data or once all MCUs were decoded.
+     */
+    bool decodeMcu(int16_t (*blocks)[64], uint8_t coeffs);
+
+    /**
+     * @return The index of the next MCU to be decoded.
+     */
+    uint32_t mcu() const {
+        return next;
+    }
+
+    /**
+     * @return The number of MCUs in the image.
+     */
+    uint32_t mcuCount() const {
+        return (uint32_t)mcusX * mcusY;
+    }
+
+    /**
+     * @return The offset of the first byte of entropy coded data.
+     */
+    size_t scanStart() const {
+        return scan;
+    }
+
+    /**
+     * @return The offset of the SOS marker.
+     */
+    size_t sosStart() const {
+        return sos;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+    size_t pos = 0;
+    size_t scan = 0;
+    size_t sos = 0;
+    uint32_t bits = 0;
+    int8_t bitCount = 0;
+    bool marker = false;
+    uint32_t next = 0;
+    uint16_t restartsLeft = 0;
+    uint8_t expectedRst = 0;
+
+    void reset();
+    bool parseSOF(const uint8_t* seg, uint16_t n);
+    bool parseDHT(const uint8_t* seg, uint16_t n);
+    bool parseDQT(const uint8_t* seg, uint16_t n);
+    bool parseSOS(const uint8_t* seg, uint16_t n);
+    bool fallbackTables();
+
+    void fill();
+    int32_t getBits(uint8_t n);
+    int decode(const JpegHuffman& table);
+    bool restart();
+};
+
+/**
+ * Huffman codes of one table, by symbol, for encoding.
+ */
+struct JpegHuffmanCode {
+    uint16_t code[256] = {};
+    uint8_t size[256] = {};         // Code length, 0 if the table has no code for the symbol
+
+    /**
+     * Assign the canonical codes of a decoding table.
+     */
+    void set(const JpegHuffman& table);
+};
+
+/**
+ * Entropy level encoder, the counterpart of JpegDecoder.
+ * It codes quantised coefficients with the Huffman tables of a decoded image, so coefficients
+ * taken from a JpegDecoder go back out unchanged: recoding, cropping and blanking lose nothing.
+ * Output goes into a caller supplied buffer; running out of room fails the encode.
+ */
+class JpegEncoder {
+public:
+    /**
+     * Start encoding with the tables and components of a decoder.
+     * @param decoder: A decoder which has begun an image.
+     * @param out: Where the JPEG goes.
+     * @param capacity: Its size.
+     */
+    void begin(const JpegDecoder& decoder, uint8_t* out, size_t capacity);
+
+    /**
+     * Append bytes as they are, such as header segments. Only valid outside the scan.
+     * @return False if the output is full.
+     */
+    bool write(const uint8_t* bytes, size_t n);
+
+    /**
+     * Encode one block of the scan, DC predicted against the last block of the same component.
+     * @param block: 64 quantised coefficients in zigzag order, DC absolute.
+     * @param component: The component the block belongs to.
+     *
+     * @return False if a symbol is missing from the tables or the output is full.
+     */
+    bool encodeBlock(const int16_t* block, uint8_t component);
+
+    /**
+     * Pad the scan to a whole byte with ones, as the standard asks.
+     * @return False if the output is full.
+     */
+    bool finish();
+
+    /**
+     * @return The number of bytes written so far.
+     */
+    size_t size() const {
+        return used;
+    }
+
+private:
+    JpegHuffmanCode dc[JPEG_HUFFMAN_TABLES];
+    JpegHuffmanCode ac[JPEG_HUFFMAN_TABLES];
+    JpegComponent comp[JPEG_MAX_COMPONENTS] = {};
+    uint8_t* out = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint32_t bits = 0;
+    uint8_t bitCount = 0;
+    bool ok = false;
+
+    void putByte(uint8_t b);
+    void putBits(uint32_t v, uint8_t n);
+    bool putSymbol(const JpegHuffmanCode& table, uint8_t symbol);
+    void putValue(int32_t v, uint8_t size);
+};
+
+/**
+ * Magnitude category of a coefficient: the number of bits of its absolute value.
+ */
+inline uint8_t jpegCategory(int32_t v) {
+    if (v < 0) v = -v;
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/**
+ * Sign extend a JPEG magnitude category value.
+ */
+inline int32_t jpegExtend(int32_t v, uint8_t size) {
+    return v < (1 << (size - 1)) ? v - (1 << size) + 1 : v;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "json_arena.h"
+#include "io.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+
+JsonArena JSON_ARENA;
+
+static size_t aligned(size_t n) {
+    return (n + JSON_ARENA_ALIGN - 1) & ~(size_t)(JSON_ARENA_ALIGN - 1);
+}
+
+/**
+ * The size stored in front of a block.
+ */
+static uint32_t& header(void* ptr) {
+    return *(uint32_t*)((uint8_t*)ptr - JSON_ARENA_ALIGN);
+}
+
+/**
+ * Allocate the region, in PSRAM if there is any. Tried once.
+ */
+bool JsonArena::begin() {
+    if (region || size) return region != nullptr;
+    psram = psramFound();
+    size = psram ? JSON_ARENA_SIZE : JSON_ARENA_INTERNAL_SIZE;
+    region = (uint8_t*)heap_caps_malloc(size, psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!region) debugf("No room for a %u byte JSON arena, documents use the heap\n", (unsigned)size);
+    return region != nullptr;
+}
+
+void* JsonArena::allocate(size_t n) {
+    const size_t need = JSON_ARENA_ALIGN + aligned(n);
+    if (!begin() || used + need > size) {
+        spilled++;
+        return malloc(n);
+    }
+
+    uint8_t* block = region + used + JSON_ARENA_ALIGN;
+    header(block) = n;
+    last = used;
+    used += need;
+    live++;
+    if (used > peak) peak = used;
+    return block;
+}
+
+void JsonArena::deallocate(void* ptr) {
+    if (!ptr) return;
+    if (!owns(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    // Only the newest block's space comes back before the arena is empty.
+    if ((uint8_t*)ptr - JSON_ARENA_ALIGN == region + last) {
+        used = last;
+        last = SIZE_MAX;
+    }
+    if (--live == 0) {
+        used = 0;
+        last = SIZE_MAX;
+    }
+}
+
+void* JsonArena::reallocate(void* ptr, size_t n) {
+    if (!ptr) return allocate(n);
+    if (!owns(ptr)) return realloc(ptr, n);
+
+    const size_t old = header(ptr);
+    const size_t start = (uint8_t*)ptr - region;
+    if (start - JSON_ARENA_ALIGN == last && start + aligned(n) <= size) {
+        header(ptr) = n;
+        used = start + aligned(n);
+        if (used > peak) peak = used;
+        return ptr;
+    }
+    if (n <= old) return ptr;
+
+    void* moved = allocate(n);
+    if (!moved) return nullptr;
+    memcpy(moved, ptr, old);
+    deallocate(ptr);
+    return moved;
+}
+
+/**
+ * Print how full the arena got.
+ */
+void JsonArena::report() const {
+    if (!size) return;
+    debugf("JSON arena: at most %u of %u bytes in %s, %lu allocations spilled to the heap\n",
+           (unsigned)peak, (unsigned)size, psram ? "PSRAM" : "internal RAM", (unsigned long)spilled);
+}
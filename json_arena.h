@@ -0,0 +1,75 @@
+#pragma once
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ArduinoJson.h>
+
+/**
+ * Size of the arena every JsonDocument allocates from: in PSRAM if the board has it,
+ * else a smaller one in internal RAM. Allocations which don't fit spill to the heap.
+ */
+#define JSON_ARENA_SIZE (32 * 1024)
+#define JSON_ARENA_INTERNAL_SIZE (8 * 1024)
+
+/**
+ * Blocks are aligned, and preceded by their size, to this many bytes.
+ */
+#define JSON_ARENA_ALIGN 8
+
+/**
+ * A bump allocator for ArduinoJson, so that parsing the cache, log and network files takes
+ * nothing from the heap. The region is allocated once, on first use, and kept for the wake.
+ *
+ * Blocks are handed out from the front and only the newest one can grow or shrink in place,
+ * which is how a document grows its pools and strings while it is being parsed. Giving back
+ * the newest block returns its space, and the arena is empty again once the last block is
+ * given back: documents are local to the functions using them, so it is empty at every phase
+ * boundary. Only used from the main task.
+ */
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t size) override;
+
+    /**
+     * Most bytes the arena held at once, its size, and how many allocations spilled to the heap.
+     */
+    size_t highWater() const {
+        return peak;
+    }
+
+    size_t capacity() const {
+        return size;
+    }
+
+    uint32_t spills() const {
+        return spilled;
+    }
+
+    /**
+     * Print how full the arena got.
+     */
+    void report() const;
+
+private:
+    bool begin();
+    bool owns(const void* ptr) const {
+        return region && (const uint8_t*)ptr >= region && (const uint8_t*)ptr < region + size;
+    }
+
+    uint8_t* region = nullptr;
+    size_t size = 0;
+    size_t used = 0;
+    size_t last = SIZE_MAX;     // Offset of the newest block, SIZE_MAX once it was given back
+    size_t peak = 0;
+    uint32_t live = 0;
+    uint32_t spilled = 0;
+    bool psram = false;
+};
+
+extern JsonArena JSON_ARENA;
+
+#endif
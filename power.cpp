@@ -0,0 +1,173 @@
+#include "power.h"
+#include "io.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static portMUX_TYPE powerLock = portMUX_INITIALIZER_UNLOCKED;
+#define POWER_LOCK() portENTER_CRITICAL(&powerLock)
+#define POWER_UNLOCK() portEXIT_CRITICAL(&powerLock)
+#else
+#include <chrono>
+#define POWER_LOCK()
+#define POWER_UNLOCK()
+#endif
+
+PowerMeter POWER;
+
+/**
+ * The default hook: print the report.
+ */
+static void printReport(void* ctx, const PowerReport& r) {
+    debugf("Wake took %lu ms: %lu active, %lu idle, %lu light sleep; radio %lu, camera %lu\n",
+           (unsigned long)(r.wallUs / 1000), (unsigned long)(r.activeUs / 1000), (unsigned long)(r.idleUs / 1000),
+           (unsigned long)(r.sleepUs / 1000), (unsigned long)(r.radioUs / 1000), (unsigned long)(r.cameraUs / 1000));
+    debugf("Drew about %.1f uAh, %.1f mA on average%s\n", r.chargeUah, r.averageUa / 1000.0f,
+           r.lightSleep ? "" : " (no light sleep in this build)");
+}
+
+/**
+ * Microseconds since boot, including simulated waits off the station.
+ */
+uint64_t PowerMeter::now() const {
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    static const auto boot = std::chrono::steady_clock::now();
+    const auto real = std::chrono::steady_clock::now() - boot;
+    return std::chrono::duration_cast<std::chrono::microseconds>(real).count() + simulatedUs;
+#endif
+}
+
+/**
+ * Enable frequency scaling and automatic light sleep where the build supports them, and start metering.
+ */
+void PowerMeter::begin() {
+    lightSleep = false;
+#if defined(ESP_PLATFORM) && defined(CONFIG_PM_ENABLE)
+    esp_pm_config_t config = {};
+    config.max_freq_mhz = POWER_MAX_MHZ;
+    config.min_freq_mhz = POWER_MIN_MHZ;
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    config.light_sleep_enable = true;
+#endif
+    const esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) debugf("Power management not configured: 0x%x\n", err);
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    lightSleep = err == ESP_OK;
+#endif
+#elif !defined(ESP_PLATFORM)
+    lightSleep = POWER_SIMULATED_LIGHT_SLEEP;
+#endif
+    if (!hook) hook = printReport;
+
+    POWER_LOCK();
+    const uint64_t t = now();
+    activeUs += t - last;
+    chargeUaUs += (t - last) * (uint64_t)POWER_ACTIVE_UA;
+    last = t;
+    POWER_UNLOCK();
+}
+
+/**
+ * Current drawn in the present state.
+ */
+uint32_t PowerMeter::drawUa() const {
+    uint32_t ua = busy > 0 ? POWER_ACTIVE_UA : (lightSleep && !rails ? POWER_LIGHT_SLEEP_UA : POWER_IDLE_UA);
+    if (rails & POWER_RAIL_RADIO) ua += POWER_RADIO_UA;
+    if (rails & POWER_RAIL_CAMERA) ua += POWER_CAMERA_UA;
+    return ua;
+}
+
+/**
+ * Book the time since the last state change to the present state. Called with the lock held.
+ */
+void PowerMeter::accrue() {
+    const uint64_t t = now();
+    const uint64_t dt = t > last ? t - last : 0;
+    last = t;
+
+    if (busy > 0) activeUs += dt;
+    else if (lightSleep && !rails) sleepUs += dt;
+    else idleUs += dt;
+    if (rails & POWER_RAIL_RADIO) radioUs += dt;
+    if (rails & POWER_RAIL_CAMERA) cameraUs += dt;
+    chargeUaUs += dt * drawUa();
+}
+
+/**
+ * Wait, letting the idle task light sleep if nothing else needs the CPU.
+ */
+void PowerMeter::wait(uint32_t ms) {
+    leave();
+#ifdef ESP_PLATFORM
+    // With tickless idle, the idle task light sleeps until the next timer or task wakes.
+    vTaskDelay(pdMS_TO_TICKS(ms));
+#else
+    POWER_LOCK();
+    simulatedUs += (uint64_t)ms * 1000;
+    POWER_UNLOCK();
+#endif
+    enter();
+}
+
+void PowerMeter::enter() {
+    POWER_LOCK();
+    accrue();
+    busy++;
+    POWER_UNLOCK();
+}
+
+void PowerMeter::leave() {
+    POWER_LOCK();
+    accrue();
+    if (busy > 0) busy--;
+    POWER_UNLOCK();
+}
+
+void PowerMeter::railOn(PowerRail rail) {
+    POWER_LOCK();
+    accrue();
+    rails |= rail;
+    POWER_UNLOCK();
+}
+
+void PowerMeter::railOff(PowerRail rail) {
+    POWER_LOCK();
+    accrue();
+    rails &= ~rail;
+    POWER_UNLOCK();
+}
+
+/**
+ * Replace the default hook, which prints the report.
+ */
+void PowerMeter::setHook(PowerHook h, void* ctx) {
+    hook = h;
+    hookCtx = ctx;
+}
+
+/**
+ * Close the wake's accounts and hand the report to the hook.
+ */
+PowerReport PowerMeter::finish() {
+    POWER_LOCK();
+    accrue();
+    PowerReport r;
+    r.wallUs = last;
+    r.activeUs = activeUs;
+    r.idleUs = idleUs;
+    r.sleepUs = sleepUs;
+    r.radioUs = radioUs;
+    r.cameraUs = cameraUs;
+    r.chargeUah = chargeUaUs / 3600000000.0;
+    r.averageUa = last ? (float)chargeUaUs / last : 0;
+    r.lightSleep = lightSleep;
+    POWER_UNLOCK();
+
+    if (hook) hook(hookCtx, r);
+    return r;
+}
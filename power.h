@@ -0,0 +1,133 @@
+#pragma once
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/**
+ * Estimated supply current of the station board in each state, in microamps. Tune against a meter.
+ * The CPU is active, idle with its clocks running, or in automatic light sleep. The radio and
+ * camera add their draw on top while their rails are on, and hold the chip out of light sleep.
+ */
+#define POWER_ACTIVE_UA 45000
+#define POWER_IDLE_UA 28000
+#define POWER_LIGHT_SLEEP_UA 1500
+#define POWER_RADIO_UA 75000
+#define POWER_CAMERA_UA 110000
+
+/**
+ * CPU clock range for dynamic frequency scaling between waits.
+ */
+#define POWER_MAX_MHZ 240
+#define POWER_MIN_MHZ 40
+
+/**
+ * Whether simulated waits off the station count as light sleep, as on a build with tickless idle.
+ */
+#define POWER_SIMULATED_LIGHT_SLEEP 1
+
+enum PowerRail : uint8_t {
+    POWER_RAIL_RADIO = 1 << 0,
+    POWER_RAIL_CAMERA = 1 << 1
+};
+
+/**
+ * Where the time and charge of one wake went.
+ */
+struct PowerReport {
+    uint32_t wallUs;            // Boot to report
+    uint32_t activeUs;          // CPU doing work
+    uint32_t idleUs;            // CPU waiting with its clocks running
+    uint32_t sleepUs;           // CPU in light sleep
+    uint32_t radioUs;           // Radio rail on
+    uint32_t cameraUs;          // Camera rail on
+    float chargeUah;            // Estimated charge drawn
+    float averageUa;            // Estimated mean current
+    bool lightSleep;            // Whether automatic light sleep was available
+};
+
+/**
+ * Receives the report at the end of a wake, e.g. to print, log, or collect it in a simulation.
+ */
+typedef void (*PowerHook)(void* ctx, const PowerReport& report);
+
+/**
+ * Timed waits which let the chip light sleep, and an estimate of the current drawn through a wake.
+ * The estimate integrates the state currents above over time, so it is only as good as they are.
+ * Off the station, waits advance a simulated clock instead of sleeping.
+ */
+class PowerMeter {
+public:
+    /**
+     * Enable frequency scaling and automatic light sleep where the build supports them, and start metering.
+     * Time since boot before this counts as active.
+     */
+    void begin();
+
+    /**
+     * Wait, letting the idle task light sleep if nothing else needs the CPU. Replaces delay().
+     * @param ms: The time to wait.
+     */
+    void wait(uint32_t ms);
+
+    /**
+     * Mark a task as doing work, or as blocked. The CPU counts as active while any task is.
+     * The calling task is active from begin() on.
+     */
+    void enter();
+    void leave();
+
+    /**
+     * Record a rail being switched on or off.
+     */
+    void railOn(PowerRail rail);
+    void railOff(PowerRail rail);
+
+    /**
+     * Replace the default hook, which prints the report.
+     */
+    void setHook(PowerHook hook, void* ctx = nullptr);
+
+    /**
+     * Close the wake's accounts and hand the report to the hook.
+     */
+    PowerReport finish();
+
+    /**
+     * Microseconds since boot, including simulated waits off the station.
+     */
+    uint64_t now() const;
+
+    bool lightSleepEnabled() const {
+        return lightSleep;
+    }
+
+private:
+    uint64_t last = 0;
+    uint64_t activeUs = 0;
+    uint64_t idleUs = 0;
+    uint64_t sleepUs = 0;
+    uint64_t radioUs = 0;
+    uint64_t cameraUs = 0;
+    uint64_t chargeUaUs = 0;    // Microamps x microseconds
+    uint64_t simulatedUs = 0;
+    int8_t busy = 1;
+    uint8_t rails = 0;
+    bool lightSleep = false;
+    PowerHook hook = nullptr;
+    void* hookCtx = nullptr;
+
+    uint32_t drawUa() const;
+    void accrue();
+};
+
+extern PowerMeter POWER;
+
+/**
+ * Wait on the station meter. Drop-in for delay() in sampling loops and polling waits.
+ */
+inline void powerWait(uint32_t ms) {
+    POWER.wait(ms);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include "profile.h"
+#include "heap.h"
+#include "json_arena.h"
+#include "power.h"
+#include "io.h"
+#include "esp_heap_caps.h"
+
+const char* const PROFILE_NAMES[PROFILE_PHASES] = {
+    "mount", "wifi", "clock", "qnh", "sample", "capture", "analyse", "spool", "upload", "backlog"
+};
+
+Profiler PROFILER;
+
+/**
+ * The last wakes, across deep sleep.
+ */
+RTC_DATA_ATTR ProfileRing PROFILE_RING;
+
+/**
+ * Free and least ever free bytes of internal RAM or PSRAM.
+ */
+static uint32_t freeBytes(bool psram) {
+    return heap_caps_get_free_size(psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+}
+
+static uint32_t leastFreeBytes(bool psram) {
+    return heap_caps_get_minimum_free_size(psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+}
+
+/**
+ * The least free memory during a scope, in KiB. The heap keeps a minimum since boot, which
+ * only moves if the scope went lower than anything before it.
+ */
+static uint16_t lowKb(uint32_t enterFree, uint32_t enterMin, bool psram) {
+    uint32_t low = freeBytes(psram);
+    if (enterFree < low) low = enterFree;
+    const uint32_t least = leastFreeBytes(psram);
+    if (least < enterMin && least < low) low = least;
+    low /= 1024;
+    return low < 0xFFFF ? low : 0xFFFE;
+}
+
+/**
+ * Start profiling a wake.
+ */
+void Profiler::begin(uint32_t time) {
+    current = {};
+    current.seq = PROFILE_RING.seq++;
+    current.time = time;
+    for (uint8_t p = 0; p < PROFILE_PHASES; p++) {
+        current.phases[p].heapLowKb = 0xFFFF;
+        current.phases[p].psramLowKb = 0xFFFF;
+        open[p] = {};
+    }
+    HEAP.begin();
+}
+
+void Profiler::enter(ProfilePhase phase) {
+    if (phase >= PROFILE_PHASES) return;
+    HEAP.enter(phase);
+    Open& o = open[phase];
+    if (o.depth++) return;
+    o.start = POWER.now();
+    o.heapFree = freeBytes(false);
+    o.heapMin = leastFreeBytes(false);
+    o.psramFree = freeBytes(true);
+    o.psramMin = leastFreeBytes(true);
+}
+
+void Profiler::leave(ProfilePhase phase) {
+    if (phase >= PROFILE_PHASES) return;
+    Open& o = open[phase];
+    if (!o.depth) return;
+    HEAP.leave(phase);
+    if (--o.depth) return;
+
+    PhaseProfile& p = current.phases[phase];
+    p.us += POWER.now() - o.start;
+    const uint16_t heap = lowKb(o.heapFree, o.heapMin, false);
+    const uint16_t psram = lowKb(o.psramFree, o.psramMin, true);
+    if (heap < p.heapLowKb) p.heapLowKb = heap;
+    if (psram < p.psramLowKb) p.psramLowKb = psram;
+}
+
+/**
+ * Close this wake and keep it in the ring, dropping the oldest if it is full.
+ */
+void Profiler::commit() {
+    for (uint8_t p = 0; p < PROFILE_PHASES; p++) {
+        if (open[p].depth) {
+            open[p].depth = 1;
+            leave((ProfilePhase)p);
+        }
+    }
+    current.wallUs = POWER.now();
+    current.jsonPeak = JSON_ARENA.highWater() < 0xFFFF ? JSON_ARENA.highWater() : 0xFFFF;
+    current.jsonSpills = JSON_ARENA.spills() < 0xFFFF ? JSON_ARENA.spills() : 0xFFFF;
+    for (uint8_t p = 0; p < PROFILE_PHASES; p++) {
+        const HeapPhase& h = HEAP.phase(p);
+        PhaseProfile& f = current.phases[p];
+        f.allocs = h.allocs < 0xFFFF ? h.allocs : 0xFFFF;
+        f.allocKb = heapKb(h.bytes);
+        f.peakKb = heapKb(h.peak);
+        f.largestKb = h.largest == 0xFFFFFFFF ? 0xFFFF : h.largest / 1024 < 0xFFFF ? h.largest / 1024 : 0xFFFE;
+    }
+
+    ProfileRing& ring = PROFILE_RING;
+    if (ring.count == PROFILE_CYCLES) {
+        ring.head = (ring.head + 1) % PROFILE_CYCLES;
+        ring.count--;
+    }
+    ring.cycles[(ring.head + ring.count) % PROFILE_CYCLES] = current;
+    ring.count++;
+    if (ring.unsent < ring.count) ring.unsent++;
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v) {
+    p = put16(p, v);
+    return put16(p, v >> 16);
+}
+
+/**
+ * Encode the wakes not uploaded yet, oldest first.
+ * @return The length written, 0 if there is nothing to send or out is too small.
+ */
+size_t Profiler::encode(char* out, size_t capacity) const {
+    const ProfileRing& ring = PROFILE_RING;
+    if (!out || !ring.unsent) return 0;
+
+    uint8_t raw[2 + PROFILE_CYCLES * PROFILE_RECORD_BYTES];
+    uint8_t* p = raw;
+    *p++ = PROFILE_VERSION;
+    *p++ = ring.unsent;
+    for (uint8_t i = ring.count - ring.unsent; i < ring.count; i++) {
+        const WakeProfile& w = ring.cycles[(ring.head + i) % PROFILE_CYCLES];
+        p = put16(p, w.seq);
+        p = put32(p, w.time);
+        p = put32(p, w.wallUs);
+        p = put16(p, w.jsonPeak);
+        p = put16(p, w.jsonSpills);
+        for (uint8_t f = 0; f < PROFILE_PHASES; f++) {
+            p = put32(p, w.phases[f].us);
+            p = put16(p, w.phases[f].heapLowKb);
+            p = put16(p, w.phases[f].psramLowKb);
+            p = put16(p, w.phases[f].allocs);
+            p = put16(p, w.phases[f].allocKb);
+            p = put16(p, w.phases[f].peakKb);
+            p = put16(p, w.phases[f].largestKb);
+        }
+    }
+
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    const size_t len = p - raw;
+    const size_t encoded = (len * 4 + 2) / 3;
+    if (encoded + 1 > capacity) return 0;
+
+    char* o = out;
+    for (size_t i = 0; i < len; i += 3) {
+        const uint32_t v = (raw[i] << 16) | (i + 1 < len ? raw[i + 1] << 8 : 0) | (i + 2 < len ? raw[i + 2] : 0);
+        *o++ = alphabet[(v >> 18) & 63];
+        *o++ = alphabet[(v >> 12) & 63];
+        if (i + 1 < len) *o++ = alphabet[(v >> 6) & 63];
+        if (i + 2 < len) *o++ = alphabet[v & 63];
+    }
+    *o = '\0';
+    return o - out;
+}
+
+/**
+ * The encoded wakes went out.
+ */
+void Profiler::uploaded() {
+    PROFILE_RING.unsent = 0;
+}
+
+/**
+ * Print this wake's phases.
+ */
+void Profiler::report() const {
+    debugf("Wake %u profile:\n", current.seq);
+    for (uint8_t p = 0; p < PROFILE_PHASES; p++) {
+        const PhaseProfile& f = current.phases[p];
+        if (f.heapLowKb == 0xFFFF) continue;
+        debugf("  %-8s %9lu us, heap low %u KiB, PSRAM low %u KiB, %u allocations of %u KiB\n", PROFILE_NAMES[p],
+               (unsigned long)f.us, f.heapLowKb, f.psramLowKb, f.allocs, f.allocKb);
+    }
+    HEAP.report();
+    JSON_ARENA.report();
+}
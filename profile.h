@@ -0,0 +1,171 @@
+#pragma once
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Wake cycles kept in RTC memory until they are uploaded with the status. 8 take about 1.4 KiB.
+ */
+#define PROFILE_CYCLES 8
+
+/**
+ * Version of the encoded record, bumped whenever the phases or the layout change.
+ * host/profile_histogram.py decodes it and must be kept in step.
+ */
+#define PROFILE_VERSION 3
+
+/**
+ * The phases of a wake. Keep in the order of host/profile_histogram.py.
+ */
+enum ProfilePhase : uint8_t {
+    PROFILE_MOUNT = 0,          // File system mount and log / cache files
+    PROFILE_WIFI,               // wifiSetup: scan and connect
+    PROFILE_CLOCK,              // fetchCurrentTime
+    PROFILE_QNH,                // fetchQNH
+    PROFILE_SAMPLE,             // Waiting for the barometer and hygrometer
+    PROFILE_CAPTURE,            // Camera init and capture
+    PROFILE_ANALYSE,            // Sky statistics, hash and crop
+    PROFILE_SPOOL,              // Writing readings and images for later
+    PROFILE_UPLOAD,             // Status, reading and image of this wake
+    PROFILE_BACKLOG,            // Queued and logged readings with their images
+    PROFILE_PHASES
+};
+
+/**
+ * Names of the phases, for reports.
+ */
+extern const char* const PROFILE_NAMES[PROFILE_PHASES];
+
+/**
+ * One phase of one wake. Times are summed over every scope of the phase, including nested ones.
+ * Low water marks are the least free memory seen during the phase, in KiB, 0xFFFF if it never ran.
+ * The allocations are those HeapTracker attributed to the phase, see heap.h.
+ */
+struct PhaseProfile {
+    uint32_t us;
+    uint16_t heapLowKb;
+    uint16_t psramLowKb;
+    uint16_t allocs;            // Allocations made, saturating
+    uint16_t allocKb;           // KiB they took
+    uint16_t peakKb;            // Most KiB live at once
+    uint16_t largestKb;         // Smallest largest free internal block, 0xFFFF if not measured
+};
+
+/**
+ * One wake.
+ */
+struct WakeProfile {
+    uint16_t seq;               // Counts wakes since cold boot
+    uint32_t time;              // Wake time, UTC
+    uint32_t wallUs;            // Boot to commit
+    uint16_t jsonPeak;          // Most bytes the JSON arena held, see json_arena.h
+    uint16_t jsonSpills;        // JSON allocations which didn't fit in the arena
+    PhaseProfile phases[PROFILE_PHASES];
+};
+
+/**
+ * Size of the encoded records: version, count, then per wake seq, time, wall time, JSON arena
+ * peak and spills, and the phases, all little endian, as unpadded base64url.
+ */
+#define PROFILE_RECORD_BYTES (2 + 4 + 4 + 2 + 2 + PROFILE_PHASES * 16)
+#define PROFILE_ENCODED_MAX (((2 + PROFILE_CYCLES * PROFILE_RECORD_BYTES) * 4 + 2) / 3 + 1)
+
+/**
+ * The profiles of the last wakes, kept in RTC memory until a status upload takes them, with the
+ * wake count they are numbered by.
+ */
+struct ProfileRing {
+    WakeProfile cycles[PROFILE_CYCLES] = {};
+    uint8_t head = 0;           // Oldest
+    uint8_t count = 0;
+    uint8_t unsent = 0;         // Newest cycles not uploaded yet
+    uint16_t seq = 0;
+};
+
+/**
+ * Profiles the phases of this wake and keeps the last few wakes.
+ */
+class Profiler {
+public:
+    /**
+     * Start profiling a wake.
+     * @param time: The wake time, or 0 if the clock is not set yet.
+     */
+    void begin(uint32_t time);
+
+    /**
+     * Enter and leave a phase. Scopes of a phase may nest, or repeat.
+     */
+    void enter(ProfilePhase phase);
+    void leave(ProfilePhase phase);
+
+    /**
+     * Set the wake time once the clock is known.
+     */
+    void setTime(uint32_t time) {
+        current.time = time;
+    }
+
+    /**
+     * Close this wake and keep it in the ring, dropping the oldest if it is full.
+     */
+    void commit();
+
+    /**
+     * Encode the wakes not uploaded yet, oldest first.
+     * @param out: Where to write the NUL terminated base64url text.
+     * @param capacity: Size of out, PROFILE_ENCODED_MAX is always enough.
+     *
+     * @return The length written, 0 if there is nothing to send or out is too small.
+     */
+    size_t encode(char* out, size_t capacity) const;
+
+    /**
+     * The encoded wakes went out.
+     */
+    void uploaded();
+
+    /**
+     * Print this wake's phases.
+     */
+    void report() const;
+
+private:
+    struct Open {
+        uint64_t start;
+        uint32_t heapFree;
+        uint32_t heapMin;
+        uint32_t psramFree;
+        uint32_t psramMin;
+        uint8_t depth;
+    };
+
+    WakeProfile current = {};
+    Open open[PROFILE_PHASES] = {};
+};
+
+extern Profiler PROFILER;
+
+/**
+ * Profiles a phase for as long as it is in scope.
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfilePhase phase) : phase(phase) {
+        PROFILER.enter(phase);
+    }
+
+    ~ProfileScope() {
+        PROFILER.leave(phase);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfilePhase phase;
+};
+
+#endif
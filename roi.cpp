@@ -0,0 +1,242 @@
+#include "roi.h"
+#include "jpeg.h"
+#include "sky.h"
+#include "io.h"
+#include <string.h>
+
+static JpegDecoder decoder;
+static JpegEncoder encoder;
+
+/**
+ * A region resolved to pixels of one image: [left, right) by [top, bottom),
+ * plus the circle itself for ROI_CIRCLE.
+ */
+struct RoiPixels {
+    uint8_t shape;
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+    SkyMask circle;
+};
+
+static inline int32_t clampi(int32_t v, int32_t lo, int32_t hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static RoiPixels resolve(const ImageRoi& roi, uint16_t width, uint16_t height) {
+    RoiPixels px = {roi.shape, 0, 0, width, height, SkyMask::forImage(width, height)};
+    if (roi.shape == ROI_CIRCLE) {
+        const SkyMask& m = px.circle;
+        px.left = clampi(m.cx - m.radius, 0, width);
+        px.top = clampi(m.cy - m.radius, 0, height);
+        px.right = clampi(m.cx + m.radius + 1, 0, width);
+        px.bottom = clampi(m.cy + m.radius + 1, 0, height);
+    } else if (roi.shape == ROI_RECT) {
+        px.left = (int32_t)width * roi.left / 1000;
+        px.top = (int32_t)height * roi.top / 1000;
+        px.right = clampi((int32_t)width * roi.right / 1000, 0, width);
+        px.bottom = clampi((int32_t)height * roi.bottom / 1000, 0, height);
+    }
+    return px;
+}
+
+/**
+ * Whether the pixels [x0, x1) by [y0, y1) lie wholly outside the region.
+ */
+static bool misses(const RoiPixels& px, int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    if (x1 <= px.left || x0 >= px.right || y1 <= px.top || y0 >= px.bottom) return true;
+    if (px.shape != ROI_CIRCLE) return false;
+
+    // Nearest point of the rectangle to the centre.
+    const int32_t dx = clampi(px.circle.cx, x0, x1 - 1) - px.circle.cx;
+    const int32_t dy = clampi(px.circle.cy, y0, y1 - 1) - px.circle.cy;
+    return dx * dx + dy * dy > px.circle.radius * px.circle.radius;
+}
+
+/**
+ * The MCUs [mx0, mx1) by [my0, my1) covering a region of the image the decoder has begun.
+ * @return False if the region is empty.
+ */
+static bool mcuBounds(const RoiPixels& px, uint16_t* mx0, uint16_t* my0, uint16_t* mx1, uint16_t* my1) {
+    if (px.right <= px.left || px.bottom <= px.top) return false;
+    const int32_t mcuW = 8 * decoder.hmax;
+    const int32_t mcuH = 8 * decoder.vmax;
+    *mx0 = px.left / mcuW;
+    *my0 = px.top / mcuH;
+    *mx1 = (px.right + mcuW - 1) / mcuW;
+    *my1 = (px.bottom + mcuH - 1) / mcuH;
+    return true;
+}
+
+/**
+ * Size of a JPEG once cropped to a region, without cropping it.
+ * @return False if the JPEG is not supported or the region misses it.
+ */
+bool cropSize(const uint8_t* jpg, size_t len, const ImageRoi& roi, uint16_t* width, uint16_t* height) {
+    if (!decoder.begin(jpg, len)) return false;
+    const RoiPixels px = resolve(roi, decoder.width, decoder.height);
+    uint16_t mx0, my0, mx1, my1;
+    if (!mcuBounds(px, &mx0, &my0, &mx1, &my1)) return false;
+
+    // The last MCU column and row may be partial, as in the original.
+    const uint32_t right = (uint32_t)mx1 * 8 * decoder.hmax;
+    const uint32_t bottom = (uint32_t)my1 * 8 * decoder.vmax;
+    *width = (right < decoder.width ? right : decoder.width) - (uint32_t)mx0 * 8 * decoder.hmax;
+    *height = (bottom < decoder.height ? bottom : decoder.height) - (uint32_t)my0 * 8 * decoder.vmax;
+    return true;
+}
+
+/**
+ * Write a DHT segment with every table the scan uses.
+ */
+static bool writeTables() {
+    bool used[2][JPEG_HUFFMAN_TABLES] = {};
+    for (uint8_t c = 0; c < decoder.components; c++) {
+        used[0][decoder.comp[c].td] = true;
+        used[1][decoder.comp[c].ta] = true;
+    }
+
+    uint16_t length = 2;
+    for (uint8_t tc = 0; tc < 2; tc++) {
+        for (uint8_t th = 0; th < JPEG_HUFFMAN_TABLES; th++) {
+            if (!used[tc][th]) continue;
+            const JpegHuffman& t = tc ? decoder.ac[th] : decoder.dc[th];
+            length += 17;
+            for (uint8_t l = 0; l < 16; l++) length += t.counts[l];
+        }
+    }
+
+    const uint8_t marker[4] = {0xFF, JPEG_DHT, (uint8_t)(length >> 8), (uint8_t)length};
+    if (!encoder.write(marker, 4)) return false;
+    for (uint8_t tc = 0; tc < 2; tc++) {
+        for (uint8_t th = 0; th < JPEG_HUFFMAN_TABLES; th++) {
+            if (!used[tc][th]) continue;
+            const JpegHuffman& t = tc ? decoder.ac[th] : decoder.dc[th];
+            const uint8_t id = (tc << 4) | th;
+            uint16_t total = 0;
+            for (uint8_t l = 0; l < 16; l++) total += t.counts[l];
+            if (!encoder.write(&id, 1) || !encoder.write(t.counts, 16) || !encoder.write(t.symbols, total)) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Copy the headers up to the scan: the frame header gets the cropped size,
+ * restart intervals are dropped, and the Huffman tables are written out whether
+ * or not the original carried them.
+ */
+static bool writeHeaders(const uint8_t* jpg, uint16_t width, uint16_t height) {
+    static const uint8_t soi[2] = {0xFF, JPEG_SOI};
+    if (!encoder.write(soi, 2)) return false;
+
+    size_t p = 2;
+    while (p < decoder.sosStart()) {
+        const uint8_t type = jpg[p + 1];
+        if (type == 0xFF) {
+            p++;
+            continue;
+        }
+        const size_t n = 2 + ((jpg[p + 2] << 8) | jpg[p + 3]);
+
+        if (type == JPEG_SOF0 || type == JPEG_SOF1) {
+            uint8_t sof[4 + 6 + 3 * JPEG_MAX_COMPONENTS];
+            if (n > sizeof(sof)) return false;
+            memcpy(sof, jpg + p, n);
+            sof[5] = height >> 8;
+            sof[6] = height;
+            sof[7] = width >> 8;
+            sof[8] = width;
+            if (!encoder.write(sof, n)) return false;
+        } else if (type != JPEG_DRI && type != JPEG_DHT) {
+            if (!encoder.write(jpg + p, n)) return false;
+        }
+        p += n;
+    }
+
+    return writeTables() && encoder.write(jpg + decoder.sosStart(), decoder.scanStart() - decoder.sosStart());
+}
+
+/**
+ * Crop a JPEG to the whole MCUs covering a region, and blank the blocks outside it if asked.
+ * @return The length of the cropped JPEG, 0 on failure.
+ */
+size_t jpegCrop(const uint8_t* jpg, size_t len, const ImageRoi& roi, uint8_t* out, size_t capacity) {
+    uint16_t width, height;
+    if (!out || !cropSize(jpg, len, roi, &width, &height)) return 0;
+    const RoiPixels px = resolve(roi, decoder.width, decoder.height);
+    uint16_t mx0 = 0, my0 = 0, mx1 = 0, my1 = 0;
+    if (!mcuBounds(px, &mx0, &my0, &mx1, &my1)) return 0;
+
+    encoder.begin(decoder, out, capacity);
+    if (!writeHeaders(jpg, width, height)) return 0;
+
+    // Black for luma, neutral for chroma.
+    const uint16_t q0 = decoder.qt[decoder.comp[0].tq][0];
+    const int16_t black = -(1024 + q0 / 2) / q0;
+
+    int16_t blocks[JPEG_MAX_BLOCKS][64];
+    while (decoder.mcu() < decoder.mcuCount()) {
+        const uint32_t mcu = decoder.mcu();
+        const uint16_t mx = mcu % decoder.mcusX;
+        const uint16_t my = mcu / decoder.mcusX;
+        if (my >= my1) break;
+
+        // Every MCU has to be decoded to get to the next, but only those inside the crop are kept.
+        if (!decoder.decodeMcu(blocks, 64)) return 0;
+        if (mx < mx0 || mx >= mx1 || my < my0) continue;
+
+        uint8_t b = 0;
+        for (uint8_t c = 0; c < decoder.components; c++) {
+            const JpegComponent& cc = decoder.comp[c];
+            const int32_t bw = 8 * decoder.hmax / cc.h;     // Pixels covered by one block of this component
+            const int32_t bh = 8 * decoder.vmax / cc.v;
+            for (uint8_t by = 0; by < cc.v; by++) {
+                for (uint8_t bx = 0; bx < cc.h; bx++, b++) {
+                    int16_t* block = blocks[b];
+                    if (roi.blank) {
+                        const int32_t x0 = ((int32_t)mx * cc.h + bx) * bw;
+                        const int32_t y0 = ((int32_t)my * cc.v + by) * bh;
+                        if (misses(px, x0, y0, x0 + bw, y0 + bh)) {
+                            memset(block, 0, 64 * sizeof(int16_t));
+                            block[0] = c ? 0 : black;
+                        }
+                    }
+                    if (!encoder.encodeBlock(block, c)) return 0;
+                }
+            }
+        }
+    }
+
+    static const uint8_t eoi[2] = {0xFF, JPEG_EOI};
+    if (!encoder.finish() || !encoder.write(eoi, 2)) return 0;
+    return encoder.size();
+}
+
+/**
+ * Crop a captured image to the configured region, into a block from IMAGE_POOL.
+ * @return The cropped image, empty if cropping is off or failed.
+ */
+ImageBuffer cropImage(const ImageBuffer& jpg) {
+    const ImageRoi roi;
+    uint16_t width, height;
+    if (!jpg || roi.shape == ROI_NONE) return ImageBuffer();
+    if (!cropSize(jpg.data(), jpg.size(), roi, &width, &height)) {
+        debugln("Image can't be cropped");
+        return ImageBuffer();
+    }
+
+    // A crop which doesn't fit in the space of the original isn't worth having.
+    ImageBuffer cropped = ImageBuffer::fromPool(&IMAGE_POOL, jpg.size(), width, height);
+    if (!cropped) return cropped;
+    const size_t len = jpegCrop(jpg.data(), jpg.size(), roi, cropped.data(), cropped.size());
+    if (!len) {
+        debugln("Failed to crop image");
+        return ImageBuffer();
+    }
+
+    cropped.truncate(len);
+    debugf("Cropped image to %ux%u, %u -> %u bytes\n", width, height, jpg.size(), len);
+    return cropped;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef ROI_H
+#define ROI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "image_buffer.h"
+
+/**
+ * Region of interest shapes.
+ * ROI_CIRCLE keeps the fisheye circle of sky.h, ROI_RECT the rectangle below.
+ */
+#define ROI_NONE 0
+#define ROI_CIRCLE 1
+#define ROI_RECT 2
+
+/**
+ * The part of the frame uploaded and spooled. Images are cropped to it losslessly, in the
+ * compressed domain, so the crop snaps outwards to whole MCUs (16 x 8 pixels at 4:2:2).
+ */
+#define ROI_SHAPE ROI_CIRCLE
+
+/**
+ * The rectangle, in permille of the frame: [left, right) by [top, bottom).
+ */
+#define ROI_RECT_LEFT 0
+#define ROI_RECT_TOP 0
+#define ROI_RECT_RIGHT 1000
+#define ROI_RECT_BOTTOM 1000
+
+/**
+ * Whether blocks inside the crop but wholly outside the region are blanked to black.
+ * A blank block costs a few bits instead of tens of bytes.
+ */
+#define ROI_BLANK true
+
+/**
+ * A region of interest, independent of image size.
+ */
+struct ImageRoi {
+    uint8_t shape = ROI_SHAPE;
+    uint16_t left = ROI_RECT_LEFT;      // Permille of the width, rectangles only
+    uint16_t top = ROI_RECT_TOP;        // Permille of the height, rectangles only
+    uint16_t right = ROI_RECT_RIGHT;
+    uint16_t bottom = ROI_RECT_BOTTOM;
+    bool blank = ROI_BLANK;
+};
+
+/**
+ * Size of a JPEG once cropped to a region, without cropping it.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param roi: The region to keep.
+ * @param width: The cropped width.
+ * @param height: The cropped height.
+ *
+ * @return False if the JPEG is not supported or the region misses it.
+ */
+bool cropSize(const uint8_t* jpg, size_t len, const ImageRoi& roi, uint16_t* width, uint16_t* height);
+
+/**
+ * Crop a JPEG to the whole MCUs covering a region, and blank the blocks outside it if asked.
+ * Coefficients are carried over untouched and re-coded with the image's own Huffman tables,
+ * so what is kept is bit for bit what the camera encoded. The output has no restart markers.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param roi: The region to keep.
+ * @param out: Where the cropped JPEG goes.
+ * @param capacity: Its size.
+ *
+ * @return The length of the cropped JPEG, 0 on failure.
+ */
+size_t jpegCrop(const uint8_t* jpg, size_t len, const ImageRoi& roi, uint8_t* out, size_t capacity);
+
+/**
+ * Crop a captured image to the configured region, into a block from IMAGE_POOL.
+ * @param jpg: The captured image.
+ *
+ * @return The cropped image, empty if cropping is off or failed, in which case keep the original.
+ */
+ImageBuffer cropImage(const ImageBuffer& jpg);
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef SENSOR_DRIVER_H
+#define SENSOR_DRIVER_H
+
+#include <stdint.h>
+
+/**
+ * Tries a sample gets before the sensor is considered down. A sensor samples once per wake
+ * and comes up afresh every boot, so the tries are taken within the one sample.
+ */
+#define SENSOR_MAX_FAILURES 3
+
+struct Reading;
+
+/**
+ * Health of a sensor as seen by its driver.
+ */
+enum SensorHealth : uint8_t {
+    SENSOR_DOWN = 0,        // Not initialized, or the last sample failed every try
+    SENSOR_OK,              // Last sample succeeded at the first try
+    SENSOR_DEGRADED         // Last sample succeeded, but only after failed tries
+};
+
+/**
+ * Static interface every sensor driver implements, through CRTP so that the
+ * sampling loop has no virtual calls. A driver derives from SensorDriver<Itself>
+ * and provides:
+ *
+ *   bool initImpl();                   // Bring the sensor up
+ *   bool sampleImpl(Reading* reading); // Fill in the fields this sensor measures
+ *   bool teardownImpl();               // Optional, power the sensor down
+ *
+ * The base keeps track of health on top of those.
+ */
+template <typename Derived>
+class SensorDriver {
+public:
+    /**
+     * Bring the sensor up.
+     * @return True if the sensor is ready to sample.
+     */
+    bool init() {
+        failures = 0;
+        up = self().initImpl();
+        return up;
+    }
+
+    /**
+     * Take a sample, if the sensor is up, trying up to SENSOR_MAX_FAILURES times.
+     * A sensor which fails every try is down until it is initialized again.
+     * @param reading: The reading to fill in.
+     * @return True if the sample succeeded.
+     */
+    bool sample(Reading* reading) {
+        if (!up) return false;
+        failures = 0;
+        while (!self().sampleImpl(reading)) {
+            if (++failures >= SENSOR_MAX_FAILURES) {
+                up = false;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Power the sensor down. It must be initialized again before the next sample.
+     */
+    bool teardown() {
+        up = false;
+        return self().teardownImpl();
+    }
+
+    SensorHealth health() const {
+        if (!up) return SENSOR_DOWN;
+        return failures == 0 ? SENSOR_OK : SENSOR_DEGRADED;
+    }
+
+    bool ready() const {
+        return up;
+    }
+
+protected:
+    bool up = false;
+    uint8_t failures = 0;
+
+    /**
+     * Default for drivers with nothing to power down.
+     */
+    bool teardownImpl() {
+        return true;
+    }
+
+private:
+    Derived& self() {
+        return *static_cast<Derived*>(this);
+    }
+};
+
+#endif
@@ -1,8 +1,72 @@
 # include "sensors.h"
+#include <new>
 
 bool PROD = false;
 double SEALEVELPRESSURE_HPA = UNDEFINED;
 unsigned long lastPressed = millis();
+SensorQueue I2C_QUEUE;
+
+
+/**
+ * I2C TRANSACTION QUEUE
+ */
+
+#ifdef ESP_PLATFORM
+static TaskHandle_t i2cWorker = nullptr;
+static portMUX_TYPE i2cMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void i2cLock(void*) { portENTER_CRITICAL(&i2cMux); }
+static void i2cUnlock(void*) { portEXIT_CRITICAL(&i2cMux); }
+static void i2cKick(void*) { if (i2cWorker) xTaskNotifyGive(i2cWorker); }
+static void* i2cSelf(void*) { return xTaskGetCurrentTaskHandle(); }
+static void i2cWake(void* waiter, void*) { xTaskNotifyGive((TaskHandle_t) waiter); }
+
+// The timeout only guards against a lost wake up, await() re-checks the job anyway.
+static void i2cPark(void*) { ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)); }
+static void i2cYield(void*) { taskYIELD(); }
+
+/**
+ * Worker task: sleep until kicked, then run everything that is queued.
+ */
+static void i2cWorkerTask(void* arg) {
+    SensorQueue* queue = (SensorQueue*) arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (queue -> service() > 0) {}
+    }
+}
+
+/**
+ * Start the task servicing the sensor transaction queue.
+ */
+bool startI2CWorker(SensorQueue* queue) {
+    if (i2cWorker) return true;
+
+    if (xTaskCreate(i2cWorkerTask, "i2c", 3072, queue, configMAX_PRIORITIES - 2, &i2cWorker) != pdPASS) {
+        debugln("Couldn't start I2C worker, running transactions inline.");
+        i2cWorker = nullptr;
+        return false;
+    }
+
+    SensorQueue::Hooks hooks;
+    hooks.lock = i2cLock;
+    hooks.unlock = i2cUnlock;
+    hooks.kick = i2cKick;
+    hooks.self = i2cSelf;
+    hooks.wake = i2cWake;
+    hooks.park = i2cPark;
+    hooks.yield = i2cYield;
+    queue -> setHooks(hooks);
+    return true;
+}
+#else
+/**
+ * No tasks off the station: transactions run inline in await().
+ */
+bool startI2CWorker(SensorQueue* queue) {
+    return false;
+}
+#endif
 
 
 /**
@@ -66,6 +130,26 @@ double calcDP(double temperature, double humidity, double pressure, double altit
     return (dewPoint - (altitude / 1000.0));
 }
 
+/**
+ * Calculate altitude with the international barometric formula.
+ */
+double calcAltitude(double pressure, double qnh) {
+    return 44330.0 * (1.0 - pow((pressure / 100.0) / qnh, 0.1903));
+}
+
+
+
+/**
+ * Build the station sensors on a started bus, and start the bus worker.
+ */
+Sensors stationSensors(TwoWire *wire) {
+    I2C_QUEUE.bus = WireBus(wire);
+    startI2CWorker(&I2C_QUEUE);
+    return Sensors(BMP390Driver<SensorBus>(SensorBus(&I2C_QUEUE)),
+                   SHT31Driver<SensorBus>(SensorBus(&I2C_QUEUE)),
+                   CameraDriver());
+}
+
 
 
 /**
@@ -85,8 +169,9 @@ void appendReading(fs::FS &fs, Reading* reading) {
         return;
     }
 
-    JsonDocument doc;
+    JsonDocument doc(&JSON_ARENA);
     DeserializationError error = deserializeJson(doc, fileContent);
+    heapFree(fileContent);
     
     // If deserialization fails, start with an empty document
     if (error) {
@@ -105,9 +190,13 @@ void appendReading(fs::FS &fs, Reading* reading) {
     newReading["humidity"] = reading->humidity;
     newReading["pressure"] = reading->pressure;
     newReading["dewpoint"] = reading->dewpoint;
+    if (reading->cloudFraction != UNDEFINED) {
+        newReading["cloud_fraction"] = reading->cloudFraction;
+        newReading["brightness"] = reading->brightness;
+    }
 
-    // Open the file for writing
-    File file = fs.open(LOG_FILE, FILE_WRITE);
+    // Write the log's replacement, which takes its place once complete
+    File file = beginReplace(fs, LOG_FILE);
     
     // Check if the file opened successfully
     if (!file) {
@@ -116,10 +205,8 @@ void appendReading(fs::FS &fs, Reading* reading) {
     }
 
     // Serialize the updated JSON document to the file
-    if (serializeJson(doc, file) == 0) debugln("Error: Failed to write to log file.");
-
-    // Close the file
-    file.close();
+    const bool written = serializeJson(doc, file) > 0;
+    if (!endReplace(fs, file, LOG_FILE, written)) debugln("Error: Failed to write to log file.");
 }
 
 
@@ -133,36 +220,60 @@ ReadingLog readLog(fs::FS &fs) {
     // Check if fileContent is valid
     if (fileContent == nullptr || strlen(fileContent) <= 1) {
         debugln("Error: Failed to read the log file or file is empty.");
-        return {0, nullptr};
+        heapFree(fileContent);
+        return {0, nullptr, nullptr};
     }
 
-    JsonDocument doc;
+    JsonDocument doc(&JSON_ARENA);
     DeserializationError error = deserializeJson(doc, fileContent);
+    heapFree(fileContent);
     
     if (error) {
         debug("Error deserializing JSON: ");
         debugln(error.c_str());
-        return {0, nullptr};
+        return {0, nullptr, nullptr};
     }
 
     // Extract the array of readings from the parsed JSON
     JsonArray readings = doc["readings"];
     size_t numReadings = readings.size();
 
-    // Dynamically allocate memory for Reading array on the heap
-    Reading* log = new Reading[numReadings];
+    // A long backlog is a large block, so it goes by size class, to PSRAM once it is large
+    Reading* log = (Reading*)heapAlloc(numReadings * sizeof(Reading));
+    char* timestamps = (char*)heapAlloc(numReadings * LOG_TIMESTAMP_LENGTH);
+    if (!log || !timestamps) {
+        heapFree(log);
+        heapFree(timestamps);
+        return {0, nullptr, nullptr};
+    }
 
     // Iterate over the JSON array and populate the log array
     for (size_t i = 0; i < numReadings; i++) {
         JsonObject reading = readings[i];
-        log[i] = Reading(
-            reading["timestamp"] | "None",               // Use "None" as a default if not present
+        char* timestamp = timestamps + i * LOG_TIMESTAMP_LENGTH;
+        snprintf(timestamp, LOG_TIMESTAMP_LENGTH, "%s", reading["timestamp"] | "None");
+        new (&log[i]) Reading(
+            timestamp,                                   // "None" if not present
             reading["temperature"] | 0.0,                // Default to 0.0
             reading["humidity"] | 0.0,                   // Default to 0.0
             reading["pressure"] | 0.0,                   // Default to 0.0
-            reading["dewpoint"] | 0.0                    // Default to 0.0
+            reading["dewpoint"] | 0.0,                   // Default to 0.0
+            UNDEFINED,                                   // Altitude is not logged
+            reading["cloud_fraction"] | UNDEFINED,       // Only present if the image was analysed
+            reading["brightness"] | UNDEFINED
         );
     }
 
-    return {numReadings, log};
+    return {numReadings, log, timestamps};
+}
+
+/**
+ * Give back the readings and timestamps of a log from readLog.
+ * @param log: The log, empty afterwards.
+ */
+void freeLog(ReadingLog* log) {
+    for (size_t i = 0; i < log -> size; i++) log -> readings[i].~Reading();
+    heapFree(log -> readings);
+    heapFree(log -> timestamps);
+    *log = {0, nullptr, nullptr};
 }
\ No newline at end of file
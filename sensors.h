@@ -3,26 +3,31 @@
 #define SENSORS_H
 
 #include <Wire.h>
-#include <Adafruit_GFX.h>
-#include <Adafruit_SSD1306.h>
-#include "Adafruit_Sensor.h"
-#include "Adafruit_SHT31.h"
-#include "Adafruit_BMP3XX.h"
 #include "io.h"
+#include "i2c_bus.h"
+#include "i2c_queue.h"
+#include "bmp390.h"
+#include "sht31.h"
+#include "sensor_driver.h"
+#include "camera.h"
+#include "power.h"
+#ifdef ESP_PLATFORM
+#include "freertos/event_groups.h"
+#endif
 
 #define MAGNUS_A 17.625
 #define MAGNUS_B 243.04
-#define CAMERA_CLK 5000000
-#define CAMERA_MODEL_ESP32S3_EYE
 #define UNDEFINED -69420.00
 #define SAMPLES 100
+#define BMP_BATCH_FRAMES 64
+#define STANDARD_QNH 1013.25
+#define SAMPLED_BMP (1 << 0)
+#define SAMPLED_SHT (1 << 1)
 #define DISPLAY_WIDTH 128
 #define DISPLAY_HEIGHT 64
 #define SLEEP_MINS 20
 #define BUTTON_PIN 47
 
-#include "camera_pins.h"
-
 
 /**
  * A singular timestamped reading from the sensors.
@@ -35,6 +40,8 @@ struct Reading : public Printable {
     double pressure;              // Pressure in Pascals
     double dewpoint;              // Dew point in degrees Celsius
     double altitude;              // Altitude in meters
+    double cloudFraction;         // Fraction of the sky covered by cloud, from the image
+    double brightness;            // Mean sky brightness in the image, 0 to 255
 
     // Constructor with default values for all fields
     Reading(const char* ts = "None", 
@@ -42,8 +49,11 @@ struct Reading : public Printable {
             double hum = UNDEFINED, 
             double pres = UNDEFINED, 
             double dew = UNDEFINED,
-            double alt = UNDEFINED)
-        : timestamp(ts), temperature(temp), humidity(hum), pressure(pres), dewpoint(dew), altitude(alt) {}
+            double alt = UNDEFINED,
+            double cloud = UNDEFINED,
+            double bright = UNDEFINED)
+        : timestamp(ts), temperature(temp), humidity(hum), pressure(pres), dewpoint(dew), altitude(alt),
+          cloudFraction(cloud), brightness(bright) {}
 
     /**
      * Helper function to format a double value to a string with 5 decimal places
@@ -79,22 +89,51 @@ struct Reading : public Printable {
         n += p.print(formatDouble(dewpoint, "deg C"));
         n += p.print(" | ");
 
+        if (cloudFraction != UNDEFINED) {
+            n += p.print(formatDouble(cloudFraction * 100, "% cloud"));
+            n += p.print(" | ");
+        }
+
         // Return the total number of bytes printed
         return n;
     }
 };
 
 /**
- * Struct to hold a log of readings.
+ * Room for a logged timestamp, "YYYY-MM-DD HH:MM:SS" and its terminator.
+ */
+#define LOG_TIMESTAMP_LENGTH 20
+
+/**
+ * Struct to hold a log of readings. The readings' timestamps point into timestamps,
+ * as the document they were parsed from is gone. Both are given back with freeLog.
  */
 struct ReadingLog{
     size_t size;
     Reading *readings;
+    char *timestamps;
 };
 
 extern unsigned long lastPressed;
 extern bool PROD;
 
+/**
+ * All sensor bus traffic goes through a single transaction queue,
+ * serviced by a worker task so several sensors can sample concurrently.
+ */
+typedef I2CQueue<WireBus> SensorQueue;
+typedef QueuedBus<SensorQueue> SensorBus;
+extern SensorQueue I2C_QUEUE;
+
+/**
+ * Start the task servicing the sensor transaction queue.
+ * If it can't be started, transactions are executed inline by whoever waits on them.
+ * @param queue: The queue to service.
+ *
+ * @return True if the worker is running.
+ */
+bool startI2CWorker(SensorQueue* queue);
+
 /**
  * Removes the outliers from an array and returns the mean of the remaining values.
  * 
@@ -117,6 +156,16 @@ double removeOutliersandGetMean(double* dataArr, uint16_t size);
  */
 double calcDP(double temperature, double humidity, double pressure, double altitude);
 
+/**
+ * Calculate altitude with the international barometric formula.
+ * 
+ * @param pressure: The station pressure in Pascals.
+ * @param qnh: The sea level pressure in hectoPascals.
+ * 
+ * @return The altitude in meters.
+ */
+double calcAltitude(double pressure, double qnh);
+
 /**
  * Append a reading object to the log file.
  * @param fs: The file system reference to use for the cache.
@@ -126,7 +175,7 @@ void appendReading(fs::FS &fs, Reading* reading);
 
 /**
  * Read the log file and return an array of readings.
- * WARNING: DYNAMICALLY ALLOCATED HEAP ARRAY.
+ * WARNING: DYNAMICALLY ALLOCATED HEAP ARRAY, given back with freeLog.
  * @param fs: The file system reference to use for the cache.
  * 
  * @return A ReadingLog struct containing an array of readings, and the number of readings.
@@ -134,52 +183,29 @@ void appendReading(fs::FS &fs, Reading* reading);
 ReadingLog readLog(fs::FS &fs);
 
 /**
- * Struct to hold sensor details and functionality.
+ * Give back the readings and timestamps of a log from readLog.
+ * @param log: The log, empty afterwards.
  */
-struct Sensors {
-
-    struct Status {
-        bool CAM = false;
-        bool SHT = false;
-        bool BMP = false;
-        bool WIFI = false;
-        bool SCREEN = false;
-    } status;
-
-    TwoWire *wire;
-    camera_fb_t *frame;
-    camera_config_t config;
-    Adafruit_BMP3XX BMP;
-    Adafruit_SHT31 SHT;
-    Adafruit_SSD1306 SCREEN;
-
-    Sensors(){}
-
-    Sensors(TwoWire *w) : wire(w) {
-        SHT = Adafruit_SHT31();
-        BMP = Adafruit_BMP3XX();
-        SCREEN = Adafruit_SSD1306();
-        status.BMP = initBMP();
-        status.SHT = initSHT();
-        status.CAM = initCAM();
-    }
+void freeLog(ReadingLog* log);
 
-    bool all_down() {
-        return !status.CAM && !status.SHT && !status.BMP && !status.SCREEN;
-    }
+/**
+ * Barometer driver: BMP390 sampled with hardware oversampling (x8 pressure) and
+ * IIR filtering, letting the FIFO fill up between burst reads instead of polling
+ * every sample. Fills in pressure and temperature.
+ */
+template <typename Bus>
+class BMP390Driver : public SensorDriver<BMP390Driver<Bus>> {
+    friend class SensorDriver<BMP390Driver<Bus>>;
 
-    bool initSHT() {
-        if (!SHT.begin()) {
-            debugln("Couldn't find SHT31.");
-            return false;
-        }
+public:
+    BMP390<Bus> BMP;
 
-        debugln("SHT31-D found and initialized");
-        return true;
-    }
+    BMP390Driver() {}
+    BMP390Driver(Bus bus) : BMP(bus) {}
 
-    bool initBMP() {
-        if (!BMP.begin_I2C(0x77, wire)) {
+private:
+    bool initImpl() {
+        if (!BMP.begin()) {
             debugln("Couldn't find BMP3XX.");
             return false;
         }
@@ -188,191 +214,241 @@ struct Sensors {
         return true;
     }
 
-    esp_err_t cameraTeardown() {
-        esp_err_t err = ESP_OK;
+    bool sampleImpl(Reading *reading) {
+        if (!BMP.startFifo(BMP390_OS_8X, BMP390_OS_1X, BMP390_IIR_3, BMP390_ODR_25)) {
+            debugln("Couldn't configure BMP3XX FIFO.");
+            return false;
+        }
 
-        // Deinitialize camera
-        err = esp_camera_deinit();
+        BMP390Sample samples[BMP390_FIFO_FRAMES];
+        double presses[SAMPLES];
+        double tempers_bmp[SAMPLES];
+        uint8_t errors = 0;
+        uint8_t valid = 0;
 
-        // Display any errors associated with camera deinitialization
-        if (err != ESP_OK) debugf("Error deinitializing camera: %s\n", esp_err_to_name(err));
-        else debugf("Camera deinitialized successfully\n");
-        
-        debugln();
-        return err;
-    }
+        while ( valid < SAMPLES && errors < 5 ) {
+            // Wait for as many frames as are still needed, up to a FIFO's worth.
+            const uint8_t wanted = min(SAMPLES - valid, BMP_BATCH_FRAMES);
+            powerWait(wanted * BMP.samplePeriodMs());
 
-    bool initCAM() {
-        debugln("Setting up camera...");
-        config.ledc_channel = LEDC_CHANNEL_0;
-        config.ledc_timer = LEDC_TIMER_0;
-        config.pin_d0 = Y2_GPIO_NUM;
-        config.pin_d1 = Y3_GPIO_NUM;
-        config.pin_d2 = Y4_GPIO_NUM;
-        config.pin_d3 = Y5_GPIO_NUM;
-        config.pin_d4 = Y6_GPIO_NUM;
-        config.pin_d5 = Y7_GPIO_NUM;
-        config.pin_d6 = Y8_GPIO_NUM;
-        config.pin_d7 = Y9_GPIO_NUM;
-        config.pin_xclk = XCLK_GPIO_NUM;
-        config.pin_pclk = PCLK_GPIO_NUM;
-        config.pin_vsync = VSYNC_GPIO_NUM;
-        config.pin_href = HREF_GPIO_NUM;
-        config.pin_sscb_sda = SIOD_GPIO_NUM;
-        config.pin_sscb_scl = SIOC_GPIO_NUM;
-        config.pin_pwdn = PWDN_GPIO_NUM;
-        config.pin_reset = RESET_GPIO_NUM;
-        config.xclk_freq_hz = CAMERA_CLK;
-        config.frame_size = FRAMESIZE_QHD;
-        config.pixel_format = PIXFORMAT_JPEG;
-        config.grab_mode = CAMERA_GRAB_LATEST; // Needs to be "CAMERA_GRAB_LATEST" for camera to capture.
-        config.fb_location = CAMERA_FB_IN_PSRAM;
-        config.jpeg_quality = 10;
-        config.fb_count = 1;
-
-        /** if PSRAM keep res and jpeg quality.
-        * Limit the frame size & quality when PSRAM is not available
-        */
-        if(!psramFound()) {
-            debugln("Couldn't find PSRAM on the board!");
-            config.frame_size = FRAMESIZE_SVGA;
-            config.fb_location = CAMERA_FB_IN_DRAM;
-            config.jpeg_quality = 30;
-        }
+            const int got = BMP.readFifo(samples);
+            if (got <= 0) {
+                errors++;
+                continue;
+            }
 
-        /**
-        * Initialize the camera
-        */
-        esp_err_t initErr = esp_camera_init(&config);
-        if (initErr != ESP_OK) {
-            debugf("Camera init failed with error 0x%x", initErr);
-            if (initErr == ESP_ERR_NOT_FOUND) debugln("Camera not found");
-            esp_err_t deinitErr = cameraTeardown();
-            if (deinitErr != ESP_OK) debugf("Camera de-init failed with error 0x%x", deinitErr);
-            debugln();
-            return false;
+            for (int i = 0; i < got && valid < SAMPLES; i++) {
+                if (isnan(samples[i].pressure) || isnan(samples[i].temperature)) continue;
+                presses[valid] = samples[i].pressure;
+                tempers_bmp[valid] = samples[i].temperature;
+                valid++;
+            }
         }
 
-        sensor_t * s = esp_camera_sensor_get();
-        s->set_brightness(s, 0);     // -2 to 2
-        s->set_contrast(s, 1);       // -2 to 2
-        s->set_saturation(s, 0);     // -2 to 2
-        s->set_special_effect(s, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
-        s->set_whitebal(s, 1);       // 0 = disable , 1 = enable
-        s->set_awb_gain(s, 1);       // 0 = disable , 1 = enable
-        s->set_wb_mode(s, 2);        // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
-        s->set_exposure_ctrl(s, 1);  // 0 = disable , 1 = enable
-        s->set_aec2(s, 0);           // 0 = disable , 1 = enable
-        s->set_ae_level(s, 0);       // -2 to 2
-        s->set_aec_value(s, 300);    // 0 to 1200
-        s->set_gain_ctrl(s, 1);      // 0 = disable , 1 = enable
-        s->set_agc_gain(s, 0);       // 0 to 30
-        s->set_gainceiling(s, (gainceiling_t)6);  // 0 to 6 (6 from "timelapse" example sjr, OK)
-        s->set_bpc(s, 0);            // 0 = disable , 1 = enable
-        s->set_wpc(s, 1);            // 0 = disable , 1 = enable
-        s->set_raw_gma(s, 1);        // 0 = disable , 1 = enable
-        s->set_lenc(s, 1);           // 0 = disable , 1 = enable
-        s->set_hmirror(s, 0);        // 0 = disable , 1 = enable
-        s->set_vflip(s, 1);          // 0 = disable , 1 = enable
-        s->set_dcw(s, 1);            // 0 = disable , 1 = enable
-        s->set_colorbar(s, 0);       // 0 = disable , 1 = enable
-
-        delay(100);
-
-        /**
-        * Attempt to capture an image with the given settings.
-        * If no capture, set camera status to false and de-init camera.
-        */
-        frame = esp_camera_fb_get();
-        if(!frame) {
-            debugln("Camera capture failed");
-            esp_err_t deinitErr = cameraTeardown();
-            if (deinitErr != ESP_OK) debugf("Camera de-init failed with error 0x%x", deinitErr);
-            debugln();
-            esp_camera_fb_return(frame);
-            return false;
-        }
+        BMP.stop();
 
-        esp_camera_fb_return(frame);
-        debugln("Camera configuration complete!");
+        if (errors >= 5 || valid == 0) return false;
+        reading -> temperature = removeOutliersandGetMean(tempers_bmp, valid);
+        reading -> pressure = removeOutliersandGetMean(presses, valid);
         return true;
     }
 
-    camera_fb_t* read_cam() {
-        debugln("Taking image...");
-        for(int i = 0; i < 3; i++) {
-            frame = esp_camera_fb_get();
-            delay(20);
-            esp_camera_fb_return(frame);
-            delay(20);
-        }
-        frame = esp_camera_fb_get();
-        delay(20);
-
-        if (!frame) {
-            debugln("Camera capture failed");
-            return nullptr;
-        }
-
-        debugln("Image captured!");
-        return frame;
+    bool teardownImpl() {
+        return BMP.stop();
     }
+};
 
-    void read_bmp(Reading *reading, double QNH) {
-        if (BMP.performReading()) return;
+/**
+ * Hygrometer driver: SHT31 in periodic mode, fetching one combined, CRC checked
+ * temperature + humidity frame per measurement. Fills in humidity and temperature.
+ */
+template <typename Bus>
+class SHT31Driver : public SensorDriver<SHT31Driver<Bus>> {
+    friend class SensorDriver<SHT31Driver<Bus>>;
 
-        double presses[SAMPLES];
-        double altids[SAMPLES];
-        double tempers_bmp[SAMPLES];
-        uint8_t errors = 0;
-        uint8_t valid = 0;
+public:
+    SHT31<Bus> SHT;
 
-        while ( valid < SAMPLES && errors < 5 ) {
-            presses[valid] = BMP.readPressure();
-            altids[valid] = BMP.readAltitude(QNH);
-            tempers_bmp[valid] = BMP.readTemperature();
-            if (isnan(presses[valid]) || isnan(altids[valid]) || isnan(tempers_bmp[valid])) {
-                errors++;
-                continue;
-            }
-            else valid++;
-            delay(50);
-        }
+    SHT31Driver() {}
+    SHT31Driver(Bus bus) : SHT(bus) {}
 
-        if (errors < 5) {
-            reading -> altitude = removeOutliersandGetMean(altids, valid);
-            reading -> temperature = removeOutliersandGetMean(tempers_bmp, valid);
-            reading -> pressure = removeOutliersandGetMean(presses, valid);
+private:
+    bool initImpl() {
+        if (!SHT.begin()) {
+            debugln("Couldn't find SHT31.");
+            return false;
         }
+
+        debugln("SHT31-D found and initialized");
+        return true;
     }
 
-    void read_sht(Reading *reading) {
+    bool sampleImpl(Reading *reading) {
+        if (!SHT.startPeriodic(SHT31_MPS_10)) {
+            debugln("Couldn't start SHT31 periodic mode.");
+            return false;
+        }
+
         double h[SAMPLES];
         double t[SAMPLES];
+        SHT31Sample sample;
         uint8_t errors = 0;
+        uint8_t misses = 0;
         uint8_t valid = 0;
 
         while (valid < SAMPLES && errors < 5) {
-            h[valid] = SHT.readHumidity();
-            t[valid] = SHT.readTemperature();
-            if (isnan(h[valid]) || isnan(t[valid])) {
+            powerWait(SHT.samplePeriodMs());
+            const int got = SHT.fetch(&sample);
+
+            // An occasional "not ready" is timing jitter, a run of them is a dead sensor.
+            if (got == 0) {
+                if (++misses >= 3) {
+                    errors++;
+                    misses = 0;
+                }
+                continue;
+            }
+            misses = 0;
+
+            if (got < 0 || isnan(sample.humidity) || isnan(sample.temperature)) {
                 errors++;
                 continue;
             }
-            else valid++;
-            delay(50);
+            h[valid] = sample.humidity;
+            t[valid] = sample.temperature;
+            valid++;
         }
 
-        if( errors < 5 ) { 
-            reading -> humidity = removeOutliersandGetMean(h, valid);
-            reading -> temperature = removeOutliersandGetMean(t, valid);
-        }
+        SHT.stop();
+
+        if (errors >= 5 || valid == 0) return false;
+        reading -> humidity = removeOutliersandGetMean(h, valid);
+        reading -> temperature = removeOutliersandGetMean(t, valid);
+        return true;
     }
 
-    void read(Reading *reading, double QNH) {
-        if (status.BMP) read_bmp(reading, QNH);
-        if (status.SHT) read_sht(reading);
+    bool teardownImpl() {
+        return SHT.stop();
+    }
+};
 
+/**
+ * Statuses of the station components, as reported to the server.
+ */
+struct SensorStatus {
+    bool CAM = false;
+    bool SHT = false;
+    bool BMP = false;
+    bool WIFI = false;
+    bool SCREEN = false;
+    uint32_t SKIPPED_BYTES = 0;     // Image bytes left unsent as duplicates since the last report
+};
+
+/**
+ * The sensors of a station, composed of drivers at compile time.
+ * Every driver implements the SensorDriver interface, so the same suite runs on the
+ * station drivers or on the host mocks in host/mock_drivers.h.
+ *
+ * @tparam Baro: Barometer driver, fills in pressure (and temperature).
+ * @tparam Hygro: Hygrometer driver, fills in humidity and temperature.
+ * @tparam Cam: Camera driver, additionally providing capture(), wantsBracket() and bracket().
+ */
+template <typename Baro, typename Hygro, typename Cam>
+struct SensorSuite {
+    typedef SensorStatus Status;
+
+    Status status;
+    Baro baro;
+    Hygro hygro;
+    Cam cam;
+
+    SensorSuite() {}
+    SensorSuite(Baro b, Hygro h, Cam c) : baro(b), hygro(h), cam(c) {}
+
+    /**
+     * Initialize every sensor.
+     * @return True if at least one sensor came up.
+     */
+    bool begin() {
+        beginSensors();
+        beginCamera();
+        return !all_down();
+    }
+
+    /**
+     * Initialize the barometer and hygrometer, leaving the camera down.
+     * @return True if either came up.
+     */
+    bool beginSensors() {
+        baro.init();
+        hygro.init();
+        refreshStatus();
+        return status.BMP || status.SHT;
+    }
+
+    /**
+     * Initialize the camera, which is the slowest to come up.
+     * @return True if it came up.
+     */
+    bool beginCamera() {
+        cam.init();
+        refreshStatus();
+        return status.CAM;
+    }
+
+    bool all_down() {
+        return !status.CAM && !status.SHT && !status.BMP && !status.SCREEN;
+    }
+
+    /**
+     * Mirror the driver health into the reported statuses.
+     */
+    void refreshStatus() {
+        status.BMP = baro.health() != SENSOR_DOWN;
+        status.SHT = hygro.health() != SENSOR_DOWN;
+        status.CAM = cam.health() != SENSOR_DOWN;
+    }
+
+    ImageBuffer read_cam() {
+        return cam.capture();
+    }
+
+    /**
+     * Take a bracket of exposures if the last capture was bright enough for one.
+     * @param sink: Where each frame goes, while the next is exposed.
+     * @param ctx: Passed to the sink.
+     *
+     * @return The number of frames the sink took.
+     */
+    uint8_t read_bracket(BracketSink sink, void* ctx) {
+        if (!status.CAM || !cam.wantsBracket()) return 0;
+        return cam.bracket(sink, ctx);
+    }
+
+    bool cameraTeardown() {
+        const bool ok = cam.teardown();
+        refreshStatus();
+        return ok;
+    }
+
+    /**
+     * Compute the altitude of a reading from its pressure.
+     * @param reading: The reading, with pressure already set.
+     * @param QNH: The sea level pressure in hPa, or UNDEFINED for the standard atmosphere.
+     */
+    void applyQNH(Reading *reading, double QNH) {
+        if (reading -> pressure == UNDEFINED) return;
+        if (QNH <= 0) {
+            debugln("No QNH available, assuming standard atmosphere for altitude.");
+            QNH = STANDARD_QNH;
+        }
+        reading -> altitude = calcAltitude(reading -> pressure, QNH);
+    }
+
+    /**
+     * Fill in the dewpoint once all of its inputs are known.
+     */
+    void finishReading(Reading *reading) {
         if (reading -> temperature != UNDEFINED &&
             reading -> humidity != UNDEFINED &&
             reading -> pressure != UNDEFINED &&
@@ -384,6 +460,123 @@ struct Sensors {
                                              reading -> altitude);
         }
     }
+
+    /**
+     * Sample every sensor in turn. The hygrometer temperature wins over the barometer one.
+     */
+    void read(Reading *reading, double QNH) {
+        baro.sample(reading);
+        hygro.sample(reading);
+        applyQNH(reading, QNH);
+        finishReading(reading);
+        refreshStatus();
+    }
+
+#ifdef ESP_PLATFORM
+    /**
+     * Background sampling state, see beginRead / endRead.
+     */
+    EventGroupHandle_t sampling = nullptr;
+    Reading baroReading;
+    Reading hygroReading;
+
+    /**
+     * Start sampling the barometer and hygrometer concurrently in background tasks,
+     * sharing the bus through the transaction queue, so that sampling overlaps with
+     * network setup. The QNH is not needed until endRead, since altitude comes from
+     * the averaged pressure.
+     *
+     * @return True if sampling was started.
+     */
+    bool beginRead() {
+        if (sampling) return true;
+
+        sampling = xEventGroupCreate();
+        if (!sampling) return false;
+
+        baroReading = Reading();
+        hygroReading = Reading();
+
+        // Sensors which are down, or whose task won't start, count as already done.
+        EventBits_t done = 0;
+        if (!baro.ready() || xTaskCreate(baroTask, "baro", 8192, this, 2, nullptr) != pdPASS) done |= SAMPLED_BMP;
+        if (!hygro.ready() || xTaskCreate(hygroTask, "hygro", 4096, this, 2, nullptr) != pdPASS) done |= SAMPLED_SHT;
+        if (done) xEventGroupSetBits(sampling, done);
+
+        debugln("Sampling in the background...");
+        return true;
+    }
+
+    /**
+     * Wait for background sampling to finish and merge the results into reading.
+     * Falls back to sampling synchronously if beginRead was not called or failed.
+     * @param reading: The reading to fill.
+     * @param QNH: The sea level pressure in hPa.
+     */
+    void endRead(Reading *reading, double QNH) {
+        if (!sampling) {
+            read(reading, QNH);
+            return;
+        }
+
+        POWER.leave();
+        xEventGroupWaitBits(sampling, SAMPLED_BMP | SAMPLED_SHT, pdFALSE, pdTRUE, portMAX_DELAY);
+        POWER.enter();
+        vEventGroupDelete(sampling);
+        sampling = nullptr;
+
+        // Same precedence as sequential sampling: the hygrometer temperature wins.
+        reading -> pressure = baroReading.pressure;
+        reading -> temperature = baroReading.temperature;
+        if (hygroReading.temperature != UNDEFINED) reading -> temperature = hygroReading.temperature;
+        reading -> humidity = hygroReading.humidity;
+
+        applyQNH(reading, QNH);
+        finishReading(reading);
+        refreshStatus();
+    }
+
+private:
+    static void baroTask(void* arg) {
+        SensorSuite* self = (SensorSuite*) arg;
+        POWER.enter();
+        self -> baro.sample(&self -> baroReading);
+        POWER.leave();
+        xEventGroupSetBits(self -> sampling, SAMPLED_BMP);
+        vTaskDelete(nullptr);
+    }
+
+    static void hygroTask(void* arg) {
+        SensorSuite* self = (SensorSuite*) arg;
+        POWER.enter();
+        self -> hygro.sample(&self -> hygroReading);
+        POWER.leave();
+        xEventGroupSetBits(self -> sampling, SAMPLED_SHT);
+        vTaskDelete(nullptr);
+    }
+#else
+    bool beginRead() {
+        return false;
+    }
+
+    void endRead(Reading *reading, double QNH) {
+        read(reading, QNH);
+    }
+#endif
 };
 
-#endif
\ No newline at end of file
+/**
+ * The station: BMP390 and SHT31 on the queued sensor bus, plus the OV5640 camera.
+ */
+typedef SensorSuite<BMP390Driver<SensorBus>, SHT31Driver<SensorBus>, CameraDriver> Sensors;
+
+/**
+ * Build the station sensors on a started bus, and start the bus worker.
+ * Nothing is initialized yet, call begin() for that.
+ * @param wire: The bus the sensors are on, already started with wire -> begin(sda, scl).
+ *
+ * @return The station sensors.
+ */
+Sensors stationSensors(TwoWire *wire);
+
+#endif
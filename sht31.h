@@ -0,0 +1,178 @@
+#pragma once
+#ifndef SHT31_H
+#define SHT31_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "i2c_bus.h"
+
+/**
+ * Commands of the Sensirion SHT3x, sent MSB first.
+ * See the SHT3x-DIS datasheet, section 4.
+ */
+#define SHT31_ADDRESS           0x44
+
+#define SHT31_CMD_SOFTRESET     0x30A2
+#define SHT31_CMD_BREAK         0x3093
+#define SHT31_CMD_STATUS        0xF32D
+#define SHT31_CMD_CLEAR_STATUS  0x3041
+#define SHT31_CMD_FETCH         0xE000
+#define SHT31_CMD_ART           0x2B32
+
+/**
+ * Milliseconds the sensor needs after a break before it takes the next command
+ * (datasheet, 1 ms), with some margin.
+ */
+#define SHT31_BREAK_MS          2
+
+#define SHT31_CRC_POLY          0x31
+#define SHT31_CRC_INIT          0xFF
+#define SHT31_FRAME_LEN         6
+
+/**
+ * Periodic acquisition rates with high repeatability, as command words.
+ */
+enum SHT31Rate : uint16_t {
+    SHT31_MPS_0_5 = 0x2032,
+    SHT31_MPS_1 = 0x2130,
+    SHT31_MPS_2 = 0x2236,
+    SHT31_MPS_4 = 0x2334,
+    SHT31_MPS_10 = 0x2737
+};
+
+/**
+ * A single temperature + humidity frame from the sensor.
+ */
+struct SHT31Sample {
+    double temperature;     // Temperature in degrees Celsius
+    double humidity;        // Humidity as percentage
+};
+
+/**
+ * Register level SHT31 driver using periodic acquisition.
+ * The sensor converts on its own schedule and each fetch returns one combined
+ * temperature + humidity frame, instead of a clock-stretched single shot per quantity.
+ *
+ * @tparam Bus: Any type providing the bus interface described in i2c_bus.h.
+ */
+template <typename Bus>
+class SHT31 {
+public:
+    SHT31() {}
+    SHT31(Bus b, uint8_t address = SHT31_ADDRESS) : bus(b), addr(address) {}
+
+    /**
+     * Stop the periodic acquisition the sensor may have been left in, as it then only
+     * listens for a break, and check that its status word reads back intact.
+     * @return True if the sensor answered with a valid status word.
+     */
+    bool begin() {
+        stop();
+        bus.wait(SHT31_BREAK_MS);
+
+        uint8_t status[3];
+        if (!commandRead(SHT31_CMD_STATUS, status, 3)) return false;
+        return crc8(status, 2) == status[2];
+    }
+
+    /**
+     * Start periodic acquisition at the given rate.
+     */
+    bool startPeriodic(SHT31Rate mps) {
+        rate = mps;
+        return command(mps);
+    }
+
+    /**
+     * Start accelerated response time mode (4 measurements per second).
+     */
+    bool startART() {
+        rate = SHT31_MPS_4;
+        return command(SHT31_CMD_ART);
+    }
+
+    /**
+     * Stop periodic acquisition, returning the sensor to single shot idle.
+     * The sensor accepts the next command after 1ms.
+     */
+    bool stop() {
+        return command(SHT31_CMD_BREAK);
+    }
+
+    /**
+     * Milliseconds between two measurements at the configured rate.
+     */
+    uint32_t samplePeriodMs() const {
+        switch (rate) {
+            case SHT31_MPS_0_5: return 2000;
+            case SHT31_MPS_1: return 1000;
+            case SHT31_MPS_2: return 500;
+            case SHT31_MPS_4: return 250;
+            default: return 100;
+        }
+    }
+
+    /**
+     * Fetch the latest frame from the sensor and check both CRCs.
+     * @param out: The sample to fill.
+     *
+     * @return 1 if a frame was read, 0 if no new measurement was ready, -1 on a CRC error.
+     */
+    int fetch(SHT31Sample* out) {
+        uint8_t frame[SHT31_FRAME_LEN];
+
+        // The sensor NACKs the read header when there is no new measurement.
+        if (!commandRead(SHT31_CMD_FETCH, frame, SHT31_FRAME_LEN)) return 0;
+        return parseFrame(frame, out) ? 1 : -1;
+    }
+
+    /**
+     * Convert a raw 6 byte frame (T msb, T lsb, crc, RH msb, RH lsb, crc).
+     * @return True if both CRCs matched and out was filled.
+     */
+    static bool parseFrame(const uint8_t* frame, SHT31Sample* out) {
+        if (crc8(frame, 2) != frame[2] || crc8(frame + 3, 2) != frame[5]) return false;
+        const uint16_t t = (uint16_t)(frame[0] << 8 | frame[1]);
+        const uint16_t h = (uint16_t)(frame[3] << 8 | frame[4]);
+        out -> temperature = -45.0 + 175.0 * (t / 65535.0);
+        out -> humidity = 100.0 * (h / 65535.0);
+        return true;
+    }
+
+    /**
+     * CRC-8 as used by Sensirion: polynomial 0x31, init 0xFF, no reflection.
+     */
+    static uint8_t crc8(const uint8_t* data, size_t len) {
+        uint8_t crc = SHT31_CRC_INIT;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            for (uint8_t b = 0; b < 8; b++) {
+                crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ SHT31_CRC_POLY) : (uint8_t)(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    Bus bus;
+
+private:
+    uint8_t addr = SHT31_ADDRESS;
+    uint16_t rate = SHT31_MPS_10;
+
+    bool command(uint16_t cmd) {
+        const uint8_t buf[2] = {(uint8_t)(cmd >> 8), (uint8_t)(cmd & 0xFF)};
+        return bus.write(addr, buf, 2);
+    }
+
+    /**
+     * A command and the read of its answer, as one sequence. Not a register read:
+     * the sensor wants a stop between the two.
+     */
+    bool commandRead(uint16_t cmd, uint8_t* rx, size_t len) {
+        const uint8_t buf[2] = {(uint8_t)(cmd >> 8), (uint8_t)(cmd & 0xFF)};
+        const I2CTransfer transfers[2] = {{buf, 2, nullptr, 0}, {nullptr, 0, rx, len}};
+        return bus.sequence(addr, transfers, 2);
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "sky.h"
+#include "sensors.h"
+#include <math.h>
+#include <string.h>
+#include "thumbnail.h"
+
+/**
+ * The columns [x0, x1) of a row which lie inside the mask.
+ * @return False if the row misses the mask entirely.
+ */
+bool SkyMask::span(int32_t y, uint16_t width, int32_t* x0, int32_t* x1) const {
+    const int32_t dy = y - cy;
+    if (dy < -radius || dy > radius) return false;
+    const int32_t half = (int32_t)sqrtf((float)(radius * radius - dy * dy));
+    *x0 = cx - half < 0 ? 0 : cx - half;
+    *x1 = cx + half + 1 > width ? width : cx + half + 1;
+    return *x1 > *x0;
+}
+
+/**
+ * Classify a run of RGB888 pixels and add them to the counts.
+ * @param rgb: The first pixel.
+ * @param n: The number of pixels.
+ * @param counts: The counts to add to.
+ */
+void skyClassifyRun(const uint8_t* rgb, size_t n, SkyCounts* counts) {
+    uint32_t cloud = 0;
+    uint32_t luma = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t r = rgb[3 * i];
+        const uint32_t g = rgb[3 * i + 1];
+        const uint32_t b = rgb[3 * i + 2];
+        cloud += r * SKY_RB_DEN >= b * SKY_RB_NUM;
+        luma += (77 * r + 150 * g + 29 * b) >> 8;   // BT.601
+    }
+
+    counts -> pixels += n;
+    counts -> cloud += cloud;
+    counts -> luma += luma;
+}
+
+/**
+ * Classify the pixels of an RGB888 image inside a mask.
+ * @return The totals over the mask.
+ */
+SkyCounts skyClassify(const uint8_t* rgb, uint16_t width, uint16_t height, const SkyMask& mask) {
+    SkyCounts counts;
+    int32_t x0, x1;
+    for (uint16_t y = 0; y < height; y++) {
+        if (!mask.span(y, width, &x0, &x1)) continue;
+        skyClassifyRun(rgb + ((size_t)y * width + x0) * 3, x1 - x0, &counts);
+    }
+    return counts;
+}
+
+/**
+ * Reduce counts to statistics.
+ */
+SkyStats skyStats(const SkyCounts& counts) {
+    if (!counts.pixels) return {UNDEFINED, UNDEFINED, 0};
+    return {
+        (double)counts.cloud / counts.pixels,
+        (double)counts.luma / counts.pixels,
+        counts.pixels
+    };
+}
+
+/**
+ * Decode a captured JPEG at 1/8 scale and compute its sky statistics.
+ * @param jpg: The captured image.
+ * @param stats: The statistics to fill in.
+ *
+ * @return True if the image could be decoded.
+ */
+bool skyAnalyse(const ImageBuffer& jpg, SkyStats* stats) {
+    uint16_t w, h;
+    if (!jpg || !stats || !previewSize(jpg.data(), jpg.size(), PREVIEW_DC, &w, &h)) return false;
+
+    const unsigned long start = millis();
+    ImageBuffer rgb = ImageBuffer::fromPool(&IMAGE_POOL, (size_t)w * h * 3, w, h);
+    if (!rgb || !decodePreview(jpg.data(), jpg.size(), PREVIEW_DC, rgb.data(), rgb.size(), &w, &h)) {
+        debugln("Failed to decode image for sky analysis");
+        return false;
+    }
+
+    *stats = skyStats(skyClassify(rgb.data(), w, h, SkyMask::forImage(w, h)));
+    debugf("Sky: %.3f cloud, brightness %.1f over %u px (%lu ms)\n", stats -> cloudFraction, stats -> brightness, stats -> pixels, millis() - start);
+    return stats -> pixels > 0;
+}
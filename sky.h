@@ -0,0 +1,103 @@
+#pragma once
+#ifndef SKY_H
+#define SKY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "image_buffer.h"
+
+/**
+ * A pixel is cloud when its red / blue ratio is at least SKY_RB_NUM / SKY_RB_DEN.
+ * Clear sky scatters far more blue than red, cloud scatters both about equally.
+ */
+#define SKY_RB_NUM 60
+#define SKY_RB_DEN 100
+
+/**
+ * The fisheye circle, in permille of the frame: centre as a fraction of width and height,
+ * radius as a fraction of half the height. Pixels outside it are horizon, mount or housing.
+ */
+#define SKY_MASK_CX 500
+#define SKY_MASK_CY 500
+#define SKY_MASK_RADIUS 950
+
+/**
+ * Per pixel totals over the part of an image inside the mask.
+ */
+struct SkyCounts {
+    uint32_t pixels = 0;        // Pixels inside the mask
+    uint32_t cloud = 0;         // Pixels classified as cloud
+    uint64_t luma = 0;          // Sum of the luma of all pixels
+};
+
+/**
+ * Sky statistics of one image.
+ */
+struct SkyStats {
+    double cloudFraction;       // Fraction of the sky covered by cloud, 0 to 1
+    double brightness;          // Mean luma inside the mask, 0 to 255
+    uint32_t pixels;            // Pixels the statistics are computed over
+};
+
+/**
+ * The fisheye mask, as a circle in pixel coordinates of the image it is applied to.
+ */
+struct SkyMask {
+    int32_t cx;
+    int32_t cy;
+    int32_t radius;
+
+    /**
+     * The default mask, scaled to an image of the given size.
+     */
+    static SkyMask forImage(uint16_t width, uint16_t height) {
+        return {
+            (int32_t)width * SKY_MASK_CX / 1000,
+            (int32_t)height * SKY_MASK_CY / 1000,
+            (int32_t)height * SKY_MASK_RADIUS / 2000
+        };
+    }
+
+    /**
+     * The columns [x0, x1) of a row which lie inside the mask.
+     * @return False if the row misses the mask entirely.
+     */
+    bool span(int32_t y, uint16_t width, int32_t* x0, int32_t* x1) const;
+};
+
+/**
+ * Classify a run of RGB888 pixels and add them to the counts.
+ * Branch free, so the compiler can vectorise it.
+ * @param rgb: The first pixel.
+ * @param n: The number of pixels.
+ * @param counts: The counts to add to.
+ */
+void skyClassifyRun(const uint8_t* rgb, size_t n, SkyCounts* counts);
+
+/**
+ * Classify the pixels of an RGB888 image inside a mask.
+ * @param rgb: The image, rows of width pixels.
+ * @param width: The image width.
+ * @param height: The image height.
+ * @param mask: The part of the image to classify.
+ *
+ * @return The totals over the mask.
+ */
+SkyCounts skyClassify(const uint8_t* rgb, uint16_t width, uint16_t height, const SkyMask& mask);
+
+/**
+ * Reduce counts to statistics.
+ */
+SkyStats skyStats(const SkyCounts& counts);
+
+/**
+ * Decode a captured JPEG at 1/8 scale, from its DC coefficients, and compute its sky statistics.
+ * The decoded pixels live in a block from IMAGE_POOL for the duration of the call.
+ * @param jpg: The captured image.
+ * @param stats: The statistics to fill in.
+ *
+ * @return True if the image could be decoded.
+ */
+bool skyAnalyse(const ImageBuffer& jpg, SkyStats* stats);
+
+#endif
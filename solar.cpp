@@ -0,0 +1,105 @@
+#include "solar.h"
+#include "sensors.h"
+#include <math.h>
+
+#define DEG (M_PI / 180.0)
+
+/**
+ * Geometric solar elevation, after the NOAA solar calculator.
+ * Double precision throughout: Julian centuries in float lose minutes.
+ * @return The elevation of the centre of the sun above the horizon, in degrees.
+ */
+double solarElevation(time_t utc, double latitude, double longitude) {
+    const double jd = (double)utc / 86400.0 + 2440587.5;
+    const double t = (jd - 2451545.0) / 36525.0;            // Julian centuries since J2000
+
+    const double meanLong = fmod(280.46646 + t * (36000.76983 + t * 0.0003032), 360.0);
+    const double meanAnomaly = 357.52911 + t * (35999.05029 - 0.0001537 * t);
+    const double eccentricity = 0.016708634 - t * (0.000042037 + 0.0000001267 * t);
+    const double m = meanAnomaly * DEG;
+    const double centre = sin(m) * (1.914602 - t * (0.004817 + 0.000014 * t)) +
+                          sin(2 * m) * (0.019993 - 0.000101 * t) +
+                          sin(3 * m) * 0.000289;
+
+    const double omega = (125.04 - 1934.136 * t) * DEG;
+    const double apparentLong = (meanLong + centre - 0.00569 - 0.00478 * sin(omega)) * DEG;
+    const double meanObliquity = 23.0 + (26.0 + (21.448 - t * (46.815 + t * (0.00059 - t * 0.001813))) / 60.0) / 60.0;
+    const double obliquity = (meanObliquity + 0.00256 * cos(omega)) * DEG;
+    const double declination = asin(sin(obliquity) * sin(apparentLong));
+
+    // Equation of time, in minutes.
+    const double y = tan(obliquity / 2) * tan(obliquity / 2);
+    const double l0 = meanLong * DEG;
+    const double eqTime = 4.0 / DEG * (y * sin(2 * l0) - 2 * eccentricity * sin(m) +
+                                      4 * eccentricity * y * sin(m) * cos(2 * l0) -
+                                      0.5 * y * y * sin(4 * l0) - 1.25 * eccentricity * eccentricity * sin(2 * m));
+
+    const double minutes = fmod((double)utc, 86400.0) / 60.0;
+    const double solarTime = fmod(minutes + eqTime + 4.0 * longitude + 1440.0, 1440.0);
+    const double hourAngle = (solarTime / 4.0 - 180.0) * DEG;
+
+    const double lat = latitude * DEG;
+    double cosZenith = sin(lat) * sin(declination) + cos(lat) * cos(declination) * cos(hourAngle);
+    cosZenith = cosZenith > 1 ? 1 : cosZenith < -1 ? -1 : cosZenith;
+    return 90.0 - acos(cosZenith) / DEG;
+}
+
+/**
+ * The band a solar elevation falls in.
+ */
+SolarPhase solarPhase(double elevation) {
+    if (elevation < SOLAR_NIGHT_ELEVATION) return SOLAR_NIGHT;
+    if (elevation < SOLAR_DAY_ELEVATION) return SOLAR_TWILIGHT;
+    return SOLAR_DAY;
+}
+
+/**
+ * The first time after utc at which the sun changes band.
+ * Steps forward SCHEDULE_SEARCH_STEP seconds at a time, then bisects the step the change falls in.
+ * A band visited for less than a step can be missed, which only happens near the poles.
+ * @return The time of the change, or 0 if there is none within the horizon.
+ */
+time_t nextPhaseChange(time_t utc, double latitude, double longitude, uint32_t horizon) {
+    const SolarPhase phase = solarPhase(solarElevation(utc, latitude, longitude));
+
+    time_t before = utc;
+    for (uint32_t ahead = SCHEDULE_SEARCH_STEP; ahead <= horizon; ahead += SCHEDULE_SEARCH_STEP) {
+        time_t after = utc + ahead;
+        if (solarPhase(solarElevation(after, latitude, longitude)) == phase) {
+            before = after;
+            continue;
+        }
+
+        while (after - before > SCHEDULE_SEARCH_PRECISION) {
+            const time_t mid = before + (after - before) / 2;
+            if (solarPhase(solarElevation(mid, latitude, longitude)) == phase) before = mid;
+            else after = mid;
+        }
+        return after;
+    }
+    return 0;
+}
+
+/**
+ * Plan the next wake from the position of the sun.
+ * @return The plan.
+ */
+WakePlan planWake(time_t utc, uint32_t cadence, double latitude, double longitude) {
+    WakePlan plan = {SOLAR_UNKNOWN, UNDEFINED, cadence};
+    if (utc < SCHEDULE_VALID_EPOCH) return plan;
+
+    plan.elevation = solarElevation(utc, latitude, longitude);
+    plan.phase = solarPhase(plan.elevation);
+
+    uint32_t limit = SCHEDULE_MAX_SLEEP_MINS * 60;
+    if (plan.phase == SOLAR_TWILIGHT) limit = cadence < SCHEDULE_TWILIGHT_MINS * 60 ? cadence : SCHEDULE_TWILIGHT_MINS * 60;
+    else if (plan.phase == SOLAR_DAY) limit = cadence;
+
+    // Wake on a band change rather than sleep through it.
+    const time_t change = nextPhaseChange(utc, latitude, longitude, limit);
+    plan.sleepSecs = change ? change - utc : limit;
+
+    if (plan.sleepSecs > SCHEDULE_TWILIGHT_MINS * 60) plan.sleepSecs -= (uint64_t)plan.sleepSecs * SCHEDULE_DRIFT_PERMILLE / 1000;
+    if (plan.sleepSecs < SCHEDULE_SEARCH_PRECISION) plan.sleepSecs = SCHEDULE_SEARCH_PRECISION;
+    return plan;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef SOLAR_H
+#define SOLAR_H
+
+#include <stdint.h>
+#include <time.h>
+#include "sensors.h"
+
+/**
+ * Where the station stands, in degrees: north and east positive.
+ */
+#define STATION_LATITUDE 56.8777
+#define STATION_LONGITUDE 14.8091
+
+/**
+ * Solar elevation bands, in degrees. Below SOLAR_NIGHT_ELEVATION (the end of civil twilight)
+ * the sky is too dark to image. Up to SOLAR_DAY_ELEVATION the sky changes quickly around
+ * sunrise and sunset, so captures are dense.
+ */
+#define SOLAR_NIGHT_ELEVATION -6.0
+#define SOLAR_DAY_ELEVATION 6.0
+
+/**
+ * Wake cadence per band, in minutes; the day cadence is only a default for the adaptive one.
+ * At night the station sleeps until the sun comes back, at most SCHEDULE_MAX_SLEEP_MINS at a time.
+ * Sleeps longer than the twilight cadence are cut short by SCHEDULE_DRIFT_PERMILLE for the drift
+ * of the RTC slow clock, so the station wakes early rather than late.
+ */
+#define SCHEDULE_TWILIGHT_MINS 5
+#define SCHEDULE_DAY_MINS SLEEP_MINS
+#define SCHEDULE_MAX_SLEEP_MINS 720
+#define SCHEDULE_DRIFT_PERMILLE 20
+
+/**
+ * How far ahead band changes are looked for, and how finely.
+ */
+#define SCHEDULE_SEARCH_STEP 300
+#define SCHEDULE_SEARCH_PRECISION 15
+
+/**
+ * Any earlier clock has not been set yet.
+ */
+#define SCHEDULE_VALID_EPOCH 1577836800     // 2020-01-01
+
+enum SolarPhase {
+    SOLAR_UNKNOWN,
+    SOLAR_NIGHT,
+    SOLAR_TWILIGHT,
+    SOLAR_DAY
+};
+
+/**
+ * When to wake next, and why.
+ */
+struct WakePlan {
+    SolarPhase phase;           // The band the sun is in now
+    double elevation;           // The solar elevation now, in degrees
+    uint32_t sleepSecs;         // Seconds to sleep before the next wake
+};
+
+/**
+ * Geometric solar elevation, without atmospheric refraction, after the NOAA solar calculator.
+ * Good to about 0.01 degrees between 1800 and 2100.
+ * @param utc: The time.
+ * @param latitude: Degrees north.
+ * @param longitude: Degrees east.
+ *
+ * @return The elevation of the centre of the sun above the horizon, in degrees.
+ */
+double solarElevation(time_t utc, double latitude, double longitude);
+
+/**
+ * The band a solar elevation falls in.
+ */
+SolarPhase solarPhase(double elevation);
+
+/**
+ * The first time after utc at which the sun changes band.
+ * @param utc: The time to search from.
+ * @param latitude: Degrees north.
+ * @param longitude: Degrees east.
+ * @param horizon: How far ahead to look, in seconds.
+ *
+ * @return The time of the change to within SCHEDULE_SEARCH_PRECISION seconds, or 0 if there is none within the horizon.
+ */
+time_t nextPhaseChange(time_t utc, double latitude, double longitude, uint32_t horizon);
+
+/**
+ * Plan the next wake from the position of the sun.
+ * By day and in twilight the station wakes at the cadence of the band, or when the band changes if that comes first.
+ * At night it sleeps until twilight. With no valid clock it falls back to the day cadence.
+ * @param utc: The time now.
+ * @param cadence: The daytime wake interval in seconds.
+ * @param latitude: Degrees north.
+ * @param longitude: Degrees east.
+ *
+ * @return The plan.
+ */
+WakePlan planWake(time_t utc, uint32_t cadence = SCHEDULE_DAY_MINS * 60, double latitude = STATION_LATITUDE, double longitude = STATION_LONGITUDE);
+
+#endif
@@ -10,44 +10,126 @@ Sensors sensors;
 // Struct of network information.
 NetworkInfo network;
 
-FS* fileSystem;
+/**
+ * Subsystem start and stop, brought up through SUBSYSTEMS on first use.
+ */
+bool startStorage(void*) {
+    ProfileScope scope(PROFILE_MOUNT);
+    STORAGE = DetermineFileSystem();
+    if (!STORAGE) {
+      debugln("Failed to mount any file system");
+      return false;
+    }
+    recoverFiles(*STORAGE);
+    initLogFile(*STORAGE);
+    initCacheFile(*STORAGE);
+    return true;
+}
+
+bool startBus(void*) {
+    /**
+     * wire.begin(sda, scl)
+     * 32,33 for ESP32 "S1" WROVER
+     * 41,42 for ESP32 S3
+     */
+    wire.begin(41,42);
+    sensors = stationSensors(&wire);
+    return true;
+}
+
+bool startSensors(void*) {
+    if (!sensors.beginSensors()) return false;
+
+    // Sample in the background while everything else comes up.
+    sensors.beginRead();
+    return true;
+}
+
+bool startCamera(void*) {
+    POWER.railOn(POWER_RAIL_CAMERA);
+    if (sensors.beginCamera()) return true;
+    POWER.railOff(POWER_RAIL_CAMERA);
+    return false;
+}
+
+void stopCamera(void*) {
+    sensors.cameraTeardown();
+    POWER.railOff(POWER_RAIL_CAMERA);
+}
+
+void stopRadio(void*) {
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    sensors.status.WIFI = false;
+    POWER.railOff(POWER_RAIL_RADIO);
+}
+
+bool startRadio(void*) {
+    ProfileScope scope(PROFILE_WIFI);
+    POWER.railOn(POWER_RAIL_RADIO);
+    if (wifiSetup(&network, &sensors.status)) {
+      configTime(0, 0, "pool.ntp.org");
+      return true;
+    }
+    stopRadio(nullptr);
+    return false;
+}
 
 void setup() {
     if (DEBUG == 1) { 
       Serial.begin(115200);
       debugln("Setting up...");
     }
+    SUBSYSTEMS.mark("setup");
 
-    // Initialize file system reuirements.
-    fileSystem = DetermineFileSystem();
-    if (!fileSystem) {
-      debugln("Failed to mount any file system");
-      delay(100);
-      deepSleepMins(SLEEP_MINS);
-    }
+    // Nothing to image in the dark: back to sleep before anything comes up.
+    checkAndSleep(time(nullptr));
 
-    initLogFile(*fileSystem);
-    initCacheFile(*fileSystem);
+    // Waits from here on let the chip light sleep, and are metered.
+    POWER.begin();
+    PROFILER.begin(time(nullptr));
 
-    /**
-     * wire.begin(sda, scl)
-     * 32,33 for ESP32 "S1" WROVER
-     * 41,42 for ESP32 S3
-     */
-    sensors = Sensors(&wire);
-    sensors.wire -> begin(41,42);
+    SUBSYSTEMS.define(SUBSYSTEM_STORAGE, "storage", 0, startStorage);
+    SUBSYSTEMS.define(SUBSYSTEM_BUS, "bus", 0, startBus);
+    SUBSYSTEMS.define(SUBSYSTEM_SENSORS, "sensors", SUBSYSTEM_BIT(SUBSYSTEM_BUS), startSensors);
+    SUBSYSTEMS.define(SUBSYSTEM_CAMERA, "camera", SUBSYSTEM_BIT(SUBSYSTEM_BUS), startCamera, stopCamera);
+    SUBSYSTEMS.define(SUBSYSTEM_RADIO, "radio", SUBSYSTEM_BIT(SUBSYSTEM_STORAGE), startRadio, stopRadio);
+
+    // Sampling takes longest, so it starts first and overlaps the rest.
+    SUBSYSTEMS.require(SUBSYSTEM_SENSORS);
 
-    wifiSetup(&network, &sensors.status);
+    // Most wakes only sample and spool; the radio comes up every few wakes, or when the backlog needs it.
+    // Everything else, storage included, comes up where it is first used, if at all.
+    UPLOADS.radio = UPLOADS.radioDue(time(nullptr));
+    if (!UPLOADS.radio) debugf("Radio off this wake, %u readings queued\n", UPLOADS.count);
 
-    configTime(0, 0, "pool.ntp.org");
+    // The radio is first used to set the clock, with storage caching when it last did. Offline the clock is read as it is.
     setenv("TZ", "CET-1-CEST-2,M3.5.0/02:00:00,M10.5.0/03:00:00", 1);
-    fetchCurrentTime(*fileSystem, &network.TIMEINFO, &sensors.status);
-    // fetchQNH(*fileSystem, &network.TIMEINFO, &network);
+    const bool online = UPLOADS.radio && SUBSYSTEMS.require(SUBSYSTEM_RADIO);
+    PROFILER.enter(PROFILE_CLOCK);
+    if (online) fetchCurrentTime(*STORAGE, &network.TIMEINFO, &sensors.status);
+    else getTime(&network.TIMEINFO, 10);
+    PROFILER.leave(PROFILE_CLOCK);
+    PROFILER.setTime(time(nullptr));
+    SUBSYSTEMS.mark("clock");
 }
 
 void loop() {
-  serverInterop(*fileSystem, &network.TIMEINFO, &sensors, &network);
-  debugln("Going to sleep...");
+  serverInterop(&network.TIMEINFO, &sensors, &network);
+  // Storage has no stop, so it stays mounted for the trace once releaseAll marks it off.
+  const bool stored = SUBSYSTEMS.up(SUBSYSTEM_STORAGE);
+  SUBSYSTEMS.releaseAll();
+  const WakePlan plan = planWake(time(nullptr), CADENCE.interval);
+  SUBSYSTEMS.mark("sleep");
+  SUBSYSTEMS.report();
+  POWER.finish();
+  PROFILER.commit();
+  PROFILER.report();
+
+  // Everything traced this wake goes to storage in one write, instead of blocking on Serial.
+  // Wakes which never needed storage don't mount it for the trace alone, and their records go.
+  if (stored) traceFlush(*STORAGE, time(nullptr));
+  debugf("Sun at %.1f degrees, going to sleep for %lu s...\n", plan.elevation, (unsigned long)plan.sleepSecs);
   delay(100);
-  deepSleepMins(SLEEP_MINS);
-}
\ No newline at end of file
+  deepSleepMins(plan.sleepSecs / 60.0);
+}
@@ -0,0 +1,114 @@
+#include "subsystem.h"
+#include "io.h"
+#include "esp_timer.h"
+
+Subsystems SUBSYSTEMS;
+
+/**
+ * Microseconds since boot.
+ */
+static inline uint32_t sinceBoot() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+/**
+ * Describe a subsystem. Nothing is started.
+ */
+void Subsystems::define(SubsystemId id, const char* name, uint8_t needs, SubsystemStart start, SubsystemStop stop, void* ctx) {
+    if (id >= SUBSYSTEM_COUNT) return;
+    Subsystem& s = systems[id];
+    s.name = name;
+    s.needs = needs & ~SUBSYSTEM_BIT(id);
+    s.start = start;
+    s.stop = stop;
+    s.ctx = ctx;
+    s.state = SUBSYSTEM_OFF;
+}
+
+/**
+ * Bring a subsystem up, after its dependencies, unless it is up already.
+ * @return True if it is up.
+ */
+bool Subsystems::require(SubsystemId id) {
+    if (id >= SUBSYSTEM_COUNT) return false;
+    Subsystem& s = systems[id];
+    if (s.state != SUBSYSTEM_OFF) return s.state == SUBSYSTEM_UP;
+    if (!s.start) {
+        debugf("Subsystem %u is not defined\n", id);
+        return false;
+    }
+    if (starting & SUBSYSTEM_BIT(id)) {
+        debugf("Dependency cycle through %s\n", s.name);
+        return false;
+    }
+
+    starting |= SUBSYSTEM_BIT(id);
+    bool ok = true;
+    for (uint8_t dep = 0; ok && dep < SUBSYSTEM_COUNT; dep++) {
+        if (!(s.needs & SUBSYSTEM_BIT(dep))) continue;
+        ok = require((SubsystemId)dep);
+        if (!ok) debugf("%s needs %s, which is down\n", s.name, systems[dep].name);
+    }
+
+    if (ok) {
+        const uint32_t begun = sinceBoot();
+        ok = s.start(s.ctx);
+        s.startUs += sinceBoot() - begun;
+        debugf("%s %s in %lu us\n", s.name, ok ? "up" : "failed", (unsigned long)(sinceBoot() - begun));
+    }
+
+    starting &= ~SUBSYSTEM_BIT(id);
+    s.state = ok ? SUBSYSTEM_UP : SUBSYSTEM_FAILED;
+    return ok;
+}
+
+/**
+ * Tear a subsystem down, after everything which depends on it.
+ */
+void Subsystems::release(SubsystemId id) {
+    if (id >= SUBSYSTEM_COUNT || systems[id].state != SUBSYSTEM_UP) return;
+
+    for (uint8_t dep = 0; dep < SUBSYSTEM_COUNT; dep++) {
+        if (systems[dep].needs & SUBSYSTEM_BIT(id)) release((SubsystemId)dep);
+    }
+
+    Subsystem& s = systems[id];
+    const uint32_t begun = sinceBoot();
+    if (s.stop) s.stop(s.ctx);
+    s.stopUs += sinceBoot() - begun;
+    s.state = SUBSYSTEM_OFF;
+}
+
+/**
+ * Tear everything down, dependents first.
+ */
+void Subsystems::releaseAll() {
+    for (uint8_t id = 0; id < SUBSYSTEM_COUNT; id++) release((SubsystemId)id);
+}
+
+/**
+ * Record that the wake reached a phase.
+ */
+void Subsystems::mark(const char* name) {
+    if (phaseCount >= BOOT_MAX_PHASES) return;
+    phases[phaseCount++] = {name, sinceBoot()};
+}
+
+/**
+ * Print the phases and the subsystem timings.
+ */
+void Subsystems::report() const {
+    debugln("Boot timing:");
+    uint32_t last = 0;
+    for (uint8_t i = 0; i < phaseCount; i++) {
+        debugf("  %-12s %9lu us  +%lu us\n", phases[i].name, (unsigned long)phases[i].at, (unsigned long)(phases[i].at - last));
+        last = phases[i].at;
+    }
+
+    for (uint8_t id = 0; id < SUBSYSTEM_COUNT; id++) {
+        const Subsystem& s = systems[id];
+        if (!s.name || (!s.startUs && !s.stopUs && s.state == SUBSYSTEM_OFF)) continue;
+        debugf("  %-12s start %lu us, stop %lu us%s\n", s.name, (unsigned long)s.startUs, (unsigned long)s.stopUs,
+               s.state == SUBSYSTEM_FAILED ? ", failed" : "");
+    }
+}
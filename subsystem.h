@@ -0,0 +1,118 @@
+#pragma once
+#ifndef SUBSYSTEM_H
+#define SUBSYSTEM_H
+
+#include <stdint.h>
+
+/**
+ * Phases the boot timing report keeps, on top of every subsystem start and stop.
+ */
+#define BOOT_MAX_PHASES 16
+
+/**
+ * The parts of the station which are brought up on first use and torn down after it.
+ */
+enum SubsystemId : uint8_t {
+    SUBSYSTEM_STORAGE = 0,      // SD card or LittleFS, with the log and cache files
+    SUBSYSTEM_BUS,              // Sensor I2C bus and its worker
+    SUBSYSTEM_SENSORS,          // Barometer and hygrometer, sampling in the background
+    SUBSYSTEM_CAMERA,
+    SUBSYSTEM_RADIO,            // WiFi, configured from storage
+    SUBSYSTEM_COUNT
+};
+
+#define SUBSYSTEM_BIT(id) ((uint8_t)(1u << (id)))
+
+enum SubsystemState : uint8_t {
+    SUBSYSTEM_OFF = 0,
+    SUBSYSTEM_UP,
+    SUBSYSTEM_FAILED            // Not retried until the next wake
+};
+
+/**
+ * Bring a subsystem up, or down. ctx is the one given to Subsystems::define.
+ */
+typedef bool (*SubsystemStart)(void* ctx);
+typedef void (*SubsystemStop)(void* ctx);
+
+/**
+ * A subsystem, what it depends on, and how long it took to start and stop.
+ */
+struct Subsystem {
+    const char* name = nullptr;
+    uint8_t needs = 0;              // SUBSYSTEM_BIT of each dependency
+    SubsystemStart start = nullptr;
+    SubsystemStop stop = nullptr;   // Optional
+    void* ctx = nullptr;
+    SubsystemState state = SUBSYSTEM_OFF;
+    uint32_t startUs = 0;
+    uint32_t stopUs = 0;
+};
+
+/**
+ * A point of the wake, in microseconds since boot.
+ */
+struct BootPhase {
+    const char* name;
+    uint32_t at;
+};
+
+/**
+ * The subsystems of the station, brought up in dependency order when first required.
+ */
+class Subsystems {
+public:
+    /**
+     * Describe a subsystem. Nothing is started.
+     * @param id: The subsystem.
+     * @param name: Name for the report.
+     * @param needs: SUBSYSTEM_BIT of each subsystem which must be up first.
+     * @param start: Brings it up, returning false on failure.
+     * @param stop: Tears it down, or nullptr if there is nothing to do.
+     * @param ctx: Passed to start and stop.
+     */
+    void define(SubsystemId id, const char* name, uint8_t needs, SubsystemStart start, SubsystemStop stop = nullptr, void* ctx = nullptr);
+
+    /**
+     * Bring a subsystem up, after its dependencies, unless it is up already.
+     * A subsystem which failed, or whose dependency failed, is not tried again this wake.
+     * @return True if it is up.
+     */
+    bool require(SubsystemId id);
+
+    /**
+     * Tear a subsystem down, after everything which depends on it.
+     * It comes back up on the next require.
+     */
+    void release(SubsystemId id);
+
+    /**
+     * Tear everything down, dependents first.
+     */
+    void releaseAll();
+
+    bool up(SubsystemId id) const {
+        return id < SUBSYSTEM_COUNT && systems[id].state == SUBSYSTEM_UP;
+    }
+
+    /**
+     * Record that the wake reached a phase.
+     * @param name: The phase, a string literal.
+     */
+    void mark(const char* name);
+
+    /**
+     * Print the phases and the subsystem timings.
+     */
+    void report() const;
+
+private:
+    Subsystem systems[SUBSYSTEM_COUNT];
+    BootPhase phases[BOOT_MAX_PHASES];
+    uint8_t phaseCount = 0;
+    uint8_t starting = 0;           // Subsystems being started, to catch dependency cycles
+};
+
+extern Subsystems SUBSYSTEMS;
+
+#endif
@@ -0,0 +1,153 @@
+#include "thumbnail.h"
+#include "jpeg.h"
+#include "io.h"
+#include "img_converters.h"
+
+/**
+ * Weight of the first AC coefficients in the mean of half a block: cos terms of the
+ * 8 point IDCT averaged over 4 samples, times the 1/(4 sqrt 2) scale. 29/256 = 0.1133.
+ */
+#define PREVIEW_AC_WEIGHT 29
+
+static JpegDecoder decoder;
+
+static inline uint8_t clamp8(int32_t v) {
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/**
+ * Store one pixel, converting from JFIF YCbCr.
+ */
+static inline void putPixel(uint8_t* p, int32_t y, int32_t cb, int32_t cr) {
+    p[0] = clamp8(y + ((91881 * cr) >> 16));
+    p[1] = clamp8(y - ((22554 * cb + 46802 * cr) >> 16));
+    p[2] = clamp8(y + ((116130 * cb) >> 16));
+}
+
+/**
+ * Size of the preview of a JPEG at a scale, without decoding it.
+ * @return False if the JPEG is not supported.
+ */
+bool previewSize(const uint8_t* jpg, size_t len, uint8_t scale, uint16_t* width, uint16_t* height) {
+    if ((scale != PREVIEW_DC && scale != PREVIEW_DC_AC) || !decoder.begin(jpg, len)) return false;
+    *width = (decoder.width + scale - 1) / scale;
+    *height = (decoder.height + scale - 1) / scale;
+    return true;
+}
+
+/**
+ * Decode a reduced scale RGB888 preview of a JPEG straight from its low frequency coefficients.
+ * @return False if the JPEG could not be decoded or the output is too small.
+ */
+bool decodePreview(const uint8_t* jpg, size_t len, uint8_t scale, uint8_t* rgb, size_t capacity, uint16_t* width, uint16_t* height) {
+    uint16_t w, h;
+    if (!rgb || !previewSize(jpg, len, scale, &w, &h)) return false;
+    if ((size_t)w * h * 3 > capacity) return false;
+
+    const uint8_t sub = 8 / scale;                      // Preview pixels per block side
+    const uint8_t coeffs = sub == 1 ? 1 : 3;
+    const JpegComponent& yc = decoder.comp[0];
+    const uint16_t q0 = decoder.qt[yc.tq][0];
+    const uint16_t q1 = decoder.qt[yc.tq][1];
+    const uint16_t q2 = decoder.qt[yc.tq][2];
+    const bool colour = decoder.components == 3;
+    int16_t blocks[JPEG_MAX_BLOCKS][64];
+
+    while (decoder.mcu() < decoder.mcuCount()) {
+        const uint32_t mcu = decoder.mcu();
+        if (!decoder.decodeMcu(blocks, coeffs)) return false;
+        const uint32_t mx = mcu % decoder.mcusX;
+        const uint32_t my = mcu / decoder.mcusX;
+
+        // Chroma DC of each chroma block, dequantised and scaled to a pixel value.
+        int32_t cb[16], cr[16];
+        uint8_t b = yc.h * yc.v;
+        for (uint8_t c = 1; colour && c < 3; c++) {
+            const JpegComponent& cc = decoder.comp[c];
+            for (uint8_t i = 0; i < cc.h * cc.v; i++, b++) {
+                (c == 1 ? cb : cr)[i] = (blocks[b][0] * decoder.qt[cc.tq][0]) >> 3;
+            }
+        }
+
+        for (uint8_t by = 0; by < yc.v; by++) {
+            for (uint8_t bx = 0; bx < yc.h; bx++) {
+                const int16_t* block = blocks[by * yc.h + bx];
+                const int32_t mean = ((block[0] * q0) >> 3) + 128;
+
+                // Chroma block covering this luma block, for any subsampling.
+                int32_t u = 0, v = 0;
+                if (colour) {
+                    const JpegComponent& cbc = decoder.comp[1];
+                    const JpegComponent& crc = decoder.comp[2];
+                    u = cb[(by * cbc.v / yc.v) * cbc.h + bx * cbc.h / yc.h];
+                    v = cr[(by * crc.v / yc.v) * crc.h + bx * crc.h / yc.h];
+                }
+
+                // Horizontal (zigzag 1) and vertical (zigzag 2) first AC terms, if decoded.
+                const int32_t ax = sub == 1 ? 0 : (block[1] * q1 * PREVIEW_AC_WEIGHT) >> 8;
+                const int32_t ay = sub == 1 ? 0 : (block[2] * q2 * PREVIEW_AC_WEIGHT) >> 8;
+
+                const uint32_t px = ((mx * yc.h) + bx) * sub;
+                const uint32_t py = ((my * yc.v) + by) * sub;
+                for (uint8_t sy = 0; sy < sub; sy++) {
+                    if (py + sy >= h) break;
+                    for (uint8_t sx = 0; sx < sub; sx++) {
+                        if (px + sx >= w) break;
+                        const int32_t luma = mean + (sx ? -ax : ax) + (sy ? -ay : ay);
+                        uint8_t* p = rgb + ((size_t)(py + sy) * w + px + sx) * 3;
+                        if (colour) putPixel(p, luma, u, v);
+                        else p[0] = p[1] = p[2] = clamp8(luma);
+                    }
+                }
+            }
+        }
+    }
+
+    *width = w;
+    *height = h;
+    return true;
+}
+
+/**
+ * Where the encoder streams its output: a pool block, and how much of it was written.
+ */
+struct ThumbnailSink {
+    ImageBuffer* out;
+    size_t written;
+};
+
+static size_t thumbnailWrite(void* arg, size_t index, const void* data, size_t len) {
+    ThumbnailSink* sink = (ThumbnailSink*)arg;
+    if (index + len > sink -> out -> size()) return 0;
+    memcpy(sink -> out -> data() + index, data, len);
+    if (index + len > sink -> written) sink -> written = index + len;
+    return len;
+}
+
+/**
+ * Make a small JPEG from a captured one: preview decode, then re-encode.
+ * @return The thumbnail, empty on failure.
+ */
+ImageBuffer makeThumbnail(const ImageBuffer& jpg, uint8_t scale, uint8_t quality) {
+    uint16_t w, h;
+    if (!jpg || !previewSize(jpg.data(), jpg.size(), scale, &w, &h)) return ImageBuffer();
+
+    ImageBuffer rgb = ImageBuffer::fromPool(&IMAGE_POOL, (size_t)w * h * 3, w, h);
+    if (!rgb || !decodePreview(jpg.data(), jpg.size(), scale, rgb.data(), rgb.size(), &w, &h)) {
+        debugln("Failed to decode preview");
+        return ImageBuffer();
+    }
+
+    // The encoder streams into a single slab, far more than a thumbnail at this size needs.
+    ImageBuffer thumb = ImageBuffer::fromPool(&IMAGE_POOL, IMAGE_POOL.slabSize(), w, h);
+    if (!thumb) return thumb;
+    ThumbnailSink sink = {&thumb, 0};
+    const bool ok = fmt2jpg_cb(rgb.data(), rgb.size(), w, h, PIXFORMAT_RGB888, quality, thumbnailWrite, &sink);
+    if (!ok) {
+        debugln("Failed to encode thumbnail");
+        return ImageBuffer();
+    }
+    thumb.truncate(sink.written);
+    debugf("Thumbnail %ux%u, %u bytes\n", w, h, sink.written);
+    return thumb;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "image_buffer.h"
+
+/**
+ * Preview scales, as the number of source pixels per preview pixel along each axis.
+ * PREVIEW_DC uses the DC coefficient only: one pixel per block.
+ * PREVIEW_DC_AC adds the first horizontal and vertical AC coefficients: two by two pixels per block.
+ */
+#define PREVIEW_DC 8
+#define PREVIEW_DC_AC 4
+
+/**
+ * Quality thumbnails are re-encoded at.
+ */
+#define THUMBNAIL_QUALITY 40
+
+/**
+ * Size of the preview of a JPEG at a scale, without decoding it.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param scale: PREVIEW_DC or PREVIEW_DC_AC.
+ * @param width: The preview width.
+ * @param height: The preview height.
+ *
+ * @return False if the JPEG is not supported.
+ */
+bool previewSize(const uint8_t* jpg, size_t len, uint8_t scale, uint16_t* width, uint16_t* height);
+
+/**
+ * Decode a reduced scale RGB888 preview of a JPEG straight from its low frequency coefficients.
+ * Chroma always comes from the DC alone.
+ * @param jpg: The JPEG.
+ * @param len: Its length.
+ * @param scale: PREVIEW_DC or PREVIEW_DC_AC.
+ * @param rgb: The preallocated output, rows of width pixels.
+ * @param capacity: The size of the output in bytes.
+ * @param width: Set to the preview width.
+ * @param height: Set to the preview height.
+ *
+ * @return False if the JPEG could not be decoded or the output is too small.
+ */
+bool decodePreview(const uint8_t* jpg, size_t len, uint8_t scale, uint8_t* rgb, size_t capacity, uint16_t* width, uint16_t* height);
+
+/**
+ * Make a small JPEG from a captured one: preview decode, then re-encode.
+ * Both the preview and the thumbnail are taken from IMAGE_POOL.
+ * @param jpg: The captured image.
+ * @param scale: PREVIEW_DC or PREVIEW_DC_AC.
+ * @param quality: The JPEG quality of the thumbnail.
+ *
+ * @return The thumbnail, empty on failure.
+ */
+ImageBuffer makeThumbnail(const ImageBuffer& jpg, uint8_t scale = PREVIEW_DC_AC, uint8_t quality = THUMBNAIL_QUALITY);
+
+#endif
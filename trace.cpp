@@ -0,0 +1,156 @@
+#include "trace.h"
+#include "power.h"
+#include <atomic>
+
+/**
+ * Records since the last flush, in TRACE_SEGMENTS segments of whole records. A record which
+ * doesn't fit in what is left of its segment starts the next, and once the ring has gone round
+ * that overwrites the oldest segment. head counts bytes since the flush, the skipped ends of
+ * segments included, so a record's bytes are only reused TRACE_SEGMENTS - 1 segments later,
+ * long after its writer is done with them. The length byte goes in last, so the flush stops
+ * at a record still being written.
+ */
+#define TRACE_SEGMENT (TRACE_BUFFER_SIZE / TRACE_SEGMENTS)
+
+static uint8_t ring[TRACE_BUFFER_SIZE];
+static std::atomic<uint32_t> head(0);
+static uint16_t ends[TRACE_SEGMENTS];           // Where each segment's records end, set as the next opens
+static std::atomic<uint32_t> committed(0);      // Records put in the ring, overwritten ones included
+static std::atomic<uint32_t> oversize(0);       // Records too long to trace at all
+
+/**
+ * Start a record: length, level, format and time.
+ */
+void traceBegin(TraceRecord& record, uint8_t level, const char* fmt) {
+    const uint32_t address = (uint32_t)(uintptr_t)fmt;
+    const uint32_t us = (uint32_t)POWER.now();
+    record.full = false;
+    record.data[0] = 0;
+    record.data[1] = level;
+    record.len = 2;
+    record.put(&address, 4);
+    record.put(&us, 4);
+}
+
+/**
+ * Append a finished record to the ring, without locks.
+ */
+void traceCommit(TraceRecord& record) {
+    if (record.full) {
+        oversize.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t at = head.load(std::memory_order_relaxed);
+    uint32_t start;
+    do {
+        start = at % TRACE_SEGMENT + record.len > TRACE_SEGMENT ? at - at % TRACE_SEGMENT + TRACE_SEGMENT : at;
+    } while (!head.compare_exchange_weak(at, start + record.len, std::memory_order_relaxed));
+    committed.fetch_add(1, std::memory_order_relaxed);
+
+    // Only the first record of a segment starts at its beginning: it closes the segment before.
+    if (start && start % TRACE_SEGMENT == 0) {
+        ends[(start / TRACE_SEGMENT - 1) % TRACE_SEGMENTS] = at == start ? TRACE_SEGMENT : at % TRACE_SEGMENT;
+    }
+
+    uint8_t* p = ring + start % TRACE_BUFFER_SIZE;
+    __atomic_store_n(p, (uint8_t)0, __ATOMIC_RELAXED);
+    memcpy(p + 1, record.data + 1, record.len - 1);
+    __atomic_store_n(p, (uint8_t)record.len, __ATOMIC_RELEASE);
+}
+
+/**
+ * The whole records of a segment, up to stop.
+ */
+static uint32_t wholeRecords(const uint8_t* segment, uint32_t stop, uint32_t* records) {
+    uint32_t used = 0;
+    while (used < stop) {
+        const uint8_t len = __atomic_load_n(segment + used, __ATOMIC_ACQUIRE);
+        if (len < TRACE_HEADER) break;
+        used += len;
+        (*records)++;
+    }
+    return used;
+}
+
+/**
+ * The segments still in the ring, oldest first: the one head is in, and up to a lap back.
+ * @param spans: Filled with each segment's offset in the ring and the bytes of its whole records.
+ * @param records: Set to the number of records in them.
+ *
+ * @return The number of segments.
+ */
+static uint8_t segments(uint32_t spans[TRACE_SEGMENTS][2], uint32_t* records) {
+    const uint32_t end = head.load(std::memory_order_acquire);
+    *records = 0;
+    if (!end) return 0;
+
+    const uint32_t last = (end - 1) / TRACE_SEGMENT;
+    const uint32_t first = last >= TRACE_SEGMENTS ? last - (TRACE_SEGMENTS - 1) : 0;
+    uint8_t count = 0;
+    for (uint32_t s = first; s <= last; s++, count++) {
+        const uint32_t offset = s % TRACE_SEGMENTS * TRACE_SEGMENT;
+        const uint32_t stop = s == last ? end - s * TRACE_SEGMENT : ends[s % TRACE_SEGMENTS];
+        spans[count][0] = offset;
+        spans[count][1] = wholeRecords(ring + offset, stop, records);
+    }
+    return count;
+}
+
+uint32_t traceDropped() {
+    uint32_t spans[TRACE_SEGMENTS][2];
+    uint32_t records;
+    segments(spans, &records);
+    return oversize.load(std::memory_order_relaxed) + committed.load(std::memory_order_relaxed) - records;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * Append the records since the last flush to TRACE_FILE, and empty the ring.
+ * @return True if the records were written.
+ */
+bool traceFlush(fs::FS &fs, uint32_t time) {
+    // Only whole records: stop at the first one still being written.
+    uint32_t spans[TRACE_SEGMENTS][2];
+    uint32_t records;
+    const uint8_t count = segments(spans, &records);
+    uint32_t used = 0;
+    for (uint8_t i = 0; i < count; i++) used += spans[i][1];
+    const uint32_t dropped = oversize.load(std::memory_order_relaxed) + committed.load(std::memory_order_relaxed) - records;
+    if (!used && !dropped) return true;
+
+    File existing = fs.open(TRACE_FILE, FILE_READ);
+    const size_t size = existing ? existing.size() : 0;
+    if (existing) existing.close();
+    if (size + used > TRACE_FILE_MAX) {
+        fs.remove(TRACE_OLD_FILE);
+        fs.rename(TRACE_FILE, TRACE_OLD_FILE);
+    }
+
+    File file = fs.open(TRACE_FILE, FILE_APPEND, true);
+    if (!file) return false;
+
+    uint8_t header[16];
+    memcpy(header, TRACE_MAGIC, 4);
+    put32(header + 4, time);
+    put32(header + 8, used);
+    put32(header + 12, dropped);
+    bool ok = file.write(header, sizeof(header)) == sizeof(header);
+    for (uint8_t i = 0; ok && i < count; i++) {
+        ok = file.write(ring + spans[i][0], spans[i][1]) == spans[i][1];
+    }
+    file.close();
+
+    memset(ring, 0, sizeof(ring));
+    memset(ends, 0, sizeof(ends));
+    head.store(0, std::memory_order_release);
+    committed.store(0, std::memory_order_relaxed);
+    oversize.store(0, std::memory_order_relaxed);
+    return ok;
+}
@@ -0,0 +1,193 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include <string.h>
+#include "FS.h"
+
+/**
+ * Trace levels. Calls above TRACE_LEVEL compile to nothing.
+ */
+#define TRACE_ERROR 1
+#define TRACE_WARN 2
+#define TRACE_INFO 3
+#define TRACE_DEBUG 4
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_DEBUG
+#endif
+
+/**
+ * Records wait in RAM until traceFlush appends them to TRACE_FILE, which is moved to
+ * TRACE_OLD_FILE once it grows past TRACE_FILE_MAX. Once the ring is full, each new segment
+ * overwrites the oldest, so a flush keeps the latest records; those lost are counted.
+ */
+#define TRACE_BUFFER_SIZE 8192
+#define TRACE_SEGMENTS 8
+#define TRACE_FILE "/trace.bin"
+#define TRACE_OLD_FILE "/trace.old"
+#define TRACE_FILE_MAX (256 * 1024)
+
+/**
+ * A record is at most 255 bytes, strings arguments are cut to TRACE_MAX_STRING.
+ */
+#define TRACE_MAX_RECORD 255
+#define TRACE_MAX_STRING 64
+
+/**
+ * Record layout, little endian, decoded by host/trace_decode.py against the firmware ELF:
+ *
+ *   u8 length, u8 level, u32 format address, u32 microseconds since boot, then per argument
+ *   'i' i32 | 'q' i64 | 'd' f64 | 's' u8 length + bytes
+ *
+ * The format string is never copied: it stays a literal in flash, and its address is its id.
+ * Each flush is preceded by "TRC1", u32 wake time, u32 bytes of records, u32 records dropped.
+ */
+#define TRACE_MAGIC "TRC1"
+#define TRACE_HEADER 10
+
+/**
+ * A record being put together on the stack.
+ */
+struct TraceRecord {
+    uint8_t data[TRACE_MAX_RECORD];
+    uint16_t len;
+    bool full;
+
+    void put(const void* p, size_t n) {
+        if (full || len + n > TRACE_MAX_RECORD) {
+            full = true;
+            return;
+        }
+        memcpy(data + len, p, n);
+        len += n;
+    }
+
+    /**
+     * @param s: The string, cut at its terminator or at max bytes, whichever comes first.
+     * @param max: The size of s when it is a field which need not be terminated.
+     */
+    void putString(const char* s, size_t max = TRACE_MAX_STRING) {
+        if (!s) s = "(null)";
+        if (max > TRACE_MAX_STRING) max = TRACE_MAX_STRING;
+        size_t n = 0;
+        while (n < max && s[n]) n++;
+        const uint8_t head[2] = {'s', (uint8_t)n};
+        put(head, 2);
+        put(s, n);
+    }
+
+    template <typename T>
+    void arg(const T& v) {
+        if constexpr (std::is_base_of<String, T>::value) {
+            putString(v.c_str());
+        } else if constexpr (std::is_same<T, const __FlashStringHelper*>::value) {
+            putString((const char*)v);
+        } else if constexpr (std::is_array<T>::value && std::is_convertible<T, const char*>::value) {
+            putString(v, std::extent<T>::value);
+        } else if constexpr (std::is_convertible<T, const char*>::value) {
+            putString(v);
+        } else if constexpr (std::is_floating_point<T>::value) {
+            const double d = v;
+            const uint8_t tag = 'd';
+            put(&tag, 1);
+            put(&d, 8);
+        } else if constexpr (std::is_enum<T>::value) {
+            arg((typename std::underlying_type<T>::type)v);
+        } else if constexpr (std::is_pointer<T>::value) {
+            arg((uintptr_t)v);
+        } else {
+            static_assert(std::is_integral<T>::value, "Unsupported trace argument");
+            if (sizeof(T) <= 4) {
+                const int32_t i = (int32_t)v;
+                const uint8_t tag = 'i';
+                put(&tag, 1);
+                put(&i, 4);
+            } else {
+                const int64_t q = (int64_t)v;
+                const uint8_t tag = 'q';
+                put(&tag, 1);
+                put(&q, 8);
+            }
+        }
+    }
+};
+
+/**
+ * Append a finished record to the ring, without locks.
+ */
+void traceCommit(TraceRecord& record);
+
+/**
+ * Start a record: length, level, format and time.
+ */
+void traceBegin(TraceRecord& record, uint8_t level, const char* fmt);
+
+/**
+ * Write one record: the format's address, and the arguments in binary.
+ * @param level: The record level.
+ * @param fmt: A printf format, which must be a string literal.
+ */
+template <typename... Args>
+inline void traceWrite(uint8_t level, const char* fmt, const Args&... args) {
+    TraceRecord record;
+    traceBegin(record, level, fmt);
+    (record.arg(args), ...);
+    traceCommit(record);
+}
+
+/**
+ * A format of its own for a call site: fmt, and after its terminator the file and line, which
+ * trace_decode.py --sites prints. Free text has no format to tell its records apart by otherwise.
+ */
+#define TRACE_LINE_STRING(line) #line
+#define TRACE_SITE_AT(fmt, line) fmt "\0" TRACE_FILE_NAME ":" TRACE_LINE_STRING(line)
+#define TRACE_SITE(fmt) TRACE_SITE_AT(fmt, __LINE__)
+#ifdef __FILE_NAME__
+#define TRACE_FILE_NAME __FILE_NAME__
+#else
+#define TRACE_FILE_NAME __FILE__
+#endif
+
+/**
+ * Free text, as debug / debugln used to print it, under its call site's format.
+ * A call with no text traces just the format, e.g. a line end.
+ */
+struct TraceText {
+    uint8_t level;
+    const char* fmt;
+
+    template <typename T>
+    void operator()(const T& text) {
+        traceWrite(level, fmt, text);
+    }
+
+    void operator()() {
+        traceWrite(level, fmt, "");
+    }
+};
+
+/**
+ * Trace a printf style message at a level, compiled out above TRACE_LEVEL.
+ */
+#define tracef(level, ...) do { if ((level) <= TRACE_LEVEL) traceWrite((level), __VA_ARGS__); } while (0)
+
+/**
+ * Append the records since the last flush to TRACE_FILE, and empty the ring.
+ * Must not run while other tasks are tracing.
+ * @param fs: The file system to write to.
+ * @param time: The wake time, to line flushes up with other records.
+ *
+ * @return True if the records were written.
+ */
+bool traceFlush(fs::FS &fs, uint32_t time);
+
+/**
+ * Records lost since the last flush: overwritten once the ring was full, or too long to trace.
+ * Must not run while other tasks are tracing.
+ */
+uint32_t traceDropped();
+
+#endif
@@ -0,0 +1,58 @@
+#include "upload.h"
+#include "solar.h"
+#include <string.h>
+
+/**
+ * Decide whether this wake brings the radio up.
+ * @param now: The time now.
+ *
+ * @return True if the radio is due.
+ */
+bool UploadQueue::radioDue(time_t now) const {
+    // Cold boot, or no clock yet: only the network can set it.
+    if (!primed || now < SCHEDULE_VALID_EPOCH) return true;
+
+    const uint8_t backoff = failures < UPLOAD_MAX_BACKOFF ? failures : UPLOAD_MAX_BACKOFF;
+    if (wakes + 1 >= (UPLOAD_EVERY_WAKES << backoff)) return true;
+    if (failures) return false;
+
+    if (count >= UPLOAD_RING_SIZE) return true;
+    if (spooledBytes + count * sizeof(PendingReading) >= UPLOAD_BACKLOG_BYTES) return true;
+    return count && now - (time_t)front().time >= UPLOAD_MAX_AGE_SECS;
+}
+
+/**
+ * Queue a reading.
+ * @return False if the ring is full.
+ */
+bool UploadQueue::push(const Reading& reading, time_t taken) {
+    if (count >= UPLOAD_RING_SIZE) return false;
+
+    PendingReading& p = ring[(head + count) % UPLOAD_RING_SIZE];
+    p.time = taken;
+    strncpy(p.timestamp, reading.timestamp ? reading.timestamp : "None", UPLOAD_TIMESTAMP_LENGTH - 1);
+    p.timestamp[UPLOAD_TIMESTAMP_LENGTH - 1] = '\0';
+    p.temperature = reading.temperature;
+    p.humidity = reading.humidity;
+    p.pressure = reading.pressure;
+    p.dewpoint = reading.dewpoint;
+    p.altitude = reading.altitude;
+    p.cloudFraction = reading.cloudFraction;
+    p.brightness = reading.brightness;
+    count++;
+    return true;
+}
+
+/**
+ * Record a radio session.
+ * @param ok: Whether the backlog was drained.
+ */
+void UploadQueue::sessionEnded(bool ok) {
+    primed = true;
+    wakes = 0;
+    if (ok) {
+        failures = 0;
+        spooledBytes = 0;
+        logged = false;
+    } else if (failures < UINT8_MAX) failures++;
+}
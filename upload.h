@@ -0,0 +1,108 @@
+#pragma once
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stdint.h>
+#include <time.h>
+#include "sensors.h"
+
+/**
+ * The radio comes up every UPLOAD_EVERY_WAKES wakes, or sooner once the backlog holds
+ * UPLOAD_BACKLOG_BYTES, its oldest reading is UPLOAD_MAX_AGE_SECS old, or the ring is full.
+ * After a failed session the wake interval doubles, up to eight times, and only it brings the radio back.
+ */
+#define UPLOAD_EVERY_WAKES 4
+#define UPLOAD_BACKLOG_BYTES (2 * 1024 * 1024)
+#define UPLOAD_MAX_AGE_SECS 7200
+#define UPLOAD_MAX_BACKOFF 3
+
+/**
+ * Readings waiting for the radio. 48 of them take about 2.5 KB of the 8 KB of RTC slow memory.
+ */
+#define UPLOAD_RING_SIZE 48
+#define UPLOAD_TIMESTAMP_LENGTH 20
+
+/**
+ * A reading waiting for upload, compact enough for RTC memory.
+ * UNDEFINED survives the trip through float exactly.
+ */
+struct PendingReading {
+    uint32_t time;                              // When it was taken, UTC
+    char timestamp[UPLOAD_TIMESTAMP_LENGTH];    // As formatted for the server, and naming its image
+    float temperature;
+    float humidity;
+    float pressure;
+    float dewpoint;
+    float altitude;
+    float cloudFraction;
+    float brightness;
+
+    /**
+     * @return The reading, whose timestamp points into this entry.
+     */
+    Reading toReading() const {
+        return Reading(timestamp, temperature, humidity, pressure, dewpoint, altitude, cloudFraction, brightness);
+    }
+};
+
+/**
+ * Readings taken with the radio off, and when to turn it on. Across deep sleep it keeps the
+ * readings, the wakes and image bytes since the last session, the backoff after failed ones,
+ * and whether readings overflowed into the log file.
+ */
+struct UploadQueue {
+    PendingReading ring[UPLOAD_RING_SIZE] = {};
+    uint8_t head = 0;               // Oldest entry
+    uint8_t count = 0;
+    uint8_t wakes = 0;              // Wakes since the radio was last up
+    uint8_t failures = 0;           // Failed sessions in a row
+    uint32_t spooledBytes = 0;      // Image bytes spooled since the last good session
+    bool primed = false;            // Whether the radio was ever up since cold boot
+    bool radio = false;             // Whether the radio is up this wake
+    bool logged = true;             // Whether the log file may hold readings, from cold boot until a session drains it
+
+    /**
+     * Decide whether this wake brings the radio up.
+     * @param now: The time now.
+     *
+     * @return True if the radio is due.
+     */
+    bool radioDue(time_t now) const;
+
+    /**
+     * Queue a reading.
+     * @return False if the ring is full.
+     */
+    bool push(const Reading& reading, time_t taken);
+
+    bool empty() const {
+        return !count;
+    }
+
+    const PendingReading& front() const {
+        return ring[head];
+    }
+
+    void pop() {
+        if (!count) return;
+        head = (head + 1) % UPLOAD_RING_SIZE;
+        count--;
+    }
+
+    /**
+     * Record a wake which queued its reading and spooled bytes of image.
+     * Only wakes with the radio off count towards the next session.
+     */
+    void stayedOffline(uint32_t bytes) {
+        if (!radio && wakes < UINT8_MAX) wakes++;
+        spooledBytes += bytes;
+    }
+
+    /**
+     * Record a radio session.
+     * @param ok: Whether the backlog was drained.
+     */
+    void sessionEnded(bool ok);
+};
+
+#endif
@@ -2,6 +2,37 @@
 
 double SEALEVELPRESSURE_HP = UNDEFINED;
 
+/**
+ * Hash of the last image kept, and what was skipped since, across deep sleep.
+ */
+RTC_DATA_ATTR ImageDedup IMAGE_DEDUP;
+
+/**
+ * The adaptive daytime wake interval, across deep sleep.
+ */
+RTC_DATA_ATTR Cadence CADENCE;
+
+/**
+ * Readings taken with the radio off, and when it next comes up, across deep sleep.
+ */
+RTC_DATA_ATTR UploadQueue UPLOADS;
+
+/**
+ * The last QNH fetched or read from the cache file, across deep sleep. Wakes with the radio
+ * off can't refresh it, so they use this one instead of mounting storage for the cache.
+ */
+RTC_DATA_ATTR double LAST_QNH = UNDEFINED;
+
+fs::FS* STORAGE = nullptr;
+
+/**
+ * The file system, mounted on first use.
+ * @return nullptr if none would mount.
+ */
+fs::FS* storage() {
+  return SUBSYSTEMS.require(SUBSYSTEM_STORAGE) ? STORAGE : nullptr;
+}
+
 /**
  * Get the QNH from the api if there is internet.
  * 1. read the cache for the last time we queried the api.
@@ -20,9 +51,9 @@ double fetchQNH(fs::FS &fs, tm* now, NetworkInfo *network) {
 
   // Read the last synced time from the cache.
   const char *cache = readFile(fs, CACHE_FILE);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
-  delete[] cache;
+  heapFree(cache);
 
   if (!error) {
     const char* qnhTS = doc["QNH"]["timestamp"] | "None";
@@ -80,9 +111,9 @@ void fetchCurrentTime(fs::FS &fs, tm* now, Sensors::Status* stat) {
 
   // Read the cache file.
   const char* cache = readFile(fs, CACHE_FILE);
-  JsonDocument doc;
+  JsonDocument doc(&JSON_ARENA);
   DeserializationError error = deserializeJson(doc, cache);
-  delete[] cache;
+  heapFree(cache);
   if (error) {
     debugln("Failed to parse cache JSON");
     return;
@@ -130,62 +161,177 @@ void fetchCurrentTime(fs::FS &fs, tm* now, Sensors::Status* stat) {
  * @param network: The network struct to use the wifi connection.
  * @param stat: The status struct to send to the server.
  * @param reading: The reading struct to send to the server.
- * @param img: The camera_fb_t struct w/ the image to send to the server.
+ * @param img: The image to send to the server.
+ *
+ * @return True if the server took the reading and its image.
  */
-void sendData(HTTPClient* http, NetworkInfo* network, Reading* reading, Sensors::Status* stat, camera_fb_t* img) {
+bool sendData(HTTPClient* http, NetworkInfo* network, Reading* reading, Sensors::Status* stat, const ImageBuffer& img) {
 
   if (!http || !reading || !stat) {
     debugln("Invalid parameters");
-    return;
+    return false;
   }
+  ProfileScope scope(PROFILE_UPLOAD);
 
-  // Send the statuses to the server.
-  sendStats(http, network, stat, reading -> timestamp);
-  delay(20);
+  // Send the statuses to the server. The profiles and skipped bytes in them go out only once.
+  if (httpOk(sendStats(http, network, stat, reading -> timestamp))) {
+    PROFILER.uploaded();
+    IMAGE_DEDUP.skippedBytes = 0;
+  }
+  powerWait(20);
 
   // Send the readings to the server.
-  sendReadings(http, network, reading);
-  delay(20);
+  if (!httpOk(sendReadings(http, network, reading))) return false;
+  powerWait(20);
 
   // Send the image to the server.
-  sendImage(http, network, img -> buf, img -> len, reading -> timestamp);
-  delay(20);
+  if (!img) return true;
+  const bool sent = httpOk(sendImage(http, network, img.data(), img.size(), reading -> timestamp));
+  powerWait(20);
+  return sent;
 }
 
 /**
- * Send the Logged Readings and images to the server.
+ * Send one reading taken earlier, then its image from the file system if it has one.
+ * The image is only deleted once the server took it. A reading whose image failed is
+ * sent again with it next session, so the server may see it twice but never lose it.
+ * 
+ * @param fs: The file system reference to use for the image.
+ * @param http: The HTTPClient object to use for the request.
+ * @param network: The network struct to use the wifi connection.
+ * @param reading: The reading to send.
+ *
+ * @return True if the server took the reading and its image.
+ */
+static bool sendBacklogged(fs::FS &fs, HTTPClient* http, NetworkInfo* network, Reading* reading) {
+  if (!httpOk(sendReadings(http, network, reading))) return false;
+
+  tm timestamp = {0};
+  strptime(reading -> timestamp, "%Y-%m-%d %H:%M:%S", &timestamp);
+
+  // Readings whose image was skipped as a duplicate have no file.
+  File file = openjpg(fs, &timestamp);
+  if (!file) {
+    debugln("No logged image for this reading");
+    return true;
+  }
+
+  // Each image goes back to the pool on return, so the next reload reuses its block.
+  // One the pool can't take, e.g. on a board without PSRAM, is sent straight from the file.
+  ImageBuffer img = readjpg(file);
+  const int code = img ? sendImage(http, network, img.data(), img.size(), reading -> timestamp)
+                       : sendImage(http, network, &file, file.size(), reading -> timestamp);
+  file.close();
+  const bool sent = httpOk(code);
+  if (sent) deletejpg(fs, &timestamp);
+  powerWait(20);
+  return sent;
+}
+
+/**
+ * Send the Logged Readings and images to the server, oldest first, stopping at the first
+ * the server does not take. Only those sent are dropped from the log.
  * 
  * @param fs: The file system reference to use for the cache.
  * @param http: The HTTPClient object to use for the request.
  * @param network: The network struct to use the wifi connection.
+ *
+ * @return True if the whole log was sent.
  */
-void sendLog(fs::FS &fs, HTTPClient* http, NetworkInfo* network) {
+bool sendLog(fs::FS &fs, HTTPClient* http, NetworkInfo* network) {
   if (!http || !network) {
     debugln("Invalid parameters");
-    return;
+    return false;
   }
 
+  ProfileScope scope(PROFILE_BACKLOG);
+
   // Read the log file and send it to the server.
   ReadingLog log = readLog(SD_MMC);
   Reading reading;
-  tm timestamp;
-  camera_fb_t *fb = nullptr;
-
-  for (int i = 0; i < log.size; i++) {
-    reading = log.readings[i];
-    sendReadings(http, network, &reading);
-
-    timestamp = {0};
-    strptime(reading.timestamp, "%Y-%m-%d %H:%M:%S", &timestamp);
-    readjpg(fs, &timestamp, fb);
-    sendImage(http, network, fb -> buf, fb -> len, reading.timestamp);
-    deletejpg(fs, &timestamp);
-    delay(20);
+
+  size_t sent = 0;
+  while (sent < log.size) {
+    reading = log.readings[sent];
+    if (!sendBacklogged(fs, http, network, &reading)) break;
+    sent++;
   }
 
-  esp_camera_fb_return(fb);
-  delete[] log.readings;
-  clearLog(fs);
+  const bool drained = sent == log.size;
+  freeLog(&log);
+  if (sent) clearLog(fs, sent);
+  if (!drained) debugln("Server stopped taking the log, keeping the rest");
+  return drained;
+}
+
+/**
+ * Send the readings queued in RTC memory while the radio was off, oldest first, with their spooled images.
+ * A reading leaves the queue only once the server took it; the first it does not take ends the drain.
+ * 
+ * @param fs: The file system reference to use for the images.
+ * @param http: The HTTPClient object to use for the request.
+ * @param network: The network struct to use the wifi connection.
+ *
+ * @return True if the queue was emptied.
+ */
+bool sendPending(fs::FS &fs, HTTPClient* http, NetworkInfo* network) {
+  if (!http || !network) {
+    debugln("Invalid parameters");
+    return false;
+  }
+
+  ProfileScope scope(PROFILE_BACKLOG);
+  if (!UPLOADS.empty()) debugf("Sending %u queued readings\n", UPLOADS.count);
+  while (!UPLOADS.empty()) {
+    Reading reading = UPLOADS.front().toReading();
+    if (!sendBacklogged(fs, http, network, &reading)) {
+      debugf("Server stopped taking the queue, %u readings kept\n", UPLOADS.count);
+      return false;
+    }
+    UPLOADS.pop();
+  }
+  return true;
+}
+
+/**
+ * Keep a reading for a later radio session: in RTC memory, or in the log file once that is full.
+ * The image goes to the file system, which is only mounted if there is an image or the queue is full.
+ */
+static void spoolReading(tm* now, Reading* reading, const ImageBuffer& img) {
+  ProfileScope scope(PROFILE_SPOOL);
+  const bool queued = UPLOADS.push(*reading, time(nullptr));
+  fs::FS* fs = !queued || img ? storage() : nullptr;
+  if (!queued) {
+    debugln("Upload queue full, saving to log file");
+    if (fs) {
+      appendReading(*fs, reading);
+      UPLOADS.logged = true;
+    }
+  }
+
+  // Save image to sd card
+  if (img && fs) writejpg(*fs, now, img);
+  UPLOADS.stayedOffline(fs ? img.size() : 0);
+}
+
+/**
+ * Crop one bracket frame and write it next to the reading's image.
+ * @param ctx: The reading's timestamp.
+ */
+static bool spoolBracketFrame(void* ctx, uint8_t index, const ImageBuffer& frame, uint32_t exposure) {
+  ImageBuffer cropped = cropImage(frame);
+  ProfileScope scope(PROFILE_SPOOL);
+  fs::FS* fs = storage();
+  return fs && writeBracket(*fs, (tm*)ctx, index, cropped ? cropped : frame);
+}
+
+/**
+ * Take and spool an exposure bracket, if the scene is bright enough to need one.
+ * Must run while the camera is still up and no capture is held.
+ */
+static void captureBracket(tm* now, Sensors* sensors) {
+  const uint8_t frames = sensors -> read_bracket(spoolBracketFrame, now);
+  if (frames) debugf("Spooled a bracket of %u frames\n", frames);
 }
 
 /**
@@ -196,49 +342,100 @@ void sendLog(fs::FS &fs, HTTPClient* http, NetworkInfo* network) {
  * 3.1. If not, save the readings to the log file.
  * 3.2. If yes, send the statuses, readings & image to the server.
  * 3.2.1. Send the logfile of readings to the server.
+ * Storage is only mounted for what needs it: the QNH cache on cold boot, the log file once
+ * readings overflowed into it, images and brackets, and the radio session.
  * 
- * @param fs: The file system reference to use for the cache.
  * @param now: The time struct containing the current time.
  * @param sensors: The sensors struct containing the sensor objects &statuses.
  * @param network: The network struct to use the wifi connection.
  */
-void serverInterop(fs::FS &fs, tm* now, Sensors* sensors, NetworkInfo* network) {
+void serverInterop(tm* now, Sensors* sensors, NetworkInfo* network) {
   if (!sensors || !now || !network) {
     debugln("Invalid parameters");
     return;
   }
 
-  // Instantiate the Wifi Client.
+  // Instantiate the Wifi Client, if the radio is up this wake.
   if (network -> CLIENT) delete network -> CLIENT;
-  if (WiFi.status() != WL_CONNECTED) {
+  network -> CLIENT = nullptr;
+  if (SUBSYSTEMS.up(SUBSYSTEM_RADIO) && WiFi.status() != WL_CONNECTED) {
     debugln("Disconnected from WiFi, reconnecting");
+    ProfileScope scope(PROFILE_WIFI);
     wifiSetup(network, &sensors -> status);
-    return;
   }
-  WiFiClientSecure *client = new WiFiClientSecure;
-  network -> CLIENT = client;
+  if (UPLOADS.radio && sensors -> status.WIFI) network -> CLIENT = new WiFiClientSecure;
+  else sensors -> status.WIFI = false;
 
-  // Get the QNH
-  double qnh = fetchQNH(fs, now, network);
+  // Get the QNH. Offline the cache can't be refreshed, so the last one will do unless there is none.
+  PROFILER.enter(PROFILE_QNH);
+  fs::FS* cache = sensors -> status.WIFI || LAST_QNH == UNDEFINED ? storage() : nullptr;
+  if (cache) LAST_QNH = fetchQNH(*cache, now, network);
+  const double qnh = LAST_QNH;
+  PROFILER.leave(PROFILE_QNH);
 
   // Get the sensor readings
   Reading reading;
   reading.timestamp = formattime(now);
-  sensors -> read(&reading, qnh);
+  PROFILER.enter(PROFILE_SAMPLE);
+  sensors -> endRead(&reading, qnh);
+  PROFILER.leave(PROFILE_SAMPLE);
+  SUBSYSTEMS.mark("sampled");
+
+  // Take the image, and reduce it to sky statistics which go out even when the image can't.
+  ImageBuffer img;
+  PROFILER.enter(PROFILE_CAPTURE);
+  if (SUBSYSTEMS.require(SUBSYSTEM_CAMERA)) img = sensors -> read_cam();
+  PROFILER.leave(PROFILE_CAPTURE);
+  SUBSYSTEMS.mark("captured");
+  PROFILER.enter(PROFILE_ANALYSE);
+  SkyStats sky;
+  if (skyAnalyse(img, &sky)) {
+    reading.cloudFraction = sky.cloudFraction;
+    reading.brightness = sky.brightness;
+  }
+
+  // Drop the image if it shows the same sky as the last one kept.
+  uint64_t hash;
+  int16_t distance = -1;
+  if (img && imageHash(img.data(), img.size(), &hash)) {
+    if (IMAGE_DEDUP.valid) distance = hashDistance(IMAGE_DEDUP.reference, hash);
+    if (!keepImage(&IMAGE_DEDUP, hash, img.size())) {
+      debugf("Image duplicates the last one kept, skipping %u bytes\n", img.size());
+      img.reset();
+    }
+  }
+  sensors -> status.SKIPPED_BYTES = IMAGE_DEDUP.skippedBytes;
+  PROFILER.leave(PROFILE_ANALYSE);
+
+  // Pick the next interval from how fast things are changing, and how much is waiting to go out.
+  // The log file only holds readings once the RTC queue overflowed into it.
+  fs::FS* log = UPLOADS.logged ? storage() : nullptr;
+  const uint32_t logged = log ? fileSize(*log, LOG_FILE) : 0;
+  const uint32_t backlog = logged + UPLOADS.count * sizeof(PendingReading) + UPLOADS.spooledBytes;
+  const CadenceInput observed = {time(nullptr), reading.pressure, reading.temperature, reading.cloudFraction, distance, backlog};
+  CADENCE.update(observed);
+  debugf("Change score %.2f, next daytime wake in %lu s\n", CADENCE.score, (unsigned long)CADENCE.interval);
+
+  // Keep only the region of interest, which also hands the frame back to the driver early.
+  PROFILER.enter(PROFILE_ANALYSE);
+  ImageBuffer cropped = cropImage(img);
+  if (cropped) img = std::move(cropped);
+  PROFILER.leave(PROFILE_ANALYSE);
+  SUBSYSTEMS.mark("processed");
 
   // Send the readings to the server
   if (!sensors -> status.WIFI) {
-    debugln("Website is not reachable, saving to log file");
-    appendReading(fs, &reading);
-    
-    // Take image and save to sd card
-    if (sensors -> status.CAM) {
-      camera_fb_t * fb = sensors -> read_cam();
-      writejpg(fs, now, fb);
-      esp_camera_fb_return(fb);
-      sensors -> cameraTeardown();
+    if (UPLOADS.radio) {
+      debugln("WiFi did not come up, queueing the reading");
+      UPLOADS.sessionEnded(false);
     }
+    spoolReading(now, &reading, img);
 
+    // The frame must be back with the driver before bracketing or tearing the camera down.
+    img.reset();
+    captureBracket(now, sensors);
+    SUBSYSTEMS.release(SUBSYSTEM_CAMERA);
+    SUBSYSTEMS.mark("spooled");
     return;
   }
 
@@ -249,27 +446,33 @@ void serverInterop(fs::FS &fs, tm* now, Sensors* sensors, NetworkInfo* network)
 
     // Check if the site is reachable.
     if (!websiteReachable(&http, network, reading.timestamp)) {
-      debugln("Website is not reachable, saving to log file");
-      appendReading(fs, &reading);
-
-      // Take image and save to sd card
-      if (sensors -> status.CAM) {
-        camera_fb_t * fb = sensors -> read_cam();
-        writejpg(fs, now, fb);
-        esp_camera_fb_return(fb);
-        sensors -> cameraTeardown();
-      }
+      debugln("Website is not reachable, queueing the reading");
+      UPLOADS.sessionEnded(false);
+      spoolReading(now, &reading, img);
+      img.reset();
+      captureBracket(now, sensors);
+      SUBSYSTEMS.release(SUBSYSTEM_CAMERA);
+      SUBSYSTEMS.mark("spooled");
       return;
     }
 
-    // send image to the server.
-    camera_fb_t * fb = sensors -> read_cam();
-    sendData(&http, network, &reading, &sensors -> status, fb);
-    esp_camera_fb_return(fb);
-    esp_err_t deinitErr = sensors -> cameraTeardown();
-
-    // Send the log file to the server.
-    sendLog(fs, &http, network);
+    // send image to the server, or keep it for the next session if the server did not take it.
+    const bool sent = sendData(&http, network, &reading, &sensors -> status, img);
+    if (!sent) {
+      debugln("Server did not take the reading, queueing it");
+      spoolReading(now, &reading, img);
+    }
+    img.reset();
+    captureBracket(now, sensors);
+    SUBSYSTEMS.release(SUBSYSTEM_CAMERA);
+
+    // Drain what waited for the radio: the RTC queue, then the log file it overflowed into.
+    // Once the server stops taking uploads, the rest waits for the next session.
+    // The radio needs storage, so it is mounted already.
+    fs::FS* fs = storage();
+    const bool drained = sent && fs && sendPending(*fs, &http, network) && sendLog(*fs, &http, network);
+    UPLOADS.sessionEnded(drained);
   }
-}  
-
+  SUBSYSTEMS.release(SUBSYSTEM_RADIO);
+  SUBSYSTEMS.mark("uploaded");
+}
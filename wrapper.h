@@ -1,6 +1,33 @@
 #ifndef WAPPER_H
 #define WRAPPER_H
 #include "comm.h"
+#include "sky.h"
+#include "image_hash.h"
+#include "roi.h"
+#include "cadence.h"
+#include "upload.h"
+#include "subsystem.h"
+
+/**
+ * The adaptive daytime wake interval, kept in RTC memory.
+ */
+extern Cadence CADENCE;
+
+/**
+ * Readings waiting for the radio, kept in RTC memory.
+ */
+extern UploadQueue UPLOADS;
+
+/**
+ * The file system, once storage is up.
+ */
+extern fs::FS* STORAGE;
+
+/**
+ * The file system, mounted on first use.
+ * @return nullptr if none would mount.
+ */
+fs::FS* storage();
 
 /**
  * Try to get the current time from the NTP server.
@@ -38,12 +65,14 @@ double fetchQNH(fs::FS &fs, tm* now, NetworkInfo *network);
  * 3.2. If yes, send the statuses, readings & image to the server.
  * 3.2.1. Send the logfile of readings to the server.
  * 
- * @param fs: The file system reference to use for the cache.
+ * Storage is only mounted for what needs it: the QNH cache on cold boot, the log file once
+ * readings overflowed into it, images and brackets, and the radio session.
+ * 
  * @param now: The time struct containing the current time.
  * @param sensors: The sensors struct containing the sensor objects &statuses.
  * @param network: The network struct to use the wifi connection.
  */
-void serverInterop(fs::FS &fs, tm* now, Sensors* sensors, NetworkInfo* network);
+void serverInterop(tm* now, Sensors* sensors, NetworkInfo* network);
 
 
 